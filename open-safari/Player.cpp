@@ -9,7 +9,7 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include "Player.h"
-#include <glm/gtc/matrix_transform.hpp>
+#include "core/Profiler.h"
 #include <GL/glfw.h>
 
 static const float MaxVerticalAngle = 85.0f; //must be less than 90 to avoid gimbal lock
@@ -25,70 +25,63 @@ static inline glm::vec3 ProjectVectorOnToPlane(glm::vec3 vector, glm::vec3 plane
     return glm::normalize(vector - glm::dot(vector, planeNormal) * planeNormal);
 }
 
+Player::Input Player::Input::capture() {
+    Input input;
+    input.back = glfwGetKey('S');
+    input.forward = glfwGetKey('W');
+    input.left = glfwGetKey('A');
+    input.right = glfwGetKey('D');
+    input.jump = glfwGetKey(' ');
+    glfwGetMousePos(&input.mouseX, &input.mouseY);
+    glfwSetMousePos(0, 0); //reset the mouse, so it doesn't go out of the window
+    input.mouseWheel = glfwGetMouseWheel();
+    glfwSetMouseWheel(0);
+    return input;
+}
+
 Player::Player() :
 _position(0.0f, 0.0f, 1.0f),
 _horizontalAngle(0.0f),
-_verticalAngle(0.0f),
-_fieldOfView(50.0f),
-_nearPlane(0.01f),
-_farPlane(100.0f),
-_viewportAspectRatio(4.0f/3.0f),
-_height(2.0f),
-_velocity(0.0f, 0.0f, 0.0f),
-_state(GROUND),
-_movementPlaneNormal(0.0f, 1.0f, 0.0f)
+_verticalAngle(0.0f)
 {
+    _controller.setPosition(_position - eyeOffset());
+    _camera.setPosition(_position);
 }
 
-void Player::update(float delta) {
+void Player::update(float delta, const Input& input) {
+    PROFILE_ZONE("Player::update");
     const float moveSpeed = 2.0f;
     
-    if(glfwGetKey('S')){
-        _position += delta * moveSpeed * ProjectVectorOnToPlane(-forward(), _movementPlaneNormal);
-    } else if(glfwGetKey('W')){
-        _position += delta * moveSpeed * ProjectVectorOnToPlane(forward(), _movementPlaneNormal);
+    // walk along the ground, whichever way we're looking
+    const glm::vec3 up(0.0f, 1.0f, 0.0f);
+    glm::vec3 walk(0.0f);
+    if(input.back){
+        walk -= ProjectVectorOnToPlane(forward(), up);
+    } else if(input.forward){
+        walk += ProjectVectorOnToPlane(forward(), up);
     }
-    if(glfwGetKey('A')){
-        _position += delta * moveSpeed * ProjectVectorOnToPlane(-right(), _movementPlaneNormal);
-    } else if(glfwGetKey('D')){
-        _position += delta * moveSpeed * ProjectVectorOnToPlane(right(), _movementPlaneNormal);
+    if(input.left){
+        walk -= ProjectVectorOnToPlane(right(), up);
+    } else if(input.right){
+        walk += ProjectVectorOnToPlane(right(), up);
     }
     
-    // jumping
-    if(glfwGetKey(' ')) {
-        if (_state == GROUND) {
-            _velocity = 3.0f * glm::vec3(0,1,0);
-            _state = IN_AIR;
-        }
-    }
-    
-    // gravity
-    const float psuedoGravity = 2.0f;
-    _velocity += delta * psuedoGravity * -glm::vec3(0,1,0);
-    
-    // add velocity to position
-    _position += delta * _velocity;
-    
-    // stop when colliding with y == 0
-    if (_position.y <= 0.0 + _height/2) {
-        _position.y = 0.0 + _height/2;
-        _state = GROUND;
-    }
+    // the controller handles jumping, gravity and bumping into things, in fixed steps
+    _controller.update(delta, moveSpeed * walk, input.jump);
+    _position = _controller.interpolatedPosition() + eyeOffset();
     
     //rotate camera based on mouse movement
     const float mouseSensitivity = 0.1;
-    int mouseX, mouseY;
-    glfwGetMousePos(&mouseX, &mouseY);
-    offsetOrientation(mouseSensitivity * mouseY, mouseSensitivity * mouseX);
-    glfwSetMousePos(0, 0); //reset the mouse, so it doesn't go out of the window
-
+    offsetOrientation(mouseSensitivity * input.mouseY, mouseSensitivity * input.mouseX);
+    
     //increase or decrease field of view based on mouse wheel
     const float zoomSensitivity = -0.2;
-    float fieldOfView = _fieldOfView + zoomSensitivity * (float)glfwGetMouseWheel();
+    float fieldOfView = _camera.fieldOfView() + zoomSensitivity * (float)input.mouseWheel;
     if(fieldOfView < 5.0f) fieldOfView = 5.0f;
     if(fieldOfView > 130.0f) fieldOfView = 130.0f;
     setFieldOfView(fieldOfView);
-    glfwSetMouseWheel(0);
+    
+    _camera.setPosition(_position);
 }
 
 const glm::vec3& Player::position() const {
@@ -97,47 +90,45 @@ const glm::vec3& Player::position() const {
 
 void Player::setPosition(const glm::vec3& position) {
     _position = position;
+    _controller.setPosition(_position - eyeOffset());
+    _camera.setPosition(_position);
 }
 
 void Player::offsetPosition(const glm::vec3& offset) {
-    _position += offset;
+    setPosition(_position + offset);
 }
 
 float Player::fieldOfView() const {
-    return _fieldOfView;
+    return _camera.fieldOfView();
 }
 
 void Player::setFieldOfView(float fieldOfView) {
-    assert(fieldOfView > 0.0f && fieldOfView < 180.0f);
-    _fieldOfView = fieldOfView;
+    _camera.setFieldOfView(fieldOfView);
 }
 
 float Player::nearPlane() const {
-    return _nearPlane;
+    return _camera.nearPlane();
 }
 
 float Player::farPlane() const {
-    return _farPlane;
+    return _camera.farPlane();
 }
 
 void Player::setNearAndFarPlanes(float nearPlane, float farPlane) {
-    assert(nearPlane > 0.0f);
-    assert(farPlane > nearPlane);
-    _nearPlane = nearPlane;
-    _farPlane = farPlane;
+    _camera.setNearAndFarPlanes(nearPlane, farPlane);
 }
 
-glm::mat4 Player::orientation() const {
-    glm::mat4 orientation;
-    orientation = glm::rotate(orientation, _verticalAngle, glm::vec3(1,0,0));
-    orientation = glm::rotate(orientation, _horizontalAngle, glm::vec3(0,1,0));
-    return orientation;
+const glm::mat4& Player::orientation() const {
+    return _camera.rotation();
 }
 
 void Player::offsetOrientation(float upAngle, float rightAngle) {
+    if (upAngle == 0.0f && rightAngle == 0.0f)
+        return;
     _horizontalAngle += rightAngle;
     _verticalAngle += upAngle;
     normalizeAngles();
+    updateOrientation();
 }
 
 void Player::lookAt(glm::vec3 position) {
@@ -146,42 +137,51 @@ void Player::lookAt(glm::vec3 position) {
     _verticalAngle = RadiansToDegrees(asinf(-direction.y));
     _horizontalAngle = -RadiansToDegrees(atan2f(-direction.x, -direction.z));
     normalizeAngles();
+    updateOrientation();
 }
 
 float Player::viewportAspectRatio() const {
-    return _viewportAspectRatio;
+    return _camera.viewportAspectRatio();
 }
 
 void Player::setViewportAspectRatio(float viewportAspectRatio) {
-    assert(viewportAspectRatio > 0.0);
-    _viewportAspectRatio = viewportAspectRatio;
+    _camera.setViewportAspectRatio(viewportAspectRatio);
+}
+
+const glm::vec3& Player::forward() const {
+    return _camera.forward();
+}
+
+const glm::vec3& Player::right() const {
+    return _camera.right();
+}
+
+const glm::vec3& Player::up() const {
+    return _camera.up();
 }
 
-glm::vec3 Player::forward() const {
-    glm::vec4 forward = glm::inverse(orientation()) * glm::vec4(0,0,-1,1);
-    return glm::vec3(forward);
+const glm::mat4& Player::matrix() const {
+    return _camera.matrix();
 }
 
-glm::vec3 Player::right() const {
-    glm::vec4 right = glm::inverse(orientation()) * glm::vec4(1,0,0,1);
-    return glm::vec3(right);
+const glm::mat4& Player::projection() const {
+    return _camera.projection();
 }
 
-glm::vec3 Player::up() const {
-    glm::vec4 up = glm::inverse(orientation()) * glm::vec4(0,1,0,1);
-    return glm::vec3(up);
+const glm::mat4& Player::view() const {
+    return _camera.view();
 }
 
-glm::mat4 Player::matrix() const {
-    return projection() * view();
+const Camera& Player::camera() const {
+    return _camera;
 }
 
-glm::mat4 Player::projection() const {
-    return glm::perspective(_fieldOfView, _viewportAspectRatio, _nearPlane, _farPlane);
+void Player::setCollisionGeometry(const CharacterController::Geometry& geometry) {
+    _controller.setGeometry(geometry);
 }
 
-glm::mat4 Player::view() const {
-    return orientation() * glm::translate(glm::mat4(), -_position);
+const CharacterController& Player::controller() const {
+    return _controller;
 }
 
 void Player::normalizeAngles() {
@@ -194,4 +194,16 @@ void Player::normalizeAngles() {
         _verticalAngle = MaxVerticalAngle;
     else if(_verticalAngle < -MaxVerticalAngle)
         _verticalAngle = -MaxVerticalAngle;
-}
\ No newline at end of file
+}
+
+void Player::updateOrientation() {
+    // pitch after yaw, as two rotations about the camera's axes
+    glm::quat orientation;
+    orientation = glm::rotate(orientation, _verticalAngle, glm::vec3(1,0,0));
+    orientation = glm::rotate(orientation, _horizontalAngle, glm::vec3(0,1,0));
+    _camera.setOrientation(orientation);
+}
+
+glm::vec3 Player::eyeOffset() const {
+    return glm::vec3(0.0f, _controller.settings().height/2, 0.0f);
+}
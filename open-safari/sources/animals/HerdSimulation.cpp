@@ -0,0 +1,378 @@
+//
+//  HerdSimulation.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/6/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "HerdSimulation.h"
+#include "core/ParallelFor.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/** the fewest buckets the spatial hash has */
+static const unsigned MinBuckets = 1024;
+
+HerdSimulation::Settings HerdSimulation::Settings::grazers(const glm::vec2& homeMin, const glm::vec2& homeMax) {
+    Settings settings;
+    settings.neighborRadius = 5.0f;
+    settings.separationRadius = 1.6f;
+    settings.separationWeight = 4.0f;
+    settings.alignmentWeight = 0.5f;
+    settings.cohesionWeight = 0.15f;
+    settings.fleeRadius = 25.0f;
+    settings.fleeWeight = 12.0f;
+    settings.homeWeight = 0.5f;
+    settings.goalWeight = 1.5f;
+    settings.maxSpeed = 9.0f;
+    settings.maxAcceleration = 6.0f;
+    settings.homeMin = homeMin;
+    settings.homeMax = homeMax;
+    return settings;
+}
+
+HerdSimulation::HerdSimulation(const Settings& settings) :
+    _settings(settings),
+    _threadCount(0),
+    _bucketMask(MinBuckets - 1)
+{
+    assert(settings.neighborRadius > 0.0f && settings.separationRadius <= settings.neighborRadius);
+    _stats.agents = 0;
+    _stats.threads = 0;
+    _stats.fleeing = 0;
+    _stats.hashMilliseconds = 0.0;
+    _stats.steerMilliseconds = 0.0;
+    _stats.agentsPerMillisecond = 0.0;
+}
+
+unsigned HerdSimulation::addAgent(const glm::vec2& position, const glm::vec2& velocity, float cruiseSpeed) {
+    _x.push_back(position.x);
+    _z.push_back(position.y);
+    _vx.push_back(velocity.x);
+    _vz.push_back(velocity.y);
+    _cruiseSpeed.push_back(cruiseSpeed);
+    _goalX.push_back(0.0f);
+    _goalZ.push_back(0.0f);
+    _fleeing.push_back(0);
+    
+    // about two buckets per agent keeps the chains short
+    while (_bucketMask + 1 < 2 * agentCount())
+        _bucketMask = 2 * _bucketMask + 1;
+    
+    _stats.agents = agentCount();
+    return agentCount() - 1;
+}
+
+unsigned HerdSimulation::agentCount() const {
+    return (unsigned)_x.size();
+}
+
+glm::vec2 HerdSimulation::position(unsigned agent) const {
+    assert(agent < agentCount());
+    return glm::vec2(_x[agent], _z[agent]);
+}
+
+glm::vec2 HerdSimulation::velocity(unsigned agent) const {
+    assert(agent < agentCount());
+    return glm::vec2(_vx[agent], _vz[agent]);
+}
+
+float HerdSimulation::cruiseSpeed(unsigned agent) const {
+    assert(agent < agentCount());
+    return _cruiseSpeed[agent];
+}
+
+void HerdSimulation::setCruiseSpeed(unsigned agent, float cruiseSpeed) {
+    assert(agent < agentCount());
+    _cruiseSpeed[agent] = cruiseSpeed;
+}
+
+glm::vec2 HerdSimulation::goal(unsigned agent) const {
+    assert(agent < agentCount());
+    return glm::vec2(_goalX[agent], _goalZ[agent]);
+}
+
+void HerdSimulation::setGoal(unsigned agent, const glm::vec2& direction) {
+    assert(agent < agentCount());
+    _goalX[agent] = direction.x;
+    _goalZ[agent] = direction.y;
+}
+
+bool HerdSimulation::isFleeing(unsigned agent) const {
+    assert(agent < agentCount());
+    return _fleeing[agent] != 0;
+}
+
+unsigned HerdSimulation::threadCount() const {
+    return _threadCount;
+}
+
+void HerdSimulation::setThreadCount(unsigned threadCount) {
+    _threadCount = threadCount;
+}
+
+void HerdSimulation::update(float delta, const glm::vec3& threat) {
+    if (agentCount() == 0)
+        return;
+    
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+    
+    // ParallelFor only limits its threads by the number of tasks, so one chunk per thread
+    unsigned threads = ParallelForThreadCount();
+    if (_threadCount > 0)
+        threads = std::min(threads, _threadCount);
+    unsigned chunks = std::min(threads, agentCount());
+    
+    _buildHash(chunks);
+    Clock::time_point hashed = Clock::now();
+    
+    std::atomic<unsigned> fleeing(0);
+    unsigned chunkSize = (agentCount() + chunks - 1) / chunks;
+    glm::vec2 threatPosition(threat.x, threat.z);
+    ParallelFor(chunks, [&](unsigned chunk) {
+        unsigned chunkFleeing = 0;
+        _steer(chunk * chunkSize, std::min((chunk + 1) * chunkSize, agentCount()), delta, threatPosition, chunkFleeing);
+        fleeing += chunkFleeing;
+    });
+    Clock::time_point steered = Clock::now();
+    
+    _stats.threads = chunks;
+    _stats.fleeing = fleeing;
+    _stats.hashMilliseconds = std::chrono::duration<double, std::milli>(hashed - start).count();
+    _stats.steerMilliseconds = std::chrono::duration<double, std::milli>(steered - hashed).count();
+    double milliseconds = _stats.hashMilliseconds + _stats.steerMilliseconds;
+    _stats.agentsPerMillisecond = milliseconds > 0.0 ? agentCount() / milliseconds : 0.0;
+}
+
+const HerdSimulation::Settings& HerdSimulation::settings() const {
+    return _settings;
+}
+
+const HerdSimulation::Stats& HerdSimulation::stats() const {
+    return _stats;
+}
+
+unsigned HerdSimulation::_bucket(int cellX, int cellZ) const {
+    return ((unsigned)cellX * 73856093u ^ (unsigned)cellZ * 19349663u) & _bucketMask;
+}
+
+int HerdSimulation::_cell(float coordinate) const {
+    return (int)floorf(coordinate / _settings.neighborRadius);
+}
+
+/**
+ Sorts the agents into their buckets. Each chunk counts its own agents into its own row of
+ counts, the counts are turned into where each chunk's agents in each bucket start, and then
+ each chunk copies its agents into place. Nothing is shared between the chunks while they
+ count or copy, so there are no atomics, and the agents in a bucket stay in the order they
+ were added.
+ */
+void HerdSimulation::_buildHash(unsigned chunks) {
+    unsigned agents = agentCount();
+    unsigned buckets = _bucketMask + 1;
+    unsigned chunkSize = (agents + chunks - 1) / chunks;
+    
+    _bucketOf.resize(agents);
+    _bucketStart.resize(buckets + 1);
+    _chunkCounts.assign(chunks * buckets, 0);
+    _sortedX.resize(agents);
+    _sortedZ.resize(agents);
+    _sortedVX.resize(agents);
+    _sortedVZ.resize(agents);
+    
+    ParallelFor(chunks, [&](unsigned chunk) {
+        unsigned* counts = &_chunkCounts[chunk * buckets];
+        unsigned end = std::min((chunk + 1) * chunkSize, agents);
+        for (unsigned i=chunk * chunkSize; i<end; i++) {
+            unsigned bucket = _bucket(_cell(_x[i]), _cell(_z[i]));
+            _bucketOf[i] = bucket;
+            counts[bucket]++;
+        }
+    });
+    
+    // the prefix sum runs bucket by bucket, and each bucket's chunks in order. the buckets
+    // are split into ranges: first each range is totalled, then the ranges are offset by
+    // the totals before them.
+    unsigned ranges = chunks;
+    unsigned rangeSize = (buckets + ranges - 1) / ranges;
+    std::vector<unsigned> rangeTotals(ranges + 1, 0);
+    ParallelFor(ranges, [&](unsigned range) {
+        unsigned total = 0;
+        unsigned end = std::min((range + 1) * rangeSize, buckets);
+        for (unsigned chunk=0; chunk<chunks; chunk++) {
+            const unsigned* counts = &_chunkCounts[chunk * buckets];
+            for (unsigned bucket=range * rangeSize; bucket<end; bucket++)
+                total += counts[bucket];
+        }
+        rangeTotals[range + 1] = total;
+    });
+    for (unsigned range=0; range<ranges; range++)
+        rangeTotals[range + 1] += rangeTotals[range];
+    
+    ParallelFor(ranges, [&](unsigned range) {
+        unsigned offset = rangeTotals[range];
+        unsigned end = std::min((range + 1) * rangeSize, buckets);
+        for (unsigned bucket=range * rangeSize; bucket<end; bucket++) {
+            _bucketStart[bucket] = offset;
+            for (unsigned chunk=0; chunk<chunks; chunk++) {
+                unsigned& count = _chunkCounts[chunk * buckets + bucket];
+                unsigned chunkCount = count;
+                count = offset;
+                offset += chunkCount;
+            }
+        }
+    });
+    _bucketStart[buckets] = agents;
+    
+    ParallelFor(chunks, [&](unsigned chunk) {
+        unsigned* next = &_chunkCounts[chunk * buckets];
+        unsigned end = std::min((chunk + 1) * chunkSize, agents);
+        for (unsigned i=chunk * chunkSize; i<end; i++) {
+            unsigned slot = next[_bucketOf[i]]++;
+            _sortedX[slot] = _x[i];
+            _sortedZ[slot] = _z[i];
+            _sortedVX[slot] = _vx[i];
+            _sortedVZ[slot] = _vz[i];
+        }
+    });
+}
+
+void HerdSimulation::_steer(unsigned first, unsigned end, float delta, const glm::vec2& threat, unsigned& fleeing) {
+    const Settings& s = _settings;
+    const float neighborRadiusSquared = s.neighborRadius * s.neighborRadius;
+    const float separationRadiusSquared = s.separationRadius * s.separationRadius;
+    
+    for (unsigned i=first; i<end; i++) {
+        float x = _x[i], z = _z[i];
+        glm::vec2 velocity(_vx[i], _vz[i]);
+        
+        // the neighbours: how many, their offsets and velocities added up, and the push
+        // away from the ones too close
+        float count = 0.0f, offsetX = 0.0f, offsetZ = 0.0f, sumVX = 0.0f, sumVZ = 0.0f, pushX = 0.0f, pushZ = 0.0f;
+        
+        // a neighbour is at most a cell away. two cells can hash to the same bucket, which
+        // mustn't be searched twice.
+        int cellX = _cell(x), cellZ = _cell(z);
+        unsigned searched[9];
+        unsigned searchedCount = 0;
+        for (int dz=-1; dz<=1; dz++) {
+            for (int dx=-1; dx<=1; dx++) {
+                unsigned bucket = _bucket(cellX + dx, cellZ + dz);
+                if (std::find(searched, searched + searchedCount, bucket) != searched + searchedCount)
+                    continue;
+                searched[searchedCount++] = bucket;
+                
+                unsigned j = _bucketStart[bucket];
+                unsigned bucketEnd = _bucketStart[bucket + 1];
+#if defined(__SSE__)
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 one = _mm_set1_ps(1.0f);
+                const __m128 px = _mm_set1_ps(x), pz = _mm_set1_ps(z);
+                const __m128 neighborRadius = _mm_set1_ps(neighborRadiusSquared);
+                const __m128 separationRadius = _mm_set1_ps(separationRadiusSquared);
+                __m128 count4 = zero, offsetX4 = zero, offsetZ4 = zero, sumVX4 = zero, sumVZ4 = zero, pushX4 = zero, pushZ4 = zero;
+                for (; j + 4 <= bucketEnd; j += 4) {
+                    __m128 ox = _mm_sub_ps(_mm_loadu_ps(&_sortedX[j]), px);
+                    __m128 oz = _mm_sub_ps(_mm_loadu_ps(&_sortedZ[j]), pz);
+                    __m128 distanceSquared = _mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oz, oz));
+                    // the agent itself is at zero distance
+                    __m128 other = _mm_cmpgt_ps(distanceSquared, zero);
+                    __m128 near = _mm_and_ps(other, _mm_cmplt_ps(distanceSquared, neighborRadius));
+                    __m128 close = _mm_and_ps(other, _mm_cmplt_ps(distanceSquared, separationRadius));
+                    
+                    count4 = _mm_add_ps(count4, _mm_and_ps(near, one));
+                    offsetX4 = _mm_add_ps(offsetX4, _mm_and_ps(near, ox));
+                    offsetZ4 = _mm_add_ps(offsetZ4, _mm_and_ps(near, oz));
+                    sumVX4 = _mm_add_ps(sumVX4, _mm_and_ps(near, _mm_loadu_ps(&_sortedVX[j])));
+                    sumVZ4 = _mm_add_ps(sumVZ4, _mm_and_ps(near, _mm_loadu_ps(&_sortedVZ[j])));
+                    
+                    // pushed away harder the closer they are
+                    __m128 inverse = _mm_and_ps(close, _mm_div_ps(one, _mm_max_ps(distanceSquared, _mm_set1_ps(1e-4f))));
+                    pushX4 = _mm_sub_ps(pushX4, _mm_mul_ps(ox, inverse));
+                    pushZ4 = _mm_sub_ps(pushZ4, _mm_mul_ps(oz, inverse));
+                }
+                float lanes[4];
+                _mm_storeu_ps(lanes, count4); count += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                _mm_storeu_ps(lanes, offsetX4); offsetX += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                _mm_storeu_ps(lanes, offsetZ4); offsetZ += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                _mm_storeu_ps(lanes, sumVX4); sumVX += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                _mm_storeu_ps(lanes, sumVZ4); sumVZ += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                _mm_storeu_ps(lanes, pushX4); pushX += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                _mm_storeu_ps(lanes, pushZ4); pushZ += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+                for (; j<bucketEnd; j++) {
+                    float ox = _sortedX[j] - x, oz = _sortedZ[j] - z;
+                    float distanceSquared = ox * ox + oz * oz;
+                    if (distanceSquared <= 0.0f || distanceSquared >= neighborRadiusSquared)
+                        continue;
+                    count += 1.0f;
+                    offsetX += ox;
+                    offsetZ += oz;
+                    sumVX += _sortedVX[j];
+                    sumVZ += _sortedVZ[j];
+                    if (distanceSquared < separationRadiusSquared) {
+                        float inverse = 1.0f / std::max(distanceSquared, 1e-4f);
+                        pushX -= ox * inverse;
+                        pushZ -= oz * inverse;
+                    }
+                }
+            }
+        }
+        
+        glm::vec2 acceleration = s.separationWeight * glm::vec2(pushX, pushZ);
+        if (count > 0.0f) {
+            acceleration += s.cohesionWeight * glm::vec2(offsetX, offsetZ) / count;
+            acceleration += s.alignmentWeight * (glm::vec2(sumVX, sumVZ) / count - velocity);
+        }
+        
+        // run from the threat, harder the closer it is
+        float cruiseSpeed = _cruiseSpeed[i];
+        glm::vec2 away = glm::vec2(x, z) - threat;
+        float threatDistance = glm::length(away);
+        _fleeing[i] = threatDistance < s.fleeRadius;
+        if (_fleeing[i]) {
+            if (threatDistance > 0.0f)
+                acceleration += s.fleeWeight * (1.0f - threatDistance / s.fleeRadius) * away / threatDistance;
+            cruiseSpeed = s.maxSpeed;
+            fleeing++;
+        }
+        
+        // back into the home range
+        glm::vec2 position(x, z);
+        acceleration += s.homeWeight * (glm::clamp(position, s.homeMin, s.homeMax) - position);
+        
+        // and the way it's been told to go, unless it's running or grazing
+        glm::vec2 goal(_goalX[i], _goalZ[i]);
+        if (!_fleeing[i] && cruiseSpeed > 0.0f && (goal.x != 0.0f || goal.y != 0.0f))
+            acceleration += s.goalWeight * (goal * cruiseSpeed - velocity);
+        
+        // speed up or slow down to the cruising speed, keeping the heading
+        float speed = glm::length(velocity);
+        if (speed > 1e-3f)
+            acceleration += (velocity * (cruiseSpeed / speed) - velocity);
+        else if (cruiseSpeed > 0.0f)
+            acceleration += glm::vec2(cruiseSpeed, 0.0f);
+        
+        float accelerationLength = glm::length(acceleration);
+        if (accelerationLength > s.maxAcceleration)
+            acceleration *= s.maxAcceleration / accelerationLength;
+        velocity += acceleration * delta;
+        speed = glm::length(velocity);
+        if (speed > s.maxSpeed)
+            velocity *= s.maxSpeed / speed;
+        
+        _vx[i] = velocity.x;
+        _vz[i] = velocity.y;
+        _x[i] = x + velocity.x * delta;
+        _z[i] = z + velocity.y * delta;
+    }
+}
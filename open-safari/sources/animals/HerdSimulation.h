@@ -0,0 +1,147 @@
+//
+//  HerdSimulation.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/6/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__HerdSimulation__
+#define __open_safari__HerdSimulation__
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ Moves a herd of animals across the ground as a flock: each one keeps its distance from the
+ animals right next to it, lines up with and closes in on the ones around it, runs from a
+ threat, and turns back when it strays out of its home range.
+ 
+ The agents are kept as a structure of arrays. Every update they're sorted into the buckets
+ of a spatial hash of grid cells with a counting sort that runs on the worker threads, into
+ arrays of their own, so the agents in a cell sit next to each other and the neighbours of
+ an agent can be tested four at a time with SSE. The agents are then steered in parallel
+ chunks.
+ */
+class HerdSimulation {
+public:
+    struct Settings {
+        /** how far away an agent notices the others, for lining up and closing in */
+        float neighborRadius;
+        /** how close is too close */
+        float separationRadius;
+        float separationWeight;
+        float alignmentWeight;
+        float cohesionWeight;
+        /** how close the threat can get before the agents run */
+        float fleeRadius;
+        float fleeWeight;
+        /** how hard agents turn back into their home range */
+        float homeWeight;
+        /** how hard agents turn to follow the way they've been told to go */
+        float goalWeight;
+        /** running speed, in meters per second */
+        float maxSpeed;
+        /** meters per second per second */
+        float maxAcceleration;
+        /** the corners of the home range on the ground, x and z */
+        glm::vec2 homeMin;
+        glm::vec2 homeMax;
+        
+        /** settings for a herd of grazers a bit bigger than a horse */
+        static Settings grazers(const glm::vec2& homeMin, const glm::vec2& homeMax);
+    };
+    
+    struct Stats {
+        unsigned agents;
+        /** the threads the last update() was spread across */
+        unsigned threads;
+        /** the agents running from the threat */
+        unsigned fleeing;
+        double hashMilliseconds;
+        double steerMilliseconds;
+        double agentsPerMillisecond;
+    };
+    
+    explicit HerdSimulation(const Settings& settings);
+    
+    /**
+     Adds an agent
+     
+     @param position     where it is on the ground, x and z
+     @param velocity     its velocity on the ground
+     @param cruiseSpeed  how fast it moves when nothing's chasing it
+     
+     @result the index of the agent
+     */
+    unsigned addAgent(const glm::vec2& position, const glm::vec2& velocity, float cruiseSpeed);
+    
+    unsigned agentCount() const;
+    
+    glm::vec2 position(unsigned agent) const;
+    glm::vec2 velocity(unsigned agent) const;
+    
+    /**
+     How fast the agent moves when nothing's chasing it. Dropping it close to zero makes
+     an agent stop and graze while the others move around it.
+     */
+    float cruiseSpeed(unsigned agent) const;
+    void setCruiseSpeed(unsigned agent, float cruiseSpeed);
+    
+    /**
+     The way the agent has been told to go, like the direction out of a FlowField, or zero
+     (the default) to wander with the herd. It's followed at the cruising speed.
+     */
+    glm::vec2 goal(unsigned agent) const;
+    void setGoal(unsigned agent, const glm::vec2& direction);
+    
+    /** @result true if the agent was running from the threat at the last update() */
+    bool isFleeing(unsigned agent) const;
+    
+    /**
+     The most threads update() spreads the agents across, or 0 (the default) for as many as
+     ParallelFor has. It can't go above ParallelForThreadCount().
+     */
+    unsigned threadCount() const;
+    void setThreadCount(unsigned threadCount);
+    
+    /**
+     Steps the herd forward
+     
+     @param delta   seconds since the last update
+     @param threat  the position of something to run from, like the player. Only x and z
+                    are used.
+     */
+    void update(float delta, const glm::vec3& threat);
+    
+    const Settings& settings() const;
+    const Stats& stats() const;
+
+private:
+    Settings _settings;
+    unsigned _threadCount;
+    
+    // the agents, in the order they were added
+    std::vector<float> _x, _z, _vx, _vz;
+    std::vector<float> _cruiseSpeed;
+    std::vector<float> _goalX, _goalZ;
+    std::vector<unsigned char> _fleeing;
+    
+    // the agents sorted by bucket, rebuilt every update
+    std::vector<float> _sortedX, _sortedZ, _sortedVX, _sortedVZ;
+    std::vector<unsigned> _bucketOf;
+    /** the sorted agents in bucket b run from _bucketStart[b] to _bucketStart[b + 1] */
+    std::vector<unsigned> _bucketStart;
+    /** the count of each bucket in each chunk, and then where the chunk's agents go */
+    std::vector<unsigned> _chunkCounts;
+    unsigned _bucketMask;
+    
+    Stats _stats;
+    
+    unsigned _bucket(int cellX, int cellZ) const;
+    int _cell(float coordinate) const;
+    void _buildHash(unsigned chunks);
+    void _steer(unsigned first, unsigned end, float delta, const glm::vec2& threat, unsigned& fleeing);
+};
+
+#endif /* defined(__open_safari__HerdSimulation__) */
@@ -0,0 +1,279 @@
+//
+//  Quadruped.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/4/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include "Quadruped.h"
+#include <algorithm>
+
+static const float FrameRate = 30.0f;
+/** how far the upper legs swing either way while walking, in radians */
+static const float StrideAngle = 0.45f;
+
+/** which way the neck, head and tail point out of the body in the bind pose */
+static const glm::vec3 NeckDirection = glm::normalize(glm::vec3(0.5f, 1.0f, 0.0f));
+static const glm::vec3 HeadDirection = glm::normalize(glm::vec3(1.0f, -0.6f, 0.0f));
+static const glm::vec3 TailDirection = glm::normalize(glm::vec3(-0.3f, -1.0f, 0.0f));
+
+Quadruped::Proportions Quadruped::Proportions::zebra() {
+    Proportions zebra;
+    zebra.bodyLength = 1.6f;
+    zebra.bodyHeight = 0.6f;
+    zebra.bodyWidth = 0.45f;
+    zebra.legLength = 1.0f;
+    zebra.legThickness = 0.12f;
+    zebra.neckLength = 0.7f;
+    zebra.neckThickness = 0.22f;
+    zebra.headLength = 0.55f;
+    zebra.headThickness = 0.2f;
+    zebra.tailLength = 0.5f;
+    zebra.strideSeconds = 1.0f;
+    return zebra;
+}
+
+Quadruped::Proportions Quadruped::Proportions::wildebeest() {
+    Proportions wildebeest;
+    wildebeest.bodyLength = 1.7f;
+    wildebeest.bodyHeight = 0.75f;
+    wildebeest.bodyWidth = 0.5f;
+    wildebeest.legLength = 1.05f;
+    wildebeest.legThickness = 0.13f;
+    wildebeest.neckLength = 0.55f;
+    wildebeest.neckThickness = 0.3f;
+    wildebeest.headLength = 0.55f;
+    wildebeest.headThickness = 0.24f;
+    wildebeest.tailLength = 0.6f;
+    wildebeest.strideSeconds = 1.1f;
+    return wildebeest;
+}
+
+Quadruped::Proportions Quadruped::Proportions::lion() {
+    Proportions lion;
+    lion.bodyLength = 1.7f;
+    lion.bodyHeight = 0.55f;
+    lion.bodyWidth = 0.45f;
+    lion.legLength = 0.8f;
+    lion.legThickness = 0.15f;
+    lion.neckLength = 0.35f;
+    lion.neckThickness = 0.32f;
+    lion.headLength = 0.4f;
+    lion.headThickness = 0.3f;
+    lion.tailLength = 0.8f;
+    lion.strideSeconds = 0.9f;
+    return lion;
+}
+
+Quadruped::Quadruped(const Proportions& proportions) :
+    _proportions(proportions),
+    _walk(NULL),
+    _graze(NULL)
+{
+    _buildSkeleton();
+    _buildMesh();
+    _walk = _makeWalk();
+    _graze = _makeGraze();
+}
+
+Quadruped::~Quadruped() {
+    delete _walk;
+    delete _graze;
+}
+
+const Quadruped::Proportions& Quadruped::proportions() const {
+    return _proportions;
+}
+
+const Skeleton& Quadruped::skeleton() const {
+    return _skeleton;
+}
+
+const std::vector<SkinnedMesh::Vertex>& Quadruped::vertices() const {
+    return _vertices;
+}
+
+const std::vector<GLuint>& Quadruped::indices() const {
+    return _indices;
+}
+
+const AnimationClip& Quadruped::walk() const {
+    return *_walk;
+}
+
+const AnimationClip& Quadruped::graze() const {
+    return *_graze;
+}
+
+float Quadruped::walkSpeed() const {
+    // a foot sweeps from one end of its swing to the other while it's on the ground, which
+    // is half of the cycle
+    return 2.0f * _proportions.legLength * sinf(StrideAngle) / (0.5f * _proportions.strideSeconds);
+}
+
+void Quadruped::_buildSkeleton() {
+    const Proportions& p = _proportions;
+    const glm::vec4 identity(0.0f, 0.0f, 0.0f, 1.0f);
+    const float hipDrop = 0.3f * p.bodyHeight;
+    const float boneLength = 0.5f * (p.legLength - hipDrop);
+    
+    // the order matches the Joint enum
+    JointPose root = { identity, glm::vec4(0.0f) };
+    _skeleton.addJoint("root", -1, root);
+    JointPose body = { identity, glm::vec4(0.0f, p.legLength, 0.0f, 0.0f) };
+    _skeleton.addJoint("body", Joint_Root, body);
+    JointPose neck = { identity, glm::vec4(0.45f * p.bodyLength, 0.3f * p.bodyHeight, 0.0f, 0.0f) };
+    _skeleton.addJoint("neck", Joint_Body, neck);
+    JointPose head = { identity, glm::vec4(NeckDirection * p.neckLength, 0.0f) };
+    _skeleton.addJoint("head", Joint_Neck, head);
+    JointPose tail = { identity, glm::vec4(-0.5f * p.bodyLength, 0.3f * p.bodyHeight, 0.0f, 0.0f) };
+    _skeleton.addJoint("tail", Joint_Body, tail);
+    
+    const char* legNames[] = { "frontLeft", "frontRight", "backLeft", "backRight" };
+    for (int leg=0; leg<4; leg++) {
+        float forward = leg < 2 ? 0.4f * p.bodyLength : -0.4f * p.bodyLength;
+        float side = leg % 2 == 0 ? 0.35f * p.bodyWidth : -0.35f * p.bodyWidth;
+        JointPose upper = { identity, glm::vec4(forward, -hipDrop, side, 0.0f) };
+        unsigned upperJoint = _skeleton.addJoint(std::string(legNames[leg]) + "Upper", Joint_Body, upper);
+        JointPose lower = { identity, glm::vec4(0.0f, -boneLength, 0.0f, 0.0f) };
+        _skeleton.addJoint(std::string(legNames[leg]) + "Lower", upperJoint, lower);
+    }
+}
+
+glm::vec3 Quadruped::_jointPosition(Joint joint) const {
+    // every joint's bind pose is unturned, so the translations just add up
+    glm::vec3 position(0.0f);
+    for (int j=joint; j>=0; j=_skeleton.parent(j))
+        position += glm::vec3(_skeleton.bindPose()[j].translation);
+    return position;
+}
+
+void Quadruped::_buildMesh() {
+    const Proportions& p = _proportions;
+    glm::vec3 body = _jointPosition(Joint_Body);
+    _addSegment(body - glm::vec3(0.5f * p.bodyLength, 0.0f, 0.0f), body + glm::vec3(0.5f * p.bodyLength, 0.0f, 0.0f),
+                p.bodyWidth, p.bodyHeight, Joint_Body, -1);
+    
+    glm::vec3 neck = _jointPosition(Joint_Neck);
+    _addSegment(neck, neck + NeckDirection * p.neckLength, p.neckThickness * 0.8f, p.neckThickness, Joint_Neck, Joint_Body);
+    glm::vec3 head = _jointPosition(Joint_Head);
+    _addSegment(head, head + HeadDirection * p.headLength, p.headThickness * 0.8f, p.headThickness, Joint_Head, Joint_Neck);
+    glm::vec3 tail = _jointPosition(Joint_Tail);
+    _addSegment(tail, tail + TailDirection * p.tailLength, 0.05f, 0.05f, Joint_Tail, Joint_Body);
+    
+    for (int leg=0; leg<4; leg++) {
+        Joint upper = (Joint)(Joint_FrontLeftUpper + 2 * leg);
+        Joint lower = (Joint)(upper + 1);
+        glm::vec3 hip = _jointPosition(upper);
+        glm::vec3 knee = _jointPosition(lower);
+        glm::vec3 hoof(knee.x, 0.0f, knee.z);
+        _addSegment(hip, knee, p.legThickness, p.legThickness * 1.3f, upper, -1);
+        _addSegment(knee, hoof, p.legThickness * 0.8f, p.legThickness * 0.8f, lower, upper);
+    }
+}
+
+/**
+ Adds a box from `start` to `end` with flat shaded faces. The box's depth is measured in the
+ xy plane and its width along z.
+ 
+ @param joint       the joint the box moves with
+ @param startJoint  a joint that the vertices at the start of the box follow halfway, or -1
+ */
+void Quadruped::_addSegment(const glm::vec3& start, const glm::vec3& end, float width, float depth, Joint joint, int startJoint) {
+    glm::vec3 axes[3];
+    axes[0] = glm::normalize(end - start);
+    axes[2] = glm::vec3(0.0f, 0.0f, 1.0f);
+    axes[1] = glm::cross(axes[2], axes[0]);
+    float halfSizes[3] = { 0.5f * glm::length(end - start), 0.5f * depth, 0.5f * width };
+    glm::vec3 center = 0.5f * (start + end);
+    
+    for (int axis=0; axis<3; axis++) {
+        for (int sign=-1; sign<=1; sign+=2) {
+            // the face's two edge directions, swapped on the negative side to keep the
+            // winding counterclockwise from outside
+            int u = (axis + 1) % 3, v = (axis + 2) % 3;
+            if (sign < 0)
+                std::swap(u, v);
+            
+            GLuint first = (GLuint)_vertices.size();
+            const float corners[4][2] = { {-1,-1}, {1,-1}, {1,1}, {-1,1} };
+            for (int c=0; c<4; c++) {
+                float along[3];
+                along[axis] = (float)sign;
+                along[u] = corners[c][0];
+                along[v] = corners[c][1];
+                
+                SkinnedMesh::Vertex vertex;
+                vertex.position = center;
+                for (int i=0; i<3; i++)
+                    vertex.position += axes[i] * along[i] * halfSizes[i];
+                vertex.normal = axes[axis] * (float)sign;
+                vertex.joints[0] = (GLubyte)joint;
+                vertex.joints[1] = vertex.joints[2] = vertex.joints[3] = 0;
+                vertex.weights[0] = 255;
+                vertex.weights[1] = vertex.weights[2] = vertex.weights[3] = 0;
+                if (startJoint >= 0 && along[0] < 0.0f) {
+                    vertex.joints[1] = (GLubyte)startJoint;
+                    vertex.weights[0] = 128;
+                    vertex.weights[1] = 127;
+                }
+                _vertices.push_back(vertex);
+            }
+            GLuint face[] = { first, first + 1, first + 2, first, first + 2, first + 3 };
+            _indices.insert(_indices.end(), face, face + 6);
+        }
+    }
+}
+
+AnimationClip* Quadruped::_makeWalk() const {
+    const unsigned frameCount = (unsigned)(_proportions.strideSeconds * FrameRate + 0.5f);
+    const glm::vec3 zAxis(0.0f, 0.0f, 1.0f), xAxis(1.0f, 0.0f, 0.0f);
+    
+    std::vector<JointPose> frames;
+    for (unsigned frame=0; frame<frameCount; frame++) {
+        float phase = 2.0f * (float)M_PI * frame / frameCount;
+        std::vector<JointPose> pose = _skeleton.bindPose();
+        
+        // the body bobs at the middle of each step and the head nods along
+        pose[Joint_Body].translation.y += 0.04f * _proportions.legLength * cosf(2.0f * phase);
+        pose[Joint_Neck].rotation = QuaternionFromAxisAngle(zAxis, 0.08f * sinf(2.0f * phase));
+        pose[Joint_Tail].rotation = QuaternionFromAxisAngle(xAxis, 0.2f * sinf(phase));
+        
+        // diagonal legs move together. each leg swings forward with its knee bent to lift
+        // the hoof, and pushes back with it straight.
+        const float legPhases[] = { 0.0f, (float)M_PI, (float)M_PI, 0.0f };
+        for (int leg=0; leg<4; leg++) {
+            float legPhase = phase + legPhases[leg];
+            pose[Joint_FrontLeftUpper + 2 * leg].rotation = QuaternionFromAxisAngle(zAxis, StrideAngle * sinf(legPhase));
+            pose[Joint_FrontLeftLower + 2 * leg].rotation = QuaternionFromAxisAngle(zAxis, -0.7f * std::max(cosf(legPhase), 0.0f));
+        }
+        frames.insert(frames.end(), pose.begin(), pose.end());
+    }
+    return new AnimationClip(_skeleton, frames, FrameRate, true);
+}
+
+AnimationClip* Quadruped::_makeGraze() const {
+    const float seconds = 3.0f;
+    const unsigned frameCount = (unsigned)(seconds * FrameRate);
+    const glm::vec3 zAxis(0.0f, 0.0f, 1.0f), xAxis(1.0f, 0.0f, 0.0f);
+    
+    std::vector<JointPose> frames;
+    for (unsigned frame=0; frame<frameCount; frame++) {
+        float phase = 2.0f * (float)M_PI * frame / frameCount;
+        std::vector<JointPose> pose = _skeleton.bindPose();
+        
+        // head down in the grass, nibbling, with the tail swishing at the flies
+        pose[Joint_Neck].rotation = QuaternionFromAxisAngle(zAxis, -1.3f);
+        pose[Joint_Head].rotation = QuaternionFromAxisAngle(zAxis, 0.4f + 0.1f * sinf(6.0f * phase));
+        pose[Joint_Tail].rotation = QuaternionFromAxisAngle(xAxis, 0.4f * sinf(2.0f * phase));
+        // the front legs spread a little to get the head down
+        pose[Joint_FrontLeftUpper].rotation = QuaternionFromAxisAngle(zAxis, 0.15f);
+        pose[Joint_FrontRightUpper].rotation = QuaternionFromAxisAngle(zAxis, 0.15f);
+        pose[Joint_Body].translation.y -= 0.02f * _proportions.legLength;
+        frames.insert(frames.end(), pose.begin(), pose.end());
+    }
+    return new AnimationClip(_skeleton, frames, FrameRate, true);
+}
@@ -0,0 +1,108 @@
+//
+//  Quadruped.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/4/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__Quadruped__
+#define __open_safari__Quadruped__
+
+#include <vector>
+#include <GL/glew.h>
+#include "animation/Skeleton.h"
+#include "animation/AnimationClip.h"
+#include "animation/SkinnedMesh.h"
+
+/**
+ A four legged grazing animal made out of boxes, with a skeleton and walk and graze clips.
+ 
+ The animal faces along +x with its feet on y = 0. Its skeleton has a root on the ground, a
+ body, a neck and head, a tail, and an upper and lower bone in each leg. Vertices where two
+ bones meet are shared between them, so the joints bend rather than come apart.
+ */
+class Quadruped {
+public:
+    struct Proportions {
+        float bodyLength;
+        float bodyHeight;
+        float bodyWidth;
+        /** from the ground to the middle of the body */
+        float legLength;
+        float legThickness;
+        float neckLength;
+        float neckThickness;
+        float headLength;
+        float headThickness;
+        float tailLength;
+        /** the length of one walk cycle in seconds */
+        float strideSeconds;
+        
+        static Proportions zebra();
+        static Proportions wildebeest();
+        /** low and long. its graze clip is more of a sniff around. */
+        static Proportions lion();
+    };
+    
+    explicit Quadruped(const Proportions& proportions);
+    
+    /**
+     Deletes the clips
+     */
+    ~Quadruped();
+    
+    const Proportions& proportions() const;
+    const Skeleton& skeleton() const;
+    
+    /** the mesh in the skeleton's bind pose */
+    const std::vector<SkinnedMesh::Vertex>& vertices() const;
+    const std::vector<GLuint>& indices() const;
+    
+    /** a looping walk cycle, moving at walkSpeed() */
+    const AnimationClip& walk() const;
+    
+    /** a looping clip of the animal with its head down eating */
+    const AnimationClip& graze() const;
+    
+    /** how fast the walk cycle moves the animal along, in meters per second */
+    float walkSpeed() const;
+
+private:
+    enum Joint {
+        Joint_Root,
+        Joint_Body,
+        Joint_Neck,
+        Joint_Head,
+        Joint_Tail,
+        Joint_FrontLeftUpper,
+        Joint_FrontLeftLower,
+        Joint_FrontRightUpper,
+        Joint_FrontRightLower,
+        Joint_BackLeftUpper,
+        Joint_BackLeftLower,
+        Joint_BackRightUpper,
+        Joint_BackRightLower,
+        Joint_Count
+    };
+    
+    Proportions _proportions;
+    Skeleton _skeleton;
+    std::vector<SkinnedMesh::Vertex> _vertices;
+    std::vector<GLuint> _indices;
+    AnimationClip* _walk;
+    AnimationClip* _graze;
+    
+    void _buildSkeleton();
+    void _buildMesh();
+    glm::vec3 _jointPosition(Joint joint) const;
+    void _addSegment(const glm::vec3& start, const glm::vec3& end, float width, float depth, Joint joint, int startJoint);
+    AnimationClip* _makeWalk() const;
+    AnimationClip* _makeGraze() const;
+    
+    // copying disabled
+    Quadruped(const Quadruped&);
+    const Quadruped& operator=(const Quadruped&);
+};
+
+#endif /* defined(__open_safari__Quadruped__) */
@@ -0,0 +1,265 @@
+//
+//  AnimationClip.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/4/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "AnimationClip.h"
+#include "Skeleton.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+/** the range of the three smallest components of a unit quaternion is +/- 1/sqrt(2) */
+static const float SmallestThreeRange = 0.70710678f;
+static const float FifteenBits = 32767.0f;
+
+/**
+ Picks the frames to keep from a track: the first and last, and then as few as possible in
+ between so that interpolating the kept frames stays within tolerance of every frame.
+ 
+ Each key reaches as far ahead as it can, which isn't always the fewest keys but is never far
+ off.
+ 
+ @param frameCount  the number of frames in the track
+ @param fits        fits(first, last) is true if interpolating from frame `first` to frame
+                    `last` is within tolerance of every frame between them
+ */
+template <typename Fits>
+static std::vector<unsigned> ReduceKeys(unsigned frameCount, const Fits& fits) {
+    std::vector<unsigned> keys(1, 0);
+    unsigned key = 0;
+    while (key < frameCount - 1) {
+        unsigned next = key + 1;
+        while (next + 1 < frameCount && fits(key, next + 1))
+            next++;
+        keys.push_back(next);
+        key = next;
+    }
+    return keys;
+}
+
+/**
+ Drops the last key of a track that never changes, since the first key alone holds it
+ */
+template <typename Key>
+static void DropConstantKey(std::vector<unsigned>& keys, const std::vector<Key>& packed) {
+    if (keys.size() == 2 && std::equal(packed[keys[0]].values, packed[keys[0]].values + 3, packed[keys[1]].values))
+        keys.pop_back();
+}
+
+AnimationClip::AnimationClip(const Skeleton& skeleton,
+                             const std::vector<JointPose>& frames,
+                             float frameRate,
+                             bool looping,
+                             float rotationTolerance,
+                             float translationTolerance) :
+    _jointCount(skeleton.jointCount()),
+    _frameCount(0),
+    _frameRate(frameRate),
+    _looping(looping)
+{
+    if (_jointCount == 0 || frames.empty() || frames.size() % _jointCount != 0)
+        throw std::runtime_error("Animation clip frames don't match the skeleton");
+    assert(frameRate > 0.0f);
+    
+    // a loop gets its first frame again at the end, so sampling never has to wrap between keys
+    unsigned sourceFrames = (unsigned)(frames.size() / _jointCount);
+    _frameCount = sourceFrames + (looping ? 1 : 0);
+    if (_frameCount > 65535)
+        throw std::runtime_error("Animation clip is too long");
+    
+    const float minRotationDot = cosf(0.5f * rotationTolerance);
+    std::vector<glm::vec4> rotations(_frameCount), decodedRotations(_frameCount);
+    std::vector<glm::vec4> translations(_frameCount), decodedTranslations(_frameCount);
+    std::vector<PackedKey> packed(_frameCount);
+    
+    for (unsigned joint=0; joint<_jointCount; joint++) {
+        for (unsigned frame=0; frame<_frameCount; frame++) {
+            const JointPose& pose = frames[(frame % sourceFrames) * _jointCount + joint];
+            rotations[frame] = glm::normalize(pose.rotation);
+            translations[frame] = glm::vec4(glm::vec3(pose.translation), 0.0f);
+        }
+        
+        // the keys are chosen from the quantized values, so the error that quantizing adds
+        // is counted against the tolerance too
+        for (unsigned frame=0; frame<_frameCount; frame++) {
+            packed[frame] = _packRotation(rotations[frame]);
+            decodedRotations[frame] = _unpackRotation(packed[frame]);
+        }
+        std::vector<unsigned> keys = ReduceKeys(_frameCount, [&](unsigned first, unsigned last) {
+            JointPose a = { decodedRotations[first], glm::vec4(0.0f) };
+            JointPose b = { decodedRotations[last], glm::vec4(0.0f) };
+            for (unsigned frame=first; frame<=last; frame++) {
+                JointPose interpolated;
+                InterpolatePose(a, b, (float)(frame - first) / std::max(last - first, 1u), 0.0f, interpolated);
+                if (fabsf(glm::dot(interpolated.rotation, rotations[frame])) < minRotationDot)
+                    return false;
+            }
+            return true;
+        });
+        DropConstantKey(keys, packed);
+        Track rotationTrack = { (unsigned)_rotationKeys.size(), (unsigned)keys.size() };
+        _rotationTracks.push_back(rotationTrack);
+        for (size_t i=0; i<keys.size(); i++) {
+            _rotationFrames.push_back((uint16_t)keys[i]);
+            _rotationKeys.push_back(packed[keys[i]]);
+        }
+        
+        TranslationRange range = { glm::vec3(translations[0]), glm::vec3(0.0f) };
+        glm::vec3 max = range.min;
+        for (unsigned frame=1; frame<_frameCount; frame++) {
+            range.min = glm::min(range.min, glm::vec3(translations[frame]));
+            max = glm::max(max, glm::vec3(translations[frame]));
+        }
+        range.size = max - range.min;
+        _translationRanges.push_back(range);
+        
+        for (unsigned frame=0; frame<_frameCount; frame++) {
+            packed[frame] = _packTranslation(glm::vec3(translations[frame]), range);
+            decodedTranslations[frame] = _unpackTranslation(packed[frame], range);
+        }
+        keys = ReduceKeys(_frameCount, [&](unsigned first, unsigned last) {
+            for (unsigned frame=first; frame<=last; frame++) {
+                float weight = (float)(frame - first) / std::max(last - first, 1u);
+                glm::vec4 interpolated = glm::mix(decodedTranslations[first], decodedTranslations[last], weight);
+                if (glm::length(interpolated - translations[frame]) > translationTolerance)
+                    return false;
+            }
+            return true;
+        });
+        DropConstantKey(keys, packed);
+        Track translationTrack = { (unsigned)_translationKeys.size(), (unsigned)keys.size() };
+        _translationTracks.push_back(translationTrack);
+        for (size_t i=0; i<keys.size(); i++) {
+            _translationFrames.push_back((uint16_t)keys[i]);
+            _translationKeys.push_back(packed[keys[i]]);
+        }
+    }
+}
+
+float AnimationClip::duration() const {
+    return (_frameCount - 1) / _frameRate;
+}
+
+bool AnimationClip::looping() const {
+    return _looping;
+}
+
+unsigned AnimationClip::jointCount() const {
+    return _jointCount;
+}
+
+void AnimationClip::sample(float time, JointPose* pose) const {
+    float frame = time * _frameRate;
+    float lastFrame = (float)(_frameCount - 1);
+    if (_looping && lastFrame > 0.0f) {
+        frame = fmodf(frame, lastFrame);
+        if (frame < 0.0f)
+            frame += lastFrame;
+    } else {
+        frame = std::min(std::max(frame, 0.0f), lastFrame);
+    }
+    
+    for (unsigned joint=0; joint<_jointCount; joint++) {
+        JointPose a, b;
+        float rotationWeight = 0.0f, translationWeight = 0.0f;
+        
+        // the key at or before the frame, and the one after it
+        const Track& rotationTrack = _rotationTracks[joint];
+        const uint16_t* rotationFrames = &_rotationFrames[rotationTrack.firstKey];
+        unsigned key = (unsigned)(std::upper_bound(rotationFrames, rotationFrames + rotationTrack.keyCount, (uint16_t)frame) - rotationFrames) - 1;
+        unsigned next = std::min(key + 1, rotationTrack.keyCount - 1);
+        a.rotation = _unpackRotation(_rotationKeys[rotationTrack.firstKey + key]);
+        b.rotation = _unpackRotation(_rotationKeys[rotationTrack.firstKey + next]);
+        if (next != key)
+            rotationWeight = (frame - rotationFrames[key]) / (rotationFrames[next] - rotationFrames[key]);
+        
+        const Track& translationTrack = _translationTracks[joint];
+        const TranslationRange& range = _translationRanges[joint];
+        const uint16_t* translationFrames = &_translationFrames[translationTrack.firstKey];
+        key = (unsigned)(std::upper_bound(translationFrames, translationFrames + translationTrack.keyCount, (uint16_t)frame) - translationFrames) - 1;
+        next = std::min(key + 1, translationTrack.keyCount - 1);
+        a.translation = _unpackTranslation(_translationKeys[translationTrack.firstKey + key], range);
+        b.translation = _unpackTranslation(_translationKeys[translationTrack.firstKey + next], range);
+        if (next != key)
+            translationWeight = (frame - translationFrames[key]) / (translationFrames[next] - translationFrames[key]);
+        
+        InterpolatePose(a, b, rotationWeight, translationWeight, pose[joint]);
+    }
+}
+
+unsigned AnimationClip::keyCount() const {
+    return (unsigned)(_rotationKeys.size() + _translationKeys.size());
+}
+
+size_t AnimationClip::compressedBytes() const {
+    return (_rotationKeys.size() + _translationKeys.size()) * (sizeof(PackedKey) + sizeof(uint16_t)) +
+           (_rotationTracks.size() + _translationTracks.size()) * sizeof(Track) +
+           _translationRanges.size() * sizeof(TranslationRange);
+}
+
+size_t AnimationClip::uncompressedBytes() const {
+    unsigned sourceFrames = _frameCount - (_looping ? 1 : 0);
+    return sourceFrames * _jointCount * sizeof(JointPose);
+}
+
+AnimationClip::PackedKey AnimationClip::_packRotation(glm::vec4 rotation) {
+    // drop the largest component, made positive since q and -q are the same rotation
+    int largest = 0;
+    for (int i=1; i<4; i++) {
+        if (fabsf(rotation[i]) > fabsf(rotation[largest]))
+            largest = i;
+    }
+    if (rotation[largest] < 0.0f)
+        rotation = -rotation;
+    
+    unsigned values[3];
+    for (int i=0, v=0; i<4; i++) {
+        if (i == largest)
+            continue;
+        float fraction = std::min(std::max(0.5f + 0.5f * rotation[i] / SmallestThreeRange, 0.0f), 1.0f);
+        values[v++] = (unsigned)(fraction * FifteenBits + 0.5f);
+    }
+    
+    // the index of the dropped component goes in the top bits of the first two values
+    PackedKey key;
+    key.values[0] = (uint16_t)(values[0] | ((largest >> 1) << 15));
+    key.values[1] = (uint16_t)(values[1] | ((largest & 1) << 15));
+    key.values[2] = (uint16_t)values[2];
+    return key;
+}
+
+glm::vec4 AnimationClip::_unpackRotation(const PackedKey& key) {
+    int largest = ((key.values[0] >> 15) << 1) | (key.values[1] >> 15);
+    glm::vec4 rotation;
+    float sumOfSquares = 0.0f;
+    for (int i=0, v=0; i<4; i++) {
+        if (i == largest)
+            continue;
+        float fraction = (key.values[v++] & 0x7fff) / FifteenBits;
+        rotation[i] = (2.0f * fraction - 1.0f) * SmallestThreeRange;
+        sumOfSquares += rotation[i] * rotation[i];
+    }
+    rotation[largest] = sqrtf(std::max(1.0f - sumOfSquares, 0.0f));
+    return rotation;
+}
+
+AnimationClip::PackedKey AnimationClip::_packTranslation(const glm::vec3& translation, const TranslationRange& range) {
+    PackedKey key;
+    for (int i=0; i<3; i++) {
+        float fraction = range.size[i] > 0.0f ? (translation[i] - range.min[i]) / range.size[i] : 0.0f;
+        key.values[i] = (uint16_t)(std::min(std::max(fraction, 0.0f), 1.0f) * 65535.0f + 0.5f);
+    }
+    return key;
+}
+
+glm::vec4 AnimationClip::_unpackTranslation(const PackedKey& key, const TranslationRange& range) {
+    return glm::vec4(range.min.x + range.size.x * (key.values[0] / 65535.0f),
+                     range.min.y + range.size.y * (key.values[1] / 65535.0f),
+                     range.min.z + range.size.z * (key.values[2] / 65535.0f),
+                     0.0f);
+}
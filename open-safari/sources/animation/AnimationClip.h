@@ -0,0 +1,112 @@
+//
+//  AnimationClip.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/4/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__AnimationClip__
+#define __open_safari__AnimationClip__
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "JointPose.h"
+
+class Skeleton;
+
+/**
+ A compressed animation for every joint of a skeleton.
+ 
+ Each joint has a rotation track and a translation track, and each track only keeps the
+ frames that can't be rebuilt closely enough by interpolating between the frames it keeps
+ either side of them. Rotations are stored as their three smallest components in 15 bits
+ each (the largest can be worked out from them, since the quaternion has unit length), and
+ translations as 16 bit fractions of the range each track covers, so a key is 6 bytes
+ either way.
+ */
+class AnimationClip {
+public:
+    /**
+     Compresses a clip sampled at a steady rate
+     
+     @param skeleton              the skeleton the clip animates
+     @param frames                the local pose of every joint for each frame, one frame
+                                  after another
+     @param frameRate             frames per second
+     @param looping               whether the clip wraps around from its last frame to its
+                                  first. A looping clip shouldn't repeat its first frame at
+                                  the end.
+     @param rotationTolerance     how far a rotation may be from the original, in radians
+     @param translationTolerance  how far a translation may be from the original
+     */
+    AnimationClip(const Skeleton& skeleton,
+                  const std::vector<JointPose>& frames,
+                  float frameRate,
+                  bool looping,
+                  float rotationTolerance = 0.002f,
+                  float translationTolerance = 0.001f);
+    
+    /** the length of the clip in seconds */
+    float duration() const;
+    
+    bool looping() const;
+    
+    unsigned jointCount() const;
+    
+    /**
+     Samples the pose of every joint
+     
+     @param time  seconds into the clip. It wraps around in a looping clip and is clamped
+                  to the ends in one that isn't.
+     @param pose  where to write the pose, jointCount() of them
+     */
+    void sample(float time, JointPose* pose) const;
+    
+    /** the number of keys kept, over every track */
+    unsigned keyCount() const;
+    
+    /** the memory the keys take up */
+    size_t compressedBytes() const;
+    
+    /** the memory the frames the clip was made from took up */
+    size_t uncompressedBytes() const;
+
+private:
+    struct Track {
+        unsigned firstKey;
+        unsigned keyCount;
+    };
+    
+    struct PackedKey {
+        uint16_t values[3];
+    };
+    
+    /** the box a translation track's values are fractions of */
+    struct TranslationRange {
+        glm::vec3 min;
+        glm::vec3 size;
+    };
+    
+    unsigned _jointCount;
+    /** the frames in the clip, counting the copy of the first frame that closes a loop */
+    unsigned _frameCount;
+    float _frameRate;
+    bool _looping;
+    std::vector<Track> _rotationTracks;
+    std::vector<Track> _translationTracks;
+    std::vector<TranslationRange> _translationRanges;
+    /** the frame number of every key, track after track */
+    std::vector<uint16_t> _rotationFrames;
+    std::vector<uint16_t> _translationFrames;
+    std::vector<PackedKey> _rotationKeys;
+    std::vector<PackedKey> _translationKeys;
+    
+    static PackedKey _packRotation(glm::vec4 rotation);
+    static glm::vec4 _unpackRotation(const PackedKey& key);
+    static PackedKey _packTranslation(const glm::vec3& translation, const TranslationRange& range);
+    static glm::vec4 _unpackTranslation(const PackedKey& key, const TranslationRange& range);
+};
+
+#endif /* defined(__open_safari__AnimationClip__) */
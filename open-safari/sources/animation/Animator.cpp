@@ -0,0 +1,131 @@
+//
+//  Animator.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/4/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "Animator.h"
+#include "core/ParallelFor.h"
+#include "core/Profiler.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <stdexcept>
+
+/** the smallest GL_MAX_TEXTURE_BUFFER_SIZE that OpenGL 3.2 allows */
+static const unsigned MaxTextureBufferTexels = 65536;
+/** how many characters each worker task poses */
+static const unsigned CharactersPerTask = 16;
+
+Animator::Animator(const Skeleton& skeleton) :
+    _skeleton(skeleton),
+    _buffer(0),
+    _texture(0)
+{
+    assert(skeleton.jointCount() > 0);
+    _stats.characters = 0;
+    _stats.joints = 0;
+    _stats.sampleMilliseconds = 0.0;
+    _stats.uploadMilliseconds = 0.0;
+    _stats.paletteBytes = 0;
+    
+    glGenBuffers(1, &_buffer);
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, _texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+Animator::~Animator() {
+    glDeleteTextures(1, &_texture);
+    glDeleteBuffers(1, &_buffer);
+}
+
+const Skeleton& Animator::skeleton() const {
+    return _skeleton;
+}
+
+unsigned Animator::addCharacter(const Character& character) {
+    assert(character.clip && character.clip->jointCount() == _skeleton.jointCount());
+    assert(!character.blendClip || character.blendClip->jointCount() == _skeleton.jointCount());
+    if (3 * (_characters.size() + 1) * _skeleton.jointCount() > MaxTextureBufferTexels)
+        throw std::runtime_error("Too many characters for the skinning matrix buffer");
+    
+    _characters.push_back(character);
+    _palettes.resize(3 * _characters.size() * _skeleton.jointCount());
+    _stats.characters = characterCount();
+    return characterCount() - 1;
+}
+
+unsigned Animator::characterCount() const {
+    return (unsigned)_characters.size();
+}
+
+Animator::Character& Animator::character(unsigned index) {
+    assert(index < characterCount());
+    return _characters[index];
+}
+
+const Animator::Character& Animator::character(unsigned index) const {
+    assert(index < characterCount());
+    return _characters[index];
+}
+
+void Animator::pose() {
+    PROFILE_ZONE("Animator::pose");
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+    
+    unsigned jointCount = _skeleton.jointCount();
+    unsigned tasks = (characterCount() + CharactersPerTask - 1) / CharactersPerTask;
+    ParallelFor(tasks, [&](unsigned task) {
+        unsigned end = std::min((task + 1) * CharactersPerTask, characterCount());
+        for (unsigned i=task * CharactersPerTask; i<end; i++)
+            _pose(_characters[i], &_palettes[3 * i * jointCount]);
+    });
+    
+    _stats.joints = characterCount() * jointCount;
+    _stats.sampleMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void Animator::upload() {
+    PROFILE_ZONE("Animator::upload");
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+    
+    // orphan last frame's matrices rather than wait for the GPU to finish with them
+    _stats.paletteBytes = _palettes.size() * sizeof(glm::vec4);
+    glBindBuffer(GL_TEXTURE_BUFFER, _buffer);
+    glBufferData(GL_TEXTURE_BUFFER, _stats.paletteBytes, NULL, GL_STREAM_DRAW);
+    if (!_palettes.empty())
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, _stats.paletteBytes, &_palettes[0]);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    
+    _stats.uploadMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void Animator::bindPalettes(tdogl::Program& program) const {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, _texture);
+    program.setUniform("palettes", 0);
+    program.setUniform("jointCount", (GLint)_skeleton.jointCount());
+}
+
+const Animator::Stats& Animator::stats() const {
+    return _stats;
+}
+
+void Animator::_pose(const Character& character, glm::vec4* palette) const {
+    JointPose pose[Skeleton::MaxJoints];
+    character.clip->sample(character.time, pose);
+    
+    if (character.blendClip && character.blendWeight > 0.0f) {
+        JointPose blendPose[Skeleton::MaxJoints];
+        character.blendClip->sample(character.blendTime, blendPose);
+        BlendPoses(pose, blendPose, _skeleton.jointCount(), std::min(character.blendWeight, 1.0f), pose);
+    }
+    
+    _skeleton.skinningMatrices(pose, character.transform, palette);
+}
@@ -0,0 +1,115 @@
+//
+//  Animator.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/4/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__Animator__
+#define __open_safari__Animator__
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "tdogl/Program.h"
+#include "Skeleton.h"
+#include "AnimationClip.h"
+
+/**
+ Poses a crowd of characters that share a skeleton, and keeps their skinning matrices in a
+ texture buffer for the vertex shader.
+ 
+ Each character plays one clip, optionally blended with a second. Every frame pose() samples
+ and blends the clips and builds the skinning matrices, with the characters spread over the
+ worker threads, which can be done on the game thread while the last frame draws. Then
+ upload(), on the thread with the OpenGL context, sends all the matrices at once. Character
+ i's matrices start at texel 3 * i * jointCount of the buffer, three texels (rows) per joint,
+ so a whole crowd can be drawn with one instanced draw call.
+ */
+class Animator {
+public:
+    struct Character {
+        /** places the character in the world. It must be affine. */
+        glm::mat4 transform;
+        const AnimationClip* clip;
+        /** seconds into `clip` */
+        float time;
+        /** a second clip to blend with the first, or NULL */
+        const AnimationClip* blendClip;
+        float blendTime;
+        /** how much of `blendClip` to use, 0 to 1 */
+        float blendWeight;
+    };
+    
+    struct Stats {
+        unsigned characters;
+        /** the joints posed by the last pose() */
+        unsigned joints;
+        double sampleMilliseconds;
+        double uploadMilliseconds;
+        size_t paletteBytes;
+    };
+    
+    /**
+     @param skeleton  the skeleton every character uses. It must outlive the animator.
+     */
+    explicit Animator(const Skeleton& skeleton);
+    
+    /**
+     Deletes the texture buffer
+     */
+    ~Animator();
+    
+    const Skeleton& skeleton() const;
+    
+    /**
+     Adds a character
+     
+     @result the index of the character, used with character()
+     */
+    unsigned addCharacter(const Character& character);
+    
+    unsigned characterCount() const;
+    
+    /** the character's state, which can be changed freely until the next pose() */
+    Character& character(unsigned index);
+    const Character& character(unsigned index) const;
+    
+    /**
+     Works out the skinning matrices, spread across the worker threads. Doesn't touch
+     OpenGL, so it can run on a game thread.
+     */
+    void pose();
+    
+    /**
+     Uploads the matrices from the last pose() to the texture buffer. Call it on the thread
+     with the OpenGL context, when pose() isn't running.
+     */
+    void upload();
+    
+    /**
+     Binds the skinning matrices to texture unit 0, and sets the program's "palettes" and
+     "jointCount" uniforms. The program must be in use.
+     */
+    void bindPalettes(tdogl::Program& program) const;
+    
+    const Stats& stats() const;
+
+private:
+    const Skeleton& _skeleton;
+    std::vector<Character> _characters;
+    /** three rows per joint per character */
+    std::vector<glm::vec4> _palettes;
+    GLuint _buffer;
+    GLuint _texture;
+    Stats _stats;
+    
+    void _pose(const Character& character, glm::vec4* palette) const;
+    
+    // copying disabled
+    Animator(const Animator&);
+    const Animator& operator=(const Animator&);
+};
+
+#endif /* defined(__open_safari__Animator__) */
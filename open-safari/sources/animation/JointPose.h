@@ -0,0 +1,85 @@
+//
+//  JointPose.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/4/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__JointPose__
+#define __open_safari__JointPose__
+
+#include <cmath>
+#include <glm/glm.hpp>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/**
+ The transform of a joint relative to its parent. Joints only turn and move, they never
+ scale.
+ 
+ Both parts are four floats so that a pose can be loaded into two SSE registers.
+ */
+struct JointPose {
+    /** a unit quaternion, stored x, y, z, w */
+    glm::vec4 rotation;
+    /** w is unused and kept at zero */
+    glm::vec4 translation;
+};
+
+/**
+ @result the quaternion that turns `radians` around the unit vector `axis`
+ */
+inline glm::vec4 QuaternionFromAxisAngle(const glm::vec3& axis, float radians) {
+    float s = sinf(0.5f * radians);
+    return glm::vec4(axis * s, cosf(0.5f * radians));
+}
+
+/**
+ @result the quaternion that turns by `b` and then by `a`
+ */
+inline glm::vec4 QuaternionMultiply(const glm::vec4& a, const glm::vec4& b) {
+    return glm::vec4(a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y,
+                     a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x,
+                     a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w,
+                     a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z);
+}
+
+/**
+ Interpolates between two poses: the rotations are blended with a normalized lerp along the
+ shorter arc and the translations with a lerp.
+ 
+ @param rotationWeight     how far to go from `a`'s rotation to `b`'s, 0 to 1
+ @param translationWeight  how far to go from `a`'s translation to `b`'s, 0 to 1
+ */
+inline void InterpolatePose(const JointPose& a, const JointPose& b, float rotationWeight, float translationWeight, JointPose& out) {
+#if defined(__SSE__)
+    __m128 qa = _mm_loadu_ps(&a.rotation.x);
+    __m128 qb = _mm_loadu_ps(&b.rotation.x);
+    
+    // q and -q are the same rotation, so flip b onto a's side to take the short way around
+    __m128 d = _mm_mul_ps(qa, qb);
+    d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+    d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+    __m128 sign = _mm_and_ps(d, _mm_set1_ps(-0.0f));
+    qb = _mm_xor_ps(qb, sign);
+    
+    __m128 q = _mm_add_ps(qa, _mm_mul_ps(_mm_sub_ps(qb, qa), _mm_set1_ps(rotationWeight)));
+    __m128 lengthSquared = _mm_mul_ps(q, q);
+    lengthSquared = _mm_add_ps(lengthSquared, _mm_shuffle_ps(lengthSquared, lengthSquared, _MM_SHUFFLE(2, 3, 0, 1)));
+    lengthSquared = _mm_add_ps(lengthSquared, _mm_shuffle_ps(lengthSquared, lengthSquared, _MM_SHUFFLE(1, 0, 3, 2)));
+    _mm_storeu_ps(&out.rotation.x, _mm_div_ps(q, _mm_sqrt_ps(lengthSquared)));
+    
+    __m128 ta = _mm_loadu_ps(&a.translation.x);
+    __m128 tb = _mm_loadu_ps(&b.translation.x);
+    _mm_storeu_ps(&out.translation.x, _mm_add_ps(ta, _mm_mul_ps(_mm_sub_ps(tb, ta), _mm_set1_ps(translationWeight))));
+#else
+    glm::vec4 qb = glm::dot(a.rotation, b.rotation) < 0.0f ? -b.rotation : b.rotation;
+    out.rotation = glm::normalize(glm::mix(a.rotation, qb, rotationWeight));
+    out.translation = glm::mix(a.translation, b.translation, translationWeight);
+#endif
+}
+
+#endif /* defined(__open_safari__JointPose__) */
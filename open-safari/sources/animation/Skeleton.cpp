@@ -0,0 +1,136 @@
+//
+//  Skeleton.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/4/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "Skeleton.h"
+#include <cassert>
+#include <stdexcept>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/**
+ Writes the top three rows of the rigid transform of a pose
+ */
+static void PoseToRows(const JointPose& pose, glm::vec4* rows) {
+    const glm::vec4& q = pose.rotation;
+    float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+    float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+    float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+    rows[0] = glm::vec4(1.0f - 2.0f*(yy + zz), 2.0f*(xy - wz), 2.0f*(xz + wy), pose.translation.x);
+    rows[1] = glm::vec4(2.0f*(xy + wz), 1.0f - 2.0f*(xx + zz), 2.0f*(yz - wx), pose.translation.y);
+    rows[2] = glm::vec4(2.0f*(xz - wy), 2.0f*(yz + wx), 1.0f - 2.0f*(xx + yy), pose.translation.z);
+}
+
+/**
+ Multiplies two affine matrices kept as their top three rows: out = a * b. `out` may be `a` but
+ not `b`.
+ */
+static void MultiplyRows(const glm::vec4* a, const glm::vec4* b, glm::vec4* out) {
+#if defined(__SSE__)
+    __m128 b0 = _mm_loadu_ps(&b[0].x);
+    __m128 b1 = _mm_loadu_ps(&b[1].x);
+    __m128 b2 = _mm_loadu_ps(&b[2].x);
+    // the implied fourth row of b only adds a's translation
+    const __m128 b3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+    for (int row=0; row<3; row++) {
+        __m128 r = _mm_loadu_ps(&a[row].x);
+        __m128 sum = _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+        _mm_storeu_ps(&out[row].x, sum);
+    }
+#else
+    for (int row=0; row<3; row++) {
+        glm::vec4 r = a[row];
+        out[row] = r.x * b[0] + r.y * b[1] + r.z * b[2] + glm::vec4(0.0f, 0.0f, 0.0f, r.w);
+    }
+#endif
+}
+
+Skeleton::Skeleton()
+{
+}
+
+unsigned Skeleton::addJoint(const std::string& name, int parent, const JointPose& bindPose) {
+    assert(parent < (int)jointCount());
+    if (jointCount() == MaxJoints)
+        throw std::runtime_error("Too many joints in skeleton");
+    
+    _names.push_back(name);
+    _parents.push_back(parent);
+    _bindPose.push_back(bindPose);
+    
+    // the joint's bind pose in model space is its parent's times its own
+    glm::vec4 rows[3];
+    PoseToRows(bindPose, rows);
+    if (parent >= 0) {
+        glm::vec4 local[3] = { rows[0], rows[1], rows[2] };
+        MultiplyRows(&_bindMatrices[3 * parent], local, rows);
+    }
+    _bindMatrices.insert(_bindMatrices.end(), rows, rows + 3);
+    
+    // the bind pose is rigid, so its inverse is the transposed rotation and the translation
+    // turned back
+    glm::vec3 translation(rows[0].w, rows[1].w, rows[2].w);
+    for (int row=0; row<3; row++) {
+        glm::vec3 column(rows[0][row], rows[1][row], rows[2][row]);
+        _inverseBindMatrices.push_back(glm::vec4(column, -glm::dot(column, translation)));
+    }
+    
+    return jointCount() - 1;
+}
+
+unsigned Skeleton::jointCount() const {
+    return (unsigned)_parents.size();
+}
+
+int Skeleton::parent(unsigned joint) const {
+    assert(joint < jointCount());
+    return _parents[joint];
+}
+
+const std::string& Skeleton::name(unsigned joint) const {
+    assert(joint < jointCount());
+    return _names[joint];
+}
+
+int Skeleton::findJoint(const std::string& name) const {
+    for (unsigned joint=0; joint<jointCount(); joint++) {
+        if (_names[joint] == name)
+            return (int)joint;
+    }
+    return -1;
+}
+
+const std::vector<JointPose>& Skeleton::bindPose() const {
+    return _bindPose;
+}
+
+void Skeleton::skinningMatrices(const JointPose* pose, const glm::mat4& model, glm::vec4* matrices) const {
+    // glm matrices are column major
+    glm::vec4 modelRows[3];
+    for (int row=0; row<3; row++)
+        modelRows[row] = glm::vec4(model[0][row], model[1][row], model[2][row], model[3][row]);
+    
+    // every joint's transform in the world, parents first
+    glm::vec4 world[3 * MaxJoints];
+    for (unsigned joint=0; joint<jointCount(); joint++) {
+        glm::vec4 local[3];
+        PoseToRows(pose[joint], local);
+        int parent = _parents[joint];
+        MultiplyRows(parent >= 0 ? &world[3 * parent] : modelRows, local, &world[3 * joint]);
+        MultiplyRows(&world[3 * joint], &_inverseBindMatrices[3 * joint], &matrices[3 * joint]);
+    }
+}
+
+void BlendPoses(const JointPose* a, const JointPose* b, unsigned jointCount, float weight, JointPose* out) {
+    for (unsigned joint=0; joint<jointCount; joint++)
+        InterpolatePose(a[joint], b[joint], weight, weight, out[joint]);
+}
@@ -0,0 +1,85 @@
+//
+//  Skeleton.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/4/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__Skeleton__
+#define __open_safari__Skeleton__
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "JointPose.h"
+
+/**
+ A hierarchy of joints for skinning a mesh.
+ 
+ Every joint comes after its parent, so walking the joints in order always reaches a parent
+ before its children.
+ 
+ Skinning matrices are affine, so they are kept as their top three rows: three vec4s per
+ joint, ready to be uploaded as they are.
+ */
+class Skeleton {
+public:
+    /** the most joints a skeleton can have */
+    static const unsigned MaxJoints = 64;
+    
+    Skeleton();
+    
+    /**
+     Adds a joint
+     
+     @param name      a name to find the joint by
+     @param parent    the index of the parent joint, or -1 for a root
+     @param bindPose  the joint's transform relative to its parent when the mesh is bound
+     
+     @result the index of the joint
+     */
+    unsigned addJoint(const std::string& name, int parent, const JointPose& bindPose);
+    
+    unsigned jointCount() const;
+    
+    /** @result the index of the parent joint, or -1 for a root */
+    int parent(unsigned joint) const;
+    
+    const std::string& name(unsigned joint) const;
+    
+    /** @result the index of the joint called `name`, or -1 */
+    int findJoint(const std::string& name) const;
+    
+    /** the pose of every joint when the mesh is bound */
+    const std::vector<JointPose>& bindPose() const;
+    
+    /**
+     Makes the skinning matrices for a pose: for each joint, the matrix that takes a vertex
+     from where it is in the bind pose to where the posed joint puts it in the world.
+     
+     @param pose    the local pose of every joint
+     @param model   the character's model matrix. It must be affine.
+     @param matrices  where to write the top three rows of each joint's matrix, three vec4s
+                      per joint
+     */
+    void skinningMatrices(const JointPose* pose, const glm::mat4& model, glm::vec4* matrices) const;
+
+private:
+    std::vector<std::string> _names;
+    std::vector<int> _parents;
+    std::vector<JointPose> _bindPose;
+    /** each joint's bind pose in model space, three rows per joint */
+    std::vector<glm::vec4> _bindMatrices;
+    /** the inverse of each joint's bind pose in model space, three rows per joint */
+    std::vector<glm::vec4> _inverseBindMatrices;
+};
+
+/**
+ Blends two whole poses together with InterpolatePose()
+ 
+ @param weight  how far to go from `a` to `b`, 0 to 1
+ */
+void BlendPoses(const JointPose* a, const JointPose* b, unsigned jointCount, float weight, JointPose* out);
+
+#endif /* defined(__open_safari__Skeleton__) */
@@ -0,0 +1,64 @@
+//
+//  SkinnedMesh.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/4/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "SkinnedMesh.h"
+#include <cstddef>
+#include <stdexcept>
+
+SkinnedMesh::SkinnedMesh(const tdogl::Program& program, const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices) :
+    _vao(0),
+    _vbo(0),
+    _ibo(0),
+    _indexCount((GLsizei)indices.size())
+{
+    if (vertices.empty() || indices.empty())
+        throw std::runtime_error("Skinned mesh needs vertices and triangles");
+    
+    glGenVertexArrays(1, &_vao);
+    glBindVertexArray(_vao);
+    
+    glGenBuffers(1, &_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    
+    glEnableVertexAttribArray(program.attrib("vert"));
+    glVertexAttribPointer(program.attrib("vert"), 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(program.attrib("vertNormal"));
+    glVertexAttribPointer(program.attrib("vertNormal"), 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, normal));
+    // the joint indices stay integers
+    glEnableVertexAttribArray(program.attrib("vertJoints"));
+    glVertexAttribIPointer(program.attrib("vertJoints"), 4, GL_UNSIGNED_BYTE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, joints));
+    glEnableVertexAttribArray(program.attrib("vertWeights"));
+    glVertexAttribPointer(program.attrib("vertWeights"), 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, weights));
+    
+    glGenBuffers(1, &_ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+    
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+SkinnedMesh::~SkinnedMesh() {
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteBuffers(1, &_vbo);
+    glDeleteBuffers(1, &_ibo);
+}
+
+unsigned SkinnedMesh::triangleCount() const {
+    return _indexCount / 3;
+}
+
+void SkinnedMesh::draw(unsigned instanceCount) const {
+    if (instanceCount == 0)
+        return;
+    glBindVertexArray(_vao);
+    glDrawElementsInstanced(GL_TRIANGLES, _indexCount, GL_UNSIGNED_INT, NULL, instanceCount);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,67 @@
+//
+//  SkinnedMesh.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/4/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__SkinnedMesh__
+#define __open_safari__SkinnedMesh__
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "tdogl/Program.h"
+
+/**
+ A triangle mesh bound to a skeleton, with each vertex following up to four joints.
+ 
+ The vertex shader does the skinning, so one mesh can be drawn for a whole herd with
+ instancing: each instance picks its own skinning matrices by gl_InstanceID.
+ */
+class SkinnedMesh {
+public:
+    struct Vertex {
+        glm::vec3 position;
+        glm::vec3 normal;
+        /** the joints the vertex follows */
+        GLubyte joints[4];
+        /** how much the vertex follows each joint, out of 255. They should add up to 255. */
+        GLubyte weights[4];
+    };
+    
+    /**
+     Uploads the mesh
+     
+     @param program   the program the mesh will be drawn with. It needs "vert",
+                      "vertNormal", "vertJoints" and "vertWeights" attributes.
+     @param vertices  the vertices, in the skeleton's bind pose
+     @param indices   the triangles, three indices each
+     */
+    SkinnedMesh(const tdogl::Program& program, const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+    
+    /**
+     Deletes the buffers
+     */
+    ~SkinnedMesh();
+    
+    unsigned triangleCount() const;
+    
+    /**
+     Draws `instanceCount` copies of the mesh. The program must be in use.
+     */
+    void draw(unsigned instanceCount) const;
+
+private:
+    GLuint _vao;
+    GLuint _vbo;
+    GLuint _ibo;
+    GLsizei _indexCount;
+    
+    // copying disabled
+    SkinnedMesh(const SkinnedMesh&);
+    const SkinnedMesh& operator=(const SkinnedMesh&);
+};
+
+#endif /* defined(__open_safari__SkinnedMesh__) */
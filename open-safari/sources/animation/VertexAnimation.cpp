@@ -0,0 +1,192 @@
+//
+//  VertexAnimation.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/5/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "VertexAnimation.h"
+#include "core/ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+/** the smallest GL_MAX_TEXTURE_SIZE that OpenGL 3.2 allows */
+static const unsigned MaxTextureSize = 1024;
+/** the smallest GL_MAX_TEXTURE_BUFFER_SIZE that OpenGL 3.2 allows */
+static const unsigned MaxTextureBufferTexels = 65536;
+
+VertexAnimation::VertexAnimation(tdogl::Program& program,
+                                 const Skeleton& skeleton,
+                                 const std::vector<SkinnedMesh::Vertex>& vertices,
+                                 const std::vector<GLuint>& indices,
+                                 const std::vector<const AnimationClip*>& clips,
+                                 float frameRate) :
+    _program(program),
+    _frameRate(frameRate),
+    _positions(NULL),
+    _normals(NULL),
+    _vao(0),
+    _ibo(0),
+    _indexCount((GLsizei)indices.size()),
+    _instanceBuffer(0),
+    _instanceTexture(0)
+{
+    if (vertices.empty() || indices.empty() || clips.empty())
+        throw std::runtime_error("Vertex animation needs a mesh and at least one clip");
+    if (clips.size() > MaxClips)
+        throw std::runtime_error("Too many clips for vertex animation");
+    if (vertices.size() > MaxTextureSize)
+        throw std::runtime_error("Too many vertices for vertex animation");
+    
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+    
+    // the clips are stacked in the textures, one row per frame. each clip loops, so its
+    // last frame blends back into its first rather than repeating it.
+    std::vector<unsigned> frameClips;
+    std::vector<float> frameTimes;
+    for (size_t clip=0; clip<clips.size(); clip++) {
+        assert(clips[clip]->looping() && clips[clip]->jointCount() == skeleton.jointCount());
+        unsigned frameCount = std::max((unsigned)ceilf(clips[clip]->duration() * frameRate), 1u);
+        _clipFirstFrames.push_back((GLint)frameClips.size());
+        _clipFrameCounts.push_back((GLint)frameCount);
+        for (unsigned frame=0; frame<frameCount; frame++) {
+            frameClips.push_back((unsigned)clip);
+            frameTimes.push_back(clips[clip]->duration() * frame / frameCount);
+        }
+    }
+    if (frameClips.size() > MaxTextureSize)
+        throw std::runtime_error("Too many frames for vertex animation");
+    
+    unsigned width = (unsigned)vertices.size();
+    unsigned height = (unsigned)frameClips.size();
+    std::vector<GLfloat> positions(4 * width * height);
+    tdogl::Bitmap normals(width, height, tdogl::Bitmap::Format_RGBA);
+    
+    // skin every vertex for every frame, the frames spread over the worker threads
+    ParallelFor(height, [&](unsigned frame) {
+        JointPose pose[Skeleton::MaxJoints];
+        glm::vec4 matrices[3 * Skeleton::MaxJoints];
+        clips[frameClips[frame]]->sample(frameTimes[frame], pose);
+        skeleton.skinningMatrices(pose, glm::mat4(), matrices);
+        
+        for (unsigned v=0; v<width; v++) {
+            const SkinnedMesh::Vertex& vertex = vertices[v];
+            glm::vec4 position(vertex.position, 1.0f), normal(vertex.normal, 0.0f);
+            glm::vec3 skinnedPosition(0.0f), skinnedNormal(0.0f);
+            for (int i=0; i<4; i++) {
+                if (vertex.weights[i] == 0)
+                    continue;
+                const glm::vec4* rows = &matrices[3 * vertex.joints[i]];
+                float weight = vertex.weights[i] / 255.0f;
+                skinnedPosition += weight * glm::vec3(glm::dot(rows[0], position), glm::dot(rows[1], position), glm::dot(rows[2], position));
+                skinnedNormal += weight * glm::vec3(glm::dot(rows[0], normal), glm::dot(rows[1], normal), glm::dot(rows[2], normal));
+            }
+            
+            GLfloat* texel = &positions[4 * (frame * width + v)];
+            texel[0] = skinnedPosition.x;
+            texel[1] = skinnedPosition.y;
+            texel[2] = skinnedPosition.z;
+            texel[3] = 1.0f;
+            
+            skinnedNormal = glm::normalize(skinnedNormal);
+            unsigned char pixel[4];
+            for (int i=0; i<3; i++)
+                pixel[i] = (unsigned char)(255.0f * (0.5f + 0.5f * skinnedNormal[i]) + 0.5f);
+            pixel[3] = 255;
+            normals.setPixel(v, frame, pixel);
+        }
+    });
+    
+    _positions = new tdogl::Texture((GLsizei)width, (GLsizei)height, GL_RGBA16F, &positions[0]);
+    _normals = new tdogl::Texture(normals, GL_NEAREST);
+    
+    // the vertices come out of the textures, so the mesh is only its triangles
+    glGenVertexArrays(1, &_vao);
+    glBindVertexArray(_vao);
+    glGenBuffers(1, &_ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    
+    glGenBuffers(1, &_instanceBuffer);
+    glGenTextures(1, &_instanceTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, _instanceTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _instanceBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    
+    _stats.vertices = width;
+    _stats.frames = height;
+    // half floats for the positions, bytes for the normals
+    _stats.textureBytes = width * height * (4 * sizeof(GLushort) + 4);
+    _stats.bakeMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    _stats.instances = 0;
+}
+
+VertexAnimation::~VertexAnimation() {
+    delete _positions;
+    delete _normals;
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteBuffers(1, &_ibo);
+    glDeleteTextures(1, &_instanceTexture);
+    glDeleteBuffers(1, &_instanceBuffer);
+}
+
+void VertexAnimation::setInstances(const std::vector<Instance>& instances) {
+    if (2 * instances.size() > MaxTextureBufferTexels)
+        throw std::runtime_error("Too many vertex animation instances");
+    
+    glBindBuffer(GL_TEXTURE_BUFFER, _instanceBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, instances.size() * sizeof(Instance), NULL, GL_STREAM_DRAW);
+    if (!instances.empty())
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, instances.size() * sizeof(Instance), &instances[0]);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    _stats.instances = (unsigned)instances.size();
+}
+
+void VertexAnimation::render(float time) {
+    render(_program, time);
+}
+
+void VertexAnimation::render(tdogl::Program& program, float time, unsigned first, unsigned count) {
+    assert(first <= _stats.instances);
+    count = std::min(count, _stats.instances - first);
+    if (count == 0)
+        return;
+    
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _positions->object());
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, _normals->object());
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, _instanceTexture);
+    program.setUniform("positions", 0);
+    // a program that doesn't shade, like one drawing ids, leaves the normals out
+    if (glGetUniformLocation(program.object(), "normals") != -1)
+        program.setUniform("normals", 1);
+    program.setUniform("instances", 2);
+    program.setUniform("time", time);
+    program.setUniform("frameRate", _frameRate);
+    program.setUniform1v("clipFirstFrame", &_clipFirstFrames[0], (GLsizei)_clipFirstFrames.size());
+    program.setUniform1v("clipFrameCount", &_clipFrameCounts[0], (GLsizei)_clipFrameCounts.size());
+    program.setUniform("firstInstance", (GLint)first);
+    
+    glBindVertexArray(_vao);
+    glDrawElementsInstanced(GL_TRIANGLES, _indexCount, GL_UNSIGNED_INT, NULL, count);
+    glBindVertexArray(0);
+    
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+const VertexAnimation::Stats& VertexAnimation::stats() const {
+    return _stats;
+}
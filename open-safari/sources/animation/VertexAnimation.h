@@ -0,0 +1,126 @@
+//
+//  VertexAnimation.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/5/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__VertexAnimation__
+#define __open_safari__VertexAnimation__
+
+#include <climits>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "tdogl/Program.h"
+#include "tdogl/Texture.h"
+#include "Skeleton.h"
+#include "AnimationClip.h"
+#include "SkinnedMesh.h"
+
+/**
+ Skeletal animation baked into textures, for drawing big crowds that are too far away to be
+ worth skinning.
+ 
+ Every frame of every clip is skinned once up front. The skinned positions go into a half
+ float texture and the normals into a byte texture, with one column per vertex and one row
+ per frame, and the clips stacked one above the other. The vertex shader looks its vertex up
+ by gl_VertexID and blends between the two frames either side of the current time, so the
+ mesh itself is just its indices.
+ 
+ The instances are kept in a texture buffer, two texels each, and the whole crowd is drawn
+ with one instanced draw call. Each instance plays its own clip with its own time offset.
+ */
+class VertexAnimation {
+public:
+    /** the most clips the shader can hold */
+    static const unsigned MaxClips = 8;
+    
+    struct Instance {
+        glm::vec3 position;
+        /** the turn around the y axis, in radians */
+        float heading;
+        /** which clip to play, an index into the clips the animation was made with */
+        float clip;
+        /** seconds added to the time, so the crowd doesn't move in step */
+        float timeOffset;
+        float scale;
+        float unused;
+    };
+    
+    struct Stats {
+        unsigned vertices;
+        unsigned frames;
+        size_t textureBytes;
+        double bakeMilliseconds;
+        unsigned instances;
+    };
+    
+    /**
+     Bakes the clips and uploads them
+     
+     @param program    the program the crowd will be drawn with, made from the crowd
+                       vertex shader
+     @param skeleton   the skeleton the clips and mesh are made for
+     @param vertices   the skinned mesh's vertices
+     @param indices    the skinned mesh's triangles
+     @param clips      the clips to bake, which must all be looping
+     @param frameRate  how many frames a second to bake
+     */
+    VertexAnimation(tdogl::Program& program,
+                    const Skeleton& skeleton,
+                    const std::vector<SkinnedMesh::Vertex>& vertices,
+                    const std::vector<GLuint>& indices,
+                    const std::vector<const AnimationClip*>& clips,
+                    float frameRate = 30.0f);
+    
+    /**
+     Deletes the textures and buffers
+     */
+    ~VertexAnimation();
+    
+    /**
+     Replaces the instances
+     */
+    void setInstances(const std::vector<Instance>& instances);
+    
+    /**
+     Draws every instance. The program must be in use; this binds texture units 0 to 2.
+     
+     @param time  seconds since the crowd started moving
+     */
+    void render(float time);
+    
+    /**
+     Draws some of the instances with another program made from the crowd vertex shader, like
+     one that draws ids. The program must be in use; this binds texture units 0 to 2.
+     
+     @param time   seconds since the crowd started moving
+     @param first  the first instance to draw, which the shader gets as `firstInstance`
+     @param count  how many to draw, at most
+     */
+    void render(tdogl::Program& program, float time, unsigned first = 0, unsigned count = UINT_MAX);
+    
+    const Stats& stats() const;
+
+private:
+    tdogl::Program& _program;
+    float _frameRate;
+    tdogl::Texture* _positions;
+    tdogl::Texture* _normals;
+    std::vector<GLint> _clipFirstFrames;
+    std::vector<GLint> _clipFrameCounts;
+    GLuint _vao;
+    GLuint _ibo;
+    GLsizei _indexCount;
+    GLuint _instanceBuffer;
+    GLuint _instanceTexture;
+    Stats _stats;
+    
+    // copying disabled
+    VertexAnimation(const VertexAnimation&);
+    const VertexAnimation& operator=(const VertexAnimation&);
+};
+
+#endif /* defined(__open_safari__VertexAnimation__) */
@@ -0,0 +1,166 @@
+//
+//  FrameReadback.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/16/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "FrameReadback.h"
+#include <cassert>
+#include <stdexcept>
+
+FrameReadback::FrameReadback(unsigned width, unsigned height, unsigned buffers) :
+    _width(width),
+    _height(height),
+    _framebuffer(0),
+    _texture(0),
+    _slots(buffers),
+    _oldest(0),
+    _pending(0),
+    _totalLatency(0),
+    _stats()
+{
+    assert(width > 0 && height > 0 && buffers > 0);
+    
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_2D, _texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    glGenFramebuffers(1, &_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _texture, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error("Readback framebuffer is incomplete");
+    
+    for (size_t i=0; i<_slots.size(); i++) {
+        glGenBuffers(1, &_slots[i].buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, _slots[i].buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, pictureBytes(), NULL, GL_STREAM_READ);
+        _slots[i].fence = NULL;
+        _slots[i].tag = 0;
+        _slots[i].age = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+FrameReadback::~FrameReadback() {
+    for (size_t i=0; i<_slots.size(); i++) {
+        if (_slots[i].fence)
+            glDeleteSync(_slots[i].fence);
+        glDeleteBuffers(1, &_slots[i].buffer);
+    }
+    glDeleteFramebuffers(1, &_framebuffer);
+    glDeleteTextures(1, &_texture);
+}
+
+unsigned FrameReadback::width() const {
+    return _width;
+}
+
+unsigned FrameReadback::height() const {
+    return _height;
+}
+
+unsigned FrameReadback::pictureBytes() const {
+    return 4 * _width * _height;
+}
+
+bool FrameReadback::read(unsigned framebufferWidth, unsigned framebufferHeight, unsigned tag) {
+    if (_pending == _slots.size()) {
+        _stats.dropped++;
+        return false;
+    }
+    
+    // copy the back buffer into the texture, scaling it to fit
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glReadBuffer(GL_BACK);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _framebuffer);
+    glBlitFramebuffer(0, 0, framebufferWidth, framebufferHeight, 0, 0, _width, _height, GL_COLOR_BUFFER_BIT,
+                      framebufferWidth == _width && framebufferHeight == _height ? GL_NEAREST : GL_LINEAR);
+    
+    _startRead(_framebuffer, GL_RGBA, GL_UNSIGNED_BYTE, tag);
+    return true;
+}
+
+bool FrameReadback::readFramebuffer(GLuint framebuffer, GLenum format, GLenum type, unsigned tag) {
+    if (_pending == _slots.size()) {
+        _stats.dropped++;
+        return false;
+    }
+    _startRead(framebuffer, format, type, tag);
+    return true;
+}
+
+unsigned FrameReadback::poll(const Receiver& receiver) {
+    for (unsigned i=0; i<_pending; i++)
+        _slots[(_oldest + i) % _slots.size()].age++;
+    
+    unsigned received = 0;
+    while (_pending > 0 && _receive(receiver, 0))
+        received++;
+    return received;
+}
+
+void FrameReadback::finish(const Receiver& receiver) {
+    while (_pending > 0)
+        _receive(receiver, GL_TIMEOUT_IGNORED);
+}
+
+unsigned FrameReadback::pending() const {
+    return _pending;
+}
+
+const FrameReadback::Stats& FrameReadback::stats() const {
+    return _stats;
+}
+
+void FrameReadback::_startRead(GLuint framebuffer, GLenum format, GLenum type, unsigned tag) {
+    Slot& slot = _slots[(_oldest + _pending) % _slots.size()];
+    
+    // start reading into the buffer, which returns without waiting for the copy
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, _width, _height, format, type, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.tag = tag;
+    slot.age = 0;
+    _pending++;
+    _stats.reads++;
+}
+
+bool FrameReadback::_receive(const Receiver& receiver, GLuint64 timeout) {
+    Slot& slot = _slots[_oldest];
+    // flushing makes sure the fence gets to the GPU, or it could never be signaled
+    GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    if (result == GL_TIMEOUT_EXPIRED)
+        return false;
+    if (result == GL_WAIT_FAILED)
+        throw std::runtime_error("Waiting for a readback failed");
+    glDeleteSync(slot.fence);
+    slot.fence = NULL;
+    
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pictureBytes(), GL_MAP_READ_BIT);
+    if (pixels) {
+        receiver(slot.tag, pixels);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    
+    _totalLatency += slot.age;
+    _oldest = (_oldest + 1) % _slots.size();
+    _pending--;
+    _stats.averageLatency = (float)_totalLatency / (float)(_stats.reads - _pending);
+    return true;
+}
@@ -0,0 +1,132 @@
+//
+//  FrameReadback.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/16/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__FrameReadback__
+#define __open_safari__FrameReadback__
+
+#include <functional>
+#include <vector>
+#include <GL/glew.h>
+
+/**
+ Reads what's been drawn back from the GPU without stalling the frame.
+ 
+ glReadPixels() into client memory waits for the GPU to finish everything up to it. Instead,
+ each read copies the back buffer into a texture of its own size with a blit, which scales
+ it if it has to, and starts a glReadPixels() from the texture into one of a ring of pixel
+ buffer objects, marked with a fence. The pixels are handed over a frame or
+ two later, once the fence says the copy has finished, so mapping the buffer doesn't wait.
+ 
+ Only use it on the thread with the OpenGL context.
+ */
+class FrameReadback {
+public:
+    /**
+     Called with the pixels of a finished read, as RGBA rows from the bottom up, or in
+     whatever format readFramebuffer() asked for. The pixels are only there for the length
+     of the call.
+     
+     @param tag  the one the read was started with
+     */
+    typedef std::function<void(unsigned tag, const unsigned char* pixels)> Receiver;
+    
+    struct Stats {
+        /** totals since the readback was made */
+        unsigned long reads;
+        /** reads that didn't start because every buffer was busy */
+        unsigned long dropped;
+        /** the frames between starting a read and its pixels being handed over, on average */
+        float averageLatency;
+    };
+    
+    /**
+     @param width, height  the size of the pictures read back
+     @param buffers        how many reads can be in flight at once
+     */
+    FrameReadback(unsigned width, unsigned height, unsigned buffers = 3);
+    ~FrameReadback();
+    
+    unsigned width() const;
+    unsigned height() const;
+    
+    /** the bytes in each picture, 4 for each pixel */
+    unsigned pictureBytes() const;
+    
+    /**
+     Starts reading back what's been drawn to the back buffer. Call it after drawing and
+     before swapping.
+     
+     @param framebufferWidth, framebufferHeight  the size of the back buffer in pixels,
+                                                 which gets scaled to the picture size
+     @param tag                                  handed back with the pixels
+     @result                                     false if every buffer was still busy, so
+                                                 nothing was read
+     */
+    bool read(unsigned framebufferWidth, unsigned framebufferHeight, unsigned tag);
+    
+    /**
+     Starts reading back the first color attachment of a framebuffer the size of the
+     pictures as it is, for pictures that aren't colors, like integer ids. Each pixel has to
+     come back as 4 bytes.
+     
+     @param framebuffer   the framebuffer to read
+     @param format, type  what glReadPixels() reads it as, like GL_RED_INTEGER and
+                          GL_UNSIGNED_INT
+     @param tag           handed back with the pixels
+     @result              false if every buffer was still busy, so nothing was read
+     */
+    bool readFramebuffer(GLuint framebuffer, GLenum format, GLenum type, unsigned tag);
+    
+    /**
+     Hands over the reads that have finished, oldest first, without waiting for the rest.
+     Call it once a frame.
+     
+     @result the reads handed over
+     */
+    unsigned poll(const Receiver& receiver);
+    
+    /**
+     Waits for every read in flight and hands them over
+     */
+    void finish(const Receiver& receiver);
+    
+    /** the reads in flight */
+    unsigned pending() const;
+    
+    const Stats& stats() const;
+
+private:
+    struct Slot {
+        GLuint buffer;
+        GLsync fence;
+        unsigned tag;
+        /** the polls since it started */
+        unsigned age;
+    };
+    
+    unsigned _width, _height;
+    GLuint _framebuffer;
+    GLuint _texture;
+    /** a ring, the oldest read first */
+    std::vector<Slot> _slots;
+    unsigned _oldest;
+    unsigned _pending;
+    unsigned long _totalLatency;
+    Stats _stats;
+    
+    /** reads the framebuffer into the next free buffer, and fences it */
+    void _startRead(GLuint framebuffer, GLenum format, GLenum type, unsigned tag);
+    /** hands over the oldest read, waiting up to `timeout` nanoseconds for it */
+    bool _receive(const Receiver& receiver, GLuint64 timeout);
+    
+    // copying disabled
+    FrameReadback(const FrameReadback&);
+    const FrameReadback& operator=(const FrameReadback&);
+};
+
+#endif /* defined(__open_safari__FrameReadback__) */
@@ -0,0 +1,132 @@
+//
+//  PhotoCapture.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/16/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "PhotoCapture.h"
+#include "core/Profiler.h"
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+
+PhotoCapture::PhotoCapture(unsigned width, unsigned height, const std::string& directory, unsigned thumbnailFactor,
+                           unsigned bitmaps, unsigned threads) :
+    _readback(width, height),
+    _directory(directory),
+    _thumbnailFactor(thumbnailFactor),
+    _session((unsigned long)time(NULL)),
+    _nextNumber(1),
+    _jobs(threads + 1),
+    _taken(0),
+    _dropped(0),
+    _saved(0),
+    _failed(0),
+    _saveMicroseconds(0)
+{
+    assert(thumbnailFactor > 0 && bitmaps > 0 && threads > 0);
+    for (unsigned i=0; i<bitmaps; i++) {
+        _bitmaps.push_back(std::unique_ptr<tdogl::Bitmap>(new tdogl::Bitmap(width, height, tdogl::Bitmap::Format_RGBA)));
+        _freeBitmaps.push_back(_bitmaps.back().get());
+    }
+}
+
+PhotoCapture::~PhotoCapture() {
+    finish();
+}
+
+unsigned PhotoCapture::take(unsigned framebufferWidth, unsigned framebufferHeight) {
+    if (!_readback.read(framebufferWidth, framebufferHeight, _nextNumber)) {
+        _dropped++;
+        return 0;
+    }
+    _taken++;
+    return _nextNumber++;
+}
+
+void PhotoCapture::update() {
+    _readback.poll([this](unsigned number, const unsigned char* pixels) {
+        _receive(number, pixels);
+    });
+}
+
+void PhotoCapture::finish() {
+    _readback.finish([this](unsigned number, const unsigned char* pixels) {
+        _receive(number, pixels);
+    });
+    _jobs.wait(_saving);
+}
+
+bool PhotoCapture::busy() const {
+    return _readback.pending() > 0 || _saving.value() > 0;
+}
+
+PhotoCapture::Stats PhotoCapture::stats() const {
+    Stats stats;
+    stats.taken = _taken;
+    stats.dropped = _dropped;
+    stats.saved = _saved;
+    stats.failed = _failed;
+    stats.inFlight = _readback.pending() + (unsigned)_saving.value();
+    stats.readbackLatency = _readback.stats().averageLatency;
+    unsigned long finished = stats.saved + stats.failed;
+    stats.saveMilliseconds = finished > 0 ? _saveMicroseconds / 1000.0 / finished : 0.0;
+    return stats;
+}
+
+void PhotoCapture::_receive(unsigned number, const unsigned char* pixels) {
+    tdogl::Bitmap* bitmap = NULL;
+    {
+        std::lock_guard<std::mutex> lock(_poolMutex);
+        if (!_freeBitmaps.empty()) {
+            bitmap = _freeBitmaps.back();
+            _freeBitmaps.pop_back();
+        }
+    }
+    if (!bitmap) {
+        _taken--;
+        _dropped++;
+        return;
+    }
+    
+    // the copy is the only part done here, while the buffer is mapped
+    memcpy(bitmap->pixelBuffer(), pixels, _readback.pictureBytes());
+    _jobs.run([this, bitmap, number]() { _save(bitmap, number); }, &_saving, NULL, "save photo");
+}
+
+void PhotoCapture::_save(tdogl::Bitmap* bitmap, unsigned number) {
+    PROFILE_ZONE("PhotoCapture::_save");
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+    
+    // the rows come back from the bottom up, and the alpha is whatever the shaders left
+    bitmap->flipVertically();
+    unsigned char* pixels = bitmap->pixelBuffer();
+    for (unsigned i=3; i<4 * bitmap->width() * bitmap->height(); i+=4)
+        pixels[i] = 255;
+    
+    char name[64];
+    snprintf(name, sizeof(name), "/safari-%lu-%04u", _session, number);
+    try {
+        bitmap->saveToFile(_directory + name + ".png");
+        bitmap->shrunk(_thumbnailFactor).saveToFile(_directory + name + "-thumbnail.png");
+        _saved++;
+    } catch (const std::exception& e) {
+        std::cerr << "Couldn't save photo " << number << ": " << e.what() << std::endl;
+        _failed++;
+    }
+    _free(bitmap);
+    
+    _saveMicroseconds += (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+void PhotoCapture::_free(tdogl::Bitmap* bitmap) {
+    std::lock_guard<std::mutex> lock(_poolMutex);
+    _freeBitmaps.push_back(bitmap);
+}
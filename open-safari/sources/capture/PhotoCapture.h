@@ -0,0 +1,119 @@
+//
+//  PhotoCapture.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/16/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__PhotoCapture__
+#define __open_safari__PhotoCapture__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "tdogl/Bitmap.h"
+#include "core/JobSystem.h"
+#include "FrameReadback.h"
+
+/**
+ Takes photos of what the player sees and saves them, with a thumbnail of each, without
+ holding up the frame.
+ 
+ The frame is read back with FrameReadback over the next few frames. Once it arrives its
+ pixels are copied into a Bitmap from a pool, and a job flips it the right way up, shrinks
+ it into the thumbnail and saves both as PNG files. The jobs run on a JobSystem of their
+ own, so a frame waiting on its own jobs never ends up saving a photo.
+ 
+ When the readback buffers or the pool's bitmaps are all busy, as they will be while the
+ shutter's held down, photos are dropped rather than waited for.
+ 
+ Apart from stats(), only use it on the thread with the OpenGL context.
+ */
+class PhotoCapture {
+public:
+    struct Stats {
+        /** totals since it was made */
+        unsigned long taken;
+        unsigned long dropped;
+        unsigned long saved;
+        unsigned long failed;
+        /** photos being read back or saved */
+        unsigned inFlight;
+        /** the frames a readback took on average */
+        float readbackLatency;
+        /** how long saving a photo and its thumbnail took, on average */
+        double saveMilliseconds;
+    };
+    
+    /**
+     @param width, height     the size of the photos
+     @param directory         where to save them, which has to be there already
+     @param thumbnailFactor   how many times smaller the thumbnails are across
+     @param bitmaps           the most photos held in memory at once
+     @param threads           the threads saving them
+     */
+    PhotoCapture(unsigned width, unsigned height, const std::string& directory, unsigned thumbnailFactor = 4,
+                 unsigned bitmaps = 6, unsigned threads = 2);
+    
+    /**
+     Waits for every photo to be saved
+     */
+    ~PhotoCapture();
+    
+    /**
+     Takes a photo of what's been drawn. Call it after drawing and before swapping.
+     
+     @param framebufferWidth, framebufferHeight  the size of the back buffer in pixels
+     @result                                     the photo's number, which its file is
+                                                 named after, or 0 if it was dropped
+     */
+    unsigned take(unsigned framebufferWidth, unsigned framebufferHeight);
+    
+    /**
+     Starts saving the photos that have been read back. Call it once a frame.
+     */
+    void update();
+    
+    /**
+     Waits for every photo to be read back and saved
+     */
+    void finish();
+    
+    /** whether any photos are being read back or saved */
+    bool busy() const;
+    
+    Stats stats() const;
+
+private:
+    FrameReadback _readback;
+    std::string _directory;
+    unsigned _thumbnailFactor;
+    /** named after when the game started, so photos from different games don't clash */
+    unsigned long _session;
+    unsigned _nextNumber;
+    
+    std::vector<std::unique_ptr<tdogl::Bitmap> > _bitmaps;
+    std::mutex _poolMutex;
+    std::vector<tdogl::Bitmap*> _freeBitmaps;
+    
+    JobSystem _jobs;
+    JobCounter _saving;
+    unsigned long _taken;
+    unsigned long _dropped;
+    std::atomic<unsigned long> _saved;
+    std::atomic<unsigned long> _failed;
+    std::atomic<unsigned long> _saveMicroseconds;
+    
+    void _receive(unsigned number, const unsigned char* pixels);
+    void _save(tdogl::Bitmap* bitmap, unsigned number);
+    void _free(tdogl::Bitmap* bitmap);
+    
+    // copying disabled
+    PhotoCapture(const PhotoCapture&);
+    const PhotoCapture& operator=(const PhotoCapture&);
+};
+
+#endif /* defined(__open_safari__PhotoCapture__) */
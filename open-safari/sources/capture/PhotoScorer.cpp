@@ -0,0 +1,287 @@
+//
+//  PhotoScorer.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/17/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "PhotoScorer.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+#include <emmintrin.h>
+
+namespace {
+    /** the fraction of the photo a subject has to cover to count as full size */
+    const float FullSizeCoverage = 0.16f;
+    /** how much each subject after the best adds to a photo's total */
+    const float ExtraSubjectWeight = 0.1f;
+    
+    bool ScoresHigher(const PhotoScorer::Subject& a, const PhotoScorer::Subject& b) {
+        return a.score > b.score;
+    }
+}
+
+PhotoScorer::PhotoScorer(unsigned width, unsigned height, unsigned maxId, unsigned maxMeasured, unsigned buffers) :
+    _width(width),
+    _height(height),
+    _framebuffer(0),
+    _idTexture(0),
+    _depthBuffer(0),
+    _readback(width, height, buffers),
+    _maxMeasured(maxMeasured),
+    _buffers(buffers),
+    _bins(maxId + 1),
+    _submitted(0),
+    _scored(0),
+    _dropped(0),
+    _submitMilliseconds(0.0),
+    _reduceMilliseconds(0.0)
+{
+    assert(width > 0 && height > 0 && buffers > 0);
+    
+    glGenTextures(1, &_idTexture);
+    glBindTexture(GL_TEXTURE_2D, _idTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    // the same depth format as the window's, or blitting its depth fails
+    glGenRenderbuffers(1, &_depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, _depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    
+    glGenFramebuffers(1, &_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _idTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _depthBuffer);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error("Id framebuffer is incomplete");
+    
+    for (size_t i=0; i<_bins.size(); i++)
+        _bins[i].pixels = 0;
+}
+
+PhotoScorer::~PhotoScorer() {
+    for (size_t i=0; i<_pending.size(); i++) {
+        for (size_t j=0; j<_pending[i].measurements.size(); j++)
+            _freeQueries.push_back(_pending[i].measurements[j].query);
+    }
+    if (!_freeQueries.empty())
+        glDeleteQueries((GLsizei)_freeQueries.size(), &_freeQueries[0]);
+    glDeleteFramebuffers(1, &_framebuffer);
+    glDeleteRenderbuffers(1, &_depthBuffer);
+    glDeleteTextures(1, &_idTexture);
+}
+
+unsigned PhotoScorer::width() const {
+    return _width;
+}
+
+unsigned PhotoScorer::height() const {
+    return _height;
+}
+
+bool PhotoScorer::begin(unsigned photo) {
+    if (_pending.size() == _buffers) {
+        _dropped++;
+        return false;
+    }
+    _submitStart = Clock::now();
+    _current.photo = photo;
+    _current.measurements.clear();
+    
+    // the subjects are only counted, so nothing gets written but depth. without their back
+    // faces, they mostly cover each pixel once.
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glViewport(0, 0, _width, _height);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glEnable(GL_CULL_FACE);
+    return true;
+}
+
+void PhotoScorer::measure(unsigned id, const std::function<void()>& draw) {
+    if (_current.measurements.size() == _maxMeasured)
+        return;
+    
+    Measurement measurement;
+    measurement.id = id;
+    if (_freeQueries.empty()) {
+        glGenQueries(1, &measurement.query);
+    } else {
+        measurement.query = _freeQueries.back();
+        _freeQueries.pop_back();
+    }
+    
+    // each subject on its own, as if nothing else was there
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glBeginQuery(GL_SAMPLES_PASSED, measurement.query);
+    draw();
+    glEndQuery(GL_SAMPLES_PASSED);
+    _current.measurements.push_back(measurement);
+}
+
+void PhotoScorer::drawIds(unsigned framebufferWidth, unsigned framebufferHeight) {
+    glDisable(GL_CULL_FACE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    
+    // the photo's depth, scaled down to the id buffer. depth can't be filtered.
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _framebuffer);
+    glBlitFramebuffer(0, 0, framebufferWidth, framebufferHeight, 0, 0, _width, _height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    const GLuint none[4] = { 0, 0, 0, 0 };
+    glClearBufferuiv(GL_COLOR, 0, none);
+    
+    // the animals are already in the depth, so they have to pass where they're equal to it.
+    // the scaled down depth is a pixel's worth out here and there, which the offset covers.
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(-1.0f, -4.0f);
+}
+
+void PhotoScorer::end(unsigned framebufferWidth, unsigned framebufferHeight) {
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    
+    bool started = _readback.readFramebuffer(_framebuffer, GL_RED_INTEGER, GL_UNSIGNED_INT, _current.photo);
+    assert(started);
+    (void)started;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, framebufferWidth, framebufferHeight);
+    
+    _pending.push_back(_current);
+    _submitted++;
+    _submitMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - _submitStart).count();
+}
+
+void PhotoScorer::update(const Receiver& receiver) {
+    _readback.poll([this, &receiver](unsigned, const unsigned char* pixels) {
+        _receive(receiver, (const unsigned*)pixels);
+    });
+}
+
+void PhotoScorer::finish(const Receiver& receiver) {
+    _readback.finish([this, &receiver](unsigned, const unsigned char* pixels) {
+        _receive(receiver, (const unsigned*)pixels);
+    });
+}
+
+PhotoScorer::Stats PhotoScorer::stats() const {
+    Stats stats;
+    stats.scored = _scored;
+    stats.dropped = _dropped;
+    stats.latency = _readback.stats().averageLatency;
+    stats.submitMilliseconds = _submitted > 0 ? _submitMilliseconds / _submitted : 0.0;
+    stats.reduceMilliseconds = _scored > 0 ? _reduceMilliseconds / _scored : 0.0;
+    return stats;
+}
+
+void PhotoScorer::_receive(const Receiver& receiver, const unsigned* ids) {
+    Clock::time_point start = Clock::now();
+    Pending pending = _pending.front();
+    _pending.pop_front();
+    
+    // run length encode each row into the bins. four pixels of one id, which is most of
+    // them, are one compare; the sky and ground are runs of 0.
+    for (unsigned y=0; y<_height; y++) {
+        const unsigned* row = ids + y * _width;
+        unsigned runId = row[0], runStart = 0;
+        unsigned x = 0;
+        for (; x + 4 <= _width; x += 4) {
+            __m128i quad = _mm_loadu_si128((const __m128i*)(row + x));
+            __m128i first = _mm_shuffle_epi32(quad, 0);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(quad, first)) == 0xFFFF && row[x] == runId)
+                continue;
+            for (unsigned i=x; i<x+4; i++) {
+                if (row[i] != runId) {
+                    _addRun(runId, runStart, y, i - runStart);
+                    runId = row[i];
+                    runStart = i;
+                }
+            }
+        }
+        for (; x<_width; x++) {
+            if (row[x] != runId) {
+                _addRun(runId, runStart, y, x - runStart);
+                runId = row[x];
+                runStart = x;
+            }
+        }
+        _addRun(runId, runStart, y, _width - runStart);
+    }
+    
+    // the queries were before the readback's fence, so they're ready too
+    Score score;
+    score.photo = pending.photo;
+    score.total = 0.0f;
+    for (size_t i=0; i<_seen.size(); i++) {
+        Bin& bin = _bins[_seen[i]];
+        Subject subject;
+        subject.id = _seen[i];
+        subject.pixels = bin.pixels;
+        subject.coverage = (float)bin.pixels / (float)(_width * _height);
+        subject.occlusion = 0.0f;
+        for (size_t m=0; m<pending.measurements.size(); m++) {
+            if (pending.measurements[m].id != subject.id)
+                continue;
+            GLuint unhidden = 0;
+            glGetQueryObjectuiv(pending.measurements[m].query, GL_QUERY_RESULT, &unhidden);
+            if (unhidden > 0)
+                subject.occlusion = glm::clamp(1.0f - (float)bin.pixels / (float)unhidden, 0.0f, 1.0f);
+        }
+        
+        // the middle from -1 to 1 across the photo, so the corners are sqrt(2) out
+        glm::vec2 middle((bin.sumX + 0.5f * bin.pixels) / (bin.pixels * (float)_width),
+                         (bin.sumY + 0.5f * bin.pixels) / (bin.pixels * (float)_height));
+        subject.centering = std::max(1.0f - glm::length(2.0f * middle - 1.0f) / sqrtf(2.0f), 0.0f);
+        subject.min = glm::vec2((float)bin.minX / _width, (float)bin.minY / _height);
+        subject.max = glm::vec2((float)(bin.maxX + 1) / _width, (float)(bin.maxY + 1) / _height);
+        
+        // a big, whole subject in the middle is the best photo
+        float size = std::min(sqrtf(subject.coverage / FullSizeCoverage), 1.0f);
+        subject.score = 100.0f * size * (1.0f - subject.occlusion) * (0.5f + 0.5f * subject.centering);
+        score.subjects.push_back(subject);
+        bin.pixels = 0;
+    }
+    _seen.clear();
+    
+    std::sort(score.subjects.begin(), score.subjects.end(), ScoresHigher);
+    for (size_t i=0; i<score.subjects.size(); i++)
+        score.total += (i == 0 ? 1.0f : ExtraSubjectWeight) * score.subjects[i].score;
+    
+    for (size_t m=0; m<pending.measurements.size(); m++)
+        _freeQueries.push_back(pending.measurements[m].query);
+    _scored++;
+    _reduceMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    receiver(score);
+}
+
+void PhotoScorer::_addRun(unsigned id, unsigned x, unsigned y, unsigned length) {
+    if (id == 0 || id >= _bins.size())
+        return;
+    
+    Bin& bin = _bins[id];
+    if (bin.pixels == 0) {
+        _seen.push_back(id);
+        bin.sumX = bin.sumY = 0;
+        bin.minX = x;
+        bin.maxX = x + length - 1;
+        bin.minY = bin.maxY = y;
+    }
+    bin.pixels += length;
+    // x + (x + 1) + ... + (x + length - 1)
+    bin.sumX += (unsigned long)length * x + (unsigned long)length * (length - 1) / 2;
+    bin.sumY += (unsigned long)length * y;
+    bin.minX = std::min(bin.minX, x);
+    bin.maxX = std::max(bin.maxX, x + length - 1);
+    bin.maxY = y;
+}
@@ -0,0 +1,198 @@
+//
+//  PhotoScorer.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/17/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__PhotoScorer__
+#define __open_safari__PhotoScorer__
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "FrameReadback.h"
+
+/**
+ Scores photos by what's in them: which animals can be seen, how much of each is hidden,
+ and how big and how well centered each one is.
+ 
+ The animals are drawn again into an id buffer, an integer texture with the id of the
+ animal at each pixel and 0 where there's none. The id pass tests against the depth of the
+ photo's frame, blitted from the back buffer, so only the pixels of each animal that made
+ it into the photo get its id. A few animals also get drawn alone into a cleared depth
+ buffer inside an occlusion query, which counts the pixels they would cover if nothing was
+ in front of them; the pixels they actually got, against that, is how hidden they are.
+ 
+ The id buffer is read back with FrameReadback and the query results are fetched once its
+ fence has passed, so neither stalls the frame. The ids are added up into a histogram with
+ SSE2, four pixels at a time, skipping the empty sky and ground four pixels at once and
+ taking runs of one animal in one go.
+ 
+ The id buffer is smaller than the photo, since the scores don't need every pixel.
+ 
+ Only use it on the thread with the OpenGL context.
+ */
+class PhotoScorer {
+public:
+    /**
+     An animal in a photo
+     */
+    struct Subject {
+        unsigned id;
+        /** the pixels of it that can be seen */
+        unsigned pixels;
+        /** the fraction of the photo it covers */
+        float coverage;
+        /** the fraction of it that's hidden behind something, or 0 if it wasn't measured */
+        float occlusion;
+        /** 1 with its middle in the middle of the photo, down to 0 in the corners */
+        float centering;
+        /** the corners of the box around it, from (0, 0) at the bottom left of the photo to
+            (1, 1) at the top right */
+        glm::vec2 min, max;
+        float score;
+    };
+    
+    struct Score {
+        /** the photo it's the score of */
+        unsigned photo;
+        /** the best subject's score, plus a little for each of the others */
+        float total;
+        /** the best scoring first */
+        std::vector<Subject> subjects;
+    };
+    
+    /** called with each photo's score, once it's been read back and added up */
+    typedef std::function<void(const Score& score)> Receiver;
+    
+    struct Stats {
+        /** totals since it was made */
+        unsigned long scored;
+        unsigned long dropped;
+        /** the frames a score took to come back on average */
+        float latency;
+        /** how long submitting the id pass took on the CPU, and adding up the ids, on average */
+        double submitMilliseconds;
+        double reduceMilliseconds;
+    };
+    
+    /**
+     @param width, height  the size of the id buffer
+     @param maxId          the biggest id that will be drawn
+     @param maxMeasured    how many subjects can be measured for occlusion in each photo
+     @param buffers        how many photos can be being scored at once
+     */
+    PhotoScorer(unsigned width, unsigned height, unsigned maxId, unsigned maxMeasured = 16, unsigned buffers = 3);
+    ~PhotoScorer();
+    
+    unsigned width() const;
+    unsigned height() const;
+    
+    /**
+     Starts scoring what's been drawn to the back buffer, and binds the id buffer. Call it
+     after drawing and before swapping, and then measure() the subjects and drawIds() the
+     animals.
+     
+     @param photo  handed back with the score
+     @result       false if every buffer was still busy, so nothing will be scored
+     */
+    bool begin(unsigned photo);
+    
+    /**
+     Counts the pixels a subject would cover if nothing was in front of it. Call it after
+     begin() and before drawIds(); past the most subjects it can measure, it does nothing.
+     
+     @param id    the id the subject is drawn with
+     @param draw  draws just that subject
+     */
+    void measure(unsigned id, const std::function<void()>& draw);
+    
+    /**
+     Clears the id buffer and gets it ready for the animals to be drawn into it, with their
+     ids, against the depth of the back buffer.
+     
+     @param framebufferWidth, framebufferHeight  the size of the back buffer in pixels
+     */
+    void drawIds(unsigned framebufferWidth, unsigned framebufferHeight);
+    
+    /**
+     Starts reading the ids back, and puts back the default framebuffer, its viewport and
+     GL_LESS depth testing
+     
+     @param framebufferWidth, framebufferHeight  the size of the back buffer in pixels
+     */
+    void end(unsigned framebufferWidth, unsigned framebufferHeight);
+    
+    /**
+     Hands over the scores that are ready, without waiting for the rest. Call it once a
+     frame.
+     */
+    void update(const Receiver& receiver);
+    
+    /**
+     Waits for every score and hands them over
+     */
+    void finish(const Receiver& receiver);
+    
+    Stats stats() const;
+
+private:
+    /** the query for one subject */
+    struct Measurement {
+        unsigned id;
+        GLuint query;
+    };
+    
+    /** a photo being read back */
+    struct Pending {
+        unsigned photo;
+        std::vector<Measurement> measurements;
+    };
+    
+    /** what's been added up for one id */
+    struct Bin {
+        unsigned pixels;
+        unsigned long sumX, sumY;
+        unsigned minX, minY, maxX, maxY;
+    };
+    
+    unsigned _width, _height;
+    GLuint _framebuffer;
+    GLuint _idTexture;
+    GLuint _depthBuffer;
+    FrameReadback _readback;
+    unsigned _maxMeasured;
+    unsigned _buffers;
+    /** the photo begin() started */
+    Pending _current;
+    /** the photos being read back, oldest first */
+    std::deque<Pending> _pending;
+    std::vector<GLuint> _freeQueries;
+    
+    std::vector<Bin> _bins;
+    /** the ids with something in their bins */
+    std::vector<unsigned> _seen;
+    
+    typedef std::chrono::high_resolution_clock Clock;
+    
+    Clock::time_point _submitStart;
+    unsigned long _submitted;
+    unsigned long _scored;
+    unsigned long _dropped;
+    double _submitMilliseconds;
+    double _reduceMilliseconds;
+    
+    void _receive(const Receiver& receiver, const unsigned* ids);
+    void _addRun(unsigned id, unsigned x, unsigned y, unsigned length);
+    
+    // copying disabled
+    PhotoScorer(const PhotoScorer&);
+    const PhotoScorer& operator=(const PhotoScorer&);
+};
+
+#endif /* defined(__open_safari__PhotoScorer__) */
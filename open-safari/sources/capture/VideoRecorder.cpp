@@ -0,0 +1,278 @@
+//
+//  VideoRecorder.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/18/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "VideoRecorder.h"
+#include "core/Profiler.h"
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include <emmintrin.h>
+
+namespace {
+    // BT.601 video range, in 8 bit fixed point
+    inline unsigned char LumaOf(int r, int g, int b) {
+        return (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+    inline unsigned char BlueChromaOf(int r, int g, int b) {
+        return (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    }
+    inline unsigned char RedChromaOf(int r, int g, int b) {
+        return (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+    
+    /** a 2x2 block of pixels, from `x` along two rows */
+    void ConvertBlock(const unsigned char* row0, const unsigned char* row1, unsigned x,
+                      unsigned char* luma0, unsigned char* luma1, unsigned char* u, unsigned char* v) {
+        int r = 0, g = 0, b = 0;
+        for (unsigned i=x; i<x+2; i++) {
+            const unsigned char* p0 = row0 + 4 * i;
+            const unsigned char* p1 = row1 + 4 * i;
+            luma0[i] = LumaOf(p0[0], p0[1], p0[2]);
+            luma1[i] = LumaOf(p1[0], p1[1], p1[2]);
+            r += p0[0] + p1[0];
+            g += p0[1] + p1[1];
+            b += p0[2] + p1[2];
+        }
+        r = (r + 2) >> 2;
+        g = (g + 2) >> 2;
+        b = (b + 2) >> 2;
+        u[x / 2] = BlueChromaOf(r, g, b);
+        v[x / 2] = RedChromaOf(r, g, b);
+    }
+    
+    /** splits 8 RGBA pixels into 16 bit red, green and blue */
+    inline void Unpack(const unsigned char* pixels, __m128i& r, __m128i& g, __m128i& b) {
+        const __m128i mask = _mm_set1_epi32(0xFF);
+        __m128i p0 = _mm_loadu_si128((const __m128i*)pixels);
+        __m128i p1 = _mm_loadu_si128((const __m128i*)(pixels + 16));
+        r = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+        g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+        b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+    }
+    
+    /** the luma of 8 pixels, which wraps past 32767 but not past 65535 */
+    inline __m128i Luma(__m128i r, __m128i g, __m128i b) {
+        __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+        y = _mm_add_epi16(y, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128)));
+        return _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(16));
+    }
+    
+    /** the rounded averages of the pairs in two rows of 8 values, as 4 values */
+    inline __m128i Average2x2(__m128i row0, __m128i row1) {
+        __m128i sums = _mm_madd_epi16(_mm_add_epi16(row0, row1), _mm_set1_epi16(1));
+        return _mm_srli_epi32(_mm_add_epi32(sums, _mm_set1_epi32(2)), 2);
+    }
+    
+    /** one chroma of 8 averaged pixels */
+    inline __m128i Chroma(__m128i r, __m128i g, __m128i b, short kr, short kg, short kb) {
+        __m128i c = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(kr)), _mm_mullo_epi16(g, _mm_set1_epi16(kg)));
+        c = _mm_add_epi16(c, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(kb)), _mm_set1_epi16(128)));
+        return _mm_add_epi16(_mm_srai_epi16(c, 8), _mm_set1_epi16(128));
+    }
+    
+    /**
+     Converts RGBA pixels with their rows from the bottom up into I420: a full size luma
+     plane and quarter size blue and red chroma planes, top down. The sizes must be even.
+     Each pass takes 16 pixels across two rows, which gives 32 luma and 8 of each chroma.
+     */
+    void ConvertToI420(const unsigned char* pixels, unsigned width, unsigned height,
+                       unsigned char* luma, unsigned char* u, unsigned char* v) {
+        for (unsigned y=0; y<height; y+=2) {
+            const unsigned char* row0 = pixels + 4 * width * (height - 1 - y);
+            const unsigned char* row1 = row0 - 4 * width;
+            unsigned char* luma0 = luma + width * y;
+            unsigned char* luma1 = luma0 + width;
+            unsigned char* uRow = u + width / 2 * (y / 2);
+            unsigned char* vRow = v + width / 2 * (y / 2);
+            unsigned x = 0;
+            for (; x + 16 <= width; x += 16) {
+                __m128i r[4], g[4], b[4];
+                Unpack(row0 + 4 * x, r[0], g[0], b[0]);
+                Unpack(row0 + 4 * x + 32, r[1], g[1], b[1]);
+                Unpack(row1 + 4 * x, r[2], g[2], b[2]);
+                Unpack(row1 + 4 * x + 32, r[3], g[3], b[3]);
+                _mm_storeu_si128((__m128i*)(luma0 + x), _mm_packus_epi16(Luma(r[0], g[0], b[0]), Luma(r[1], g[1], b[1])));
+                _mm_storeu_si128((__m128i*)(luma1 + x), _mm_packus_epi16(Luma(r[2], g[2], b[2]), Luma(r[3], g[3], b[3])));
+                
+                __m128i ar = _mm_packs_epi32(Average2x2(r[0], r[2]), Average2x2(r[1], r[3]));
+                __m128i ag = _mm_packs_epi32(Average2x2(g[0], g[2]), Average2x2(g[1], g[3]));
+                __m128i ab = _mm_packs_epi32(Average2x2(b[0], b[2]), Average2x2(b[1], b[3]));
+                __m128i cu = Chroma(ar, ag, ab, -38, -74, 112);
+                __m128i cv = Chroma(ar, ag, ab, 112, -94, -18);
+                _mm_storel_epi64((__m128i*)(uRow + x / 2), _mm_packus_epi16(cu, cu));
+                _mm_storel_epi64((__m128i*)(vRow + x / 2), _mm_packus_epi16(cv, cv));
+            }
+            for (; x<width; x+=2)
+                ConvertBlock(row0, row1, x, luma0, luma1, uRow, vRow);
+        }
+    }
+}
+
+VideoRecorder::VideoRecorder(unsigned width, unsigned height, unsigned frameRate, unsigned frames, unsigned buffers) :
+    _readback(width, height, buffers),
+    _frameRate(frameRate),
+    _recording(false),
+    _recorded(0),
+    _dropped(0),
+    _converted(0),
+    _convertMilliseconds(0.0),
+    _file(NULL),
+    _writing(false),
+    _failed(false),
+    _stopping(false),
+    _written(0),
+    _writeMilliseconds(0.0)
+{
+    assert(width % 2 == 0 && height % 2 == 0 && frameRate > 0 && frames > 0);
+    for (unsigned i=0; i<frames; i++) {
+        _frames.push_back(std::unique_ptr<Frame>(new Frame(width * height * 3 / 2)));
+        _freeFrames.push_back(_frames.back().get());
+    }
+    _writer = std::thread(&VideoRecorder::_threadMain, this);
+}
+
+VideoRecorder::~VideoRecorder() {
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _queueChanged.notify_all();
+    _writer.join();
+}
+
+void VideoRecorder::start(const std::string& path) {
+    assert(!_recording);
+    std::FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("Couldn't open " + path);
+    
+    // 4:2:0 with the chroma between the luma, and BT.601 colors in video range
+    fprintf(file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+            _readback.width(), _readback.height(), _frameRate);
+    
+    std::lock_guard<std::mutex> lock(_mutex);
+    _file = file;
+    _failed = false;
+    _recording = true;
+}
+
+void VideoRecorder::stop() {
+    if (!_recording)
+        return;
+    _readback.finish([this](unsigned, const unsigned char* pixels) {
+        _receive(pixels);
+    });
+    
+    std::unique_lock<std::mutex> lock(_mutex);
+    _queueChanged.wait(lock, [this]() { return _queue.empty() && !_writing; });
+    if (_failed)
+        std::cerr << "Couldn't write all of the video" << std::endl;
+    fclose(_file);
+    _file = NULL;
+    _recording = false;
+}
+
+bool VideoRecorder::recording() const {
+    return _recording;
+}
+
+void VideoRecorder::update(unsigned framebufferWidth, unsigned framebufferHeight) {
+    if (_recording) {
+        if (_readback.read(framebufferWidth, framebufferHeight, 0))
+            _recorded++;
+        else
+            _dropped++;
+    }
+    _readback.poll([this](unsigned, const unsigned char* pixels) {
+        _receive(pixels);
+    });
+}
+
+VideoRecorder::Stats VideoRecorder::stats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Stats stats;
+    stats.recorded = _recorded;
+    stats.dropped = _dropped;
+    stats.written = _written;
+    stats.inFlight = _readback.pending() + (unsigned)_queue.size() + (_writing ? 1 : 0);
+    stats.readbackLatency = _readback.stats().averageLatency;
+    stats.convertMilliseconds = _converted > 0 ? _convertMilliseconds / _converted : 0.0;
+    stats.writeMilliseconds = _written > 0 ? _writeMilliseconds / _written : 0.0;
+    stats.megabytesWritten = _written * (double)_frames[0]->size() / (1024.0 * 1024.0);
+    return stats;
+}
+
+void VideoRecorder::_receive(const unsigned char* pixels) {
+    Frame* frame = NULL;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_freeFrames.empty()) {
+            frame = _freeFrames.back();
+            _freeFrames.pop_back();
+        }
+    }
+    if (!frame) {
+        _recorded--;
+        _dropped++;
+        return;
+    }
+    
+    // converting is about as quick as copying, so it's done here, while the buffer's mapped
+    PROFILE_ZONE("VideoRecorder convert");
+    Clock::time_point start = Clock::now();
+    unsigned width = _readback.width(), height = _readback.height();
+    unsigned char* luma = &(*frame)[0];
+    unsigned char* u = luma + width * height;
+    unsigned char* v = u + width * height / 4;
+    ConvertToI420(pixels, width, height, luma, u, v);
+    _convertMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    _converted++;
+    
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(frame);
+    }
+    _queueChanged.notify_all();
+}
+
+void VideoRecorder::_threadMain() {
+    Profiler::shared().setThreadName("Video writer");
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        // stop() has emptied the queue by the time it's stopping
+        _queueChanged.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+        if (_stopping)
+            return;
+        
+        Frame* frame = _queue.front();
+        _queue.pop_front();
+        _writing = true;
+        std::FILE* file = _file;
+        lock.unlock();
+        
+        Clock::time_point start = Clock::now();
+        bool written;
+        {
+            PROFILE_ZONE("VideoRecorder write");
+            written = fwrite("FRAME\n", 1, 6, file) == 6 && fwrite(&(*frame)[0], 1, frame->size(), file) == frame->size();
+        }
+        double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        
+        lock.lock();
+        if (written)
+            _written++;
+        else
+            _failed = true;
+        _writeMilliseconds += milliseconds;
+        _freeFrames.push_back(frame);
+        _writing = false;
+        // stop() might be waiting for the queue to empty
+        _queueChanged.notify_all();
+    }
+}
@@ -0,0 +1,131 @@
+//
+//  VideoRecorder.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/18/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__VideoRecorder__
+#define __open_safari__VideoRecorder__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FrameReadback.h"
+
+/**
+ Records what the player sees to a video file, a frame at a time, without holding up the
+ frame.
+ 
+ Each frame is read back with FrameReadback. Once it arrives it's converted straight out of
+ the mapped buffer into I420, a full size luma plane and quarter size chroma planes, with
+ SSE2. That's about what copying it would cost, and it's less than half the size. The
+ converted frames go into a pool and a writer thread writes them to a YUV4MPEG2 (.y4m)
+ file, which players and encoders like ffmpeg read as it is.
+ 
+ The pool bounds the memory it takes. When the readback buffers or the pool's frames are
+ all busy, because the disk can't keep up, frames are dropped rather than waited for.
+ 
+ Apart from stats(), only use it on the thread with the OpenGL context.
+ */
+class VideoRecorder {
+public:
+    struct Stats {
+        /** totals since it was made */
+        unsigned long recorded;
+        unsigned long dropped;
+        unsigned long written;
+        /** frames being read back or waiting to be written */
+        unsigned inFlight;
+        /** the frames a readback took on average */
+        float readbackLatency;
+        /** how long converting and writing a frame took, on average */
+        double convertMilliseconds;
+        double writeMilliseconds;
+        double megabytesWritten;
+    };
+    
+    /**
+     @param width, height  the size of the video, which must be even
+     @param frameRate      the frames a second it plays back at
+     @param frames         the most converted frames held in memory at once
+     @param buffers        how many readbacks can be in flight at once
+     */
+    VideoRecorder(unsigned width, unsigned height, unsigned frameRate, unsigned frames = 8, unsigned buffers = 3);
+    
+    /**
+     Stops recording, and the writer thread
+     */
+    ~VideoRecorder();
+    
+    /**
+     Starts recording into a new file
+     
+     @param path  where to write the video
+     @throws std::runtime_error if the file can't be opened
+     */
+    void start(const std::string& path);
+    
+    /**
+     Waits for every frame recorded to be written, and closes the file
+     */
+    void stop();
+    
+    bool recording() const;
+    
+    /**
+     Records a frame of what's been drawn, if it's recording, and converts the frames from
+     earlier that have been read back. Call it once a frame, after drawing and before
+     swapping.
+     
+     @param framebufferWidth, framebufferHeight  the size of the back buffer in pixels
+     */
+    void update(unsigned framebufferWidth, unsigned framebufferHeight);
+    
+    Stats stats() const;
+
+private:
+    typedef std::chrono::high_resolution_clock Clock;
+    
+    /** the planes of a converted frame, one after the other */
+    typedef std::vector<unsigned char> Frame;
+    
+    FrameReadback _readback;
+    unsigned _frameRate;
+    std::vector<std::unique_ptr<Frame> > _frames;
+    bool _recording;
+    unsigned long _recorded;
+    unsigned long _dropped;
+    unsigned long _converted;
+    double _convertMilliseconds;
+    
+    // shared with the writer thread
+    mutable std::mutex _mutex;
+    std::condition_variable _queueChanged;
+    std::FILE* _file;
+    std::vector<Frame*> _freeFrames;
+    std::deque<Frame*> _queue;
+    /** whether the writer thread is writing a frame */
+    bool _writing;
+    bool _failed;
+    bool _stopping;
+    unsigned long _written;
+    double _writeMilliseconds;
+    std::thread _writer;
+    
+    void _receive(const unsigned char* pixels);
+    void _threadMain();
+    
+    // copying disabled
+    VideoRecorder(const VideoRecorder&);
+    const VideoRecorder& operator=(const VideoRecorder&);
+};
+
+#endif /* defined(__open_safari__VideoRecorder__) */
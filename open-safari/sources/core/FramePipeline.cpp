@@ -0,0 +1,131 @@
+//
+//  FramePipeline.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/11/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "FramePipeline.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cassert>
+
+static double Milliseconds(std::chrono::high_resolution_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+FramePipeline::FramePipeline(const Step& simulate, const Step& synchronize, const Step& render) :
+    _simulate(simulate),
+    _synchronize(synchronize),
+    _render(render),
+    _framesInFlight(2),
+    _simulating(false),
+    _quit(false),
+    _thread(&FramePipeline::_gameThreadMain, this)
+{
+    _stats.simulateMilliseconds = 0.0;
+    _stats.synchronizeMilliseconds = 0.0;
+    _stats.renderMilliseconds = 0.0;
+    _stats.overlapMilliseconds = 0.0;
+    _stats.waitMilliseconds = 0.0;
+    _stats.frameMilliseconds = 0.0;
+    _stats.framesInFlight = _framesInFlight;
+}
+
+FramePipeline::~FramePipeline() {
+    _waitForGame();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _changed.notify_all();
+    _thread.join();
+}
+
+void FramePipeline::runFrame() {
+    Clock::time_point frameStart = Clock::now();
+    if (_lastFrameStart != Clock::time_point())
+        _stats.frameMilliseconds = Milliseconds(frameStart - _lastFrameStart);
+    _lastFrameStart = frameStart;
+    _stats.framesInFlight = _framesInFlight;
+    
+    // the game thread may still be on a frame from before a switch to one in flight
+    _waitForGame();
+    _stats.waitMilliseconds = Milliseconds(Clock::now() - frameStart);
+    
+    if (_framesInFlight == 1) {
+        Clock::time_point start = Clock::now();
+        _simulate();
+        _simulateStart = start;
+        _simulateEnd = Clock::now();
+        _stats.simulateMilliseconds = Milliseconds(_simulateEnd - _simulateStart);
+        _stats.overlapMilliseconds = 0.0;
+    } else {
+        _measureOverlap();
+    }
+    
+    Clock::time_point start = Clock::now();
+    _synchronize();
+    _stats.synchronizeMilliseconds = Milliseconds(Clock::now() - start);
+    
+    if (_framesInFlight > 1) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _simulating = true;
+        }
+        _changed.notify_all();
+    }
+    
+    _renderStart = Clock::now();
+    _render();
+    _renderEnd = Clock::now();
+    _stats.renderMilliseconds = Milliseconds(_renderEnd - _renderStart);
+}
+
+unsigned FramePipeline::framesInFlight() const {
+    return _framesInFlight;
+}
+
+void FramePipeline::setFramesInFlight(unsigned framesInFlight) {
+    assert(framesInFlight == 1 || framesInFlight == 2);
+    _framesInFlight = framesInFlight;
+}
+
+const FramePipeline::Stats& FramePipeline::stats() const {
+    return _stats;
+}
+
+void FramePipeline::_waitForGame() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _changed.wait(lock, [this]() { return !_simulating; });
+}
+
+void FramePipeline::_measureOverlap() {
+    // the simulate that just finished ran alongside the last render
+    _stats.simulateMilliseconds = Milliseconds(_simulateEnd - _simulateStart);
+    Clock::time_point overlapStart = std::max(_simulateStart, _renderStart);
+    Clock::time_point overlapEnd = std::min(_simulateEnd, _renderEnd);
+    _stats.overlapMilliseconds = overlapEnd > overlapStart ? Milliseconds(overlapEnd - overlapStart) : 0.0;
+}
+
+void FramePipeline::_gameThreadMain() {
+    Profiler::shared().setThreadName("Game");
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _changed.wait(lock, [this]() { return _simulating || _quit; });
+        if (_quit)
+            return;
+        
+        lock.unlock();
+        Clock::time_point start = Clock::now();
+        _simulate();
+        Clock::time_point end = Clock::now();
+        lock.lock();
+        
+        _simulateStart = start;
+        _simulateEnd = end;
+        _simulating = false;
+        _changed.notify_all();
+    }
+}
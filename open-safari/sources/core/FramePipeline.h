@@ -0,0 +1,108 @@
+//
+//  FramePipeline.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/11/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__FramePipeline__
+#define __open_safari__FramePipeline__
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ Runs a game's frames as a two stage pipeline: the next frame is simulated on a game thread
+ while the render thread, the one calling runFrame(), draws the last one.
+ 
+ Each frame has three steps. simulate() runs on the game thread and may only touch game
+ state. synchronize() runs on the render thread while the game thread is stopped between
+ frames. It copies what the renderer needs from the game state into a snapshot, does
+ anything that has to be on the render thread (like uploading to OpenGL), and hands over
+ the input for the next simulate(). render() then draws from the snapshot while the next
+ simulate() runs. The game thread never gets more than a frame ahead, so what's on screen
+ is never more than one frame older than the game state.
+ 
+ With one frame in flight the steps run one after another on the render thread instead,
+ which is handy for comparing the two, and for code that isn't safe to run alongside
+ rendering yet.
+ */
+class FramePipeline {
+public:
+    typedef std::function<void()> Step;
+    
+    struct Stats {
+        /** the last frame's steps */
+        double simulateMilliseconds;
+        double synchronizeMilliseconds;
+        double renderMilliseconds;
+        /** how long the last render and simulate ran at the same time */
+        double overlapMilliseconds;
+        /** the render thread waiting for the game thread to finish */
+        double waitMilliseconds;
+        /** from the start of one runFrame() to the start of the next */
+        double frameMilliseconds;
+        unsigned framesInFlight;
+    };
+    
+    /**
+     @param simulate     steps the game, on the game thread
+     @param synchronize  copies out the game state, on the render thread
+     @param render       draws the copy, on the render thread
+     */
+    FramePipeline(const Step& simulate, const Step& synchronize, const Step& render);
+    
+    /**
+     Waits for the frame being simulated, then stops the game thread
+     */
+    ~FramePipeline();
+    
+    /**
+     Runs a frame. With two frames in flight it waits for the game thread to finish the
+     frame it's on, synchronizes, starts the game thread on the next frame and renders.
+     With one it simulates, synchronizes and renders in turn.
+     */
+    void runFrame();
+    
+    /**
+     1 to run the steps one after another, or 2 (the default) to simulate and render at the
+     same time. Changes take effect at the next runFrame().
+     */
+    unsigned framesInFlight() const;
+    void setFramesInFlight(unsigned framesInFlight);
+    
+    const Stats& stats() const;
+
+private:
+    typedef std::chrono::high_resolution_clock Clock;
+    
+    Step _simulate;
+    Step _synchronize;
+    Step _render;
+    unsigned _framesInFlight;
+    Stats _stats;
+    Clock::time_point _lastFrameStart;
+    Clock::time_point _renderStart, _renderEnd;
+    
+    // shared with the game thread
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    bool _simulating;
+    bool _quit;
+    Clock::time_point _simulateStart, _simulateEnd;
+    std::thread _thread;
+    
+    void _waitForGame();
+    void _measureOverlap();
+    void _gameThreadMain();
+    
+    // copying disabled
+    FramePipeline(const FramePipeline&);
+    const FramePipeline& operator=(const FramePipeline&);
+};
+
+#endif /* defined(__open_safari__FramePipeline__) */
@@ -0,0 +1,185 @@
+//
+//  GpuProfiler.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/20/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include <cassert>
+#include <cstring>
+
+namespace {
+    /** how much of each frame goes into the smoothed times */
+    const double Smoothing = 0.05;
+}
+
+GpuProfiler::GpuProfiler(unsigned maxPasses, unsigned frames) :
+    _supported(glQueryCounter != NULL && glGetQueryObjectui64v != NULL),
+    _maxPasses(maxPasses),
+    _track(0),
+    _frames(frames),
+    _current(NULL),
+    _frameNumber(0),
+    _timed(0),
+    _dropped(0),
+    _totalLatency(0),
+    _frameMilliseconds(0.0)
+{
+    assert(maxPasses > 0 && frames > 0);
+    if (!_supported)
+        return;
+    
+    // each pass begins and ends with a query, and so does the frame
+    for (size_t i=0; i<_frames.size(); i++) {
+        _frames[i].queries.resize(2 * maxPasses + 2);
+        glGenQueries((GLsizei)_frames[i].queries.size(), &_frames[i].queries[0]);
+        _free.push_back(&_frames[i]);
+    }
+    _track = Profiler::shared().addTrack("GPU");
+}
+
+GpuProfiler::~GpuProfiler() {
+    if (!_supported)
+        return;
+    for (size_t i=0; i<_frames.size(); i++)
+        glDeleteQueries((GLsizei)_frames[i].queries.size(), &_frames[i].queries[0]);
+}
+
+bool GpuProfiler::supported() const {
+    return _supported;
+}
+
+void GpuProfiler::beginFrame() {
+    assert(!_current);
+    if (!_supported)
+        return;
+    
+    // the GPU writes timestamps in order, so once a frame's last one is there the rest are too
+    while (!_pending.empty()) {
+        Frame& frame = *_pending.front();
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        _read(frame);
+        _free.push_back(&frame);
+        _pending.pop_front();
+    }
+    
+    if (_free.empty()) {
+        _dropped++;
+        return;
+    }
+    _current = _free.back();
+    _free.pop_back();
+    _current->used = 0;
+    _current->marks.clear();
+    _open.clear();
+    
+    // reading the GPU's clock doesn't wait for it, so the CPU's clock is read on either side
+    uint64_t before = Profiler::now();
+    GLint64 gpuNanoseconds = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNanoseconds);
+    uint64_t after = Profiler::now();
+    _current->gpuNanoseconds = gpuNanoseconds;
+    _current->cpuTicks = before + (after - before) / 2;
+    
+    glQueryCounter(_current->queries[_current->used++], GL_TIMESTAMP);
+}
+
+void GpuProfiler::endFrame() {
+    if (_current) {
+        assert(_open.empty());
+        glQueryCounter(_current->queries[_current->used++], GL_TIMESTAMP);
+        _current->number = _frameNumber;
+        _pending.push_back(_current);
+        _current = NULL;
+    }
+    _frameNumber++;
+}
+
+void GpuProfiler::beginPass(const char* name) {
+    if (!_current)
+        return;
+    if (_current->marks.size() == _maxPasses) {
+        _open.push_back(-1);
+        return;
+    }
+    
+    Mark mark;
+    mark.name = name;
+    mark.depth = (unsigned)_open.size();
+    mark.begin = _current->used++;
+    mark.end = mark.begin;
+    glQueryCounter(_current->queries[mark.begin], GL_TIMESTAMP);
+    _open.push_back((int)_current->marks.size());
+    _current->marks.push_back(mark);
+}
+
+void GpuProfiler::endPass() {
+    if (!_current)
+        return;
+    assert(!_open.empty());
+    int mark = _open.back();
+    _open.pop_back();
+    if (mark < 0)
+        return;
+    
+    _current->marks[mark].end = _current->used++;
+    glQueryCounter(_current->queries[_current->marks[mark].end], GL_TIMESTAMP);
+}
+
+const std::vector<GpuProfiler::Pass>& GpuProfiler::passes() const {
+    return _passes;
+}
+
+GpuProfiler::Stats GpuProfiler::stats() const {
+    Stats stats;
+    stats.timed = _timed;
+    stats.dropped = _dropped;
+    stats.latency = _timed > 0 ? (float)_totalLatency / _timed : 0.0f;
+    stats.frameMilliseconds = _frameMilliseconds;
+    return stats;
+}
+
+void GpuProfiler::_read(Frame& frame) {
+    _results.resize(frame.used);
+    for (unsigned i=0; i<frame.used; i++)
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &_results[i]);
+    
+    // onto the CPU's timeline, from where the two clocks were read together
+    Profiler& profiler = Profiler::shared();
+    double ticksPerNanosecond = profiler.ticksPerMicrosecond() / 1000.0;
+    auto toTicks = [&](uint64_t nanoseconds) {
+        return frame.cpuTicks + (int64_t)((int64_t)(nanoseconds - frame.gpuNanoseconds) * ticksPerNanosecond);
+    };
+    profiler.record(_track, "GPU frame", toTicks(_results[0]), toTicks(_results[frame.used - 1]));
+    double frameMilliseconds = (_results[frame.used - 1] - _results[0]) / 1000000.0;
+    _frameMilliseconds += (frameMilliseconds - _frameMilliseconds) * Smoothing;
+    
+    for (size_t i=0; i<_passes.size(); i++)
+        _passes[i].milliseconds = 0.0;
+    for (size_t m=0; m<frame.marks.size(); m++) {
+        const Mark& mark = frame.marks[m];
+        uint64_t begin = _results[mark.begin], end = _results[mark.end];
+        profiler.record(_track, mark.name, toTicks(begin), toTicks(end));
+        
+        // the same pass can come more than once in a frame, and its times are added up
+        size_t p = 0;
+        while (p < _passes.size() && strcmp(_passes[p].name, mark.name) != 0)
+            p++;
+        if (p == _passes.size()) {
+            Pass pass = { mark.name, mark.depth, 0.0, 0.0 };
+            _passes.push_back(pass);
+        }
+        _passes[p].milliseconds += (end - begin) / 1000000.0;
+    }
+    for (size_t i=0; i<_passes.size(); i++)
+        _passes[i].averageMilliseconds += (_passes[i].milliseconds - _passes[i].averageMilliseconds) * Smoothing;
+    
+    _totalLatency += _frameNumber - frame.number;
+    _timed++;
+}
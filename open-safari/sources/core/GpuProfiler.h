@@ -0,0 +1,163 @@
+//
+//  GpuProfiler.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/20/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__GpuProfiler__
+#define __open_safari__GpuProfiler__
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <GL/glew.h>
+
+/**
+ Times how long the GPU takes on each pass of a frame.
+ 
+ Each pass gets a GL_TIMESTAMP query where it begins and another where it ends, so passes
+ can be nested, and they say when the GPU did them as well as how long it took. A frame's
+ queries are only read once the last of them is available, a few frames later, so reading
+ them never waits on the GPU. When every frame's queries are still waiting, the frame just
+ isn't timed.
+ 
+ The times are turned into ticks of Profiler::now(), from the GPU's clock read alongside
+ the CPU's at the start of each frame, and recorded onto the profiler's "GPU" track, so
+ they show up in the exported trace under what the CPU was doing when it submitted them.
+ 
+ If the driver doesn't have timer queries, it does nothing.
+ 
+ Only use it on the thread with the OpenGL context.
+ */
+class GpuProfiler {
+public:
+    /**
+     What a pass took on the GPU
+     */
+    struct Pass {
+        const char* name;
+        /** how many passes it's inside of */
+        unsigned depth;
+        /** in the last frame read back, 0 if it wasn't in it */
+        double milliseconds;
+        /** smoothed over the last few dozen frames */
+        double averageMilliseconds;
+    };
+    
+    struct Stats {
+        /** totals since it was made */
+        unsigned long timed;
+        unsigned long dropped;
+        /** the frames the times took to come back on average */
+        float latency;
+        /** the GPU's time from the start to the end of a frame, smoothed like the passes' */
+        double frameMilliseconds;
+    };
+    
+    /**
+     @param maxPasses  the most passes timed in a frame; the rest aren't timed
+     @param frames     how many frames can be waiting to be read back at once
+     */
+    GpuProfiler(unsigned maxPasses = 32, unsigned frames = 4);
+    ~GpuProfiler();
+    
+    /** whether the driver has timer queries */
+    bool supported() const;
+    
+    /**
+     Starts timing a frame, and reads back the frames from earlier that the GPU has
+     finished. Call it before drawing anything.
+     */
+    void beginFrame();
+    
+    /**
+     Ends the frame. Call it after drawing everything, before swapping.
+     */
+    void endFrame();
+    
+    /**
+     Starts and ends a pass, between beginFrame() and endFrame(). Passes have to end in the
+     opposite order they began.
+     
+     @param name  what's being drawn, which has to last as long as the profiler does
+     */
+    void beginPass(const char* name);
+    void endPass();
+    
+    /**
+     Every pass that's been timed, in the order they first came in a frame
+     */
+    const std::vector<Pass>& passes() const;
+    
+    Stats stats() const;
+
+private:
+    /** a pass in a frame, and the queries it began and ended with */
+    struct Mark {
+        const char* name;
+        unsigned depth;
+        unsigned begin, end;
+    };
+    
+    /** the queries of a frame */
+    struct Frame {
+        std::vector<GLuint> queries;
+        unsigned used;
+        std::vector<Mark> marks;
+        /** the GPU's clock, in nanoseconds, and the CPU's, in ticks, at the same time */
+        int64_t gpuNanoseconds;
+        uint64_t cpuTicks;
+        unsigned long number;
+    };
+    
+    bool _supported;
+    unsigned _maxPasses;
+    unsigned _track;
+    std::vector<Frame> _frames;
+    std::vector<Frame*> _free;
+    /** the frames being waited on, oldest first */
+    std::deque<Frame*> _pending;
+    /** the frame being timed, or NULL if it isn't */
+    Frame* _current;
+    /** the marks of the passes that have begun and not ended, or -1 for ones not timed */
+    std::vector<int> _open;
+    std::vector<Pass> _passes;
+    std::vector<uint64_t> _results;
+    
+    unsigned long _frameNumber;
+    unsigned long _timed;
+    unsigned long _dropped;
+    unsigned long _totalLatency;
+    double _frameMilliseconds;
+    
+    void _read(Frame& frame);
+    
+    // copying disabled
+    GpuProfiler(const GpuProfiler&);
+    const GpuProfiler& operator=(const GpuProfiler&);
+};
+
+/**
+ Times the GPU's part of the scope it's in as a pass
+ */
+class GpuZone {
+public:
+    GpuZone(GpuProfiler& profiler, const char* name) : _profiler(profiler) { _profiler.beginPass(name); }
+    ~GpuZone() { _profiler.endPass(); }
+
+private:
+    GpuProfiler& _profiler;
+    
+    // copying disabled
+    GpuZone(const GpuZone&);
+    const GpuZone& operator=(const GpuZone&);
+};
+
+#define GPU_ZONE_NAME(line) gpuZone ## line
+#define GPU_ZONE_LINE(profiler, name, line) GpuZone GPU_ZONE_NAME(line)(profiler, name)
+/** times the GPU's part of the rest of the scope it's in */
+#define GPU_ZONE(profiler, name) GPU_ZONE_LINE(profiler, name, __LINE__)
+
+#endif /* defined(__open_safari__GpuProfiler__) */
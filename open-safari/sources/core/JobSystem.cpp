@@ -0,0 +1,349 @@
+//
+//  JobSystem.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/10/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cassert>
+
+struct JobCounter::Job {
+    JobSystem::Function function;
+    JobCounter* counter;
+    const char* name;
+};
+
+namespace {
+    /** the job system a worker belongs to, and its number in it. thread_local isn't in
+        Apple's clang yet, and __thread is fine for plain values. */
+    __thread const JobSystem* CurrentSystem = NULL;
+    __thread unsigned CurrentThread = 0;
+    
+    /** how many times a worker looks for a job before going to sleep */
+    const unsigned SpinsBeforeSleeping = 64;
+    
+    /** the most jobs a thread's deque holds */
+    const long DequeCapacity = 4096;
+    
+    /** xorshift, for picking who to steal from */
+    unsigned NextRandom(unsigned& seed) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+}
+
+/**
+ A Chase-Lev work-stealing deque of a fixed size, with the memory orders from "Correct and
+ Efficient Work-Stealing for Weak Memory Models" (Lê et al. 2013). Only the thread that
+ owns it pushes and pops, at the bottom. Any thread can steal from the top.
+ */
+class JobSystem::Deque {
+public:
+    Deque() : _top(0), _bottom(0), _jobs(DequeCapacity) {}
+    
+    /** @result false if it's full */
+    bool push(Job* job) {
+        long bottom = _bottom.load(std::memory_order_relaxed);
+        long top = _top.load(std::memory_order_acquire);
+        if (bottom - top >= DequeCapacity)
+            return false;
+        _jobs[bottom & (DequeCapacity - 1)].store(job, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+        return true;
+    }
+    
+    /** @result the newest job, or NULL if it's empty */
+    Job* pop() {
+        long bottom = _bottom.load(std::memory_order_relaxed) - 1;
+        _bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long top = _top.load(std::memory_order_relaxed);
+        
+        Job* job = NULL;
+        if (top <= bottom) {
+            job = _jobs[bottom & (DequeCapacity - 1)].load(std::memory_order_relaxed);
+            if (top == bottom) {
+                // the last one, which a thief might be taking too
+                if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    job = NULL;
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+        } else {
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+    
+    /** @result the oldest job, or NULL if it's empty or another thread got there first */
+    Job* steal() {
+        long top = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long bottom = _bottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+            return NULL;
+        
+        Job* job = _jobs[top & (DequeCapacity - 1)].load(std::memory_order_relaxed);
+        if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return NULL;
+        return job;
+    }
+
+private:
+    // the thieves hammer the top and the owner the bottom, so they're a cache line apart
+    std::atomic<long> _top;
+    char _padding[64 - sizeof(std::atomic<long>)];
+    std::atomic<long> _bottom;
+    std::vector<std::atomic<Job*> > _jobs;
+};
+
+JobCounter::JobCounter() :
+    _value(0)
+{
+}
+
+int JobCounter::value() const {
+    return _value.load();
+}
+
+JobSystem::JobSystem(unsigned threadCount) :
+    _owner(std::this_thread::get_id()),
+    _threadStats(new ThreadStats[std::max(threadCount, 1u) + 1]),
+    _began(NULL),
+    _ended(NULL),
+    _queueSize(0),
+    _queued(0),
+    _sleepers(0),
+    _quit(false)
+{
+    threadCount = std::max(threadCount, 1u);
+    for (unsigned i=0; i<threadCount; i++)
+        _deques.push_back(std::unique_ptr<Deque>(new Deque));
+    // the last one is for the threads without a deque
+    for (unsigned i=0; i<=threadCount; i++) {
+        _threadStats[i].jobs = 0;
+        _threadStats[i].steals = 0;
+        _threadStats[i].overflows = 0;
+    }
+    for (unsigned i=1; i<threadCount; i++)
+        _workers.push_back(std::thread(&JobSystem::_workerMain, this, i));
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _quit = true;
+    }
+    _wake.notify_all();
+    for (size_t i=0; i<_workers.size(); i++)
+        _workers[i].join();
+    
+    assert(_queued == 0);
+}
+
+JobSystem& JobSystem::shared() {
+    static JobSystem system(std::max(std::thread::hardware_concurrency(), 1u));
+    return system;
+}
+
+unsigned JobSystem::threadCount() const {
+    return (unsigned)_deques.size();
+}
+
+unsigned JobSystem::currentThread() const {
+    if (CurrentSystem == this)
+        return CurrentThread;
+    if (std::this_thread::get_id() == _owner)
+        return 0;
+    return threadCount();
+}
+
+void JobSystem::run(const Function& function, JobCounter* counter, JobCounter* after, const char* name) {
+    Job* job = new Job;
+    job->function = function;
+    job->counter = counter;
+    job->name = name;
+    if (counter)
+        counter->_value++;
+    
+    if (after) {
+        std::lock_guard<std::mutex> lock(after->_mutex);
+        if (after->_value > 0) {
+            after->_continuations.push_back(job);
+            return;
+        }
+    }
+    _push(job);
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    unsigned thread = currentThread();
+    unsigned seed = thread * 7919 + 1;
+    while (counter._value > 0) {
+        Job* job = _take(thread, seed);
+        if (job)
+            _execute(job, thread);
+        else
+            std::this_thread::yield();
+    }
+    
+    // the thread that finished the last job may still be holding the lock
+    std::lock_guard<std::mutex> lock(counter._mutex);
+}
+
+void JobSystem::parallelFor(unsigned count, unsigned grainSize, const std::function<void(unsigned begin, unsigned end)>& function,
+                            const char* name) {
+    if (count == 0)
+        return;
+    grainSize = std::max(grainSize, 1u);
+    if (count <= grainSize || threadCount() == 1) {
+        function(0, count);
+        return;
+    }
+    
+    JobCounter counter;
+    _splitRange(0, count, grainSize, &function, &counter, name);
+    wait(counter);
+}
+
+void JobSystem::setHooks(Hook began, Hook ended) {
+    _began = began;
+    _ended = ended;
+}
+
+JobSystem::Stats JobSystem::stats() const {
+    Stats stats;
+    stats.threads = threadCount();
+    stats.jobs = 0;
+    stats.steals = 0;
+    stats.overflows = 0;
+    for (unsigned i=0; i<=threadCount(); i++) {
+        stats.jobs += _threadStats[i].jobs;
+        stats.steals += _threadStats[i].steals;
+        stats.overflows += _threadStats[i].overflows;
+    }
+    return stats;
+}
+
+void JobSystem::_push(Job* job) {
+    unsigned thread = currentThread();
+    if (thread < threadCount()) {
+        if (!_deques[thread]->push(job)) {
+            _threadStats[thread].overflows++;
+            _execute(job, thread);
+            return;
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        _queue.push_back(job);
+        _queueSize = (unsigned)_queue.size();
+    }
+    
+    // a sleeping worker checks _queued after saying it's asleep, so one of the two sees
+    // the other
+    _queued++;
+    if (_sleepers > 0) {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _wake.notify_one();
+    }
+}
+
+JobSystem::Job* JobSystem::_take(unsigned thread, unsigned& seed) {
+    Job* job = NULL;
+    if (thread < threadCount())
+        job = _deques[thread]->pop();
+    
+    // try every other deque once, starting at a random one
+    if (!job && threadCount() > 1) {
+        unsigned start = NextRandom(seed) % threadCount();
+        for (unsigned i=0; i<threadCount() && !job; i++) {
+            unsigned victim = (start + i) % threadCount();
+            if (victim == thread)
+                continue;
+            job = _deques[victim]->steal();
+            if (job)
+                _threadStats[thread].steals++;
+        }
+    }
+    
+    if (!job && _queueSize > 0) {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        if (!_queue.empty()) {
+            job = _queue.front();
+            _queue.erase(_queue.begin());
+            _queueSize = (unsigned)_queue.size();
+        }
+    }
+    
+    if (job)
+        _queued--;
+    return job;
+}
+
+void JobSystem::_execute(Job* job, unsigned thread) {
+    if (_began)
+        _began(job->name, thread);
+    job->function();
+    if (_ended)
+        _ended(job->name, thread);
+    _threadStats[thread].jobs++;
+    _finish(job);
+}
+
+void JobSystem::_finish(Job* job) {
+    std::vector<Job*> continuations;
+    JobCounter* counter = job->counter;
+    delete job;
+    if (counter) {
+        std::lock_guard<std::mutex> lock(counter->_mutex);
+        if (--counter->_value == 0)
+            continuations.swap(counter->_continuations);
+    }
+    for (size_t i=0; i<continuations.size(); i++)
+        _push(continuations[i]);
+}
+
+void JobSystem::_splitRange(unsigned begin, unsigned end, unsigned grainSize, const std::function<void(unsigned, unsigned)>* function,
+                            JobCounter* counter, const char* name) {
+    // leave the top half for someone else and carry on with the bottom half
+    while (end - begin > grainSize) {
+        unsigned middle = begin + (end - begin) / 2;
+        run([=]() { _splitRange(middle, end, grainSize, function, counter, name); }, counter, NULL, name);
+        end = middle;
+    }
+    (*function)(begin, end);
+}
+
+void JobSystem::_workerMain(unsigned thread) {
+    Profiler::shared().setThreadName("Job worker " + std::to_string(thread));
+    CurrentSystem = this;
+    CurrentThread = thread;
+    unsigned seed = thread * 7919 + 1;
+    unsigned spins = 0;
+    while (true) {
+        Job* job = _take(thread, seed);
+        if (job) {
+            _execute(job, thread);
+            spins = 0;
+            continue;
+        }
+        if (++spins < SpinsBeforeSleeping) {
+            std::this_thread::yield();
+            continue;
+        }
+        
+        spins = 0;
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _sleepers++;
+        _wake.wait(lock, [this]() { return _quit || _queued > 0; });
+        _sleepers--;
+        if (_quit)
+            return;
+    }
+}
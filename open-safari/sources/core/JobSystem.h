@@ -0,0 +1,185 @@
+//
+//  JobSystem.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/10/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__JobSystem__
+#define __open_safari__JobSystem__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+/**
+ Counts the jobs in a group that haven't finished. Waiting on a counter, or starting a job
+ after one, is how jobs depend on each other. A counter has to outlive the jobs that count
+ on it, so wait on it before it goes away.
+ */
+class JobCounter {
+public:
+    JobCounter();
+    
+    /** @result the jobs that haven't finished */
+    int value() const;
+
+private:
+    friend class JobSystem;
+    struct Job;
+    
+    std::atomic<int> _value;
+    std::mutex _mutex;
+    /** jobs to start once the value gets to zero */
+    std::vector<Job*> _continuations;
+    
+    // copying disabled
+    JobCounter(const JobCounter&);
+    const JobCounter& operator=(const JobCounter&);
+};
+
+/**
+ Runs jobs on a pool of worker threads that steal work from each other.
+ 
+ Each worker, and the thread that made the job system, has a Chase-Lev deque of jobs. A
+ thread pushes the jobs it starts onto the bottom of its own deque and pops from there too,
+ newest first, which keeps the data it just touched in its cache, and needs no locks. A
+ thread with nothing left steals the oldest job off the top of a random other deque, which
+ tends to be a big one. Jobs started from other threads go in a shared queue instead.
+ 
+ Waiting on a counter runs jobs until the counter gets to zero, so the waiting thread does
+ its share of the work and jobs can wait on jobs they started without tying up a thread.
+ Workers that find nothing to do spin for a little while then sleep until a job is started.
+ */
+class JobSystem {
+public:
+    typedef std::function<void()> Function;
+    
+    /**
+     Called on the thread running a job, just before and after it runs, to time it
+     
+     @param name    the name it was started with
+     @param thread  the thread running it, 0 for the one that made the job system
+     */
+    typedef void (*Hook)(const char* name, unsigned thread);
+    
+    struct Stats {
+        unsigned threads;
+        /** totals since the job system was made */
+        unsigned long jobs;
+        unsigned long steals;
+        /** jobs run right away because their thread's deque was full */
+        unsigned long overflows;
+    };
+    
+    /**
+     @param threadCount  the threads to spread jobs over, including the one making the job
+                         system, which only runs jobs while it waits. At least 1.
+     */
+    explicit JobSystem(unsigned threadCount);
+    
+    /**
+     Stops the workers. Every counter should have been waited on first.
+     */
+    ~JobSystem();
+    
+    /**
+     @result the job system ParallelFor uses, with a thread for each core, made the first
+             time it's asked for
+     */
+    static JobSystem& shared();
+    
+    unsigned threadCount() const;
+    
+    /**
+     @result the thread this is called on: 0 for the one that made the job system, 1 and up
+             for the workers, or threadCount() for any other thread
+     */
+    unsigned currentThread() const;
+    
+    /**
+     Starts a job
+     
+     @param function  the job
+     @param counter   counts up now and down once the job has finished, or NULL
+     @param after     if not NULL, the job doesn't start until this counter gets to zero
+     @param name      for the profiling hooks. It has to outlive the job.
+     */
+    void run(const Function& function, JobCounter* counter = NULL, JobCounter* after = NULL, const char* name = "job");
+    
+    /**
+     Runs jobs until the counter gets to zero
+     */
+    void wait(JobCounter& counter);
+    
+    /**
+     Calls function(begin, end) over ranges covering 0 to count, returning once they've all
+     run. The range is split in half, again and again, until the pieces are no longer than
+     grainSize, and the halves are left on the deque for other threads to steal, so a
+     thread only splits what it doesn't get help with.
+     
+     @param grainSize  the most indices to hand to one call, at least 1
+     */
+    void parallelFor(unsigned count, unsigned grainSize, const std::function<void(unsigned begin, unsigned end)>& function,
+                     const char* name = "parallelFor");
+    
+    /**
+     Sets the functions called around every job, or NULL for none. Only call it while no
+     jobs are running.
+     */
+    void setHooks(Hook began, Hook ended);
+    
+    Stats stats() const;
+
+private:
+    typedef JobCounter::Job Job;
+    class Deque;
+    
+    /** what each thread counts, padded so they don't share cache lines */
+    struct ThreadStats {
+        std::atomic<unsigned long> jobs;
+        std::atomic<unsigned long> steals;
+        std::atomic<unsigned long> overflows;
+        char padding[64 - 3 * sizeof(std::atomic<unsigned long>)];
+    };
+    
+    std::thread::id _owner;
+    std::vector<std::unique_ptr<Deque> > _deques;
+    std::unique_ptr<ThreadStats[]> _threadStats;
+    std::vector<std::thread> _workers;
+    Hook _began;
+    Hook _ended;
+    
+    /** jobs started from threads without a deque */
+    std::mutex _queueMutex;
+    std::vector<Job*> _queue;
+    std::atomic<unsigned> _queueSize;
+    
+    /** jobs pushed and not yet taken, for deciding whether to sleep */
+    std::atomic<int> _queued;
+    std::atomic<unsigned> _sleepers;
+    std::mutex _sleepMutex;
+    std::condition_variable _wake;
+    bool _quit;
+    
+    void _push(Job* job);
+    Job* _take(unsigned thread, unsigned& seed);
+    void _execute(Job* job, unsigned thread);
+    void _finish(Job* job);
+    void _splitRange(unsigned begin, unsigned end, unsigned grainSize, const std::function<void(unsigned, unsigned)>* function,
+                     JobCounter* counter, const char* name);
+    void _workerMain(unsigned thread);
+    
+    // copying disabled
+    JobSystem(const JobSystem&);
+    const JobSystem& operator=(const JobSystem&);
+};
+
+#endif /* defined(__open_safari__JobSystem__) */
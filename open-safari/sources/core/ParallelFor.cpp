@@ -0,0 +1,25 @@
+//
+//  ParallelFor.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 5/26/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "ParallelFor.h"
+#include <algorithm>
+#include "core/JobSystem.h"
+
+void ParallelFor(unsigned count, const std::function<void(unsigned index)>& task) {
+    // a few ranges per thread, so threads that finish early can steal the rest
+    JobSystem& jobs = JobSystem::shared();
+    unsigned grainSize = std::max(count / (4 * jobs.threadCount()), 1u);
+    jobs.parallelFor(count, grainSize, [&](unsigned begin, unsigned end) {
+        for (unsigned i=begin; i<end; i++)
+            task(i);
+    }, "ParallelFor");
+}
+
+unsigned ParallelForThreadCount() {
+    return JobSystem::shared().threadCount();
+}
@@ -0,0 +1,28 @@
+//
+//  ParallelFor.h
+//  open-safari
+//
+//  Created by Darren Tsung on 5/26/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__ParallelFor__
+#define __open_safari__ParallelFor__
+
+#include <functional>
+
+/**
+ Runs task(0), task(1), ..., task(count - 1) spread across the shared JobSystem's threads
+ and the calling thread, returning once every task has finished.
+ 
+ The tasks are handed out in a few ranges per thread, which the threads steal from each
+ other. Tasks can call ParallelFor themselves, and the waiting thread runs other jobs.
+ */
+void ParallelFor(unsigned count, const std::function<void(unsigned index)>& task);
+
+/**
+ @result the number of threads ParallelFor spreads tasks across, including the caller
+ */
+unsigned ParallelForThreadCount();
+
+#endif /* defined(__open_safari__ParallelFor__) */
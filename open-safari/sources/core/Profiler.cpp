@@ -0,0 +1,206 @@
+//
+//  Profiler.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/19/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+    const unsigned MaxDepth = 64;
+    
+    double MicrosecondsNow() {
+        typedef std::chrono::high_resolution_clock Clock;
+        return std::chrono::duration<double, std::micro>(Clock::now().time_since_epoch()).count();
+    }
+    
+    void WriteJsonString(FILE* file, const char* string) {
+        fputc('"', file);
+        for (const char* c=string; *c; c++) {
+            if (*c == '"' || *c == '\\')
+                fputc('\\', file);
+            if ((unsigned char)*c >= ' ')
+                fputc(*c, file);
+        }
+        fputc('"', file);
+    }
+}
+
+struct Profiler::Track {
+    struct Zone {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+    };
+    
+    std::string name;
+    unsigned id;
+    /** the zones ever recorded, the last TrackCapacity of which are in the ring. only the
+        track's thread writes it. */
+    std::atomic<unsigned long> recorded;
+    Zone zones[TrackCapacity];
+    /** the zones begun with beginZone() that haven't ended yet */
+    Zone open[MaxDepth];
+    unsigned depth;
+};
+
+__thread Profiler::Track* Profiler::_currentTrack = NULL;
+
+Profiler& Profiler::shared() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() :
+    _startTicks(now()),
+    _startMicroseconds(MicrosecondsNow())
+{
+}
+
+void Profiler::setThreadName(const std::string& name) {
+    Track& track = _track();
+    std::lock_guard<std::mutex> lock(_mutex);
+    track.name = name;
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end) {
+    _push(_track(), name, start, end);
+}
+
+unsigned Profiler::addTrack(const std::string& name) {
+    return _addTrack(name)->id;
+}
+
+void Profiler::record(unsigned track, const char* name, uint64_t start, uint64_t end) {
+    Track* added;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        assert(track > 0 && track <= _tracks.size());
+        added = _tracks[track - 1];
+    }
+    _push(*added, name, start, end);
+}
+
+double Profiler::ticksPerMicrosecond() const {
+    return (now() - _startTicks) / (MicrosecondsNow() - _startMicroseconds);
+}
+
+void Profiler::beginZone(const char* name) {
+    Track& track = _track();
+    assert(track.depth < MaxDepth);
+    track.open[track.depth].name = name;
+    track.open[track.depth].start = now();
+    track.depth++;
+}
+
+void Profiler::endZone() {
+    uint64_t end = now();
+    Track& track = _track();
+    assert(track.depth > 0);
+    track.depth--;
+    record(track.open[track.depth].name, track.open[track.depth].start, end);
+}
+
+unsigned Profiler::exportChromeTrace(const std::string& path) {
+    std::vector<Track*> tracks;
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        tracks = _tracks;
+        for (size_t i=0; i<tracks.size(); i++)
+            names.push_back(tracks[i]->name);
+    }
+    
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file)
+        throw std::runtime_error("Couldn't open " + path);
+    
+    // the trace's times are in microseconds since the profiler started
+    double ticksPerMicrosecond = this->ticksPerMicrosecond();
+    unsigned written = 0;
+    std::vector<Track::Zone> zones;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t t=0; t<tracks.size(); t++) {
+        Track& track = *tracks[t];
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                t == 0 ? "" : ",\n", track.id);
+        WriteJsonString(file, names[t].c_str());
+        fprintf(file, "}}");
+        
+        // copy the ring out, then drop the zones that got written over while it was copied
+        unsigned long recorded = track.recorded.load(std::memory_order_acquire);
+        unsigned long first = recorded > TrackCapacity ? recorded - TrackCapacity : 0;
+        zones.clear();
+        for (unsigned long i=first; i<recorded; i++)
+            zones.push_back(track.zones[i & (TrackCapacity - 1)]);
+        // the slot after the last one recorded may be being written right now, too
+        unsigned long recordedAfter = track.recorded.load(std::memory_order_acquire) + 1;
+        unsigned long firstIntact = recordedAfter > TrackCapacity ? recordedAfter - TrackCapacity : 0;
+        size_t skipped = firstIntact > first ? std::min((size_t)(firstIntact - first), zones.size()) : 0;
+        
+        for (size_t i=skipped; i<zones.size(); i++) {
+            const Track::Zone& zone = zones[i];
+            fprintf(file, ",\n{\"name\":");
+            WriteJsonString(file, zone.name);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", track.id,
+                    ((int64_t)(zone.start - _startTicks)) / ticksPerMicrosecond, (zone.end - zone.start) / ticksPerMicrosecond);
+            written++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    bool failed = ferror(file) != 0;
+    if (fclose(file) != 0 || failed)
+        throw std::runtime_error("Couldn't write " + path);
+    return written;
+}
+
+Profiler::Stats Profiler::stats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Stats stats;
+    stats.tracks = (unsigned)_tracks.size();
+    stats.zones = 0;
+    stats.overwritten = 0;
+    for (size_t i=0; i<_tracks.size(); i++) {
+        unsigned long recorded = _tracks[i]->recorded.load(std::memory_order_relaxed);
+        stats.zones += recorded;
+        stats.overwritten += recorded > TrackCapacity ? recorded - TrackCapacity : 0;
+    }
+    return stats;
+}
+
+Profiler::Track& Profiler::_track() {
+    if (_currentTrack)
+        return *_currentTrack;
+    
+    _currentTrack = _addTrack("");
+    return *_currentTrack;
+}
+
+Profiler::Track* Profiler::_addTrack(const std::string& name) {
+    Track* track = new Track();
+    track->recorded.store(0);
+    track->depth = 0;
+    std::lock_guard<std::mutex> lock(_mutex);
+    track->id = (unsigned)_tracks.size() + 1;
+    track->name = name.empty() ? "Thread " + std::to_string(track->id) : name;
+    _tracks.push_back(track);
+    return track;
+}
+
+void Profiler::_push(Track& track, const char* name, uint64_t start, uint64_t end) {
+    // the exporter only reads the zone after it sees the count go past it
+    unsigned long index = track.recorded.load(std::memory_order_relaxed);
+    Track::Zone& zone = track.zones[index & (TrackCapacity - 1)];
+    zone.name = name;
+    zone.start = start;
+    zone.end = end;
+    track.recorded.store(index + 1, std::memory_order_release);
+}
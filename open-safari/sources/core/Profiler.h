@@ -0,0 +1,156 @@
+//
+//  Profiler.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/19/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__Profiler__
+#define __open_safari__Profiler__
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <x86intrin.h>
+
+/**
+ Records how long each zone of code took, on every thread, for looking at in Chrome's
+ tracing view (chrome://tracing) or Perfetto.
+ 
+ Zones are timed with the CPU's timestamp counter, which takes a few nanoseconds to read.
+ Each thread records into a ring of its own, so recording never takes a lock or waits on
+ another thread; when a ring is full its oldest zones are written over. The rings are only
+ read to export them, which copies each one out and throws away whatever got written over
+ while it was copying.
+ 
+ Zone names aren't copied, so they have to last as long as the profiler, like string
+ literals do.
+ */
+class Profiler {
+public:
+    /** the zones each thread keeps */
+    static const unsigned TrackCapacity = 1 << 15;
+    
+    struct Stats {
+        /** threads that have recorded zones, and tracks that were added */
+        unsigned tracks;
+        /** totals since it started */
+        unsigned long zones;
+        unsigned long overwritten;
+    };
+    
+    /**
+     The profiler everything records into
+     */
+    static Profiler& shared();
+    
+    /**
+     The timestamp counter, in ticks
+     */
+    static uint64_t now() { return __rdtsc(); }
+    
+    /**
+     Names the thread calling it, for the exported trace
+     */
+    void setThreadName(const std::string& name);
+    
+    /**
+     Records a zone on the thread calling it
+     
+     @param name        what was timed
+     @param start, end  when it started and ended, from now()
+     */
+    void record(const char* name, uint64_t start, uint64_t end);
+    
+    /**
+     Adds a track that isn't any thread's, for zones timed some other way, like on the GPU
+     
+     @param name  what it's called in the exported trace
+     @result      the track, for recording onto
+     */
+    unsigned addTrack(const std::string& name);
+    
+    /**
+     Records a zone onto a track from addTrack(). Unlike recording onto a thread's own track
+     this takes a lock, and only one thread at a time can record onto each track.
+     
+     @param track       from addTrack()
+     @param name        what was timed
+     @param start, end  when it started and ended, in ticks of now()
+     */
+    void record(unsigned track, const char* name, uint64_t start, uint64_t end);
+    
+    /**
+     How many ticks of now() there are to a microsecond, measured against the system clock
+     since the profiler started
+     */
+    double ticksPerMicrosecond() const;
+    
+    /**
+     Starts and ends zones on the thread calling them, for code that can't hold a
+     ProfileZone, like hooks called around something else. Zones have to end in the
+     opposite order they began, and can be nested up to 64 deep.
+     */
+    void beginZone(const char* name);
+    void endZone();
+    
+    /**
+     Writes every zone the threads still have to a Chrome trace file
+     
+     @param path  where to write it, which is usually named .json
+     @result      the zones written
+     @throws std::runtime_error if it can't be written
+     */
+    unsigned exportChromeTrace(const std::string& path);
+    
+    Stats stats();
+
+private:
+    struct Track;
+    
+    static __thread Track* _currentTrack;
+    
+    std::mutex _mutex;
+    /** every thread's track, which stay around after their threads finish */
+    std::vector<Track*> _tracks;
+    /** when it started, in ticks and in microseconds of the system clock, for converting
+        ticks into time */
+    uint64_t _startTicks;
+    double _startMicroseconds;
+    
+    Profiler();
+    /** the track of the thread calling it, which is made the first time */
+    Track& _track();
+    Track* _addTrack(const std::string& name);
+    static void _push(Track& track, const char* name, uint64_t start, uint64_t end);
+    
+    // copying disabled
+    Profiler(const Profiler&);
+    const Profiler& operator=(const Profiler&);
+};
+
+/**
+ Times the scope it's in, from when it's made to when it's destroyed
+ */
+class ProfileZone {
+public:
+    explicit ProfileZone(const char* name) : _name(name), _start(Profiler::now()) {}
+    ~ProfileZone() { Profiler::shared().record(_name, _start, Profiler::now()); }
+
+private:
+    const char* _name;
+    uint64_t _start;
+    
+    // copying disabled
+    ProfileZone(const ProfileZone&);
+    const ProfileZone& operator=(const ProfileZone&);
+};
+
+#define PROFILE_ZONE_NAME(line) profileZone ## line
+#define PROFILE_ZONE_LINE(name, line) ProfileZone PROFILE_ZONE_NAME(line)(name)
+/** times the rest of the scope it's in */
+#define PROFILE_ZONE(name) PROFILE_ZONE_LINE(name, __LINE__)
+
+#endif /* defined(__open_safari__Profiler__) */
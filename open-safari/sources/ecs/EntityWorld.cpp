@@ -0,0 +1,295 @@
+//
+//  EntityWorld.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/9/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "EntityWorld.h"
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+    struct ComponentInfo {
+        size_t size;
+        size_t alignment;
+    };
+    
+    /** filled in as the types are first used. entries never move once they're written. */
+    ComponentInfo ComponentInfos[EntityWorld::MaxComponentTypes];
+    std::atomic<unsigned> ComponentTypeCount(0);
+    std::mutex ComponentMutex;
+    
+    /** new[] gives at least this alignment */
+    const size_t ChunkAlignment = 16;
+    
+    size_t AlignUp(size_t offset, size_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+}
+
+EntityWorld::ComponentType EntityWorld::_registerComponent(size_t size, size_t alignment) {
+    std::lock_guard<std::mutex> lock(ComponentMutex);
+    unsigned type = ComponentTypeCount;
+    if (type == MaxComponentTypes)
+        throw std::runtime_error("Too many component types");
+    if (alignment > ChunkAlignment)
+        throw std::runtime_error("Component types can't be aligned to more than 16 bytes");
+    ComponentInfos[type].size = size;
+    ComponentInfos[type].alignment = alignment;
+    ComponentTypeCount = type + 1;
+    return type;
+}
+
+EntityWorld::Query::Query() :
+    _reads(0),
+    _writes(0),
+    _excluded(0)
+{
+}
+
+EntityWorld::ComponentMask EntityWorld::Query::reads() const {
+    return _reads & ~_writes;
+}
+
+EntityWorld::ComponentMask EntityWorld::Query::writes() const {
+    return _writes;
+}
+
+EntityWorld::ComponentMask EntityWorld::Query::excluded() const {
+    return _excluded;
+}
+
+bool EntityWorld::Query::matches(ComponentMask mask) const {
+    ComponentMask required = _reads | _writes;
+    return (mask & required) == required && (mask & _excluded) == 0;
+}
+
+unsigned EntityWorld::Chunk::count() const {
+    return _count;
+}
+
+const Entity* EntityWorld::Chunk::entities() const {
+    return reinterpret_cast<const Entity*>(_data);
+}
+
+EntityWorld::EntityWorld() :
+    _entityCount(0),
+    _locks(0)
+{
+}
+
+EntityWorld::~EntityWorld() {
+    for (std::unordered_map<ComponentMask, Archetype*>::iterator it = _archetypes.begin(); it != _archetypes.end(); ++it) {
+        for (size_t i=0; i<it->second->chunks.size(); i++)
+            delete[] it->second->chunks[i];
+        delete it->second;
+    }
+}
+
+Entity EntityWorld::create() {
+    return _create(0);
+}
+
+void EntityWorld::destroy(Entity entity) {
+    assert(_locks == 0);
+    if (!alive(entity))
+        return;
+    
+    Record& record = _records[entity.index];
+    _removeRow(record.archetype, record.chunk, record.row);
+    record.archetype = NULL;
+    // zero is never handed out
+    if (++record.generation == 0)
+        record.generation = 1;
+    _freeIndices.push_back(entity.index);
+    _entityCount--;
+}
+
+bool EntityWorld::alive(Entity entity) const {
+    return entity.index < _records.size() && _records[entity.index].archetype != NULL &&
+           _records[entity.index].generation == entity.generation;
+}
+
+void EntityWorld::gatherChunks(const Query& query, std::vector<Chunk>& chunks) const {
+    for (std::unordered_map<ComponentMask, Archetype*>::const_iterator it = _archetypes.begin(); it != _archetypes.end(); ++it) {
+        const Archetype* archetype = it->second;
+        if (!query.matches(archetype->mask))
+            continue;
+        for (size_t i=0; i<archetype->chunks.size(); i++) {
+            Chunk chunk;
+            chunk._query = &query;
+            chunk._offsets = &archetype->offsets[0];
+            chunk._data = archetype->chunks[i];
+            chunk._count = i + 1 < archetype->chunks.size() ? archetype->capacity : archetype->lastCount;
+            chunks.push_back(chunk);
+        }
+    }
+}
+
+void EntityWorld::forEachChunk(const Query& query, const std::function<void(const Chunk& chunk)>& function) {
+    std::vector<Chunk> chunks;
+    gatherChunks(query, chunks);
+    lock();
+    for (size_t i=0; i<chunks.size(); i++)
+        function(chunks[i]);
+    unlock();
+}
+
+unsigned EntityWorld::count(const Query& query) const {
+    unsigned count = 0;
+    for (std::unordered_map<ComponentMask, Archetype*>::const_iterator it = _archetypes.begin(); it != _archetypes.end(); ++it) {
+        const Archetype* archetype = it->second;
+        if (query.matches(archetype->mask) && !archetype->chunks.empty())
+            count += (unsigned)(archetype->chunks.size() - 1) * archetype->capacity + archetype->lastCount;
+    }
+    return count;
+}
+
+void EntityWorld::lock() {
+    _locks++;
+}
+
+void EntityWorld::unlock() {
+    assert(_locks > 0);
+    _locks--;
+}
+
+EntityWorld::Stats EntityWorld::stats() const {
+    Stats stats;
+    stats.entities = _entityCount;
+    stats.archetypes = (unsigned)_archetypes.size();
+    stats.chunks = 0;
+    unsigned capacity = 0;
+    for (std::unordered_map<ComponentMask, Archetype*>::const_iterator it = _archetypes.begin(); it != _archetypes.end(); ++it) {
+        stats.chunks += (unsigned)it->second->chunks.size();
+        capacity += (unsigned)it->second->chunks.size() * it->second->capacity;
+    }
+    stats.chunkFill = capacity > 0 ? (float)_entityCount / capacity : 0.0f;
+    return stats;
+}
+
+EntityWorld::Archetype* EntityWorld::_archetype(ComponentMask mask) {
+    std::unordered_map<ComponentMask, Archetype*>::iterator found = _archetypes.find(mask);
+    if (found != _archetypes.end())
+        return found->second;
+    
+    Archetype* archetype = new Archetype;
+    archetype->mask = mask;
+    archetype->offsets.assign(MaxComponentTypes, 0);
+    archetype->lastCount = 0;
+    size_t rowBytes = sizeof(Entity);
+    for (ComponentType type=0; type<MaxComponentTypes; type++) {
+        if ((mask >> type) & 1) {
+            archetype->types.push_back(type);
+            rowBytes += ComponentInfos[type].size;
+        }
+    }
+    
+    // the entities first, then an array for each type. padding between the arrays can push
+    // the last one past the end, in which case fewer fit.
+    for (unsigned capacity = ChunkBytes / rowBytes; ; capacity--) {
+        size_t offset = sizeof(Entity) * capacity;
+        for (size_t i=0; i<archetype->types.size(); i++) {
+            const ComponentInfo& info = ComponentInfos[archetype->types[i]];
+            offset = AlignUp(offset, info.alignment);
+            archetype->offsets[archetype->types[i]] = (unsigned)offset;
+            offset += info.size * capacity;
+        }
+        if (offset <= ChunkBytes) {
+            archetype->capacity = capacity;
+            break;
+        }
+    }
+    
+    _archetypes[mask] = archetype;
+    return archetype;
+}
+
+Entity EntityWorld::_create(ComponentMask mask) {
+    assert(_locks == 0);
+    Entity entity;
+    if (_freeIndices.empty()) {
+        entity.index = (uint32_t)_records.size();
+        Record record;
+        record.generation = 1;
+        _records.push_back(record);
+    } else {
+        entity.index = _freeIndices.back();
+        _freeIndices.pop_back();
+    }
+    
+    Record& record = _records[entity.index];
+    entity.generation = record.generation;
+    record.archetype = _archetype(mask);
+    _addRow(record.archetype, entity, &record.chunk, &record.row);
+    _entityCount++;
+    return entity;
+}
+
+void EntityWorld::_addRow(Archetype* archetype, Entity entity, unsigned* chunk, unsigned* row) {
+    if (archetype->chunks.empty() || archetype->lastCount == archetype->capacity) {
+        archetype->chunks.push_back(new unsigned char[ChunkBytes]);
+        archetype->lastCount = 0;
+    }
+    *chunk = (unsigned)archetype->chunks.size() - 1;
+    *row = archetype->lastCount++;
+    reinterpret_cast<Entity*>(archetype->chunks[*chunk])[*row] = entity;
+}
+
+void EntityWorld::_move(Entity entity, ComponentMask mask) {
+    assert(_locks == 0);
+    Record& record = _records[entity.index];
+    Archetype* from = record.archetype;
+    Archetype* to = _archetype(mask);
+    unsigned chunk, row;
+    _addRow(to, entity, &chunk, &row);
+    
+    // bring along the components it keeps
+    for (size_t i=0; i<from->types.size(); i++) {
+        ComponentType type = from->types[i];
+        if (!((mask >> type) & 1))
+            continue;
+        size_t size = ComponentInfos[type].size;
+        memcpy(to->chunks[chunk] + to->offsets[type] + row * size,
+               from->chunks[record.chunk] + from->offsets[type] + record.row * size, size);
+    }
+    
+    _removeRow(from, record.chunk, record.row);
+    record.archetype = to;
+    record.chunk = chunk;
+    record.row = row;
+}
+
+void EntityWorld::_removeRow(Archetype* archetype, unsigned chunk, unsigned row) {
+    // fill the hole with the archetype's last entity
+    unsigned lastChunk = (unsigned)archetype->chunks.size() - 1;
+    unsigned lastRow = archetype->lastCount - 1;
+    if (chunk != lastChunk || row != lastRow) {
+        unsigned char* to = archetype->chunks[chunk];
+        unsigned char* from = archetype->chunks[lastChunk];
+        Entity moved = reinterpret_cast<Entity*>(from)[lastRow];
+        reinterpret_cast<Entity*>(to)[row] = moved;
+        for (size_t i=0; i<archetype->types.size(); i++) {
+            ComponentType type = archetype->types[i];
+            size_t size = ComponentInfos[type].size;
+            memcpy(to + archetype->offsets[type] + row * size, from + archetype->offsets[type] + lastRow * size, size);
+        }
+        _records[moved.index].chunk = chunk;
+        _records[moved.index].row = row;
+    }
+    
+    if (--archetype->lastCount == 0) {
+        delete[] archetype->chunks.back();
+        archetype->chunks.pop_back();
+        archetype->lastCount = archetype->chunks.empty() ? 0 : archetype->capacity;
+    }
+}
+
+void* EntityWorld::_component(Entity entity, ComponentType type) const {
+    const Record& record = _records[entity.index];
+    return record.archetype->chunks[record.chunk] + record.archetype->offsets[type] + record.row * ComponentInfos[type].size;
+}
@@ -0,0 +1,327 @@
+//
+//  EntityWorld.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/9/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__EntityWorld__
+#define __open_safari__EntityWorld__
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+/**
+ A handle to an entity. Handles are cheap to copy and compare, and a handle to an entity
+ that has been destroyed is caught by its generation even after the index is reused.
+ */
+struct Entity {
+    uint32_t index;
+    /** zero in a handle that was never given an entity */
+    uint32_t generation;
+    
+    Entity() : index(0), generation(0) {}
+    
+    bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+/**
+ Entities made of plain data components, stored by archetype.
+ 
+ Every entity with the same set of component types shares an archetype, and an archetype
+ keeps its entities in 16 KB chunks. Inside a chunk each component type is its own array
+ (structure of arrays), so code working over one or two components of many entities walks
+ memory in a straight line. Adding or removing a component moves the entity to another
+ archetype, and destroying one moves the archetype's last entity into the hole, so every
+ chunk but the last of each archetype is full.
+ 
+ Components must be plain data that can be moved with memcpy and don't need destroying,
+ such as structs of numbers and glm vectors. Up to 64 component types can be used.
+ 
+ A Query picks out the archetypes with the components it reads and writes, and iterating
+ it hands over whole chunks. Entities can't be created, destroyed or change components
+ while chunks are being iterated. Getting and changing the components of one entity
+ through its handle is fine at any time.
+ */
+class EntityWorld {
+public:
+    /** the size of a chunk */
+    static const unsigned ChunkBytes = 16 * 1024;
+    
+    /** the most component types there can be */
+    static const unsigned MaxComponentTypes = 64;
+    
+    typedef unsigned ComponentType;
+    typedef uint64_t ComponentMask;
+    
+    /**
+     @result the number of a component type, the same in every EntityWorld
+     */
+    template<class T>
+    static ComponentType componentType();
+    
+    /**
+     The component types a piece of code works with, and how. The archetypes it matches
+     have every component read or written, and none excluded.
+     */
+    class Query {
+    public:
+        Query();
+        
+        template<class T> Query& read();
+        template<class T> Query& write();
+        template<class T> Query& without();
+        
+        /** the types only read */
+        ComponentMask reads() const;
+        ComponentMask writes() const;
+        ComponentMask excluded() const;
+        
+        bool matches(ComponentMask mask) const;
+    
+    private:
+        ComponentMask _reads;
+        ComponentMask _writes;
+        ComponentMask _excluded;
+    };
+    
+    /**
+     The entities in one chunk that a query matched, with their components as arrays of
+     count() elements
+     */
+    class Chunk {
+    public:
+        unsigned count() const;
+        const Entity* entities() const;
+        
+        /** a component the query reads or writes */
+        template<class T> const T* read() const;
+        
+        /** a component the query writes */
+        template<class T> T* write() const;
+    
+    private:
+        friend class EntityWorld;
+        
+        const Query* _query;
+        const unsigned* _offsets;
+        unsigned char* _data;
+        unsigned _count;
+    };
+    
+    struct Stats {
+        unsigned entities;
+        unsigned archetypes;
+        unsigned chunks;
+        /** how full the chunks are on average, 0 to 1 */
+        float chunkFill;
+    };
+    
+    EntityWorld();
+    ~EntityWorld();
+    
+    /**
+     @result a new entity with no components
+     */
+    Entity create();
+    
+    /**
+     @result a new entity with the given components, which must be different types
+     */
+    template<class... Components>
+    Entity create(const Components&... components);
+    
+    /**
+     Destroys the entity with its components. Does nothing if it's already gone.
+     */
+    void destroy(Entity entity);
+    
+    /**
+     @result true if the handle is to an entity that hasn't been destroyed
+     */
+    bool alive(Entity entity) const;
+    
+    /**
+     Gives the entity a component, replacing the one of that type it already has
+     */
+    template<class T>
+    void add(Entity entity, const T& component);
+    
+    /**
+     Takes a component away from the entity, if it has it
+     */
+    template<class T>
+    void remove(Entity entity);
+    
+    template<class T>
+    bool has(Entity entity) const;
+    
+    /**
+     @result the entity's component of that type, or NULL if it doesn't have one. The pointer
+             stays valid until entities are created, destroyed or change components.
+     */
+    template<class T>
+    T* get(Entity entity);
+    template<class T>
+    const T* get(Entity entity) const;
+    
+    /**
+     Adds the chunks the query matches to `chunks`. The chunks stay valid until entities are
+     created, destroyed or change components, and the query has to outlive them.
+     */
+    void gatherChunks(const Query& query, std::vector<Chunk>& chunks) const;
+    
+    /**
+     Calls `function` for each chunk the query matches, on this thread
+     */
+    void forEachChunk(const Query& query, const std::function<void(const Chunk& chunk)>& function);
+    
+    /**
+     @result the number of entities the query matches
+     */
+    unsigned count(const Query& query) const;
+    
+    /**
+     Stops entities from being created, destroyed or changing components until unlock(), for
+     code that holds onto gathered chunks. Locks can be nested.
+     */
+    void lock();
+    void unlock();
+    
+    Stats stats() const;
+
+private:
+    struct Archetype {
+        ComponentMask mask;
+        std::vector<ComponentType> types;
+        /** where each type's array starts in a chunk, by component type */
+        std::vector<unsigned> offsets;
+        /** the entities that fit in a chunk */
+        unsigned capacity;
+        std::vector<unsigned char*> chunks;
+        /** the entities in the last chunk. the others are full. */
+        unsigned lastCount;
+    };
+    
+    /** where an entity's components live */
+    struct Record {
+        Archetype* archetype;
+        unsigned chunk;
+        unsigned row;
+        uint32_t generation;
+    };
+    
+    std::unordered_map<ComponentMask, Archetype*> _archetypes;
+    std::vector<Record> _records;
+    std::vector<uint32_t> _freeIndices;
+    unsigned _entityCount;
+    int _locks;
+    
+    static ComponentType _registerComponent(size_t size, size_t alignment);
+    
+    Archetype* _archetype(ComponentMask mask);
+    Entity _create(ComponentMask mask);
+    void _addRow(Archetype* archetype, Entity entity, unsigned* chunk, unsigned* row);
+    void _move(Entity entity, ComponentMask mask);
+    void _removeRow(Archetype* archetype, unsigned chunk, unsigned row);
+    void* _component(Entity entity, ComponentType type) const;
+    
+    // copying disabled
+    EntityWorld(const EntityWorld&);
+    const EntityWorld& operator=(const EntityWorld&);
+};
+
+template<class T>
+EntityWorld::ComponentType EntityWorld::componentType() {
+    static_assert(std::is_trivially_destructible<T>::value, "components must be plain data");
+    static const ComponentType type = _registerComponent(sizeof(T), std::alignment_of<T>::value);
+    return type;
+}
+
+template<class T>
+EntityWorld::Query& EntityWorld::Query::read() {
+    _reads |= ComponentMask(1) << componentType<T>();
+    return *this;
+}
+
+template<class T>
+EntityWorld::Query& EntityWorld::Query::write() {
+    _writes |= ComponentMask(1) << componentType<T>();
+    return *this;
+}
+
+template<class T>
+EntityWorld::Query& EntityWorld::Query::without() {
+    _excluded |= ComponentMask(1) << componentType<T>();
+    return *this;
+}
+
+template<class T>
+const T* EntityWorld::Chunk::read() const {
+    ComponentType type = componentType<T>();
+    assert(((_query->reads() | _query->writes()) >> type) & 1);
+    return reinterpret_cast<const T*>(_data + _offsets[type]);
+}
+
+template<class T>
+T* EntityWorld::Chunk::write() const {
+    ComponentType type = componentType<T>();
+    assert((_query->writes() >> type) & 1);
+    return reinterpret_cast<T*>(_data + _offsets[type]);
+}
+
+template<class... Components>
+Entity EntityWorld::create(const Components&... components) {
+    ComponentMask mask = 0;
+    int types[] = { 0, (mask |= ComponentMask(1) << componentType<Components>(), 0)... };
+    (void)types;
+    assert(__builtin_popcountll(mask) == sizeof...(Components));
+    
+    Entity entity = _create(mask);
+    int copies[] = { 0, (*static_cast<Components*>(_component(entity, componentType<Components>())) = components, 0)... };
+    (void)copies;
+    return entity;
+}
+
+template<class T>
+void EntityWorld::add(Entity entity, const T& component) {
+    assert(alive(entity));
+    ComponentType type = componentType<T>();
+    const Record& record = _records[entity.index];
+    if (!((record.archetype->mask >> type) & 1))
+        _move(entity, record.archetype->mask | (ComponentMask(1) << type));
+    *static_cast<T*>(_component(entity, type)) = component;
+}
+
+template<class T>
+void EntityWorld::remove(Entity entity) {
+    assert(alive(entity));
+    ComponentType type = componentType<T>();
+    const Record& record = _records[entity.index];
+    if ((record.archetype->mask >> type) & 1)
+        _move(entity, record.archetype->mask & ~(ComponentMask(1) << type));
+}
+
+template<class T>
+bool EntityWorld::has(Entity entity) const {
+    return alive(entity) && ((_records[entity.index].archetype->mask >> componentType<T>()) & 1);
+}
+
+template<class T>
+T* EntityWorld::get(Entity entity) {
+    return has<T>(entity) ? static_cast<T*>(_component(entity, componentType<T>())) : NULL;
+}
+
+template<class T>
+const T* EntityWorld::get(Entity entity) const {
+    return has<T>(entity) ? static_cast<const T*>(_component(entity, componentType<T>())) : NULL;
+}
+
+#endif /* defined(__open_safari__EntityWorld__) */
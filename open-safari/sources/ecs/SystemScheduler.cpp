@@ -0,0 +1,89 @@
+//
+//  SystemScheduler.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/9/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "SystemScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include "core/ParallelFor.h"
+#include "core/Profiler.h"
+
+/** @result true if one query writes a component the other uses */
+static bool Conflict(const EntityWorld::Query& a, const EntityWorld::Query& b) {
+    return (a.writes() & (b.reads() | b.writes())) != 0 || (b.writes() & a.reads()) != 0;
+}
+
+SystemScheduler::SystemScheduler(EntityWorld& world) :
+    _world(world),
+    _stageCount(0)
+{
+    _stats.systems = 0;
+    _stats.stages = 0;
+    _stats.chunks = 0;
+    _stats.milliseconds = 0.0;
+}
+
+void SystemScheduler::add(const std::string& name, const EntityWorld::Query& query, const ChunkFunction& function) {
+    System system;
+    system.name = name;
+    system.query = query;
+    system.function = function;
+    system.stage = 0;
+    for (size_t i=0; i<_systems.size(); i++) {
+        if (Conflict(_systems[i].query, query))
+            system.stage = std::max(system.stage, _systems[i].stage + 1);
+    }
+    _systems.push_back(system);
+    _stageCount = std::max(_stageCount, system.stage + 1);
+    _stats.systems = (unsigned)_systems.size();
+    _stats.stages = _stageCount;
+}
+
+void SystemScheduler::run() {
+    PROFILE_ZONE("SystemScheduler::run");
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+    
+    _world.lock();
+    _stats.chunks = 0;
+    for (unsigned stage=0; stage<_stageCount; stage++) {
+        _work.clear();
+        for (size_t i=0; i<_systems.size(); i++) {
+            const System& system = _systems[i];
+            if (system.stage != stage)
+                continue;
+            _chunks.clear();
+            _world.gatherChunks(system.query, _chunks);
+            for (size_t c=0; c<_chunks.size(); c++) {
+                Work work;
+                work.system = &system;
+                work.chunk = _chunks[c];
+                _work.push_back(work);
+            }
+        }
+        
+        ParallelFor((unsigned)_work.size(), [this](unsigned index) {
+            const Work& work = _work[index];
+            work.system->function(work.chunk);
+        });
+        _stats.chunks += (unsigned)_work.size();
+    }
+    _world.unlock();
+    
+    _stats.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+std::vector<std::vector<std::string> > SystemScheduler::stages() const {
+    std::vector<std::vector<std::string> > stages(_stageCount);
+    for (size_t i=0; i<_systems.size(); i++)
+        stages[_systems[i].stage].push_back(_systems[i].name);
+    return stages;
+}
+
+const SystemScheduler::Stats& SystemScheduler::stats() const {
+    return _stats;
+}
@@ -0,0 +1,96 @@
+//
+//  SystemScheduler.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/9/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__SystemScheduler__
+#define __open_safari__SystemScheduler__
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "ecs/EntityWorld.h"
+
+/**
+ Runs systems over the chunks of an EntityWorld, as many at once as their components allow.
+ 
+ A system is a query and a function run on each chunk the query matches. The components a
+ query reads and writes are all the scheduler knows about what a system touches, so two
+ systems conflict when one writes a component the other reads or writes. Systems are split
+ into stages: each system goes in the stage after the last one holding an earlier system it
+ conflicts with, which keeps the order they were added in wherever it matters. The chunks of
+ every system in a stage are then handed out together with ParallelFor, so systems in the
+ same stage run alongside each other and a big system is spread over the worker threads too.
+ 
+ A system's function can be called on any thread and on several chunks at once, so anything
+ it touches besides the chunk's components has to be left alone or only read.
+ */
+class SystemScheduler {
+public:
+    typedef std::function<void(const EntityWorld::Chunk& chunk)> ChunkFunction;
+    
+    struct Stats {
+        unsigned systems;
+        unsigned stages;
+        /** over every system in the last run() */
+        unsigned chunks;
+        double milliseconds;
+    };
+    
+    /**
+     @param world  the entities the systems run over, which must outlive the scheduler
+     */
+    SystemScheduler(EntityWorld& world);
+    
+    /**
+     Adds a system after the ones already added
+     
+     @param name      for reports
+     @param query     the components the system uses
+     @param function  called for each chunk the query matches
+     */
+    void add(const std::string& name, const EntityWorld::Query& query, const ChunkFunction& function);
+    
+    /**
+     Runs every system once, returning when they've all finished. Entities can't be created,
+     destroyed or change components while it runs.
+     */
+    void run();
+    
+    /**
+     @result the systems in each stage, by name, for checking the order is what was meant
+     */
+    std::vector<std::vector<std::string> > stages() const;
+    
+    const Stats& stats() const;
+
+private:
+    struct System {
+        std::string name;
+        EntityWorld::Query query;
+        ChunkFunction function;
+        unsigned stage;
+    };
+    
+    /** a chunk for a system to work on */
+    struct Work {
+        const System* system;
+        EntityWorld::Chunk chunk;
+    };
+    
+    EntityWorld& _world;
+    std::vector<System> _systems;
+    unsigned _stageCount;
+    std::vector<EntityWorld::Chunk> _chunks;
+    std::vector<Work> _work;
+    Stats _stats;
+    
+    // copying disabled
+    SystemScheduler(const SystemScheduler&);
+    const SystemScheduler& operator=(const SystemScheduler&);
+};
+
+#endif /* defined(__open_safari__SystemScheduler__) */
@@ -0,0 +1,74 @@
+//
+//  LodSelector.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/2/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#define _USE_MATH_DEFINES
+#include "LodSelector.h"
+#include <cassert>
+#include <cmath>
+
+LodSelector::LodSelector() :
+    _position(0.0f),
+    _projectionScale(1.0f),
+    _aspectRatio(1.0f),
+    _firstThreshold(0.005f),
+    _hysteresis(0.15f)
+{
+}
+
+void LodSelector::setView(const glm::vec3& position, float fieldOfView, float aspectRatio) {
+    assert(fieldOfView > 0.0f && fieldOfView < 180.0f);
+    assert(aspectRatio > 0.0f);
+    _position = position;
+    _projectionScale = 1.0f / tanf(fieldOfView * (float)M_PI / 360.0f);
+    _aspectRatio = aspectRatio;
+}
+
+float LodSelector::screenCoverage(const glm::vec3& center, float radius) const {
+    float distance = glm::length(center - _position);
+    if (distance <= radius)
+        return 1.0f;
+    
+    // the projected radius, where the screen is 2 high and 2 * aspect wide
+    float projectedRadius = radius * _projectionScale / distance;
+    float coverage = (float)M_PI * projectedRadius * projectedRadius / (4.0f * _aspectRatio);
+    return coverage < 1.0f ? coverage : 1.0f;
+}
+
+unsigned LodSelector::select(const glm::vec3& center, float radius, unsigned lodCount, unsigned currentLod) const {
+    assert(lodCount > 0);
+    unsigned lod = currentLod < lodCount ? currentLod : lodCount - 1;
+    float coverage = screenCoverage(center, radius);
+    
+    while (lod + 1 < lodCount && coverage < _threshold(lod + 1) * (1.0f - _hysteresis))
+        lod++;
+    while (lod > 0 && coverage > _threshold(lod) * (1.0f + _hysteresis))
+        lod--;
+    return lod;
+}
+
+float LodSelector::firstThreshold() const {
+    return _firstThreshold;
+}
+
+void LodSelector::setFirstThreshold(float firstThreshold) {
+    assert(firstThreshold > 0.0f);
+    _firstThreshold = firstThreshold;
+}
+
+float LodSelector::hysteresis() const {
+    return _hysteresis;
+}
+
+void LodSelector::setHysteresis(float hysteresis) {
+    assert(hysteresis >= 0.0f && hysteresis < 1.0f);
+    _hysteresis = hysteresis;
+}
+
+float LodSelector::_threshold(unsigned lod) const {
+    return ldexpf(_firstThreshold, 1 - (int)lod);
+}
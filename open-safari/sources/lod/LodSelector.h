@@ -0,0 +1,79 @@
+//
+//  LodSelector.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/2/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__LodSelector__
+#define __open_safari__LodSelector__
+
+#include <glm/glm.hpp>
+
+/**
+ Picks a level of detail for an object from how much of the screen it covers.
+ 
+ The coverage of an object is the area of its bounding sphere projected onto the screen, as a
+ fraction of the screen. Level 1 is used once the coverage falls below the first threshold,
+ and each level after that at half the threshold of the one before, which fits a chain where
+ every level has half the triangles of the one before it.
+ 
+ An object has to go past a threshold by the hysteresis fraction before it changes level, so
+ objects sitting right at a threshold don't keep popping back and forth.
+ */
+class LodSelector {
+public:
+    LodSelector();
+    
+    /**
+     Sets up the view the coverage is worked out for. Call this every frame before select().
+     
+     @param position      the camera position
+     @param fieldOfView   the vertical field of view, in degrees
+     @param aspectRatio   the viewport width divided by its height
+     */
+    void setView(const glm::vec3& position, float fieldOfView, float aspectRatio);
+    
+    /**
+     @result the fraction of the screen covered by the sphere, from 0 to 1
+     */
+    float screenCoverage(const glm::vec3& center, float radius) const;
+    
+    /**
+     @param center      the center of the object's bounding sphere, in world space
+     @param radius      the radius of the bounding sphere
+     @param lodCount    the number of levels of detail the object has
+     @param currentLod  the level the object was drawn with last time
+     
+     @result the level of detail to draw the object with, from 0 (the most detailed) to
+             lodCount - 1
+     */
+    unsigned select(const glm::vec3& center, float radius, unsigned lodCount, unsigned currentLod) const;
+    
+    /**
+     The screen coverage below which an object switches to level 1. Defaults to 0.005.
+     */
+    float firstThreshold() const;
+    void setFirstThreshold(float firstThreshold);
+    
+    /**
+     How far past a threshold (as a fraction of it) an object must go before it changes
+     level. Defaults to 0.15.
+     */
+    float hysteresis() const;
+    void setHysteresis(float hysteresis);
+
+private:
+    glm::vec3 _position;
+    /** 1 / tan(fieldOfView / 2) */
+    float _projectionScale;
+    float _aspectRatio;
+    float _firstThreshold;
+    float _hysteresis;
+    
+    /** the coverage below which level `lod` is used */
+    float _threshold(unsigned lod) const;
+};
+
+#endif /* defined(__open_safari__LodSelector__) */
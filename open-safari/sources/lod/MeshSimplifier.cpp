@@ -0,0 +1,278 @@
+//
+//  MeshSimplifier.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/2/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cassert>
+#include <queue>
+#include <unordered_map>
+
+/** collapses that turn a triangle's normal further than this (a cosine) are skipped */
+static const float MinNormalAgreement = 0.2f;
+
+namespace {
+    /**
+     The symmetric 4x4 matrix of a sum of squared plane distances, upper triangle only
+     */
+    struct Quadric {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+        
+        Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+        
+        /** adds the plane ax + by + cz + d = 0, with the normal (a, b, c) unit length */
+        void addPlane(double a, double b, double c, double d, double weight) {
+            a2 += weight * a * a; ab += weight * a * b; ac += weight * a * c; ad += weight * a * d;
+            b2 += weight * b * b; bc += weight * b * c; bd += weight * b * d;
+            c2 += weight * c * c; cd += weight * c * d;
+            d2 += weight * d * d;
+        }
+        
+        void operator+=(const Quadric& other) {
+            a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+            b2 += other.b2; bc += other.bc; bd += other.bd;
+            c2 += other.c2; cd += other.cd;
+            d2 += other.d2;
+        }
+        
+        /** the weighted sum of squared distances from `p` to the planes */
+        double error(const glm::vec3& p) const {
+            double x = p.x, y = p.y, z = p.z;
+            return a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x
+                 + b2*y*y + 2*bc*y*z + 2*bd*y
+                 + c2*z*z + 2*cd*z
+                 + d2;
+        }
+    };
+    
+    struct Collapse {
+        double cost;
+        GLuint from, to;
+        /** the versions of both vertices when the cost was worked out */
+        unsigned fromVersion, toVersion;
+        
+        bool operator<(const Collapse& other) const {
+            // std::priority_queue pops the largest
+            return cost > other.cost;
+        }
+    };
+    
+    class Simplifier {
+    public:
+        Simplifier(const std::vector<tdogl::Mesh::Vertex>& vertices, const std::vector<GLuint>& indices) :
+        _vertices(vertices),
+        _triangles(indices),
+        _triangleAlive(indices.size() / 3, true),
+        _aliveTriangles(indices.size() / 3),
+        _quadrics(vertices.size()),
+        _vertexTriangles(vertices.size()),
+        _locked(vertices.size(), false),
+        _removed(vertices.size(), false),
+        _versions(vertices.size(), 0)
+        {
+            assert(indices.size() % 3 == 0);
+            
+            std::unordered_map<unsigned long long, unsigned> edgeUses;
+            for (size_t t=0; t<_triangleAlive.size(); t++) {
+                const GLuint* corners = &_triangles[3 * t];
+                for (int c=0; c<3; c++) {
+                    _vertexTriangles[corners[c]].push_back((unsigned)t);
+                    edgeUses[_edgeKey(corners[c], corners[(c + 1) % 3])]++;
+                }
+                
+                // area weighted, so big triangles hold their shape more than slivers
+                glm::vec3 cross = glm::cross(_position(corners[1]) - _position(corners[0]),
+                                             _position(corners[2]) - _position(corners[0]));
+                float length = glm::length(cross);
+                if (length <= 0.0f)
+                    continue;
+                glm::vec3 normal = cross / length;
+                double d = -glm::dot(normal, _position(corners[0]));
+                for (int c=0; c<3; c++)
+                    _quadrics[corners[c]].addPlane(normal.x, normal.y, normal.z, d, 0.5 * length);
+            }
+            
+            // vertices on open edges hold the outline and the texture seams in place
+            for (size_t t=0; t<_triangleAlive.size(); t++) {
+                const GLuint* corners = &_triangles[3 * t];
+                for (int c=0; c<3; c++) {
+                    if (edgeUses[_edgeKey(corners[c], corners[(c + 1) % 3])] == 1) {
+                        _locked[corners[c]] = true;
+                        _locked[corners[(c + 1) % 3]] = true;
+                    }
+                }
+            }
+            
+            for (size_t t=0; t<_triangleAlive.size(); t++) {
+                const GLuint* corners = &_triangles[3 * t];
+                for (int c=0; c<3; c++) {
+                    _pushCollapse(corners[c], corners[(c + 1) % 3]);
+                    _pushCollapse(corners[(c + 1) % 3], corners[c]);
+                }
+            }
+        }
+        
+        void run(size_t targetTriangles, double maxError) {
+            while (_aliveTriangles > targetTriangles && !_collapses.empty()) {
+                Collapse collapse = _collapses.top();
+                _collapses.pop();
+                
+                if (_removed[collapse.from] || _removed[collapse.to])
+                    continue;
+                if (collapse.fromVersion != _versions[collapse.from] || collapse.toVersion != _versions[collapse.to])
+                    continue;
+                if (maxError > 0.0 && collapse.cost > maxError)
+                    break;
+                if (_flips(collapse.from, collapse.to))
+                    continue;
+                
+                _collapse(collapse.from, collapse.to);
+            }
+        }
+        
+        std::vector<GLuint> result() const {
+            std::vector<GLuint> indices;
+            indices.reserve(3 * _aliveTriangles);
+            for (size_t t=0; t<_triangleAlive.size(); t++) {
+                if (_triangleAlive[t])
+                    indices.insert(indices.end(), &_triangles[3 * t], &_triangles[3 * t] + 3);
+            }
+            return indices;
+        }
+    
+    private:
+        const std::vector<tdogl::Mesh::Vertex>& _vertices;
+        std::vector<GLuint> _triangles;
+        std::vector<bool> _triangleAlive;
+        size_t _aliveTriangles;
+        std::vector<Quadric> _quadrics;
+        /** may hold dead triangles, which are skipped */
+        std::vector<std::vector<unsigned> > _vertexTriangles;
+        std::vector<bool> _locked;
+        std::vector<bool> _removed;
+        /** bumped whenever a vertex's quadric changes */
+        std::vector<unsigned> _versions;
+        std::priority_queue<Collapse> _collapses;
+        
+        static unsigned long long _edgeKey(GLuint a, GLuint b) {
+            if (a > b)
+                std::swap(a, b);
+            return ((unsigned long long)a << 32) | b;
+        }
+        
+        const glm::vec3& _position(GLuint vertex) const {
+            return _vertices[vertex].position;
+        }
+        
+        void _pushCollapse(GLuint from, GLuint to) {
+            if (_locked[from])
+                return;
+            Quadric quadric = _quadrics[from];
+            quadric += _quadrics[to];
+            Collapse collapse = { quadric.error(_position(to)), from, to, _versions[from], _versions[to] };
+            _collapses.push(collapse);
+        }
+        
+        /** @result true if moving `from` onto `to` turns any triangle over */
+        bool _flips(GLuint from, GLuint to) const {
+            const std::vector<unsigned>& triangles = _vertexTriangles[from];
+            for (size_t i=0; i<triangles.size(); i++) {
+                unsigned t = triangles[i];
+                if (!_triangleAlive[t])
+                    continue;
+                const GLuint* corners = &_triangles[3 * t];
+                if (corners[0] == to || corners[1] == to || corners[2] == to)
+                    continue; // this one disappears
+                
+                glm::vec3 before[3], after[3];
+                for (int c=0; c<3; c++) {
+                    before[c] = _position(corners[c]);
+                    after[c] = corners[c] == from ? _position(to) : before[c];
+                }
+                glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                float lengths = glm::length(normalBefore) * glm::length(normalAfter);
+                if (lengths <= 0.0f || glm::dot(normalBefore, normalAfter) < MinNormalAgreement * lengths)
+                    return true;
+            }
+            return false;
+        }
+        
+        void _collapse(GLuint from, GLuint to) {
+            std::vector<unsigned>& triangles = _vertexTriangles[from];
+            for (size_t i=0; i<triangles.size(); i++) {
+                unsigned t = triangles[i];
+                if (!_triangleAlive[t])
+                    continue;
+                GLuint* corners = &_triangles[3 * t];
+                if (corners[0] == to || corners[1] == to || corners[2] == to) {
+                    _triangleAlive[t] = false;
+                    _aliveTriangles--;
+                    continue;
+                }
+                for (int c=0; c<3; c++) {
+                    if (corners[c] == from)
+                        corners[c] = to;
+                }
+                _vertexTriangles[to].push_back(t);
+            }
+            triangles.clear();
+            
+            _removed[from] = true;
+            _quadrics[to] += _quadrics[from];
+            _versions[to]++;
+            
+            // the edges around `to` cost something new now. the neighbours' other edges keep
+            // their costs, since their quadrics haven't changed, and flips are checked again
+            // when they come off the queue.
+            std::vector<unsigned>& around = _vertexTriangles[to];
+            size_t kept = 0;
+            for (size_t i=0; i<around.size(); i++) {
+                if (_triangleAlive[around[i]])
+                    around[kept++] = around[i];
+            }
+            around.resize(kept);
+            for (size_t i=0; i<around.size(); i++) {
+                const GLuint* corners = &_triangles[3 * around[i]];
+                for (int c=0; c<3; c++) {
+                    if (corners[c] == to)
+                        continue;
+                    _pushCollapse(corners[c], to);
+                    _pushCollapse(to, corners[c]);
+                }
+            }
+        }
+    };
+}
+
+std::vector<GLuint> SimplifyMesh(const std::vector<tdogl::Mesh::Vertex>& vertices,
+                                 const std::vector<GLuint>& indices,
+                                 size_t targetTriangles,
+                                 float maxError)
+{
+    Simplifier simplifier(vertices, indices);
+    simplifier.run(targetTriangles, maxError);
+    return simplifier.result();
+}
+
+std::vector<std::vector<GLuint> > BuildLodChain(const std::vector<tdogl::Mesh::Vertex>& vertices,
+                                                const std::vector<GLuint>& indices,
+                                                unsigned maxLods,
+                                                float ratio)
+{
+    assert(ratio > 0.0f && ratio < 1.0f);
+    std::vector<std::vector<GLuint> > lods(1, indices);
+    while (lods.size() < maxLods) {
+        size_t triangles = lods.back().size() / 3;
+        std::vector<GLuint> next = SimplifyMesh(vertices, lods.back(), (size_t)(triangles * ratio));
+        // not worth a level of its own
+        if (next.empty() || next.size() / 3 > triangles * (1.0f + ratio) / 2.0f)
+            break;
+        lods.push_back(next);
+    }
+    return lods;
+}
@@ -0,0 +1,54 @@
+//
+//  MeshSimplifier.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/2/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__MeshSimplifier__
+#define __open_safari__MeshSimplifier__
+
+#include <vector>
+#include "tdogl/Mesh.h"
+
+/**
+ Reduces a triangle mesh with quadric error metrics (Garland and Heckbert).
+ 
+ Edges are collapsed cheapest first, where the cost of moving a vertex is the sum of squared
+ distances to the planes of the triangles around it, accumulated as the mesh collapses. A
+ vertex always collapses onto the other end of its edge rather than a new position, so the
+ result indexes the original vertices and every level of detail can share one vertex buffer.
+ 
+ Vertices on open edges (including texture seams, where the vertices are split) never move,
+ so the outline and seams of the mesh are kept. Collapses that would flip a triangle over
+ are skipped.
+ 
+ Nothing here touches OpenGL, so it can run in a tool as well as at load time.
+ 
+ @param vertices        the mesh vertices
+ @param indices         the triangles to reduce, three indices each
+ @param targetTriangles stop once there are this many triangles left
+ @param maxError        stop before a collapse that costs more than this, in squared world
+                        units. Zero means no limit.
+ 
+ @result the reduced triangles. There can be more than `targetTriangles` of them if no
+         more collapses are possible.
+ */
+std::vector<GLuint> SimplifyMesh(const std::vector<tdogl::Mesh::Vertex>& vertices,
+                                 const std::vector<GLuint>& indices,
+                                 size_t targetTriangles,
+                                 float maxError = 0.0f);
+
+/**
+ Makes a chain of levels of detail, each with about `ratio` times the triangles of the one
+ before. The chain ends early once simplifying stops making progress.
+ 
+ @result the index lists, starting with `indices` itself
+ */
+std::vector<std::vector<GLuint> > BuildLodChain(const std::vector<tdogl::Mesh::Vertex>& vertices,
+                                                const std::vector<GLuint>& indices,
+                                                unsigned maxLods,
+                                                float ratio = 0.5f);
+
+#endif /* defined(__open_safari__MeshSimplifier__) */
@@ -15,22 +15,349 @@
 
 // standard libraries
 #import <iostream> 
+#import <cmath>
+#import <algorithm>
+#import <sstream>
+#import <map>
+#import <cstring>
+#import <cstdio>
+#import <thread>
 
 #import "tdogl/Program.h"
 #import "tdogl/Texture.h"
+#import "tdogl/Mesh.h"
+#import "scene/AABBTree.h"
+#import "scene/BoundsCuller.h"
+#import "scene/OcclusionCuller.h"
+#import "scene/Camera.h"
+#import "scene/TriangleBVH.h"
+#import "terrain/Terrain.h"
+#import "terrain/TerrainTile.h"
+#import "world/WorldStreamer.h"
+#import "vegetation/Vegetation.h"
+#import "lod/MeshSimplifier.h"
+#import "lod/LodSelector.h"
+#import "animation/Animator.h"
+#import "animation/SkinnedMesh.h"
+#import "animation/VertexAnimation.h"
+#import "animals/Quadruped.h"
+#import "animals/HerdSimulation.h"
+#import "navigation/NavigationGrid.h"
+#import "navigation/PathFinder.h"
+#import "physics/PhysicsWorld.h"
+#import "ecs/EntityWorld.h"
+#import "ecs/SystemScheduler.h"
+#import "core/JobSystem.h"
+#import "core/ParallelFor.h"
+#import "core/FramePipeline.h"
+#import "core/Profiler.h"
+#import "core/GpuProfiler.h"
+#import "capture/PhotoCapture.h"
+#import "capture/PhotoScorer.h"
+#import "capture/VideoRecorder.h"
 #import "Player.h"
 
 // constants
+const char* const WINDOW_TITLE = "Open Safari";
 const glm::vec2 SCREEN_SIZE(800, 600);
 const float FPS = 60;
+const int CRATE_GRID_SIZE = 32;
+const float CRATE_SPACING = 6.0f;
+// the crates spin around the y axis, so their bounds have to hold every rotation of the cube
+const glm::vec3 CRATE_BOUNDS_EXTENTS(sqrtf(2.0f), 1.0f, sqrtf(2.0f));
+const float CRATE_BOUNDS_RADIUS = sqrtf(3.0f);
+const unsigned MAX_OCCLUDERS = 24;
+// the boulders that look biggest hide things too, with their coarsest level of detail shrunk
+// a little, so they never cover anything the boulder itself doesn't
+const unsigned MAX_ROCK_OCCLUDERS = 16;
+const float ROCK_OCCLUDER_SHRINK = 0.85f;
+// the ground is a kilometer square centered on the origin, heights from -10m to 50m, split
+// into 4x4 heightmap tiles that are streamed in around the player
+const float TERRAIN_CELL_SIZE = 2.0f;
+const float TERRAIN_HEIGHT_SCALE = 60.0f;
+const glm::vec3 TERRAIN_ORIGIN(-512.0f, -10.0f, -512.0f);
+const int TERRAIN_TILES = 4;
+const float TERRAIN_TILE_SIZE = 128 * TERRAIN_CELL_SIZE;
+const float TERRAIN_LOAD_RADIUS = 200.0f;
+const float TERRAIN_KEEP_RADIUS = 400.0f;
+const size_t TERRAIN_CPU_BUDGET = 2 * 1024 * 1024;
+const size_t TERRAIN_GPU_BUDGET = 16 * 1024 * 1024;
+// boulders scattered in a ring around the crates, drawn with levels of detail
+const int ROCK_COUNT = 150;
+const float ROCK_RING_INNER_RADIUS = 100.0f;
+const float ROCK_RING_OUTER_RADIUS = 125.0f;
+const unsigned ROCK_LOD_COUNT = 6;
+// a herd of zebras flocking out on the plain, each taking turns to walk and graze, and
+// running from the player
+const int ZEBRA_COUNT = 500;
+const glm::vec2 ZEBRA_RANGE_MIN(-200.0f, 10.0f);
+const glm::vec2 ZEBRA_RANGE_MAX(-100.0f, 110.0f);
+// a much bigger herd of wildebeest further out, drawn from baked animation
+const int WILDEBEEST_COUNT = 10000;
+const glm::vec2 WILDEBEEST_RANGE_MIN(60.0f, -340.0f);
+const glm::vec2 WILDEBEEST_RANGE_MAX(360.0f, -80.0f);
+// agents in the herd benchmark, run with --benchmark
+const int HERD_BENCHMARK_AGENTS = 10000;
+// the animals find their way over a grid with a cell for every terrain cell, where slopes
+// are harder going and the steepest ones and the boulders can't be crossed
+const unsigned NAVIGATION_SECTORS = TERRAIN_TILES * 128 / NavigationGrid::SectorCells;
+const float NAVIGATION_MAX_SLOPE_DEGREES = 35.0f;
+// the wildebeest migrate between two waterholes, following a flow field until they're close
+const glm::vec2 WATERHOLES[] = { glm::vec2(100.0f, -300.0f), glm::vec2(320.0f, -120.0f) };
+const float WATERHOLE_RADIUS = 40.0f;
+const float MIGRATION_SECONDS = 120.0f;
+// a few lions prowling around the zebras, each finding its own way there
+const int LION_COUNT = 4;
+// the path finder benchmark, run with --benchmark, is on a grid of 4096x4096 cells
+const unsigned PATH_BENCHMARK_SECTORS = 4096 / NavigationGrid::SectorCells;
+const int PATH_BENCHMARK_PATHS = 1000;
+// the occlusion benchmark crouches this high behind the biggest boulder, this many times its
+// size back from it, and looks past it towards the crates
+const float OCCLUSION_BENCHMARK_EYE_HEIGHT = 0.5f;
+const float OCCLUSION_BENCHMARK_EYE_DISTANCE = 1.0f;
+const int OCCLUSION_BENCHMARK_RUNS = 20;
+// the cull benchmark culls this many boxes, with and without the AABB tree
+const unsigned CULL_BENCHMARK_OBJECTS = 100000;
+// the profiler benchmark records this many empty zones on each thread, and fails if one
+// costs more than this
+const unsigned PROFILER_BENCHMARK_ZONES = 4000000;
+const double PROFILER_BENCHMARK_MAX_NANOSECONDS = 50.0;
+// the job benchmark culls this many spheres, in ranges of the grain size
+const unsigned JOB_BENCHMARK_SPHERES = 1 << 20;
+const unsigned JOB_BENCHMARK_GRAIN = 2048;
+// the camera benchmark moves and turns a camera this many times
+const int CAMERA_BENCHMARK_UPDATES = 1000000;
+// the character controller benchmark walks this many controllers for a number of frames,
+// on a patch of ground this many meters across with boulders on it
+const unsigned CONTROLLER_BENCHMARK_COUNT = 500;
+const int CONTROLLER_BENCHMARK_FRAMES = 120;
+const int CONTROLLER_BENCHMARK_GROUND = 128;
+const int CONTROLLER_BENCHMARK_ROCKS = 200;
+// crates the player tosses, and how hard. the oldest is taken away to make room for more.
+const unsigned TOSSED_CRATE_LIMIT = 64;
+const float TOSSED_CRATE_SIZE = 0.5f;
+const float TOSSED_CRATE_MASS = 20.0f;
+const float TOSS_SPEED = 12.0f;
+// the physics benchmark drops this many bodies in piles and steps them
+const int PHYSICS_BENCHMARK_BODIES = 2000;
+const int PHYSICS_BENCHMARK_STEPS = 300;
+// how far away the player can look at things, and how many pixels across the picture is
+// that the raycast benchmark casts a ray through each pixel of
+const float PICK_DISTANCE = 50.0f;
+const int RAYCAST_BENCHMARK_SIZE = 512;
+// photos are scored at a fraction of their size, by the animals in them, drawn with ids from
+// 1 up. the nearest few animals in view are measured for how much of them is hidden.
+const unsigned PHOTO_SCORE_DIVISOR = 2;
+const unsigned PHOTO_SUBJECTS_MEASURED = 16;
+const float PHOTO_SUBJECT_RADIUS = 2.0f;
+const unsigned FIRST_ZEBRA_ID = 1;
+const unsigned FIRST_LION_ID = FIRST_ZEBRA_ID + ZEBRA_COUNT;
+const unsigned FIRST_WILDEBEEST_ID = FIRST_LION_ID + LION_COUNT;
+const unsigned END_ANIMAL_ID = FIRST_WILDEBEEST_ID + WILDEBEEST_COUNT;
+// the GPU profiler's overlay is a frame at 60 fps across, with a row for each pass. the CPU's
+// time for the frame is smoothed as much as the GPU's passes are.
+const float PROFILER_OVERLAY_WIDTH = 1.0f;
+const float PROFILER_OVERLAY_ROW_HEIGHT = 0.04f;
+const double RENDER_TIME_SMOOTHING = 0.05;
+
+// the crate as a solid for the occlusion culler
+const glm::vec3 CRATE_OCCLUDER_VERTICES[] = {
+    glm::vec3(-1,-1,-1), glm::vec3( 1,-1,-1), glm::vec3( 1, 1,-1), glm::vec3(-1, 1,-1),
+    glm::vec3(-1,-1, 1), glm::vec3( 1,-1, 1), glm::vec3( 1, 1, 1), glm::vec3(-1, 1, 1)
+};
+const unsigned short CRATE_OCCLUDER_INDICES[] = {
+    0,1,2, 0,2,3, // back
+    4,6,5, 4,7,6, // front
+    0,4,5, 0,5,1, // bottom
+    3,2,6, 3,6,7, // top
+    0,3,7, 0,7,4, // left
+    1,5,6, 1,6,2  // right
+};
 
 // globals
 tdogl::Program* gProgram = NULL;
 tdogl::Texture* gTexture = NULL;
+tdogl::Program* gTerrainProgram = NULL;
+WorldStreamer* gWorld = NULL;
+tdogl::Program* gVegetationProgram = NULL;
+Vegetation* gVegetation = NULL;
+tdogl::Program* gRockProgram = NULL;
+tdogl::Mesh* gRockMesh = NULL;
+// the boulder as a solid for the occlusion culler, and the box around it
+std::vector<glm::vec3> gRockOccluderVertices;
+std::vector<unsigned short> gRockOccluderIndices;
+AABB gRockBounds;
+LodSelector gLodSelector;
+EntityWorld gEntities;
+SystemScheduler gSystems(gEntities);
+// the frustum the systems cull against, from the player after they've moved this frame
+Frustum gViewFrustum;
+// where a prop sits on the ground
+struct Placement {
+    glm::vec3 position;
+    float scale;
+    float degreesRotated;
+    /** false until the terrain under it has loaded */
+    bool grounded;
+};
+// a boulder, drawn with gRockMesh
+struct Boulder {
+    unsigned lod;
+    bool visible;
+    /** its proxy in gCollisionTree, once it's on the ground */
+    int collider;
+};
+unsigned gRocksDrawn = 0;
+unsigned gRocksOccluded = 0;
+unsigned gRockTrianglesDrawn = 0;
+tdogl::Program* gAnimalProgram = NULL;
+Quadruped* gZebra = NULL;
+SkinnedMesh* gZebraMesh = NULL;
+Animator* gZebraAnimator = NULL;
+HerdSimulation* gZebraHerd = NULL;
+/** seconds until each zebra switches between walking and grazing */
+std::vector<float> gZebraSwitchTimes;
+std::vector<float> gZebraHeights;
+tdogl::Program* gCrowdProgram = NULL;
+Quadruped* gWildebeest = NULL;
+VertexAnimation* gWildebeestCrowd = NULL;
+std::vector<VertexAnimation::Instance> gWildebeestInstances;
+HerdSimulation* gWildebeestHerd = NULL;
+std::vector<float> gWildebeestSwitchTimes;
+/** how far through its clip each wildebeest is, which runs faster the faster it goes */
+std::vector<float> gWildebeestClipTimes;
+NavigationGrid* gNavigation = NULL;
+/** which terrain tiles have had their slopes put into the navigation grid */
+std::vector<bool> gNavigationTiles;
+unsigned gWaterhole = 0;
+float gMigrationTime = 0.0f;
+PathFinder* gPathFinder = NULL;
+Quadruped* gLion = NULL;
+SkinnedMesh* gLionMesh = NULL;
+Animator* gLionAnimator = NULL;
+struct Lion {
+    glm::vec2 position;
+    float groundHeight;
+    /** the path it's following, and the waypoint it's heading for */
+    std::vector<glm::vec2> waypoints;
+    size_t nextWaypoint;
+    /** the path it's waiting for, or 0 */
+    unsigned request;
+    /** seconds until it sets off again */
+    float restTime;
+};
+std::vector<Lion> gLions;
+bool gTossKeyWasDown = false;
+PhysicsWorld* gPhysics = NULL;
+// the bodies of the tossed crates, oldest first
+std::vector<int> gTossedCrates;
+float gCrowdTime = 0.0f;
 Player gPlayer;
+FramePipeline* gPipeline = NULL;
+// what Render() draws from, copied out of the game state in Synchronize() so the game thread
+// can get on with the next frame
+struct FrameSnapshot {
+    Camera camera;
+    float degreesRotated;
+    float crowdTime;
+    struct RockDraw {
+        glm::mat4 model;
+        unsigned lod;
+    };
+    std::vector<RockDraw> rocks;
+    std::vector<glm::mat4> tossedCrates;
+    /** roughly where the middle of each animal is, in the order of their ids, while the
+        shutter's held */
+    std::vector<glm::vec3> animals;
+};
+FrameSnapshot gFrame;
+// the input and time step the game thread simulates its next frame with, also handed over
+// in Synchronize()
+struct GameInput {
+    Player::Input player;
+    bool pickTarget;
+    bool tossCrate;
+};
+GameInput gGameInput = GameInput();
+float gGameDelta = 0.0f;
+float gFrameDelta = 0.0f;
+bool gPipelineKeyWasDown = false;
+PhotoCapture* gPhotos = NULL;
+glm::ivec2 gFramebufferSize;
+// a photo is taken every frame the shutter's held, like a camera's burst mode
+bool gShutterDown = false;
+// how long frames take while photos are being taken and saved, against while they aren't
+struct FrameTimes {
+    unsigned frames;
+    double milliseconds;
+    double worstMilliseconds;
+};
+FrameTimes gPhotoFrameTimes = FrameTimes();
+FrameTimes gPlainFrameTimes = FrameTimes();
+// gameplay video, recorded while the R key's been pressed
+VideoRecorder* gRecorder = NULL;
+bool gRecordKeyWasDown = false;
+// the profiler's trace is written out with the K key
+bool gTraceKeyWasDown = false;
+// how long the GPU takes on each pass, shown over the game with the G key
+GpuProfiler* gGpuProfiler = NULL;
+tdogl::Program* gOverlayProgram = NULL;
+bool gShowProfilerOverlay = false;
+bool gOverlayKeyWasDown = false;
+double gLastOverlayTitleTime = 0.0;
+// how long Render() took on the CPU, not counting the swap, smoothed like the GPU's passes
+double gRenderMilliseconds = 0.0;
+FrameTimes gRecordingFrameTimes = FrameTimes();
+PhotoScorer* gScorer = NULL;
+tdogl::Program* gAnimalIdProgram = NULL;
+tdogl::Program* gCrowdIdProgram = NULL;
+float gBestPhotoScore = 0.0f;
+double gLastStatsTime = 0.0;
+// the benchmarks take seconds, so they only run with --benchmark on the command line
+bool gRunBenchmarks = false;
 GLuint gVAO = 0;
 GLuint gVBO = 0;
 float gDegreesRotated = 0.0f;
+std::vector<glm::vec3> gCratePositions;
+// the crates never move, so they're culled four at a time straight from their bounds
+BoundsCuller gCrateCuller;
+// what the player collides with besides the ground: a shape, and where it is
+struct Collider {
+    const TriangleBVH* shape;
+    glm::mat4 model;
+    glm::mat4 inverseModel;
+    /** what it belongs to: a boulder's entity, or a crate's number with -1 for boulders */
+    Entity entity;
+    int crate;
+};
+std::vector<Collider> gColliders;
+AABBTree gCollisionTree;
+TriangleBVH* gRockShape = NULL;
+TriangleBVH* gCrateShape = NULL;
+OcclusionCuller gOcclusionCuller;
+unsigned gDrawnCrateCount = 0;
+// what a ray from the player lands on first
+struct RayTarget {
+    enum Type {
+        Nothing,
+        Ground,
+        Crate,
+        Rock
+    };
+    Type type;
+    /** the boulder, for rocks */
+    Entity entity;
+    /** the crate's number, for crates */
+    int crate;
+    float distance;
+    glm::vec3 normal;
+};
+RayTarget gLastPickedTarget = RayTarget();
+bool gShowOcclusionBuffer = false;
+bool gOcclusionKeyWasDown = false;
+GLuint gDebugQuadVAO = 0;
+GLuint gDebugQuadVBO = 0;
+tdogl::Texture* gOcclusionTexture = NULL;
 
 
 // returns the full path the file `fileName` in the resources directory of the bundle
@@ -40,12 +367,32 @@ static std::string ResourcePath(std::string fileName) {
     return std::string([path cStringUsingEncoding:NSUTF8StringEncoding]);
 }
 
+// where photos are saved: a folder in the user's pictures, made if it isn't there
+static std::string PhotoDirectory() {
+    NSArray* paths = NSSearchPathForDirectoriesInDomains(NSPicturesDirectory, NSUserDomainMask, YES);
+    NSString* path = [[paths objectAtIndex:0] stringByAppendingPathComponent:@"Open Safari"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:NULL];
+    return std::string([path fileSystemRepresentation]);
+}
+
+// returns the full path the file `fileName` in the user's temporary directory
+static std::string TemporaryPath(std::string fileName) {
+    NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithUTF8String:fileName.c_str()]];
+    return std::string([path fileSystemRepresentation]);
+}
+
 // load shaders into a gProgram
 static void LoadShaders() {
+    PROFILE_ZONE("LoadShaders");
     std::vector<tdogl::Shader> shaders;
     shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("vertex-shader.txt"), GL_VERTEX_SHADER));
     shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("fragment-shader.txt"), GL_FRAGMENT_SHADER));
-    gProgram = new tdogl::Program(shaders);
+    // the overlay program draws the debug quad too, so their attributes have to be in the same places
+    const char* attribs[] = { "vert", "vertTexCoord" };
+    std::vector<std::string> attribNames(attribs, attribs + 2);
+    gProgram = new tdogl::Program(shaders, attribNames);
+    shaders[1] = tdogl::Shader::shaderFromFile(ResourcePath("overlay-fragment-shader.txt"), GL_FRAGMENT_SHADER);
+    gOverlayProgram = new tdogl::Program(shaders, attribNames);
     
     gProgram->use();
     // create the camera matrix and set it as the uniform once (since it's not changing in the program)
@@ -57,13 +404,1227 @@ static void LoadShaders() {
     gProgram->stopUsing();
 }
 
+// load the terrain and vegetation shaders and set up gWorld to stream in the heightmap tiles
+static void LoadTerrain() {
+    PROFILE_ZONE("LoadTerrain");
+    std::vector<tdogl::Shader> shaders;
+    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("terrain-vertex-shader.txt"), GL_VERTEX_SHADER));
+    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("terrain-fragment-shader.txt"), GL_FRAGMENT_SHADER));
+    gTerrainProgram = new tdogl::Program(shaders);
+    
+    std::vector<tdogl::Shader> vegetationShaders;
+    vegetationShaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("vegetation-vertex-shader.txt"), GL_VERTEX_SHADER));
+    vegetationShaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("vegetation-fragment-shader.txt"), GL_FRAGMENT_SHADER));
+    gVegetationProgram = new tdogl::Program(vegetationShaders);
+    
+    // the density map covers the whole world
+    tdogl::Bitmap density = tdogl::Bitmap::bitmapFromFile(ResourcePath("vegetation-density.png"));
+    gVegetation = new Vegetation(*gVegetationProgram, density, TERRAIN_ORIGIN, TERRAIN_TILES * TERRAIN_TILE_SIZE);
+    
+    WorldStreamer::Budget budget = { TERRAIN_CPU_BUDGET, TERRAIN_GPU_BUDGET };
+    gWorld = new WorldStreamer(TERRAIN_ORIGIN, TERRAIN_TILE_SIZE, TERRAIN_TILES, TERRAIN_TILES,
+                               [](int tileX, int tileZ, const glm::vec3& origin) -> WorldTile* {
+        std::ostringstream fileName;
+        fileName << "terrain-tile-" << tileX << "-" << tileZ << ".png";
+        return new TerrainTile(ResourcePath(fileName.str()), *gTerrainProgram, origin, TERRAIN_CELL_SIZE, TERRAIN_HEIGHT_SCALE, gVegetation);
+    }, budget);
+    gWorld->setRadii(TERRAIN_LOAD_RADIUS, TERRAIN_KEEP_RADIUS);
+}
+
+// the terrain of the tile under the position, or NULL if it isn't loaded
+static Terrain* TerrainUnder(const glm::vec3& position) {
+    TerrainTile* tile = static_cast<TerrainTile*>(gWorld->tileAt(position.x, position.z));
+    return tile ? tile->terrain() : NULL;
+}
+
+// makes a lumpy boulder about a meter across from a subdivided icosahedron, and simplifies
+// it into levels of detail
+static void LoadRocks() {
+    PROFILE_ZONE("LoadRocks");
+    std::vector<tdogl::Shader> shaders;
+    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("rock-vertex-shader.txt"), GL_VERTEX_SHADER));
+    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("rock-fragment-shader.txt"), GL_FRAGMENT_SHADER));
+    gRockProgram = new tdogl::Program(shaders);
+    
+    const float t = (1.0f + sqrtf(5.0f)) / 2.0f;
+    const glm::vec3 icosahedronVertices[] = {
+        glm::vec3(-1, t, 0), glm::vec3( 1, t, 0), glm::vec3(-1,-t, 0), glm::vec3( 1,-t, 0),
+        glm::vec3( 0,-1, t), glm::vec3( 0, 1, t), glm::vec3( 0,-1,-t), glm::vec3( 0, 1,-t),
+        glm::vec3( t, 0,-1), glm::vec3( t, 0, 1), glm::vec3(-t, 0,-1), glm::vec3(-t, 0, 1)
+    };
+    const GLuint icosahedronIndices[] = {
+        0,11,5, 0,5,1, 0,1,7, 0,7,10, 0,10,11, 1,5,9, 5,11,4, 11,10,2, 10,7,6, 7,1,8,
+        3,9,4, 3,4,2, 3,2,6, 3,6,8, 3,8,9, 4,9,5, 2,4,11, 6,2,10, 8,6,7, 9,8,1
+    };
+    std::vector<glm::vec3> positions;
+    for (int i=0; i<12; i++)
+        positions.push_back(glm::normalize(icosahedronVertices[i]));
+    std::vector<GLuint> indices(icosahedronIndices, icosahedronIndices + 60);
+    
+    // split every triangle into four, sharing the new vertices along each edge
+    for (int level=0; level<4; level++) {
+        std::map<std::pair<GLuint, GLuint>, GLuint> midpoints;
+        auto midpoint = [&](GLuint a, GLuint b) {
+            std::pair<GLuint, GLuint> edge(std::min(a, b), std::max(a, b));
+            std::map<std::pair<GLuint, GLuint>, GLuint>::iterator found = midpoints.find(edge);
+            if (found != midpoints.end())
+                return found->second;
+            positions.push_back(glm::normalize(positions[a] + positions[b]));
+            return midpoints[edge] = (GLuint)positions.size() - 1;
+        };
+        std::vector<GLuint> split;
+        for (size_t i=0; i<indices.size(); i+=3) {
+            GLuint a = indices[i], b = indices[i+1], c = indices[i+2];
+            GLuint ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            GLuint triangles[] = { a,ab,ca, b,bc,ab, c,ca,bc, ab,bc,ca };
+            split.insert(split.end(), triangles, triangles + 12);
+        }
+        indices.swap(split);
+    }
+    
+    // lumps and a flattened bottom
+    for (size_t i=0; i<positions.size(); i++) {
+        glm::vec3& p = positions[i];
+        float lumps = 0.12f * sinf(4.1f * p.x + 1.3f) * sinf(3.7f * p.y + 0.4f) * sinf(4.5f * p.z + 2.1f)
+                    + 0.05f * sinf(11.0f * p.x) * sinf(13.0f * p.z + 0.7f);
+        p *= 0.5f * (1.0f + lumps);
+        p.y *= p.y < 0.0f ? 0.4f : 0.7f;
+    }
+    
+    // smooth normals from the triangles around each vertex
+    std::vector<tdogl::Mesh::Vertex> vertices(positions.size());
+    for (size_t i=0; i<positions.size(); i++) {
+        vertices[i].position = positions[i];
+        vertices[i].normal = glm::vec3(0.0f);
+        vertices[i].texCoord = glm::vec2(0.0f);
+    }
+    for (size_t i=0; i<indices.size(); i+=3) {
+        glm::vec3 normal = glm::cross(positions[indices[i+1]] - positions[indices[i]],
+                                      positions[indices[i+2]] - positions[indices[i]]);
+        for (int c=0; c<3; c++)
+            vertices[indices[i+c]].normal += normal;
+    }
+    for (size_t i=0; i<vertices.size(); i++)
+        vertices[i].normal = glm::normalize(vertices[i].normal);
+    
+    std::vector<std::vector<GLuint> > lods = BuildLodChain(vertices, indices, ROCK_LOD_COUNT);
+    gRockMesh = new tdogl::Mesh(*gRockProgram, vertices, lods);
+    
+    // the coarsest level hides what's behind it, with only the vertices it uses
+    std::map<GLuint, unsigned short> occluderVertices;
+    for (size_t i=0; i<lods.back().size(); i++) {
+        GLuint vertex = lods.back()[i];
+        if (!occluderVertices.count(vertex)) {
+            occluderVertices[vertex] = (unsigned short)gRockOccluderVertices.size();
+            gRockOccluderVertices.push_back(gRockMesh->center() + (positions[vertex] - gRockMesh->center()) * ROCK_OCCLUDER_SHRINK);
+        }
+        gRockOccluderIndices.push_back(occluderVertices[vertex]);
+    }
+    gRockBounds = AABB(positions[0], positions[0]);
+    for (size_t i=1; i<positions.size(); i++) {
+        gRockBounds.min = glm::min(gRockBounds.min, positions[i]);
+        gRockBounds.max = glm::max(gRockBounds.max, positions[i]);
+    }
+    // collided with at full detail
+    gRockShape = new TriangleBVH(positions, indices);
+    
+    // scatter the boulders around the ring
+    srand(7);
+    for (int i=0; i<ROCK_COUNT; i++) {
+        float angle = 2.0f * (float)M_PI * rand() / RAND_MAX;
+        float distance = ROCK_RING_INNER_RADIUS + (ROCK_RING_OUTER_RADIUS - ROCK_RING_INNER_RADIUS) * rand() / RAND_MAX;
+        Placement placement;
+        placement.position = glm::vec3(distance * cosf(angle), 0.0f, distance * sinf(angle));
+        placement.scale = 1.0f + 3.0f * rand() / RAND_MAX;
+        placement.degreesRotated = 360.0f * rand() / RAND_MAX;
+        placement.grounded = false;
+        Boulder boulder;
+        boulder.lod = 0;
+        boulder.visible = false;
+        boulder.collider = AABBTree::NullNode;
+        gEntities.create(placement, boulder);
+    }
+    
+    // sunk a little way into whatever ground has loaded under them
+    gSystems.add("settle boulders", EntityWorld::Query().write<Placement>().read<Boulder>(), [](const EntityWorld::Chunk& chunk) {
+        Placement* placements = chunk.write<Placement>();
+        for (unsigned i=0; i<chunk.count(); i++) {
+            Placement& placement = placements[i];
+            Terrain* terrain = TerrainUnder(placement.position);
+            placement.grounded = terrain != NULL;
+            if (terrain)
+                placement.position.y = terrain->heightAt(placement.position.x, placement.position.z) - 0.1f * placement.scale;
+        }
+    });
+    
+    // each in view gets the level of detail that fits how big it is on screen
+    gSystems.add("pick boulder detail", EntityWorld::Query().read<Placement>().write<Boulder>(), [](const EntityWorld::Chunk& chunk) {
+        const Placement* placements = chunk.read<Placement>();
+        Boulder* boulders = chunk.write<Boulder>();
+        for (unsigned i=0; i<chunk.count(); i++) {
+            const Placement& placement = placements[i];
+            glm::vec3 center = placement.position + placement.scale * gRockMesh->center();
+            float radius = placement.scale * gRockMesh->radius();
+            boulders[i].visible = placement.grounded && gViewFrustum.intersectsSphere(center, radius);
+            if (boulders[i].visible)
+                boulders[i].lod = gLodSelector.select(center, radius, gRockMesh->lodCount(), boulders[i].lod);
+        }
+    });
+}
+
+// where a prop is drawn and collided with
+static glm::mat4 PlacementModel(const Placement& placement) {
+    return glm::translate(glm::mat4(), placement.position) *
+           glm::rotate(glm::mat4(), placement.degreesRotated, glm::vec3(0,1,0)) *
+           glm::scale(glm::mat4(), glm::vec3(placement.scale));
+}
+
+// the other way, built in reverse rather than inverting the model matrix
+static glm::mat4 PlacementInverseModel(const Placement& placement) {
+    return glm::scale(glm::mat4(), glm::vec3(1.0f / placement.scale)) *
+           glm::rotate(glm::mat4(), -placement.degreesRotated, glm::vec3(0,1,0)) *
+           glm::translate(glm::mat4(), -placement.position);
+}
+
+// copies out the boulders the systems found in view
+static void SnapshotRocks() {
+    PROFILE_ZONE("SnapshotRocks");
+    gFrame.rocks.clear();
+    gEntities.forEachChunk(EntityWorld::Query().read<Placement>().read<Boulder>(), [](const EntityWorld::Chunk& chunk) {
+        const Placement* placements = chunk.read<Placement>();
+        const Boulder* boulders = chunk.read<Boulder>();
+        for (unsigned i=0; i<chunk.count(); i++) {
+            if (!boulders[i].visible)
+                continue;
+            const Placement& placement = placements[i];
+            FrameSnapshot::RockDraw draw;
+            draw.model = PlacementModel(placement);
+            draw.lod = boulders[i].lod;
+            gFrame.rocks.push_back(draw);
+        }
+    });
+}
+
+// copies out where the animals are, for scoring photos
+static void SnapshotAnimals() {
+    PROFILE_ZONE("SnapshotAnimals");
+    gFrame.animals.clear();
+    const glm::vec3 up(0.0f, 1.0f, 0.0f);
+    for (unsigned i=0; i<gZebraAnimator->characterCount(); i++)
+        gFrame.animals.push_back(glm::vec3(gZebraAnimator->character(i).transform[3]) + up);
+    for (unsigned i=0; i<gLionAnimator->characterCount(); i++)
+        gFrame.animals.push_back(glm::vec3(gLionAnimator->character(i).transform[3]) + up);
+    for (size_t i=0; i<gWildebeestInstances.size(); i++)
+        gFrame.animals.push_back(gWildebeestInstances[i].position + up);
+}
+
+// draws the boulders in the snapshot that aren't hidden behind nearer things
+static void RenderRocks(const glm::mat4& playerMatrix) {
+    PROFILE_ZONE("RenderRocks");
+    GPU_ZONE(*gGpuProfiler, "Rocks");
+    gRockProgram->use();
+    gRockProgram->setUniform("player", playerMatrix);
+    
+    gRocksDrawn = 0;
+    gRocksOccluded = 0;
+    gRockTrianglesDrawn = 0;
+    for (size_t i=0; i<gFrame.rocks.size(); i++) {
+        if (!gOcclusionCuller.test(gRockBounds.transformed(gFrame.rocks[i].model))) {
+            gRocksOccluded++;
+            continue;
+        }
+        gRockProgram->setUniform("model", gFrame.rocks[i].model);
+        gRockMesh->draw(gFrame.rocks[i].lod);
+        gRocksDrawn++;
+        gRockTrianglesDrawn += gRockMesh->triangleCount(gFrame.rocks[i].lod);
+    }
+    
+    gRockProgram->stopUsing();
+}
+
+// adds a shape for the player to collide with
+static int AddCollider(const TriangleBVH* shape, const glm::mat4& model, const glm::mat4& inverseModel, Entity entity, int crate) {
+    Collider collider = { shape, model, inverseModel, entity, crate };
+    gColliders.push_back(collider);
+    return gCollisionTree.insert(shape->bounds().transformed(model), (unsigned)gColliders.size() - 1);
+}
+
+// gives the boulders that have settled onto the ground something to bump into, and keeps it
+// where they are
+static void UpdateRockColliders() {
+    PROFILE_ZONE("UpdateRockColliders");
+    gEntities.forEachChunk(EntityWorld::Query().read<Placement>().write<Boulder>(), [](const EntityWorld::Chunk& chunk) {
+        const Placement* placements = chunk.read<Placement>();
+        Boulder* boulders = chunk.write<Boulder>();
+        const Entity* entities = chunk.entities();
+        for (unsigned i=0; i<chunk.count(); i++) {
+            if (!placements[i].grounded)
+                continue;
+            glm::mat4 model = PlacementModel(placements[i]);
+            if (boulders[i].collider == AABBTree::NullNode) {
+                boulders[i].collider = AddCollider(gRockShape, model, PlacementInverseModel(placements[i]), entities[i], -1);
+                continue;
+            }
+            Collider& collider = gColliders[gCollisionTree.userData(boulders[i].collider)];
+            if (collider.model != model) {
+                collider.model = model;
+                collider.inverseModel = PlacementInverseModel(placements[i]);
+                gCollisionTree.move(boulders[i].collider, gRockShape->bounds().transformed(model));
+            }
+        }
+    });
+}
+
+// the triangles of the ground and everything on it in the box, for the player to walk on
+// and bump into
+static void GatherCollisionTriangles(const AABB& bounds, std::vector<Triangle>& triangles) {
+    gWorld->forEachResident([&](WorldTile* tile) {
+        const Terrain* terrain = static_cast<TerrainTile*>(tile)->terrain();
+        if (terrain->bounds().overlaps(bounds))
+            terrain->gatherTriangles(bounds, triangles);
+    });
+    gCollisionTree.queryAABB(bounds, [&](int proxy) {
+        const Collider& collider = gColliders[gCollisionTree.userData(proxy)];
+        collider.shape->queryAABB(bounds.transformed(collider.inverseModel), [&](unsigned triangle) {
+            triangles.push_back(collider.shape->triangle(triangle).transformed(collider.model));
+            return true;
+        });
+        return true;
+    });
+}
+
+// the collider the ray hits first, or -1
+static int RaycastColliders(const Ray& ray, float maxDistance, RayHit* hit) {
+    int hitCollider = -1;
+    gCollisionTree.raycast(ray.origin, ray.direction, maxDistance, [&](int proxy, float maxDistance) {
+        unsigned index = gCollisionTree.userData(proxy);
+        const Collider& collider = gColliders[index];
+        // distances along the ray are the same in the shape's own space
+        if (!collider.shape->raycast(ray.transformed(collider.inverseModel), maxDistance, hit))
+            return maxDistance;
+        hitCollider = (int)index;
+        hit->normal = glm::normalize(glm::transpose(glm::mat3(collider.inverseModel)) * hit->normal);
+        return hit->distance;
+    });
+    return hitCollider;
+}
+
+// the collider each of the packet's rays hits first, or -1, shortening the packet's
+// distances to the hits
+static void RaycastColliders(RayPacket& packet, RayHit* hits, int* colliders) {
+    for (int r=0; r<RayPacket::Size; r++)
+        colliders[r] = -1;
+    gCollisionTree.raycast(packet, [&](int proxy, int rays) {
+        unsigned index = gCollisionTree.userData(proxy);
+        const Collider& collider = gColliders[index];
+        RayPacket local = packet.transformed(collider.inverseModel);
+        RayHit localHits[RayPacket::Size];
+        int hitRays = collider.shape->raycast(local, localHits);
+        if (!hitRays)
+            return true;
+        
+        packet.maxDistance = local.maxDistance;
+        glm::mat3 normalMatrix = glm::transpose(glm::mat3(collider.inverseModel));
+        for (int r=0; r<RayPacket::Size; r++) {
+            if (!(hitRays & (1 << r)))
+                continue;
+            hits[r] = localHits[r];
+            hits[r].normal = glm::normalize(normalMatrix * localHits[r].normal);
+            colliders[r] = (int)index;
+        }
+        return true;
+    });
+}
+
+// where the ray goes under the ground, found by stepping along it half a cell at a time
+// and then halving the step it went under in
+static bool RaycastGround(const Ray& ray, float maxDistance, RayHit* hit) {
+    auto underground = [](const glm::vec3& point) {
+        Terrain* terrain = TerrainUnder(point);
+        return terrain && point.y < terrain->heightAt(point.x, point.z);
+    };
+    
+    const float step = 0.5f * TERRAIN_CELL_SIZE / glm::length(ray.direction);
+    for (float above=0.0f; above<maxDistance; above+=step) {
+        float below = std::min(above + step, maxDistance);
+        if (!underground(ray.pointAt(below)))
+            continue;
+        for (int i=0; i<10; i++) {
+            float middle = 0.5f * (above + below);
+            if (underground(ray.pointAt(middle)))
+                below = middle;
+            else
+                above = middle;
+        }
+        glm::vec3 point = ray.pointAt(below);
+        hit->distance = below;
+        hit->normal = TerrainUnder(point)->normalAt(point.x, point.z);
+        hit->triangle = 0;
+        return true;
+    }
+    return false;
+}
+
+// what each of the rays lands on first, casting them at the crates and boulders in packets
+// and then at the ground up to whatever they hit
+static void CastRays(const Ray* rays, unsigned count, float maxDistance, RayTarget* targets) {
+    for (unsigned first=0; first<count; first+=RayPacket::Size) {
+        unsigned packetCount = std::min(count - first, (unsigned)RayPacket::Size);
+        RayPacket packet(rays + first, packetCount, maxDistance);
+        RayHit hits[RayPacket::Size];
+        int colliders[RayPacket::Size];
+        RaycastColliders(packet, hits, colliders);
+        
+        for (unsigned r=0; r<packetCount; r++) {
+            RayTarget& target = targets[first + r];
+            target.type = RayTarget::Nothing;
+            target.entity = Entity();
+            target.crate = -1;
+            target.distance = maxDistance;
+            target.normal = glm::vec3(0.0f);
+            if (colliders[r] != -1) {
+                const Collider& collider = gColliders[colliders[r]];
+                target.type = collider.crate == -1 ? RayTarget::Rock : RayTarget::Crate;
+                target.entity = collider.entity;
+                target.crate = collider.crate;
+                target.distance = hits[r].distance;
+                target.normal = hits[r].normal;
+            }
+            RayHit groundHit;
+            if (RaycastGround(rays[first + r], target.distance, &groundHit)) {
+                target.type = RayTarget::Ground;
+                target.entity = Entity();
+                target.crate = -1;
+                target.distance = groundHit.distance;
+                target.normal = groundHit.normal;
+            }
+        }
+    }
+}
+
+// a random point in a range on the ground
+static glm::vec2 RandomPointIn(const glm::vec2& min, const glm::vec2& max) {
+    return min + (max - min) * glm::vec2((float)rand() / RAND_MAX, (float)rand() / RAND_MAX);
+}
+
+// switches a grazer between walking and grazing now and then, by changing the speed it
+// cruises at
+static void SwitchGrazing(HerdSimulation& herd, unsigned agent, float walkSpeed, float& switchTime, float delta) {
+    switchTime -= delta;
+    if (switchTime > 0.0f)
+        return;
+    bool grazing = herd.cruiseSpeed(agent) > 0.0f;
+    herd.setCruiseSpeed(agent, grazing ? 0.0f : walkSpeed);
+    switchTime = (grazing ? 6.0f : 3.0f) + 6.0f * rand() / RAND_MAX;
+}
+
+// makes the cells under a boulder, and around it so animals don't brush it, impassable
+static void BlockRock(const Placement& rock) {
+    float radius = 0.5f * rock.scale + 1.0f;
+    unsigned minX, minZ, maxX, maxZ;
+    glm::vec2 center(rock.position.x, rock.position.z);
+    if (!gNavigation->cellAt(center - radius, &minX, &minZ) || !gNavigation->cellAt(center + radius, &maxX, &maxZ))
+        return;
+    for (unsigned z=minZ; z<=maxZ; z++) {
+        for (unsigned x=minX; x<=maxX; x++) {
+            if (glm::distance(gNavigation->cellCenter(x, z), center) < radius)
+                gNavigation->setCost(x, z, NavigationGrid::Blocked);
+        }
+    }
+}
+
+// sets up the navigation grid with the boulders in it. the slopes go in as the terrain
+// tiles are loaded.
+static void LoadNavigation() {
+    PROFILE_ZONE("LoadNavigation");
+    gNavigation = new NavigationGrid(glm::vec2(TERRAIN_ORIGIN.x, TERRAIN_ORIGIN.z), TERRAIN_CELL_SIZE,
+                                     NAVIGATION_SECTORS, NAVIGATION_SECTORS);
+    gNavigationTiles.assign(TERRAIN_TILES * TERRAIN_TILES, false);
+    gEntities.forEachChunk(EntityWorld::Query().read<Placement>().read<Boulder>(), [](const EntityWorld::Chunk& chunk) {
+        const Placement* placements = chunk.read<Placement>();
+        for (unsigned i=0; i<chunk.count(); i++)
+            BlockRock(placements[i]);
+    });
+}
+
+// puts the slopes of newly loaded terrain into the navigation grid, which then only has to
+// rebuild the sectors they changed. a tile keeps its slopes after it's evicted.
+static void UpdateNavigation() {
+    PROFILE_ZONE("UpdateNavigation");
+    const float minNormalY = cosf(NAVIGATION_MAX_SLOPE_DEGREES * (float)M_PI / 180.0f);
+    gWorld->forEachResident([&](WorldTile* tile) {
+        Terrain* terrain = static_cast<TerrainTile*>(tile)->terrain();
+        int tileX = (int)((terrain->origin().x - TERRAIN_ORIGIN.x) / TERRAIN_TILE_SIZE + 0.5f);
+        int tileZ = (int)((terrain->origin().z - TERRAIN_ORIGIN.z) / TERRAIN_TILE_SIZE + 0.5f);
+        if (gNavigationTiles[tileX + tileZ * TERRAIN_TILES])
+            return;
+        gNavigationTiles[tileX + tileZ * TERRAIN_TILES] = true;
+        
+        // a tile off the grid has nothing to walk on
+        unsigned firstX, firstZ;
+        if (!gNavigation->cellAt(glm::vec2(terrain->origin().x, terrain->origin().z) + 0.5f * TERRAIN_CELL_SIZE, &firstX, &firstZ))
+            return;
+        for (unsigned z=firstZ; z<firstZ + terrain->samplesZ() - 1; z++) {
+            for (unsigned x=firstX; x<firstX + terrain->samplesX() - 1; x++) {
+                glm::vec2 center = gNavigation->cellCenter(x, z);
+                float normalY = terrain->normalAt(center.x, center.y).y;
+                if (normalY < minNormalY)
+                    gNavigation->setCost(x, z, NavigationGrid::Blocked);
+                else
+                    gNavigation->setCost(x, z, 1 + (unsigned char)(20.0f * (1.0f - normalY) / (1.0f - minNormalY)));
+            }
+        }
+        const AABB& bounds = terrain->bounds();
+        gEntities.forEachChunk(EntityWorld::Query().read<Placement>().read<Boulder>(), [&](const EntityWorld::Chunk& chunk) {
+            const Placement* placements = chunk.read<Placement>();
+            for (unsigned i=0; i<chunk.count(); i++) {
+                const glm::vec3& position = placements[i].position;
+                if (position.x >= bounds.min.x && position.x <= bounds.max.x && position.z >= bounds.min.z && position.z <= bounds.max.z)
+                    BlockRock(placements[i]);
+            }
+        });
+    });
+    gNavigation->update();
+}
+
+// the turn around the y axis that points +x along a velocity on the ground
+static float HeadingOf(const glm::vec2& velocity) {
+    return atan2f(-velocity.y, velocity.x);
+}
+
+// builds the zebra and its clips, and scatters the herd over its range
+static void LoadZebras() {
+    PROFILE_ZONE("LoadZebras");
+    std::vector<tdogl::Shader> shaders;
+    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("animal-vertex-shader.txt"), GL_VERTEX_SHADER));
+    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("animal-fragment-shader.txt"), GL_FRAGMENT_SHADER));
+    // the id program draws the same meshes, so their attributes have to be in the same places
+    const char* attribs[] = { "vert", "vertNormal", "vertJoints", "vertWeights" };
+    std::vector<std::string> attribNames(attribs, attribs + 4);
+    gAnimalProgram = new tdogl::Program(shaders, attribNames);
+    shaders[1] = tdogl::Shader::shaderFromFile(ResourcePath("id-fragment-shader.txt"), GL_FRAGMENT_SHADER);
+    gAnimalIdProgram = new tdogl::Program(shaders, attribNames);
+    
+    gZebra = new Quadruped(Quadruped::Proportions::zebra());
+    gZebraMesh = new SkinnedMesh(*gAnimalProgram, gZebra->vertices(), gZebra->indices());
+    gZebraAnimator = new Animator(gZebra->skeleton());
+    gZebraHerd = new HerdSimulation(HerdSimulation::Settings::grazers(ZEBRA_RANGE_MIN, ZEBRA_RANGE_MAX));
+    
+    srand(11);
+    for (int i=0; i<ZEBRA_COUNT; i++) {
+        float angle = 2.0f * (float)M_PI * rand() / RAND_MAX;
+        float cruiseSpeed = rand() % 2 ? gZebra->walkSpeed() : 0.0f;
+        gZebraHerd->addAgent(RandomPointIn(ZEBRA_RANGE_MIN, ZEBRA_RANGE_MAX), cruiseSpeed * glm::vec2(cosf(angle), sinf(angle)), cruiseSpeed);
+        gZebraSwitchTimes.push_back(10.0f * rand() / RAND_MAX);
+        gZebraHeights.push_back(0.0f);
+        
+        // start the clips at different points so the herd doesn't move in step
+        Animator::Character character;
+        character.clip = &gZebra->walk();
+        character.time = gZebra->walk().duration() * rand() / RAND_MAX;
+        character.blendClip = &gZebra->graze();
+        character.blendTime = gZebra->graze().duration() * rand() / RAND_MAX;
+        character.blendWeight = cruiseSpeed > 0.0f ? 0.0f : 1.0f;
+        gZebraAnimator->addCharacter(character);
+    }
+}
+
+// steps the zebra herd, and poses each zebra to match how fast it's going
+static void UpdateZebras(float delta) {
+    PROFILE_ZONE("UpdateZebras");
+    gZebraHerd->update(delta, gPlayer.position());
+    
+    float walkSpeed = gZebra->walkSpeed();
+    for (unsigned i=0; i<gZebraHerd->agentCount(); i++) {
+        SwitchGrazing(*gZebraHerd, i, walkSpeed, gZebraSwitchTimes[i], delta);
+        
+        // grazing when stopped, and the walk speeds up into a run
+        glm::vec2 velocity = gZebraHerd->velocity(i);
+        float speed = glm::length(velocity);
+        Animator::Character& character = gZebraAnimator->character(i);
+        character.time += delta * speed / walkSpeed;
+        character.blendTime += delta;
+        character.blendWeight = 1.0f - std::min(speed / walkSpeed, 1.0f);
+        
+        glm::vec2 ground = gZebraHerd->position(i);
+        glm::vec3 position(ground.x, gZebraHeights[i], ground.y);
+        Terrain* terrain = TerrainUnder(position);
+        if (terrain)
+            position.y = gZebraHeights[i] = terrain->heightAt(position.x, position.z);
+        
+        // a stopped zebra keeps facing the way it was
+        if (speed > 0.05f) {
+            character.transform = glm::translate(glm::mat4(), position) *
+                                  glm::rotate(glm::mat4(), HeadingOf(velocity) * 180.0f / (float)M_PI, glm::vec3(0,1,0));
+        } else {
+            character.transform[3] = glm::vec4(position, 1.0f);
+        }
+    }
+    
+    gZebraAnimator->pose();
+}
+
+// bakes the wildebeest's clips and scatters the herd over its range
+static void LoadWildebeest() {
+    PROFILE_ZONE("LoadWildebeest");
+    std::vector<tdogl::Shader> shaders;
+    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("crowd-vertex-shader.txt"), GL_VERTEX_SHADER));
+    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("animal-fragment-shader.txt"), GL_FRAGMENT_SHADER));
+    gCrowdProgram = new tdogl::Program(shaders);
+    shaders[1] = tdogl::Shader::shaderFromFile(ResourcePath("id-fragment-shader.txt"), GL_FRAGMENT_SHADER);
+    gCrowdIdProgram = new tdogl::Program(shaders);
+    
+    // clip 0 walks and clip 1 grazes
+    gWildebeest = new Quadruped(Quadruped::Proportions::wildebeest());
+    std::vector<const AnimationClip*> clips;
+    clips.push_back(&gWildebeest->walk());
+    clips.push_back(&gWildebeest->graze());
+    gWildebeestCrowd = new VertexAnimation(*gCrowdProgram, gWildebeest->skeleton(), gWildebeest->vertices(), gWildebeest->indices(), clips);
+    gWildebeestHerd = new HerdSimulation(HerdSimulation::Settings::grazers(WILDEBEEST_RANGE_MIN, WILDEBEEST_RANGE_MAX));
+    
+    srand(13);
+    for (int i=0; i<WILDEBEEST_COUNT; i++) {
+        // most of the herd is on the move
+        float cruiseSpeed = rand() % 3 ? gWildebeest->walkSpeed() : 0.0f;
+        float angle = 0.3f * ((float)rand() / RAND_MAX - 0.5f);
+        gWildebeestHerd->addAgent(RandomPointIn(WILDEBEEST_RANGE_MIN, WILDEBEEST_RANGE_MAX), cruiseSpeed * glm::vec2(cosf(angle), sinf(angle)), cruiseSpeed);
+        gWildebeestSwitchTimes.push_back(10.0f * rand() / RAND_MAX);
+        gWildebeestClipTimes.push_back(10.0f * rand() / RAND_MAX);
+        
+        VertexAnimation::Instance instance;
+        instance.position = glm::vec3(0.0f);
+        instance.heading = angle;
+        instance.clip = 0.0f;
+        instance.timeOffset = 0.0f;
+        instance.scale = 0.9f + 0.2f * rand() / RAND_MAX;
+        instance.unused = 0.0f;
+        gWildebeestInstances.push_back(instance);
+    }
+}
+
+// steps the wildebeest herd and updates the instances to match
+static void UpdateWildebeest(float delta) {
+    PROFILE_ZONE("UpdateWildebeest");
+    gCrowdTime += delta;
+    
+    // every so often the herd heads for the other waterhole. the flow field to each one is
+    // cached, so this is only a lookup per animal.
+    gMigrationTime += delta;
+    if (gMigrationTime > MIGRATION_SECONDS) {
+        gMigrationTime = 0.0f;
+        gWaterhole = 1 - gWaterhole;
+    }
+    const FlowField& flowField = gNavigation->flowField(WATERHOLES[gWaterhole]);
+    for (unsigned i=0; i<gWildebeestHerd->agentCount(); i++) {
+        glm::vec2 position = gWildebeestHerd->position(i);
+        bool arrived = glm::distance(position, WATERHOLES[gWaterhole]) < WATERHOLE_RADIUS;
+        gWildebeestHerd->setGoal(i, arrived ? glm::vec2(0.0f) : flowField.direction(position));
+    }
+    gWildebeestHerd->update(delta, gPlayer.position());
+    
+    float walkSpeed = gWildebeest->walkSpeed();
+    for (unsigned i=0; i<gWildebeestHerd->agentCount(); i++) {
+        SwitchGrazing(*gWildebeestHerd, i, walkSpeed, gWildebeestSwitchTimes[i], delta);
+        
+        // far away there's no blending, only walking or grazing. the walk plays faster the
+        // faster the animal goes, by moving its offset from the shared time.
+        VertexAnimation::Instance& instance = gWildebeestInstances[i];
+        glm::vec2 velocity = gWildebeestHerd->velocity(i);
+        float speed = glm::length(velocity);
+        bool walking = speed > 0.3f * walkSpeed;
+        gWildebeestClipTimes[i] += walking ? delta * speed / (walkSpeed * instance.scale) : delta;
+        instance.clip = walking ? 0.0f : 1.0f;
+        instance.timeOffset = gWildebeestClipTimes[i] - gCrowdTime;
+        if (speed > 0.05f)
+            instance.heading = HeadingOf(velocity);
+        
+        // out of the streaming radius they keep the last height they had
+        glm::vec2 ground = gWildebeestHerd->position(i);
+        instance.position.x = ground.x;
+        instance.position.z = ground.y;
+        Terrain* terrain = TerrainUnder(instance.position);
+        if (terrain)
+            instance.position.y = terrain->heightAt(instance.position.x, instance.position.z);
+    }
+}
+
+// times the herd simulation with different numbers of threads, on a herd of its own
+static void BenchmarkHerds() {
+    PROFILE_ZONE("BenchmarkHerds");
+    const unsigned threadCounts[] = { 1, 4, 8 };
+    const int steps = 30;
+    for (int t=0; t<3; t++) {
+        HerdSimulation herd(HerdSimulation::Settings::grazers(WILDEBEEST_RANGE_MIN, WILDEBEEST_RANGE_MAX));
+        srand(17);
+        for (int i=0; i<HERD_BENCHMARK_AGENTS; i++)
+            herd.addAgent(RandomPointIn(WILDEBEEST_RANGE_MIN, WILDEBEEST_RANGE_MAX), glm::vec2(1.0f, 0.0f), 1.5f);
+        herd.setThreadCount(threadCounts[t]);
+        
+        double milliseconds = 0.0;
+        for (int step=0; step<steps; step++) {
+            herd.update(1.0f / FPS, glm::vec3(0.0f));
+            milliseconds += herd.stats().hashMilliseconds + herd.stats().steerMilliseconds;
+        }
+        std::cout << "Herd benchmark: " << threadCounts[t] << " threads (" << herd.stats().threads << " available), "
+                  << (int)(HERD_BENCHMARK_AGENTS * steps / milliseconds) << " agents per ms" << std::endl;
+    }
+}
+
+// culls and picks the detail of a lot of spheres with job systems of 1 thread up to one for
+// each core, to see how well the work scales
+static void BenchmarkJobs() {
+    PROFILE_ZONE("BenchmarkJobs");
+    std::vector<glm::vec4> spheres(JOB_BENCHMARK_SPHERES);
+    srand(29);
+    for (size_t i=0; i<spheres.size(); i++)
+        spheres[i] = glm::vec4(RandomPointIn(glm::vec2(-500.0f), glm::vec2(500.0f)), 20.0f * rand() / RAND_MAX, 1.0f + 3.0f * rand() / RAND_MAX);
+    glm::mat4 projection = glm::perspective(50.0f, SCREEN_SIZE.x / SCREEN_SIZE.y, 0.1f, 1000.0f);
+    Frustum frustum(projection * glm::lookAt(glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(1.0f, 10.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    LodSelector selector;
+    selector.setView(glm::vec3(0.0f, 10.0f, 0.0f), 50.0f, SCREEN_SIZE.x / SCREEN_SIZE.y);
+    std::vector<unsigned> lods(spheres.size(), 0);
+    
+    typedef std::chrono::high_resolution_clock Clock;
+    const int runs = 5;
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<unsigned> threadCounts;
+    for (unsigned threads=1; threads<cores; threads*=2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(cores);
+    
+    double oneThreadMilliseconds = 0.0;
+    for (size_t t=0; t<threadCounts.size(); t++) {
+        unsigned threads = threadCounts[t];
+        JobSystem jobs(threads);
+        Clock::time_point start = Clock::now();
+        for (int run=0; run<runs; run++) {
+            jobs.parallelFor(JOB_BENCHMARK_SPHERES, JOB_BENCHMARK_GRAIN, [&](unsigned begin, unsigned end) {
+                for (unsigned i=begin; i<end; i++) {
+                    glm::vec3 center(spheres[i].x, spheres[i].z, spheres[i].y);
+                    if (frustum.intersectsSphere(center, spheres[i].w))
+                        lods[i] = selector.select(center, spheres[i].w, ROCK_LOD_COUNT, lods[i]);
+                }
+            });
+        }
+        double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+        if (threads == 1)
+            oneThreadMilliseconds = milliseconds;
+        JobSystem::Stats stats = jobs.stats();
+        std::cout << "Job benchmark: " << threads << " threads, " << milliseconds << " ms ("
+                  << oneThreadMilliseconds / milliseconds << "x), " << stats.jobs << " jobs with "
+                  << stats.steals << " steals" << std::endl;
+    }
+}
+
+// scatters a lot of boxes about and culls them against a few views, four at a time with
+// BoundsCuller and a subtree at a time with the AABB tree
+static void BenchmarkCulling() {
+    PROFILE_ZONE("BenchmarkCulling");
+    srand(26);
+    BoundsCuller culler;
+    AABBTree tree;
+    for (unsigned i=0; i<CULL_BENCHMARK_OBJECTS; i++) {
+        glm::vec2 ground = RandomPointIn(glm::vec2(-1000.0f), glm::vec2(1000.0f));
+        glm::vec3 center(ground.x, 20.0f * rand() / RAND_MAX, ground.y);
+        glm::vec3 extents(0.5f + 2.0f * rand() / RAND_MAX);
+        culler.add(center, extents);
+        tree.insert(AABB::fromCenterExtents(center, extents), i);
+    }
+    
+    typedef std::chrono::high_resolution_clock Clock;
+    const int views = 8, runs = 10;
+    glm::mat4 projection = glm::perspective(50.0f, SCREEN_SIZE.x / SCREEN_SIZE.y, 0.1f, 1000.0f);
+    double cullerMilliseconds = 0.0, treeMilliseconds = 0.0;
+    unsigned long visible = 0;
+    std::vector<int> treeVisible;
+    for (int view=0; view<views; view++) {
+        float angle = 2.0f * (float)M_PI * view / views;
+        Frustum frustum(projection * glm::lookAt(glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(cosf(angle), 10.0f, sinf(angle)),
+                                                 glm::vec3(0.0f, 1.0f, 0.0f)));
+        for (int run=0; run<runs; run++) {
+            culler.cull(frustum);
+            cullerMilliseconds += culler.stats().milliseconds;
+            
+            Clock::time_point start = Clock::now();
+            treeVisible.clear();
+            tree.queryFrustum(frustum, [&treeVisible](int proxy) {
+                treeVisible.push_back(proxy);
+                return true;
+            });
+            treeMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+        visible += culler.stats().visible;
+    }
+    std::cout << "Cull benchmark: " << CULL_BENCHMARK_OBJECTS << " boxes, " << visible / views << " in view on average, "
+              << cullerMilliseconds / (views * runs) << " ms with BoundsCuller, " << treeMilliseconds / (views * runs)
+              << " ms with the AABB tree (" << treeVisible.size() << " in the last view)" << std::endl;
+}
+
+// makes the lions and starts them off around the zebras
+static void LoadLions() {
+    PROFILE_ZONE("LoadLions");
+    gPathFinder = new PathFinder(*gNavigation);
+    gLion = new Quadruped(Quadruped::Proportions::lion());
+    gLionMesh = new SkinnedMesh(*gAnimalProgram, gLion->vertices(), gLion->indices());
+    gLionAnimator = new Animator(gLion->skeleton());
+    
+    srand(23);
+    for (int i=0; i<LION_COUNT; i++) {
+        Lion lion;
+        lion.position = RandomPointIn(ZEBRA_RANGE_MIN - 60.0f, ZEBRA_RANGE_MAX + 60.0f);
+        lion.groundHeight = 0.0f;
+        lion.nextWaypoint = 0;
+        lion.request = 0;
+        lion.restTime = 5.0f * rand() / RAND_MAX;
+        gLions.push_back(lion);
+        
+        Animator::Character character;
+        character.clip = &gLion->walk();
+        character.time = 0.0f;
+        character.blendClip = &gLion->graze();
+        character.blendTime = 0.0f;
+        character.blendWeight = 1.0f;
+        gLionAnimator->addCharacter(character);
+    }
+}
+
+// walks each lion along its path. once it gets there it rests a while, then asks for a path
+// to wherever one of the zebras is, which arrives in a later frame.
+static void UpdateLions(float delta) {
+    PROFILE_ZONE("UpdateLions");
+    for (size_t i=0; i<gLions.size(); i++) {
+        Lion& lion = gLions[i];
+        Animator::Character& character = gLionAnimator->character((unsigned)i);
+        bool walking = lion.nextWaypoint < lion.waypoints.size();
+        if (walking) {
+            glm::vec2 offset = lion.waypoints[lion.nextWaypoint] - lion.position;
+            float distance = glm::length(offset);
+            float step = gLion->walkSpeed() * delta;
+            if (distance <= step) {
+                lion.position = lion.waypoints[lion.nextWaypoint++];
+                if (lion.nextWaypoint == lion.waypoints.size())
+                    lion.restTime = 4.0f + 6.0f * rand() / RAND_MAX;
+            } else {
+                lion.position += offset * (step / distance);
+                glm::vec3 translation(character.transform[3]);
+                character.transform = glm::translate(glm::mat4(), translation) *
+                                      glm::rotate(glm::mat4(), HeadingOf(offset) * 180.0f / (float)M_PI, glm::vec3(0,1,0));
+            }
+        } else if (lion.request == 0) {
+            lion.restTime -= delta;
+            if (lion.restTime <= 0.0f) {
+                glm::vec2 target = gZebraHerd->position(rand() % gZebraHerd->agentCount());
+                lion.request = gPathFinder->requestPath(lion.position, target, [i](const PathFinder::Path& path) {
+                    Lion& lion = gLions[i];
+                    lion.request = 0;
+                    lion.waypoints = path.waypoints;
+                    lion.nextWaypoint = 0;
+                    if (!path.found)
+                        lion.restTime = 2.0f;
+                });
+            }
+        }
+        
+        // ease between walking and sniffing around
+        if (walking)
+            character.time += delta;
+        character.blendTime += delta;
+        character.blendWeight += ((walking ? 0.0f : 1.0f) - character.blendWeight) * std::min(4.0f * delta, 1.0f);
+        
+        glm::vec3 position(lion.position.x, lion.groundHeight, lion.position.y);
+        Terrain* terrain = TerrainUnder(position);
+        if (terrain)
+            position.y = lion.groundHeight = terrain->heightAt(position.x, position.z);
+        character.transform[3] = glm::vec4(position, 1.0f);
+    }
+    
+    gLionAnimator->pose();
+}
+
+// times moving and turning a camera and then asking for what a frame needs from it: the
+// directions to walk along and the matrices to draw and cull with. once by working it all
+// out from the angles each time it's asked for, the way the player used to, and once with
+// the cached camera, which also gets asked again without moving, like the extra views of a
+// frame would.
+static void BenchmarkCameras() {
+    PROFILE_ZONE("BenchmarkCameras");
+    typedef std::chrono::high_resolution_clock Clock;
+    glm::mat4 projection = glm::perspective(50.0f, SCREEN_SIZE.x / SCREEN_SIZE.y, 0.1f, 1000.0f);
+    // summed up and printed so the work isn't optimized away
+    glm::vec4 sum(0.0f);
+    
+    Clock::time_point start = Clock::now();
+    for (int i=0; i<CAMERA_BENCHMARK_UPDATES; i++) {
+        float horizontalAngle = 0.01f * i, verticalAngle = 10.0f;
+        glm::vec3 position(0.001f * i, 2.0f, 0.0f);
+        glm::mat4 orientation;
+        orientation = glm::rotate(orientation, verticalAngle, glm::vec3(1,0,0));
+        orientation = glm::rotate(orientation, horizontalAngle, glm::vec3(0,1,0));
+        glm::vec4 forward = glm::inverse(orientation) * glm::vec4(0,0,-1,1);
+        glm::vec4 right = glm::inverse(orientation) * glm::vec4(1,0,0,1);
+        glm::mat4 view = orientation * glm::translate(glm::mat4(), -position);
+        glm::mat4 matrix = projection * view;
+        sum += forward + right + matrix[3];
+    }
+    double rebuiltNanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / CAMERA_BENCHMARK_UPDATES;
+    
+    Camera camera;
+    camera.setViewportAspectRatio(SCREEN_SIZE.x / SCREEN_SIZE.y);
+    camera.setNearAndFarPlanes(0.1f, 1000.0f);
+    start = Clock::now();
+    for (int i=0; i<CAMERA_BENCHMARK_UPDATES; i++) {
+        glm::quat orientation;
+        orientation = glm::rotate(orientation, 10.0f, glm::vec3(1,0,0));
+        orientation = glm::rotate(orientation, 0.01f * i, glm::vec3(0,1,0));
+        camera.setOrientation(orientation);
+        camera.setPosition(glm::vec3(0.001f * i, 2.0f, 0.0f));
+        sum += glm::vec4(camera.forward() + camera.right(), 0.0f) + camera.matrix()[3];
+    }
+    double cachedNanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / CAMERA_BENCHMARK_UPDATES;
+    
+    start = Clock::now();
+    for (int i=0; i<CAMERA_BENCHMARK_UPDATES; i++)
+        sum += glm::vec4(camera.forward() + camera.right(), 0.0f) + camera.matrix()[3];
+    double unchangedNanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / CAMERA_BENCHMARK_UPDATES;
+    
+    std::cout << "Camera benchmark: " << rebuiltNanoseconds << " ns per update rebuilding with inverses, "
+              << cachedNanoseconds << " ns cached, " << unchangedNanoseconds << " ns asking again unchanged"
+              << " (" << sum.x + sum.y + sum.z + sum.w << ")" << std::endl;
+}
+
+// walks a crowd of character controllers, like rangers would be, in all directions over a
+// hilly patch of ground with boulders on it of its own, and times their steps
+static void BenchmarkControllers() {
+    PROFILE_ZONE("BenchmarkControllers");
+    typedef std::chrono::high_resolution_clock Clock;
+    std::vector<Triangle> triangles;
+    auto height = [](float x, float z) { return 1.5f * sinf(0.13f * x) * cosf(0.11f * z); };
+    for (int z=0; z<CONTROLLER_BENCHMARK_GROUND; z++) {
+        for (int x=0; x<CONTROLLER_BENCHMARK_GROUND; x++) {
+            glm::vec3 corners[4];
+            for (int c=0; c<4; c++)
+                corners[c] = glm::vec3(x + (c & 1), height(x + (c & 1), z + (c >> 1)), z + (c >> 1));
+            triangles.push_back(Triangle(corners[0], corners[2], corners[1]));
+            triangles.push_back(Triangle(corners[1], corners[2], corners[3]));
+        }
+    }
+    srand(31);
+    const glm::vec2 groundMin(0.0f), groundMax((float)CONTROLLER_BENCHMARK_GROUND);
+    for (int i=0; i<CONTROLLER_BENCHMARK_ROCKS; i++) {
+        Placement rock;
+        glm::vec2 point = RandomPointIn(groundMin, groundMax);
+        rock.position = glm::vec3(point.x, height(point.x, point.y), point.y);
+        rock.scale = 1.0f + 3.0f * rand() / RAND_MAX;
+        rock.degreesRotated = 360.0f * rand() / RAND_MAX;
+        glm::mat4 model = PlacementModel(rock);
+        for (size_t t=0; t<gRockShape->triangles().size(); t++)
+            triangles.push_back(gRockShape->triangle((unsigned)t).transformed(model));
+    }
+    TriangleBVH ground(triangles);
+    
+    std::vector<CharacterController> controllers(CONTROLLER_BENCHMARK_COUNT);
+    std::vector<glm::vec3> walkVelocities(CONTROLLER_BENCHMARK_COUNT);
+    for (unsigned i=0; i<CONTROLLER_BENCHMARK_COUNT; i++) {
+        controllers[i].setGeometry([&ground](const AABB& bounds, std::vector<Triangle>& found) {
+            ground.queryAABB(bounds, [&](unsigned triangle) {
+                found.push_back(ground.triangle(triangle));
+                return true;
+            });
+        });
+        glm::vec2 point = RandomPointIn(groundMin + 16.0f, groundMax - 16.0f);
+        controllers[i].setPosition(glm::vec3(point.x, height(point.x, point.y) + 0.5f, point.y));
+        float heading = 2.0f * (float)M_PI * rand() / RAND_MAX;
+        walkVelocities[i] = 1.5f * glm::vec3(cosf(heading), 0.0f, sinf(heading));
+    }
+    
+    unsigned long steps = 0, sweeps = 0, trianglesSwept = 0, grounded = 0;
+    double milliseconds = 0.0;
+    for (int frame=0; frame<CONTROLLER_BENCHMARK_FRAMES; frame++) {
+        Clock::time_point start = Clock::now();
+        ParallelFor(CONTROLLER_BENCHMARK_COUNT, [&](unsigned i) {
+            controllers[i].update(1.0f / FPS, walkVelocities[i], false);
+        });
+        milliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        for (unsigned i=0; i<CONTROLLER_BENCHMARK_COUNT; i++) {
+            steps += controllers[i].stats().steps;
+            sweeps += controllers[i].stats().sweeps;
+            trianglesSwept += controllers[i].stats().triangles;
+        }
+    }
+    for (unsigned i=0; i<CONTROLLER_BENCHMARK_COUNT; i++)
+        grounded += controllers[i].grounded();
+    std::cout << "Controller benchmark: " << CONTROLLER_BENCHMARK_COUNT << " controllers on " << ParallelForThreadCount()
+              << " threads, " << milliseconds / CONTROLLER_BENCHMARK_FRAMES << " ms a frame, "
+              << 1000.0 * milliseconds / std::max(steps, 1ul) << " us a step with " << sweeps / std::max(steps, 1ul)
+              << " sweeps against " << trianglesSwept / std::max(steps, 1ul) << " triangles, "
+              << grounded << " on the ground at the end" << std::endl;
+}
+
+// drops a mix of boxes, spheres and capsules in piles among some fixed boxes, the way a lot
+// of crates and jeeps might come down at once, and times the steps until they've settled
+static void BenchmarkPhysics() {
+    PROFILE_ZONE("BenchmarkPhysics");
+    typedef std::chrono::high_resolution_clock Clock;
+    PhysicsWorld world;
+    world.setGround([](float x, float z, float* height, glm::vec3* normal) {
+        *height = 0.0f;
+        *normal = glm::vec3(0.0f, 1.0f, 0.0f);
+        return true;
+    });
+    for (int i=0; i<100; i++)
+        world.addBody(CollisionShape::box(glm::vec3(1.0f)), 0.0f, glm::vec3((i % 10) * 6.0f - 30.0f, 1.0f, (i / 10) * 6.0f - 30.0f));
+    srand(37);
+    for (int i=0; i<PHYSICS_BENCHMARK_BODIES; i++) {
+        glm::vec2 point = RandomPointIn(glm::vec2(-40.0f), glm::vec2(40.0f));
+        CollisionShape shape = i % 3 == 0 ? CollisionShape::box(glm::vec3(0.5f, 0.4f, 0.6f)) :
+                               i % 3 == 1 ? CollisionShape::sphere(0.4f) : CollisionShape::capsule(0.3f, 0.4f);
+        glm::quat orientation = glm::rotate(glm::quat(), 360.0f * rand() / RAND_MAX, glm::vec3(1,1,0));
+        world.addBody(shape, 1.0f, glm::vec3(point.x, 2.0f + (i % 10) * 1.5f, point.y), orientation);
+    }
+    
+    // the narrowphase and the islands are spread over the shared job system's threads
+    JobSystem::Stats jobsBefore = JobSystem::shared().stats();
+    double milliseconds = 0.0, worst = 0.0;
+    unsigned contacts = 0;
+    for (int step=0; step<PHYSICS_BENCHMARK_STEPS; step++) {
+        Clock::time_point start = Clock::now();
+        world.step();
+        double stepMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        milliseconds += stepMilliseconds;
+        worst = std::max(worst, stepMilliseconds);
+        contacts = std::max(contacts, world.stats().contacts);
+    }
+    JobSystem::Stats jobsAfter = JobSystem::shared().stats();
+    
+    // step() adds each phase's time onto the stats until the next update()
+    const PhysicsWorld::Stats& stats = world.stats();
+    std::cout << "Physics benchmark: " << PHYSICS_BENCHMARK_BODIES << " bodies on " << stats.threads << " threads, "
+              << milliseconds / PHYSICS_BENCHMARK_STEPS << " ms a step (" << worst << " ms at worst): "
+              << stats.broadphaseMilliseconds / PHYSICS_BENCHMARK_STEPS << " ms broadphase, "
+              << stats.narrowphaseMilliseconds / PHYSICS_BENCHMARK_STEPS << " ms narrowphase, "
+              << stats.solveMilliseconds / PHYSICS_BENCHMARK_STEPS << " ms solving, "
+              << (jobsAfter.jobs - jobsBefore.jobs) / PHYSICS_BENCHMARK_STEPS << " jobs with "
+              << (jobsAfter.steals - jobsBefore.steals) / PHYSICS_BENCHMARK_STEPS << " steals a step. Up to "
+              << contacts << " contacts, " << stats.awake << " still awake after "
+              << PHYSICS_BENCHMARK_STEPS << " steps" << std::endl;
+}
+
+// casts a ray through each pixel of a picture of the crates taken from above one corner of
+// them, one ray at a time and in packets of four neighboring pixels, and times them
+static void BenchmarkRaycasts() {
+    PROFILE_ZONE("BenchmarkRaycasts");
+    typedef std::chrono::high_resolution_clock Clock;
+    const glm::vec3 eye(-120.0f, 15.0f, -120.0f);
+    const glm::vec3 forward = glm::normalize(-eye);
+    const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+    const glm::vec3 up = glm::cross(right, forward);
+    const float halfWidth = tanf(0.5f * 60.0f * (float)M_PI / 180.0f);
+    
+    // each run of four is a square of pixels, for the packets
+    std::vector<Ray> rays;
+    rays.reserve(RAYCAST_BENCHMARK_SIZE * RAYCAST_BENCHMARK_SIZE);
+    for (int y=0; y<RAYCAST_BENCHMARK_SIZE; y+=2) {
+        for (int x=0; x<RAYCAST_BENCHMARK_SIZE; x+=2) {
+            for (int pixel=0; pixel<4; pixel++) {
+                glm::vec2 point = (glm::vec2(x + (pixel & 1), y + (pixel >> 1)) + 0.5f) / (float)RAYCAST_BENCHMARK_SIZE;
+                point = (2.0f * point - 1.0f) * halfWidth;
+                rays.push_back(Ray(eye, glm::normalize(forward + point.x * right + point.y * up)));
+            }
+        }
+    }
+    const float maxDistance = 400.0f;
+    
+    Clock::time_point start = Clock::now();
+    unsigned singleHits = 0;
+    for (size_t i=0; i<rays.size(); i++) {
+        RayHit hit;
+        singleHits += RaycastColliders(rays[i], maxDistance, &hit) != -1;
+    }
+    double singleSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    
+    start = Clock::now();
+    unsigned packetHits = 0;
+    for (size_t i=0; i<rays.size(); i+=RayPacket::Size) {
+        RayPacket packet(&rays[i], RayPacket::Size, maxDistance);
+        RayHit hits[RayPacket::Size];
+        int colliders[RayPacket::Size];
+        RaycastColliders(packet, hits, colliders);
+        for (int r=0; r<RayPacket::Size; r++)
+            packetHits += colliders[r] != -1;
+    }
+    double packetSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    
+    std::cout << "Raycast benchmark: " << rays.size() << " rays at " << gCollisionTree.size() << " colliders, "
+              << rays.size() / singleSeconds / 1e6 << " Mrays/s one at a time (" << singleHits << " hit), "
+              << rays.size() / packetSeconds / 1e6 << " Mrays/s in packets of " << (int)RayPacket::Size
+              << " (" << packetHits << " hit)" << std::endl;
+}
+
+// builds a big grid strewn with obstacles and times paths across it, first one at a time
+// and then through the request queue with a thread for each core
+static void BenchmarkPathFinder() {
+    PROFILE_ZONE("BenchmarkPathFinder");
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+    NavigationGrid grid(glm::vec2(0.0f), 1.0f, PATH_BENCHMARK_SECTORS, PATH_BENCHMARK_SECTORS);
+    unsigned cells = grid.cellsX();
+    srand(19);
+    for (unsigned i=0; i<cells * cells / 400; i++) {
+        unsigned x = rand() % cells, z = rand() % cells;
+        unsigned endX = std::min(x + 1 + rand() % 10, cells), endZ = std::min(z + 1 + rand() % 10, cells);
+        for (unsigned cellZ=z; cellZ<endZ; cellZ++) {
+            for (unsigned cellX=x; cellX<endX; cellX++)
+                grid.setCost(cellX, cellZ, NavigationGrid::Blocked);
+        }
+    }
+    grid.update();
+    std::cout << "Path benchmark: " << cells << "x" << cells << " cells with " << grid.stats().entrances << " entrances, built in "
+              << std::chrono::duration<double, std::milli>(Clock::now() - start).count() << " ms" << std::endl;
+    
+    std::vector<glm::vec2> starts, goals;
+    for (int i=0; i<PATH_BENCHMARK_PATHS; i++) {
+        starts.push_back(glm::vec2(rand() % cells, rand() % cells));
+        goals.push_back(glm::vec2(rand() % cells, rand() % cells));
+    }
+    
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+    PathFinder finder(grid, threads);
+    start = Clock::now();
+    for (int i=0; i<PATH_BENCHMARK_PATHS / 10; i++)
+        finder.findPath(starts[i], goals[i]);
+    double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cout << "Path benchmark: " << (int)(PATH_BENCHMARK_PATHS / 10 * 1000.0 / milliseconds) << " paths per second on one thread, "
+              << (int)finder.stats().averageNodesExpanded << " nodes expanded on average" << std::endl;
+    
+    int delivered = 0;
+    start = Clock::now();
+    for (int i=0; i<PATH_BENCHMARK_PATHS; i++)
+        finder.requestPath(starts[i], goals[i], [&delivered](const PathFinder::Path&) { delivered++; });
+    while (delivered < PATH_BENCHMARK_PATHS) {
+        std::this_thread::yield();
+        finder.update();
+    }
+    milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cout << "Path benchmark: " << (int)(PATH_BENCHMARK_PATHS * 1000.0 / milliseconds) << " paths per second on "
+              << threads << " threads" << std::endl;
+}
+
+// draws each kind of animal with one instanced draw call
+static void RenderAnimals(const glm::mat4& playerMatrix) {
+    PROFILE_ZONE("RenderAnimals");
+    GPU_ZONE(*gGpuProfiler, "Animals");
+    gAnimalProgram->use();
+    gAnimalProgram->setUniform("player", playerMatrix);
+    gAnimalProgram->setUniform("coatColor", glm::vec3(0.9f, 0.88f, 0.84f));
+    gAnimalProgram->setUniform("stripeColor", glm::vec3(0.08f, 0.08f, 0.08f));
+    gAnimalProgram->setUniform("stripeFrequency", 25.0f);
+    gZebraAnimator->bindPalettes(*gAnimalProgram);
+    gZebraMesh->draw(gZebraAnimator->characterCount());
+    
+    // the lions are plain
+    gAnimalProgram->setUniform("coatColor", glm::vec3(0.76f, 0.6f, 0.36f));
+    gAnimalProgram->setUniform("stripeColor", glm::vec3(0.76f, 0.6f, 0.36f));
+    gAnimalProgram->setUniform("stripeFrequency", 0.0f);
+    gLionAnimator->bindPalettes(*gAnimalProgram);
+    gLionMesh->draw(gLionAnimator->characterCount());
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    gAnimalProgram->stopUsing();
+    
+    // and the wildebeest, with one more
+    gCrowdProgram->use();
+    gCrowdProgram->setUniform("player", playerMatrix);
+    gCrowdProgram->setUniform("coatColor", glm::vec3(0.36f, 0.34f, 0.32f));
+    gCrowdProgram->setUniform("stripeColor", glm::vec3(0.25f, 0.23f, 0.22f));
+    gCrowdProgram->setUniform("stripeFrequency", 18.0f);
+    gWildebeestCrowd->render(gFrame.crowdTime);
+    gCrowdProgram->stopUsing();
+}
+
+// draws the animals with ids from `firstId` up to `endId` into the photo scorer, each with
+// its id
+static void DrawAnimalIds(const glm::mat4& playerMatrix, unsigned firstId, unsigned endId) {
+    const Animator* animators[] = { gZebraAnimator, gLionAnimator };
+    const SkinnedMesh* meshes[] = { gZebraMesh, gLionMesh };
+    const unsigned firstIds[] = { FIRST_ZEBRA_ID, FIRST_LION_ID, FIRST_WILDEBEEST_ID };
+    gAnimalIdProgram->use();
+    gAnimalIdProgram->setUniform("player", playerMatrix);
+    for (int kind=0; kind<2; kind++) {
+        unsigned first = std::max(firstId, firstIds[kind]);
+        unsigned end = std::min(endId, firstIds[kind + 1]);
+        if (first >= end)
+            continue;
+        animators[kind]->bindPalettes(*gAnimalIdProgram);
+        gAnimalIdProgram->setUniform("idBase", (GLint)firstIds[kind]);
+        gAnimalIdProgram->setUniform("firstInstance", (GLint)(first - firstIds[kind]));
+        meshes[kind]->draw(end - first);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    gAnimalIdProgram->stopUsing();
+    
+    unsigned first = std::max(firstId, FIRST_WILDEBEEST_ID);
+    if (first < endId) {
+        gCrowdIdProgram->use();
+        gCrowdIdProgram->setUniform("player", playerMatrix);
+        gCrowdIdProgram->setUniform("idBase", (GLint)FIRST_WILDEBEEST_ID);
+        gWildebeestCrowd->render(*gCrowdIdProgram, gFrame.crowdTime, first - FIRST_WILDEBEEST_ID, endId - first);
+        gCrowdIdProgram->stopUsing();
+    }
+}
+
+// what kind of animal an id is
+static const char* AnimalName(unsigned id) {
+    if (id >= FIRST_WILDEBEEST_ID)
+        return "wildebeest";
+    return id >= FIRST_LION_ID ? "lion" : "zebra";
+}
+
+// scores a photo that's just been taken: the nearest few animals in view are drawn on their
+// own, to see how much of each the photo could have shown, then all of them with their ids
+static void ScorePhoto(unsigned photo, const glm::mat4& playerMatrix, const Frustum& frustum) {
+    PROFILE_ZONE("ScorePhoto");
+    GPU_ZONE(*gGpuProfiler, "Photo scoring");
+    if (!gScorer->begin(photo))
+        return;
+    
+    std::vector<std::pair<float, unsigned> > subjects;
+    for (unsigned i=0; i<gFrame.animals.size(); i++) {
+        if (frustum.intersectsSphere(gFrame.animals[i], PHOTO_SUBJECT_RADIUS))
+            subjects.push_back(std::make_pair(glm::distance(gFrame.animals[i], gFrame.camera.position()), FIRST_ZEBRA_ID + i));
+    }
+    size_t measured = std::min(subjects.size(), (size_t)PHOTO_SUBJECTS_MEASURED);
+    std::partial_sort(subjects.begin(), subjects.begin() + measured, subjects.end());
+    for (size_t i=0; i<measured; i++) {
+        unsigned id = subjects[i].second;
+        gScorer->measure(id, [&]() { DrawAnimalIds(playerMatrix, id, id + 1); });
+    }
+    
+    gScorer->drawIds(gFramebufferSize.x, gFramebufferSize.y);
+    DrawAnimalIds(playerMatrix, FIRST_ZEBRA_ID, END_ANIMAL_ID);
+    gScorer->end(gFramebufferSize.x, gFramebufferSize.y);
+}
+
+// tells the player when a photo beats their best one
+static void ReceiveScore(const PhotoScorer::Score& score) {
+    if (score.subjects.empty() || score.total <= gBestPhotoScore)
+        return;
+    gBestPhotoScore = score.total;
+    const PhotoScorer::Subject& subject = score.subjects[0];
+    std::cout << "New best photo, number " << score.photo << ": " << (int)score.total << " points for a "
+              << AnimalName(subject.id) << " filling " << 100.0f * subject.coverage << "% of it, "
+              << (int)(100.0f * subject.occlusion) << "% hidden and " << (int)(100.0f * subject.centering)
+              << "% centered, and " << score.subjects.size() - 1 << " other animals" << std::endl;
+}
+
 static void LoadTextures() {
+    PROFILE_ZONE("LoadTextures");
     tdogl::Bitmap bmp = tdogl::Bitmap::bitmapFromFile(ResourcePath("wooden-crate.jpg"));
     bmp.flipVertically();
     gTexture = new tdogl::Texture(bmp);
 }
 
 static void LoadTriangle() {
+    PROFILE_ZONE("LoadTriangle");
+    
     // make and bind the VAO
     glGenVertexArrays(1, &gVAO);
     glBindVertexArray(gVAO);
@@ -138,13 +1699,241 @@ static void LoadTriangle() {
     glBindVertexArray(0);
 }
 
-// draws a single frame
-static void Render() {
-    // clear everything
-    glClearColor(0, 0, 0, 1); // black
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// lays out a grid of crates around the origin and adds their bounds to the scene tree
+static void LoadCrates() {
+    PROFILE_ZONE("LoadCrates");
+    float offset = 0.5f * (CRATE_GRID_SIZE - 1) * CRATE_SPACING;
+    for (int x=0; x<CRATE_GRID_SIZE; x++) {
+        for (int z=0; z<CRATE_GRID_SIZE; z++) {
+            glm::vec3 position(x * CRATE_SPACING - offset, 0.0f, z * CRATE_SPACING - offset);
+            gCrateCuller.add(position, CRATE_BOUNDS_EXTENTS, CRATE_BOUNDS_RADIUS);
+            gCratePositions.push_back(position);
+        }
+    }
     
+    // they're collided with as if they weren't spinning. the occluder's triangles wind the
+    // other way round to ours.
+    std::vector<Triangle> triangles;
+    for (size_t i=0; i<sizeof(CRATE_OCCLUDER_INDICES) / sizeof(CRATE_OCCLUDER_INDICES[0]); i+=3) {
+        triangles.push_back(Triangle(CRATE_OCCLUDER_VERTICES[CRATE_OCCLUDER_INDICES[i]],
+                                     CRATE_OCCLUDER_VERTICES[CRATE_OCCLUDER_INDICES[i+2]],
+                                     CRATE_OCCLUDER_VERTICES[CRATE_OCCLUDER_INDICES[i+1]]));
+    }
+    gCrateShape = new TriangleBVH(triangles);
+    for (size_t i=0; i<gCratePositions.size(); i++)
+        AddCollider(gCrateShape, glm::translate(glm::mat4(), gCratePositions[i]), glm::translate(glm::mat4(), -gCratePositions[i]), Entity(), (int)i);
+}
+
+// the crates the player can toss land on the ground and bounce off the crates already there
+static void LoadPhysics() {
+    PROFILE_ZONE("LoadPhysics");
+    gPhysics = new PhysicsWorld();
+    gPhysics->setGround([](float x, float z, float* height, glm::vec3* normal) {
+        Terrain* terrain = TerrainUnder(glm::vec3(x, 0.0f, z));
+        if (!terrain)
+            return false;
+        *height = terrain->heightAt(x, z);
+        *normal = terrain->normalAt(x, z);
+        return true;
+    });
+    for (size_t i=0; i<gCratePositions.size(); i++)
+        gPhysics->addBody(CollisionShape::box(glm::vec3(1.0f)), 0.0f, gCratePositions[i]);
+}
+
+// throws a crate the way the player is looking
+static void TossCrate() {
+    if (gTossedCrates.size() >= TOSSED_CRATE_LIMIT) {
+        gPhysics->removeBody(gTossedCrates.front());
+        gTossedCrates.erase(gTossedCrates.begin());
+    }
+    glm::vec3 direction = gPlayer.forward();
+    int crate = gPhysics->addBody(CollisionShape::box(glm::vec3(TOSSED_CRATE_SIZE)), TOSSED_CRATE_MASS,
+                                  gPlayer.position() + 1.5f * direction, gPlayer.camera().orientation());
+    gPhysics->setVelocity(crate, TOSS_SPEED * direction + gPlayer.controller().velocity(), gPlayer.right() * -4.0f);
+    gTossedCrates.push_back(crate);
+}
+
+// the camera the player takes photos with, at the size of the window's pixels, which the
+// viewport starts out as
+static void LoadPhotos() {
+    PROFILE_ZONE("LoadPhotos");
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    gFramebufferSize = glm::ivec2(viewport[2], viewport[3]);
+    gPhotos = new PhotoCapture(gFramebufferSize.x, gFramebufferSize.y, PhotoDirectory());
+    gScorer = new PhotoScorer(gFramebufferSize.x / PHOTO_SCORE_DIVISOR, gFramebufferSize.y / PHOTO_SCORE_DIVISOR,
+                              END_ANIMAL_ID - 1, PHOTO_SUBJECTS_MEASURED);
+    // video has to be an even size
+    gRecorder = new VideoRecorder(gFramebufferSize.x & ~1, gFramebufferSize.y & ~1, (unsigned)FPS);
+    gGpuProfiler = new GpuProfiler();
+    if (!gGpuProfiler->supported())
+        std::cout << "The GPU's passes can't be timed without timer queries" << std::endl;
+    std::cout << "Photos are saved in " << PhotoDirectory() << std::endl;
+}
+
+// makes a quad for showing debug textures in the corner of the screen
+static void LoadDebugQuad() {
+    PROFILE_ZONE("LoadDebugQuad");
+    glGenVertexArrays(1, &gDebugQuadVAO);
+    glBindVertexArray(gDebugQuadVAO);
+    
+    glGenBuffers(1, &gDebugQuadVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, gDebugQuadVBO);
+    
+    GLfloat vertexData[] = {
+        //  X     Y     Z       U     V
+        0.0f, 0.0f, 0.0f,   0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,   1.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,   0.0f, 1.0f,
+        1.0f, 0.0f, 0.0f,   1.0f, 0.0f,
+        1.0f, 1.0f, 0.0f,   1.0f, 1.0f,
+        0.0f, 1.0f, 0.0f,   0.0f, 1.0f
+    };
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
+    
+    glEnableVertexAttribArray(gProgram->attrib("vert"));
+    glVertexAttribPointer(gProgram->attrib("vert"), 3, GL_FLOAT, GL_FALSE, 5*sizeof(GLfloat), NULL);
+    glEnableVertexAttribArray(gProgram->attrib("vertTexCoord"));
+    glVertexAttribPointer(gProgram->attrib("vertTexCoord"), 2, GL_FLOAT, GL_TRUE, 5*sizeof(GLfloat), (const GLvoid*)(3*sizeof(GLfloat)));
+    
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+// adds the crates closest to `eye` and the boulders that look biggest from it to the
+// occlusion culler, which has to have begun its frame
+static void AddOccluders(OcclusionCuller& culler, const glm::vec3& eye, const std::vector<unsigned>& crates,
+                         const glm::mat4& rotation, const std::vector<FrameSnapshot::RockDraw>& rocks) {
+    // the closest crates cover the most of the screen, so they make the best occluders
+    std::vector<std::pair<float, unsigned> > nearest;
+    for (size_t i=0; i<crates.size(); i++) {
+        glm::vec3 offset = gCratePositions[crates[i]] - eye;
+        nearest.push_back(std::make_pair(glm::dot(offset, offset), crates[i]));
+    }
+    size_t occluderCount = std::min((size_t)MAX_OCCLUDERS, nearest.size());
+    std::partial_sort(nearest.begin(), nearest.begin() + occluderCount, nearest.end());
+    for (size_t i=0; i<occluderCount; i++) {
+        const glm::vec3& position = gCratePositions[nearest[i].second];
+        culler.addOccluder(glm::translate(glm::mat4(), position) * rotation,
+                           CRATE_OCCLUDER_VERTICES, CRATE_OCCLUDER_INDICES,
+                           sizeof(CRATE_OCCLUDER_INDICES) / sizeof(CRATE_OCCLUDER_INDICES[0]));
+    }
+    
+    // the boulders come in all sizes, so they're picked by their size over their distance
+    std::vector<std::pair<float, size_t> > biggest;
+    for (size_t i=0; i<rocks.size(); i++) {
+        const glm::mat4& model = rocks[i].model;
+        glm::vec3 offset = glm::vec3(model[3]) - eye;
+        float scale = glm::length(glm::vec3(model[0]));
+        biggest.push_back(std::make_pair(-scale * scale / std::max(glm::dot(offset, offset), 1.0f), i));
+    }
+    occluderCount = std::min((size_t)MAX_ROCK_OCCLUDERS, biggest.size());
+    std::partial_sort(biggest.begin(), biggest.begin() + occluderCount, biggest.end());
+    for (size_t i=0; i<occluderCount; i++) {
+        culler.addOccluder(rocks[biggest[i].second].model, &gRockOccluderVertices[0],
+                           &gRockOccluderIndices[0], (unsigned)gRockOccluderIndices.size());
+    }
+}
+
+// finds the crates in view, and rasterizes the nearest of them and the biggest boulders into
+// the occlusion buffer, before anything they could hide is drawn
+static void RenderOccluders(const glm::mat4& playerMatrix, const Frustum& frustum) {
+    PROFILE_ZONE("RenderOccluders");
+    gCrateCuller.cull(frustum);
+    gOcclusionCuller.beginFrame(playerMatrix);
+    const glm::mat4 rotation = glm::rotate(glm::mat4(), gFrame.degreesRotated, glm::vec3(0,1,0));
+    AddOccluders(gOcclusionCuller, gFrame.camera.position(), gCrateCuller.visibleIndices(), rotation, gFrame.rocks);
+    gOcclusionCuller.finishFrame();
+}
+
+// draws the occlusion buffer in the bottom left corner of the screen
+static void RenderOcclusionBuffer() {
+    // the texture's made the first time it's shown, and filled again after that
+    tdogl::Bitmap bmp = gOcclusionCuller.debugBitmap();
+    if (!gOcclusionTexture)
+        gOcclusionTexture = new tdogl::Texture(bmp, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, gOcclusionTexture->object());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, (GLsizei)bmp.width(), (GLsizei)bmp.height(), GL_RGB, GL_UNSIGNED_BYTE, bmp.pixelBuffer());
+    gProgram->setUniform("player", glm::mat4());
+    gProgram->setUniform("model", glm::translate(glm::mat4(), glm::vec3(-1.0f, -1.0f, 0.0f)) *
+                                  glm::scale(glm::mat4(), glm::vec3(1.0f, 0.5f, 1.0f)));
+    
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(gDebugQuadVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glEnable(GL_DEPTH_TEST);
+}
+
+// draws how long the GPU took on each pass, in the top left corner of the screen: a bar for
+// the CPU's time on the frame, one for the GPU's, and one for each pass, with a line every
+// millisecond. the window's title has the numbers.
+static void RenderProfilerOverlay() {
+    GPU_ZONE(*gGpuProfiler, "Profiler overlay");
+    const std::vector<GpuProfiler::Pass>& passes = gGpuProfiler->passes();
+    const glm::vec4 colors[] = {
+        glm::vec4(0.9f, 0.3f, 0.3f, 1.0f), glm::vec4(0.3f, 0.8f, 0.3f, 1.0f), glm::vec4(0.3f, 0.5f, 0.9f, 1.0f),
+        glm::vec4(0.9f, 0.8f, 0.2f, 1.0f), glm::vec4(0.8f, 0.4f, 0.9f, 1.0f), glm::vec4(0.3f, 0.8f, 0.8f, 1.0f)
+    };
+    const unsigned colorCount = sizeof(colors) / sizeof(colors[0]);
+    const float millisecondWidth = PROFILER_OVERLAY_WIDTH * FPS / 1000.0f;
+    const float height = (passes.size() + 2) * PROFILER_OVERLAY_ROW_HEIGHT;
+    const glm::vec2 topLeft(-0.95f, 0.95f);
+    
+    gOverlayProgram->use();
+    gOverlayProgram->setUniform("player", glm::mat4());
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(gDebugQuadVAO);
+    auto drawRect = [](float x, float y, float width, float height, const glm::vec4& color) {
+        gOverlayProgram->setUniform("model", glm::translate(glm::mat4(), glm::vec3(x, y, 0.0f)) *
+                                             glm::scale(glm::mat4(), glm::vec3(width, height, 1.0f)));
+        gOverlayProgram->setUniform("color", color);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    };
+    auto drawBar = [&](unsigned row, double milliseconds, const glm::vec4& color) {
+        float width = std::min((float)milliseconds * millisecondWidth, PROFILER_OVERLAY_WIDTH);
+        float bottom = topLeft.y - (row + 1) * PROFILER_OVERLAY_ROW_HEIGHT;
+        drawRect(topLeft.x, bottom + 0.15f * PROFILER_OVERLAY_ROW_HEIGHT, width, 0.7f * PROFILER_OVERLAY_ROW_HEIGHT, color);
+    };
+    
+    drawRect(topLeft.x, topLeft.y - height, PROFILER_OVERLAY_WIDTH, height, glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+    for (unsigned millisecond=1; millisecond * millisecondWidth < PROFILER_OVERLAY_WIDTH; millisecond++)
+        drawRect(topLeft.x + millisecond * millisecondWidth, topLeft.y - height, 0.003f, height, glm::vec4(0.35f, 0.35f, 0.35f, 1.0f));
+    drawBar(0, gRenderMilliseconds, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+    drawBar(1, gGpuProfiler->stats().frameMilliseconds, glm::vec4(0.7f, 0.7f, 0.7f, 1.0f));
+    for (size_t i=0; i<passes.size(); i++)
+        drawBar(i + 2, passes[i].averageMilliseconds, colors[i % colorCount]);
     
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    gOverlayProgram->stopUsing();
+}
+
+// draws the ground that's streamed in
+static void RenderTerrain(const glm::mat4& playerMatrix, const Frustum& frustum) {
+    PROFILE_ZONE("RenderTerrain");
+    GPU_ZONE(*gGpuProfiler, "Terrain");
+    gTerrainProgram->use();
+    gTerrainProgram->setUniform("player", playerMatrix);
+    gWorld->forEachResident([&](WorldTile* tile) {
+        static_cast<TerrainTile*>(tile)->terrain()->render(frustum);
+    });
+    gTerrainProgram->stopUsing();
+}
+
+// draws the grass on the ground
+static void RenderVegetation(const glm::mat4& playerMatrix, const Frustum& frustum) {
+    PROFILE_ZONE("RenderVegetation");
+    GPU_ZONE(*gGpuProfiler, "Vegetation");
+    gVegetationProgram->use();
+    gVegetationProgram->setUniform("player", playerMatrix);
+    gVegetation->render(frustum, gFrame.camera.position());
+    gVegetationProgram->stopUsing();
+}
+
+// draws the crates in view that aren't hidden behind nearer ones, and the ones the player threw
+static void RenderCrates(const glm::mat4& playerMatrix, const Frustum& frustum) {
+    PROFILE_ZONE("RenderCrates");
+    GPU_ZONE(*gGpuProfiler, "Crates");
     // bind the program (shaders)
     gProgram->use();
     // bind the textures
@@ -152,34 +1941,554 @@ static void Render() {
     glBindTexture(GL_TEXTURE_2D, gTexture->object());
     gProgram->setUniform("tex", 0);
     
-    gProgram->setUniform("model", glm::rotate(glm::mat4(), gDegreesRotated, glm::vec3(0,1,0)));
-    gProgram->setUniform("player", gPlayer.matrix());
+    gProgram->setUniform("player", playerMatrix);
+    
+    // the crates inside the player's view, from RenderOccluders()
+    const std::vector<unsigned>& visibleCrates = gCrateCuller.visibleIndices();
+    const glm::mat4 rotation = glm::rotate(glm::mat4(), gFrame.degreesRotated, glm::vec3(0,1,0));
     
     // bind the VAO
     glBindVertexArray(gVAO);
     
-    // draw the VAO
-    glDrawArrays(GL_TRIANGLES, 0, 6*2*3);
+    // only the crates that are in view and not hidden get submitted
+    gDrawnCrateCount = 0;
+    for (size_t i=0; i<visibleCrates.size(); i++) {
+        unsigned crate = visibleCrates[i];
+        if (!gOcclusionCuller.test(AABB::fromCenterExtents(gCratePositions[crate], CRATE_BOUNDS_EXTENTS)))
+            continue;
+        
+        gProgram->setUniform("model", glm::translate(glm::mat4(), gCratePositions[crate]) * rotation);
+        
+        // draw the VAO
+        glDrawArrays(GL_TRIANGLES, 0, 6*2*3);
+        gDrawnCrateCount++;
+    }
+    
+    // and the ones the player threw
+    for (size_t i=0; i<gFrame.tossedCrates.size(); i++) {
+        gProgram->setUniform("model", gFrame.tossedCrates[i]);
+        glDrawArrays(GL_TRIANGLES, 0, 6*2*3);
+    }
+    
+    if (gShowOcclusionBuffer)
+        RenderOcclusionBuffer();
     
     // unbind the VAO and program
     glBindVertexArray(0);
     glBindTexture(GL_TEXTURE_2D, 0);
     gProgram->stopUsing();
+}
+
+// takes a photo of what was just drawn and scores it, and starts saving and scoring the ones
+// from earlier frames that have been read back, and records the frame if it's recording
+static void Capture(const glm::mat4& playerMatrix, const Frustum& frustum) {
+    PROFILE_ZONE("Capture");
+    GPU_ZONE(*gGpuProfiler, "Capture");
+    if (gShutterDown) {
+        unsigned photo = gPhotos->take(gFramebufferSize.x, gFramebufferSize.y);
+        if (photo)
+            ScorePhoto(photo, playerMatrix, frustum);
+    }
+    gPhotos->update();
+    gScorer->update(ReceiveScore);
+    gRecorder->update(gFramebufferSize.x, gFramebufferSize.y);
+}
+
+// draws a single frame from the snapshot, on the main thread while the game thread works on
+// the next one
+static void Render() {
+    PROFILE_ZONE("Render");
+    double renderStart = glfwGetTime();
+    gGpuProfiler->beginFrame();
     
-    // swap the display buffers (displays what was just drawn)
-    glfwSwapBuffers();
+    // clear everything
+    glClearColor(0.6f, 0.75f, 0.9f, 1); // sky blue
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    
+    const glm::mat4& playerMatrix = gFrame.camera.matrix();
+    Frustum frustum(playerMatrix);
+    
+    RenderTerrain(playerMatrix, frustum);
+    RenderVegetation(playerMatrix, frustum);
+    RenderOccluders(playerMatrix, frustum);
+    RenderRocks(playerMatrix);
+    RenderAnimals(playerMatrix);
+    RenderCrates(playerMatrix, frustum);
+    Capture(playerMatrix, frustum);
+    
+    // the overlay goes on after the photos and video have read the frame, so it isn't in them
+    if (gShowProfilerOverlay)
+        RenderProfilerOverlay();
+    gGpuProfiler->endFrame();
+    gRenderMilliseconds += (1000.0 * (glfwGetTime() - renderStart) - gRenderMilliseconds) * RENDER_TIME_SMOOTHING;
+    
+    // swap the display buffers (displays what was just drawn), which waits for the GPU when
+    // it's behind
+    {
+        PROFILE_ZONE("glfwSwapBuffers");
+        glfwSwapBuffers();
+    }
 }
 
+// returns what the player is looking at
+static RayTarget PickTarget() {
+    Ray ray(gPlayer.position(), gPlayer.forward());
+    RayTarget target;
+    CastRays(&ray, 1, PICK_DISTANCE, &target);
+    return target;
+}
+
+// steps the game, on the game thread. it mustn't touch OpenGL or anything Render() uses
+// outside the snapshot.
 static void Update(float delta) {
+    PROFILE_ZONE("Update");
     const GLfloat degreesPerSecond = 20.0f;
     gDegreesRotated += delta * degreesPerSecond;
     while(gDegreesRotated > 360.0f) gDegreesRotated -= 360.0f;
     
     // update the player
-    gPlayer.update(delta);
+    gPlayer.update(delta, gGameInput.player);
+    
+    UpdateNavigation();
+    gPathFinder->update();
+    
+    // the animals
+    UpdateZebras(delta);
+    UpdateWildebeest(delta);
+    UpdateLions(delta);
+    
+    // the props, culled against where the player is looking now
+    gViewFrustum = Frustum(gPlayer.matrix());
+    gLodSelector.setView(gPlayer.position(), gPlayer.fieldOfView(), gPlayer.viewportAspectRatio());
+    gSystems.run();
+    UpdateRockColliders();
+    
+    // the tossed crates
+    if (gGameInput.tossCrate)
+        TossCrate();
+    gPhysics->update(delta);
+    
+    // report what the player is looking at when they click
+    if (gGameInput.pickTarget) {
+        RayTarget target = PickTarget();
+        bool changed = target.type != gLastPickedTarget.type || target.entity != gLastPickedTarget.entity ||
+                       target.crate != gLastPickedTarget.crate;
+        if (changed && target.type == RayTarget::Crate)
+            std::cout << "Looking at crate " << target.crate << ", " << target.distance << " m away" << std::endl;
+        else if (changed && target.type == RayTarget::Rock)
+            std::cout << "Looking at boulder " << target.entity.index << ", " << target.distance << " m away" << std::endl;
+        gLastPickedTarget = target;
+    }
+}
+
+static void AddFrameTime(FrameTimes& times, double milliseconds) {
+    times.frames++;
+    times.milliseconds += milliseconds;
+    times.worstMilliseconds = std::max(times.worstMilliseconds, milliseconds);
+}
+
+// times the shared job system's jobs in the profiler
+static void JobBegan(const char* name, unsigned thread) {
+    Profiler::shared().beginZone(name);
+}
+
+static void JobEnded(const char* name, unsigned thread) {
+    Profiler::shared().endZone();
+}
+
+// writes the zones the profiler still has, the last few seconds of each thread, to a trace
+// next to the photos
+static void ExportTrace() {
+    std::ostringstream path;
+    path << PhotoDirectory() << "/safari-" << (unsigned long)time(NULL) << "-trace.json";
+    try {
+        unsigned zones = Profiler::shared().exportChromeTrace(path.str());
+        std::cout << "Wrote " << zones << " zones to " << path.str() << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Couldn't write the trace: " << e.what() << std::endl;
+    }
+}
+
+// puts how long the frame took on the CPU and the GPU, and the GPU's passes, in the window's
+// title, for reading alongside the overlay
+static void ShowPassTimes() {
+    std::ostringstream title;
+    title.setf(std::ios::fixed);
+    title.precision(2);
+    title << WINDOW_TITLE << " - CPU " << gRenderMilliseconds << " ms, GPU " << gGpuProfiler->stats().frameMilliseconds << " ms:";
+    const std::vector<GpuProfiler::Pass>& passes = gGpuProfiler->passes();
+    for (size_t i=0; i<passes.size(); i++)
+        title << (i == 0 ? " " : ", ") << passes[i].name << " " << passes[i].averageMilliseconds;
+    glfwSetWindowTitle(title.str().c_str());
+}
+
+// starts recording into a new video next to the photos, or stops
+static void ToggleRecording() {
+    if (gRecorder->recording()) {
+        gRecorder->stop();
+        std::cout << "Stopped recording" << std::endl;
+        return;
+    }
+    std::ostringstream path;
+    path << PhotoDirectory() << "/safari-" << (unsigned long)time(NULL) << ".y4m";
+    try {
+        gRecorder->start(path.str());
+        std::cout << "Recording to " << path.str() << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Couldn't record: " << e.what() << std::endl;
+    }
+}
+
+// prints what each part of the game did in the last frame
+static void ReportStats() {
+    const BoundsCuller::Stats& cullStats = gCrateCuller.stats();
+    const OcclusionCuller::Stats& stats = gOcclusionCuller.stats();
+    std::cout << "Culling: " << cullStats.culled << " outside the frustum in " << cullStats.milliseconds << " ms, "
+              << stats.occluded - gRocksOccluded << " occluded, " << gDrawnCrateCount << " drawn ("
+              << stats.occluderTriangles << " occluder triangles in "
+              << stats.rasterizeMilliseconds << " ms)" << std::endl;
+    unsigned chunksDrawn = 0, trianglesDrawn = 0;
+    gWorld->forEachResident([&](WorldTile* tile) {
+        const Terrain::Stats& terrainStats = static_cast<TerrainTile*>(tile)->terrain()->stats();
+        chunksDrawn += terrainStats.chunksDrawn;
+        trianglesDrawn += terrainStats.trianglesDrawn;
+    });
+    std::cout << "Terrain: " << chunksDrawn << " chunks, " << trianglesDrawn << " triangles" << std::endl;
+    const WorldStreamer::Stats& worldStats = gWorld->stats();
+    std::cout << "World: " << worldStats.residentTiles << " tiles resident, "
+              << worldStats.queuedTiles << " queued, " << worldStats.loadingTiles << " loading ("
+              << worldStats.cpuBytes / 1024 << " KB CPU, " << worldStats.gpuBytes / 1024 << " KB GPU), "
+              << worldStats.loads << " loads averaging " << worldStats.averageLoadMilliseconds << " ms, "
+              << worldStats.evictions << " evictions" << std::endl;
+    const Vegetation::Stats& vegetationStats = gVegetation->stats();
+    std::cout << "Vegetation: " << vegetationStats.instances << " instances in " << vegetationStats.patches
+              << " patches (" << vegetationStats.gpuBytes / 1024 << " KB), " << vegetationStats.instancesDrawn
+              << " drawn from " << vegetationStats.patchesDrawn << " patches in " << vegetationStats.drawCalls
+              << " draw calls" << std::endl;
+    const Animator::Stats& animatorStats = gZebraAnimator->stats();
+    const HerdSimulation::Stats& herdStats = gWildebeestHerd->stats();
+    std::cout << "Herds: " << herdStats.agents + gZebraHerd->stats().agents << " animals, "
+              << herdStats.fleeing + gZebraHerd->stats().fleeing << " fleeing, wildebeest hashed in "
+              << herdStats.hashMilliseconds << " ms and steered in " << herdStats.steerMilliseconds << " ms ("
+              << (int)herdStats.agentsPerMillisecond << " per ms on " << herdStats.threads << " threads)" << std::endl;
+    const NavigationGrid::Stats& navigationStats = gNavigation->stats();
+    std::cout << "Navigation: " << navigationStats.sectors << " sectors with " << navigationStats.entrances
+              << " entrances, " << navigationStats.cachedFields << " flow fields cached, "
+              << navigationStats.sectorsRebuilt << " sectors last rebuilt in " << navigationStats.rebuildMilliseconds << " ms and "
+              << navigationStats.sectorsIntegrated << " sectors of flow in " << navigationStats.integrateMilliseconds
+              << " ms" << std::endl;
+    const PathFinder::Stats& pathStats = gPathFinder->stats();
+    std::cout << "Paths: " << pathStats.pathsFound << " found, " << pathStats.pathsFailed << " failed, "
+              << pathStats.pendingRequests << " pending, " << pathStats.averageSearchMilliseconds << " ms and "
+              << (int)pathStats.averageNodesExpanded << " nodes per search" << std::endl;
+    std::cout << "Animation: " << animatorStats.characters << " zebras, " << animatorStats.joints
+              << " joints posed in " << animatorStats.sampleMilliseconds << " ms, "
+              << animatorStats.paletteBytes / 1024 << " KB of matrices uploaded in "
+              << animatorStats.uploadMilliseconds << " ms" << std::endl;
+    const VertexAnimation::Stats& crowdStats = gWildebeestCrowd->stats();
+    std::cout << "Crowd: " << crowdStats.instances << " wildebeest from " << crowdStats.frames
+              << " baked frames of " << crowdStats.vertices << " vertices (" << crowdStats.textureBytes / 1024
+              << " KB, baked in " << crowdStats.bakeMilliseconds << " ms)" << std::endl;
+    std::cout << "Rocks: " << gRocksDrawn << " drawn with " << gRockTrianglesDrawn << " triangles, "
+              << gRocksOccluded << " occluded" << std::endl;
+    const CharacterController::Stats& controllerStats = gPlayer.controller().stats();
+    std::cout << "Player: " << (gPlayer.controller().grounded() ? "on the ground" : "in the air") << ", "
+              << controllerStats.steps << " steps with " << controllerStats.sweeps << " sweeps against "
+              << controllerStats.triangles << " triangles, " << gCollisionTree.size() << " colliders" << std::endl;
+    const PhysicsWorld::Stats& physicsStats = gPhysics->stats();
+    std::cout << "Physics: " << physicsStats.bodies << " bodies, " << physicsStats.awake << " awake in "
+              << physicsStats.islands << " islands, " << physicsStats.pairs << " pairs with " << physicsStats.contacts
+              << " contacts, " << physicsStats.steps << " steps in " << physicsStats.broadphaseMilliseconds << " + "
+              << physicsStats.narrowphaseMilliseconds << " + " << physicsStats.solveMilliseconds << " ms" << std::endl;
+    EntityWorld::Stats entityStats = gEntities.stats();
+    const SystemScheduler::Stats& systemStats = gSystems.stats();
+    JobSystem::Stats jobStats = JobSystem::shared().stats();
+    std::cout << "Jobs: " << jobStats.jobs << " run on " << jobStats.threads << " threads, "
+              << jobStats.steals << " stolen, " << jobStats.overflows << " overflowed" << std::endl;
+    std::cout << "Entities: " << entityStats.entities << " in " << entityStats.archetypes << " archetypes and "
+              << entityStats.chunks << " chunks (" << (int)(100.0f * entityStats.chunkFill) << "% full), "
+              << systemStats.systems << " systems in " << systemStats.stages << " stages ran over "
+              << systemStats.chunks << " chunks in " << systemStats.milliseconds << " ms" << std::endl;
+    const FramePipeline::Stats& pipelineStats = gPipeline->stats();
+    std::cout << "Pipeline: " << pipelineStats.framesInFlight << " frames in flight, simulated in "
+              << pipelineStats.simulateMilliseconds << " ms, synchronized in " << pipelineStats.synchronizeMilliseconds
+              << " ms, rendered in " << pipelineStats.renderMilliseconds << " ms, " << pipelineStats.overlapMilliseconds
+              << " ms overlapped, " << pipelineStats.waitMilliseconds << " ms waiting, " << pipelineStats.frameMilliseconds
+              << " ms per frame" << std::endl;
+    PhotoCapture::Stats photoStats = gPhotos->stats();
+    std::cout << "Photos: " << photoStats.taken << " taken, " << photoStats.dropped << " dropped, "
+              << photoStats.saved << " saved, " << photoStats.failed << " failed, " << photoStats.inFlight
+              << " in flight, read back in " << photoStats.readbackLatency << " frames and saved in "
+              << photoStats.saveMilliseconds << " ms; frames took "
+              << gPhotoFrameTimes.milliseconds / std::max(gPhotoFrameTimes.frames, 1u) << " ms ("
+              << gPhotoFrameTimes.worstMilliseconds << " at worst) while taking them, against "
+              << gPlainFrameTimes.milliseconds / std::max(gPlainFrameTimes.frames, 1u) << " ms ("
+              << gPlainFrameTimes.worstMilliseconds << " at worst) otherwise" << std::endl;
+    PhotoScorer::Stats scoreStats = gScorer->stats();
+    std::cout << "Scoring: " << scoreStats.scored << " scored, " << scoreStats.dropped << " dropped, submitted in "
+              << scoreStats.submitMilliseconds << " ms, added up in " << scoreStats.reduceMilliseconds << " ms after "
+              << scoreStats.latency << " frames; best photo " << (int)gBestPhotoScore << " points" << std::endl;
+    VideoRecorder::Stats videoStats = gRecorder->stats();
+    double recordingMilliseconds = gRecordingFrameTimes.milliseconds / std::max(gRecordingFrameTimes.frames, 1u);
+    double plainMilliseconds = gPlainFrameTimes.milliseconds / std::max(gPlainFrameTimes.frames, 1u);
+    std::cout << "Recording: " << videoStats.recorded << " frames recorded, " << videoStats.dropped << " dropped, "
+              << videoStats.written << " written (" << (int)videoStats.megabytesWritten << " MB), " << videoStats.inFlight
+              << " in flight, read back in " << videoStats.readbackLatency << " frames, converted in "
+              << videoStats.convertMilliseconds << " ms and written in " << videoStats.writeMilliseconds
+              << " ms; frames took " << recordingMilliseconds << " ms while recording ("
+              << (gRecordingFrameTimes.frames > 0 && plainMilliseconds > 0.0 ? (int)(100.0 * (recordingMilliseconds / plainMilliseconds - 1.0)) : 0)
+              << "% more)" << std::endl;
+    GpuProfiler::Stats gpuStats = gGpuProfiler->stats();
+    std::cout << "GPU: " << gpuStats.timed << " frames timed, " << gpuStats.dropped << " dropped, read back after "
+              << gpuStats.latency << " frames; " << gpuStats.frameMilliseconds << " ms a frame against "
+              << gRenderMilliseconds << " ms on the CPU, so " << (gpuStats.frameMilliseconds > gRenderMilliseconds ? "GPU" : "CPU")
+              << " bound (";
+    const std::vector<GpuProfiler::Pass>& passes = gGpuProfiler->passes();
+    for (size_t i=0; i<passes.size(); i++)
+        std::cout << (i == 0 ? "" : ", ") << passes[i].name << " " << passes[i].averageMilliseconds << " ms";
+    std::cout << ")" << std::endl;
+    Profiler::Stats profilerStats = Profiler::shared().stats();
+    std::cout << "Profiler: " << profilerStats.zones << " zones on " << profilerStats.tracks << " tracks, "
+              << profilerStats.overwritten << " written over" << std::endl;
+}
+
+// runs between frames on the main thread, while the game thread is stopped. streams the
+// ground and uploads the animals, copies out what Render() needs, and hands the game thread
+// the input for its next frame.
+static void Synchronize() {
+    PROFILE_ZONE("Synchronize");
+    
+    // stream in the ground around the player and refine it
+    gWorld->update(gPlayer.position());
+    gWorld->forEachResident([](WorldTile* tile) {
+        static_cast<TerrainTile*>(tile)->terrain()->update(gPlayer.position());
+    });
+    
+    gZebraAnimator->upload();
+    gLionAnimator->upload();
+    gWildebeestCrowd->setInstances(gWildebeestInstances);
+    
+    gFrame.camera = gPlayer.camera();
+    gFrame.degreesRotated = gDegreesRotated;
+    gFrame.crowdTime = gCrowdTime;
+    SnapshotRocks();
+    gFrame.tossedCrates.clear();
+    for (size_t i=0; i<gTossedCrates.size(); i++)
+        gFrame.tossedCrates.push_back(gPhysics->transform(gTossedCrates[i]) * glm::scale(glm::mat4(), glm::vec3(TOSSED_CRATE_SIZE)));
+    
+    // the keys are only read here, on the main thread
+    gGameInput.player = Player::Input::capture();
+    gGameDelta = gFrameDelta;
+    
+    // toss a crate
+    bool tossKeyDown = glfwGetKey('T') == GLFW_PRESS;
+    gGameInput.tossCrate = tossKeyDown && !gTossKeyWasDown;
+    gTossKeyWasDown = tossKeyDown;
+    
+    // toggle the occlusion buffer view
+    bool occlusionKeyDown = glfwGetKey('O') == GLFW_PRESS;
+    if (occlusionKeyDown && !gOcclusionKeyWasDown)
+        gShowOcclusionBuffer = !gShowOcclusionBuffer;
+    gOcclusionKeyWasDown = occlusionKeyDown;
+    
+    // switch between simulating alongside rendering and one after the other
+    bool pipelineKeyDown = glfwGetKey('L') == GLFW_PRESS;
+    if (pipelineKeyDown && !gPipelineKeyWasDown)
+        gPipeline->setFramesInFlight(3 - gPipeline->framesInFlight());
+    gPipelineKeyWasDown = pipelineKeyDown;
+    
+    gGameInput.pickTarget = glfwGetMouseButton(GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    gShutterDown = glfwGetMouseButton(GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+    if (gShutterDown)
+        SnapshotAnimals();
+    
+    // start or stop recording video
+    bool recordKeyDown = glfwGetKey('R') == GLFW_PRESS;
+    if (recordKeyDown && !gRecordKeyWasDown)
+        ToggleRecording();
+    gRecordKeyWasDown = recordKeyDown;
+    
+    // write out the profiler's trace
+    bool traceKeyDown = glfwGetKey('K') == GLFW_PRESS;
+    if (traceKeyDown && !gTraceKeyWasDown)
+        ExportTrace();
+    gTraceKeyWasDown = traceKeyDown;
+    
+    // toggle the GPU profiler's overlay
+    bool overlayKeyDown = glfwGetKey('G') == GLFW_PRESS;
+    if (overlayKeyDown && !gOverlayKeyWasDown) {
+        gShowProfilerOverlay = !gShowProfilerOverlay;
+        if (!gShowProfilerOverlay)
+            glfwSetWindowTitle(WINDOW_TITLE);
+    }
+    gOverlayKeyWasDown = overlayKeyDown;
+    
+    // and while it's shown, put its numbers in the title a few times a second
+    double time = glfwGetTime();
+    if (gShowProfilerOverlay && time - gLastOverlayTitleTime >= 0.25) {
+        ShowPassTimes();
+        gLastOverlayTitleTime = time;
+    }
+    
+    // report how things are going about once a second, while nothing's changing
+    if (time - gLastStatsTime >= 1.0) {
+        ReportStats();
+        gLastStatsTime = time;
+    }
+}
+
+// records a lot of empty zones, on one thread and then on one per core at once, and checks
+// a zone costs less than it should
+static void BenchmarkProfiler() {
+    PROFILE_ZONE("BenchmarkProfiler");
+    typedef std::chrono::high_resolution_clock Clock;
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned threadCounts[] = { 1, std::max(cores, 2u) };
+    for (int t=0; t<2; t++) {
+        unsigned threadCount = threadCounts[t];
+        std::vector<std::thread> threads;
+        Clock::time_point start = Clock::now();
+        for (unsigned i=0; i<threadCount; i++) {
+            threads.push_back(std::thread([]() {
+                for (unsigned zone=0; zone<PROFILER_BENCHMARK_ZONES; zone++) {
+                    PROFILE_ZONE("BenchmarkProfiler zone");
+                }
+            }));
+        }
+        for (size_t i=0; i<threads.size(); i++)
+            threads[i].join();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        
+        // with more threads than cores they take turns, so only count the time each core spent
+        double nanoseconds = seconds * 1e9 * std::min(threadCount, cores) / ((double)threadCount * PROFILER_BENCHMARK_ZONES);
+        std::cout << "Profiler benchmark: " << threadCount << " threads, " << nanoseconds << " ns a zone" << std::endl;
+        if (nanoseconds > PROFILER_BENCHMARK_MAX_NANOSECONDS)
+            throw std::runtime_error("Recording a profiler zone took longer than it should");
+    }
+}
+
+// draws nothing, but counts what a fixed view past a boulder and across the crates would draw
+// with only the frustum, and with the occlusion buffer too, and times building and testing it
+static void BenchmarkOcclusion() {
+    PROFILE_ZONE("BenchmarkOcclusion");
+    typedef std::chrono::high_resolution_clock Clock;
+    
+    // the boulders sit on flat ground, whatever's been streamed in
+    std::vector<Placement> placements;
+    gEntities.forEachChunk(EntityWorld::Query().read<Placement>().read<Boulder>(), [&](const EntityWorld::Chunk& chunk) {
+        placements.insert(placements.end(), chunk.read<Placement>(), chunk.read<Placement>() + chunk.count());
+    });
+    size_t biggest = 0;
+    for (size_t i=0; i<placements.size(); i++) {
+        placements[i].position.y = -0.1f * placements[i].scale;
+        if (placements[i].scale > placements[biggest].scale)
+            biggest = i;
+    }
+    glm::vec3 rock = placements[biggest].position;
+    glm::vec3 away = glm::normalize(glm::vec3(rock.x, 0.0f, rock.z));
+    glm::vec3 eye = glm::vec3(rock.x, OCCLUSION_BENCHMARK_EYE_HEIGHT, rock.z) +
+                    away * (OCCLUSION_BENCHMARK_EYE_DISTANCE * placements[biggest].scale);
+    
+    glm::mat4 projection = glm::perspective(50.0f, SCREEN_SIZE.x / SCREEN_SIZE.y, 0.1f, 1000.0f);
+    glm::mat4 viewProjection = projection * glm::lookAt(eye, glm::vec3(0.0f, OCCLUSION_BENCHMARK_EYE_HEIGHT, 0.0f), glm::vec3(0,1,0));
+    Frustum frustum(viewProjection);
+    
+    BoundsCuller crateCuller;
+    for (size_t i=0; i<gCratePositions.size(); i++)
+        crateCuller.add(gCratePositions[i], CRATE_BOUNDS_EXTENTS, CRATE_BOUNDS_RADIUS);
+    crateCuller.cull(frustum);
+    const std::vector<unsigned>& crates = crateCuller.visibleIndices();
+    std::vector<FrameSnapshot::RockDraw> rocks;
+    for (size_t i=0; i<placements.size(); i++) {
+        glm::vec3 center = placements[i].position + placements[i].scale * gRockMesh->center();
+        if (!frustum.intersectsSphere(center, placements[i].scale * gRockMesh->radius()))
+            continue;
+        FrameSnapshot::RockDraw draw;
+        draw.model = PlacementModel(placements[i]);
+        draw.lod = 0;
+        rocks.push_back(draw);
+    }
+    
+    OcclusionCuller culler;
+    double buildMilliseconds = 0.0, testMilliseconds = 0.0;
+    unsigned cratesDrawn = 0, rocksDrawn = 0;
+    for (int run=0; run<OCCLUSION_BENCHMARK_RUNS; run++) {
+        Clock::time_point start = Clock::now();
+        culler.beginFrame(viewProjection);
+        AddOccluders(culler, eye, crates, glm::mat4(), rocks);
+        culler.finishFrame();
+        buildMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        
+        start = Clock::now();
+        cratesDrawn = rocksDrawn = 0;
+        for (size_t i=0; i<crates.size(); i++)
+            cratesDrawn += culler.isVisible(AABB::fromCenterExtents(gCratePositions[crates[i]], CRATE_BOUNDS_EXTENTS));
+        for (size_t i=0; i<rocks.size(); i++)
+            rocksDrawn += culler.isVisible(gRockBounds.transformed(rocks[i].model));
+        testMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+    std::cout << "Occlusion benchmark: " << crates.size() << " crates and " << rocks.size() << " boulders in the frustum, "
+              << cratesDrawn << " and " << rocksDrawn << " drawn after occlusion, "
+              << buildMilliseconds / OCCLUSION_BENCHMARK_RUNS << " ms to rasterize "
+              << culler.stats().occluderTriangles << " occluder triangles, "
+              << testMilliseconds / OCCLUSION_BENCHMARK_RUNS << " ms to test" << std::endl;
+}
+
+// saves a photo-sized picture in each format as a PNG, reads it back with stb_image, and
+// checks it comes back the same, since the PNG writer is our own
+static void BenchmarkPhotoSaving() {
+    PROFILE_ZONE("BenchmarkPhotoSaving");
+    typedef std::chrono::high_resolution_clock Clock;
+    const unsigned width = (unsigned)SCREEN_SIZE.x, height = (unsigned)SCREEN_SIZE.y;
+    std::string filePath = TemporaryPath("open-safari-benchmark.png");
+    
+    srand(46);
+    for (int format=tdogl::Bitmap::Format_Grayscale; format<=tdogl::Bitmap::Format_RGBA; format++) {
+        // smooth gradients with a little noise, and flat bands, like the sky and ground
+        std::vector<unsigned char> pixels(width * height * format);
+        for (unsigned y=0; y<height; y++) {
+            for (unsigned x=0; x<width; x++) {
+                for (int channel=0; channel<format; channel++) {
+                    unsigned char value = y < height / 4 ? 180 : (unsigned char)((x + 2 * y + 40 * channel) / 4 + rand() % 4);
+                    pixels[(y * width + x) * format + channel] = value;
+                }
+            }
+        }
+        tdogl::Bitmap bitmap(width, height, (tdogl::Bitmap::Format)format, &pixels[0]);
+        
+        Clock::time_point start = Clock::now();
+        bitmap.saveToFile(filePath);
+        double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        tdogl::Bitmap loaded = tdogl::Bitmap::bitmapFromFile(filePath);
+        if (loaded.width() != width || loaded.height() != height || loaded.format() != bitmap.format() ||
+            memcmp(loaded.pixelBuffer(), bitmap.pixelBuffer(), pixels.size()) != 0)
+            throw std::runtime_error("A saved PNG didn't read back the same");
+        std::cout << "Photo benchmark: " << format << " channels, " << milliseconds
+                  << " ms to save, read back the same" << std::endl;
+    }
+    remove(filePath.c_str());
+}
+
+// times each part of the game on its own, once everything's loaded
+static void RunBenchmarks() {
+    BenchmarkProfiler();
+    BenchmarkCulling();
+    BenchmarkOcclusion();
+    BenchmarkHerds();
+    BenchmarkJobs();
+    BenchmarkCameras();
+    BenchmarkControllers();
+    BenchmarkPhysics();
+    BenchmarkRaycasts();
+    BenchmarkPathFinder();
+    BenchmarkPhotoSaving();
 }
 
 void AppMain() {
+    // time the jobs along with everything else
+    Profiler::shared().setThreadName("Main");
+    JobSystem::shared().setHooks(JobBegan, JobEnded);
+    
     if (!glfwInit())
         throw std::runtime_error("glfwInit() failed!");
     
@@ -188,8 +2497,9 @@ void AppMain() {
     glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, 3);
     glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 2);
     glfwOpenWindowHint(GLFW_WINDOW_NO_RESIZE, GL_TRUE);
-    if (!glfwOpenWindow(SCREEN_SIZE.x, SCREEN_SIZE.y, 8, 8, 8, 8, 16, 0, GLFW_WINDOW))
+    if (!glfwOpenWindow(SCREEN_SIZE.x, SCREEN_SIZE.y, 8, 8, 8, 8, 24, 0, GLFW_WINDOW))
         throw std::runtime_error("glfwOpenWindow() failed!");
+    glfwSetWindowTitle(WINDOW_TITLE);
     
     // GLFW settings
     glfwDisable(GLFW_MOUSE_CURSOR);
@@ -218,15 +2528,48 @@ void AppMain() {
     LoadShaders();
     // load the textures
     LoadTextures();
+    // load the ground
+    LoadTerrain();
+    // and the boulders on it
+    LoadRocks();
+    // and the animals
+    LoadZebras();
+    LoadWildebeest();
+    LoadNavigation();
+    LoadLions();
     
     // create buffers by points
     LoadTriangle();
+    // place the crates
+    LoadCrates();
+    LoadPhysics();
+    LoadDebugQuad();
+    LoadPhotos();
+    if (gRunBenchmarks)
+        RunBenchmarks();
     
     // setup gPlayer
     gPlayer.setPosition(glm::vec3(0,0,4));
     gPlayer.setViewportAspectRatio(SCREEN_SIZE.x / SCREEN_SIZE.y);
+    gPlayer.setNearAndFarPlanes(0.1f, 1000.0f);
+    gPlayer.setCollisionGeometry(GatherCollisionTriangles);
+    
+    // the ground under the player has to be there before the first frame
+    gWorld->update(gPlayer.position());
+    gWorld->finishLoading();
+    UpdateNavigation();
+    // and the player dropped onto it
+    Terrain* spawnTerrain = TerrainUnder(gPlayer.position());
+    if (spawnTerrain) {
+        glm::vec3 spawn = gPlayer.position();
+        gPlayer.setPosition(glm::vec3(spawn.x, spawnTerrain->heightAt(spawn.x, spawn.z) + gPlayer.controller().settings().height, spawn.z));
+    }
+    
+    // the game steps on its own thread while the last frame is drawn
+    gPipeline = new FramePipeline([]() { Update(gGameDelta); }, Synchronize, Render);
     
     double lastTime = glfwGetTime();
+    gLastStatsTime = lastTime;
     // run while the window is open
     while(glfwGetWindowParam(GLFW_OPENED)){
         // update the scene based that the previous time
@@ -237,8 +2580,14 @@ void AppMain() {
             delta = currTime - lastTime;
         }
         lastTime = currTime;
-        Update(delta);
-        Render();
+        gFrameDelta = delta;
+        double frameStart = glfwGetTime();
+        gPipeline->runFrame();
+        double frameMilliseconds = 1000.0 * (glfwGetTime() - frameStart);
+        if (gRecorder->recording())
+            AddFrameTime(gRecordingFrameTimes, frameMilliseconds);
+        else
+            AddFrameTime(gPhotos->busy() ? gPhotoFrameTimes : gPlainFrameTimes, frameMilliseconds);
         
         // check for errors
         GLenum error = glGetError();
@@ -250,10 +2599,27 @@ void AppMain() {
             glfwCloseWindow();
     }
     
+    // stop the game thread before the window goes, and finish saving and scoring the photos
+    // and writing the video
+    delete gPipeline;
+    gPipeline = NULL;
+    delete gRecorder;
+    gRecorder = NULL;
+    delete gPhotos;
+    gPhotos = NULL;
+    gScorer->finish(ReceiveScore);
+    delete gScorer;
+    gScorer = NULL;
+    delete gGpuProfiler;
+    gGpuProfiler = NULL;
     glfwTerminate();
 }
 
 int main(int argc, const char * argv[]) {
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--benchmark") == 0)
+            gRunBenchmarks = true;
+    }
     try {
         AppMain();
     } catch (const std::exception& e) {
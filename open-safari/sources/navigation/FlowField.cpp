@@ -0,0 +1,60 @@
+//
+//  FlowField.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/7/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "FlowField.h"
+#include "navigation/NavigationGrid.h"
+
+const int FlowField::StepX[FlowField::Step_Count] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int FlowField::StepZ[FlowField::Step_Count] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+/** the steps as unit vectors */
+static const float Diagonal = 0.70710678f;
+static const glm::vec2 StepDirections[] = {
+    glm::vec2(1, 0), glm::vec2(Diagonal, Diagonal), glm::vec2(0, 1), glm::vec2(-Diagonal, Diagonal),
+    glm::vec2(-1, 0), glm::vec2(-Diagonal, -Diagonal), glm::vec2(0, -1), glm::vec2(Diagonal, -Diagonal)
+};
+
+FlowField::FlowField(const NavigationGrid& grid, unsigned destination) :
+    _grid(grid),
+    _destination(destination),
+    _steps(grid.cellsX() * grid.cellsZ(), Step_None),
+    _sectorVersions(grid._sectors.size(), 0),
+    _sectorSeeds(grid._sectors.size()),
+    _lastUsed(0)
+{
+}
+
+glm::vec2 FlowField::direction(const glm::vec2& position) const {
+    unsigned char step = _stepAt(position);
+    if (step < Step_Count)
+        return StepDirections[step];
+    
+    // head for the middle of the destination cell
+    if (step == Step_Arrived) {
+        glm::vec2 offset = destination() - position;
+        float length = glm::length(offset);
+        if (length > 1e-3f)
+            return offset / length;
+    }
+    return glm::vec2(0.0f);
+}
+
+bool FlowField::reachable(const glm::vec2& position) const {
+    return _stepAt(position) != Step_None;
+}
+
+glm::vec2 FlowField::destination() const {
+    return _grid.cellCenter(_destination % _grid.cellsX(), _destination / _grid.cellsX());
+}
+
+unsigned char FlowField::_stepAt(const glm::vec2& position) const {
+    unsigned x, z;
+    if (!_grid.cellAt(position, &x, &z))
+        return Step_None;
+    return _steps[x + z * _grid.cellsX()];
+}
@@ -0,0 +1,76 @@
+//
+//  FlowField.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/7/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__FlowField__
+#define __open_safari__FlowField__
+
+#include <vector>
+#include <glm/glm.hpp>
+
+class NavigationGrid;
+
+/**
+ The way to one destination from everywhere on a NavigationGrid.
+ 
+ Every cell holds which of its eight neighbours is the next step on the cheapest path to the
+ destination, so any number of agents can look up where to go without searching. Flow
+ fields are made, cached and kept up to date by NavigationGrid::flowField().
+ */
+class FlowField {
+public:
+    /**
+     @result the unit direction to head in from the world position (x and z) to get to the
+             destination, or zero if the destination can't be reached from there or the
+             position is off the grid
+     */
+    glm::vec2 direction(const glm::vec2& position) const;
+    
+    /**
+     @result true if there's a path from the world position to the destination
+     */
+    bool reachable(const glm::vec2& position) const;
+    
+    /** the center of the destination cell, in world x and z */
+    glm::vec2 destination() const;
+
+private:
+    friend class NavigationGrid;
+    
+    enum {
+        Step_Count = 8,     /**< the steps to the eight neighbours come first */
+        Step_Arrived = 8,   /**< the destination cell */
+        Step_None = 9       /**< can't get there */
+    };
+    
+    /** the cell offsets of the steps, going around counterclockwise from +x */
+    static const int StepX[Step_Count];
+    static const int StepZ[Step_Count];
+    
+    const NavigationGrid& _grid;
+    unsigned _destination;
+    /** one step per cell, in rows along x */
+    std::vector<unsigned char> _steps;
+    /** the path cost from each entrance of the grid to the destination */
+    std::vector<float> _entranceCosts;
+    /** per sector, the grid's version of the sector and the costs it was seeded with when
+        its steps were worked out, to tell when they have to be worked out again */
+    std::vector<unsigned> _sectorVersions;
+    std::vector<std::vector<float> > _sectorSeeds;
+    unsigned long _lastUsed;
+    
+    FlowField(const NavigationGrid& grid, unsigned destination);
+    
+    /** @result the step out of the cell under the position, or Step_None off the grid */
+    unsigned char _stepAt(const glm::vec2& position) const;
+    
+    // copying disabled
+    FlowField(const FlowField&);
+    const FlowField& operator=(const FlowField&);
+};
+
+#endif /* defined(__open_safari__FlowField__) */
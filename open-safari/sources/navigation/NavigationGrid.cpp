@@ -0,0 +1,498 @@
+//
+//  NavigationGrid.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/7/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "NavigationGrid.h"
+#include "core/ParallelFor.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+
+static const unsigned SectorCellCount = NavigationGrid::SectorCells * NavigationGrid::SectorCells;
+static const float Unreachable = std::numeric_limits<float>::infinity();
+static const float DiagonalLength = 1.41421356f;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+/** a search node and its cost so far, cheapest first in a std::priority_queue */
+typedef std::pair<float, unsigned> Open;
+typedef std::priority_queue<Open, std::vector<Open>, std::greater<Open> > OpenQueue;
+
+NavigationGrid::NavigationGrid(const glm::vec2& origin, float cellSize, unsigned sectorsX, unsigned sectorsZ) :
+    _origin(origin),
+    _cellSize(cellSize),
+    _sectorsX(sectorsX),
+    _sectorsZ(sectorsZ),
+    _cellsX(sectorsX * SectorCells),
+    _cellsZ(sectorsZ * SectorCells),
+    _costs(_cellsX * _cellsZ, 1),
+    _sectors(sectorsX * sectorsZ),
+    _dirty(true),
+    _version(0),
+    _maxCachedFields(8),
+    _useCount(0)
+{
+    assert(cellSize > 0.0f && sectorsX > 0 && sectorsZ > 0);
+    for (size_t s=0; s<_sectors.size(); s++) {
+        _sectors[s].version = 0;
+        _sectors[s].dirty = true;
+    }
+    
+    _stats.sectors = (unsigned)_sectors.size();
+    _stats.entrances = 0;
+    _stats.cachedFields = 0;
+    _stats.sectorsRebuilt = 0;
+    _stats.sectorsIntegrated = 0;
+    _stats.rebuildMilliseconds = 0.0;
+    _stats.integrateMilliseconds = 0.0;
+}
+
+NavigationGrid::~NavigationGrid() {
+    for (size_t i=0; i<_fields.size(); i++)
+        delete _fields[i];
+}
+
+const glm::vec2& NavigationGrid::origin() const {
+    return _origin;
+}
+
+float NavigationGrid::cellSize() const {
+    return _cellSize;
+}
+
+unsigned NavigationGrid::cellsX() const {
+    return _cellsX;
+}
+
+unsigned NavigationGrid::cellsZ() const {
+    return _cellsZ;
+}
+
+unsigned char NavigationGrid::cost(unsigned x, unsigned z) const {
+    assert(x < _cellsX && z < _cellsZ);
+    return _costs[x + z * _cellsX];
+}
+
+void NavigationGrid::setCost(unsigned x, unsigned z, unsigned char cost) {
+    assert(x < _cellsX && z < _cellsZ);
+    assert(cost > 0);
+    unsigned cell = x + z * _cellsX;
+    if (_costs[cell] == cost)
+        return;
+    _costs[cell] = cost;
+    _sectors[_sectorOf(cell)].dirty = true;
+    _dirty = true;
+}
+
+bool NavigationGrid::cellAt(const glm::vec2& position, unsigned* x, unsigned* z) const {
+    glm::vec2 cell = glm::floor((position - _origin) / _cellSize);
+    if (cell.x < 0.0f || cell.y < 0.0f || cell.x >= _cellsX || cell.y >= _cellsZ)
+        return false;
+    *x = (unsigned)cell.x;
+    *z = (unsigned)cell.y;
+    return true;
+}
+
+glm::vec2 NavigationGrid::cellCenter(unsigned x, unsigned z) const {
+    return _origin + (glm::vec2(x, z) + 0.5f) * _cellSize;
+}
+
+void NavigationGrid::update() {
+    if (!_dirty)
+        return;
+    
+    Clock::time_point start = Clock::now();
+    _stats.sectorsIntegrated = 0;
+    _stats.integrateMilliseconds = 0.0;
+    
+    // the entrances are cheap to find again from scratch. a sector's own entrances only
+    // change if it or a neighbour changed, so only those need their paths searched again.
+    _findEntrances();
+    std::vector<bool> rebuild(_sectors.size(), false);
+    for (unsigned sz=0; sz<_sectorsZ; sz++) {
+        for (unsigned sx=0; sx<_sectorsX; sx++) {
+            if (!_sectors[sx + sz * _sectorsX].dirty)
+                continue;
+            rebuild[sx + sz * _sectorsX] = true;
+            if (sx > 0) rebuild[sx - 1 + sz * _sectorsX] = true;
+            if (sx + 1 < _sectorsX) rebuild[sx + 1 + sz * _sectorsX] = true;
+            if (sz > 0) rebuild[sx + (sz - 1) * _sectorsX] = true;
+            if (sz + 1 < _sectorsZ) rebuild[sx + (sz + 1) * _sectorsX] = true;
+        }
+    }
+    std::vector<unsigned> rebuilt;
+    for (unsigned s=0; s<_sectors.size(); s++) {
+        if (rebuild[s])
+            rebuilt.push_back(s);
+    }
+    ParallelFor((unsigned)rebuilt.size(), [&](unsigned i) {
+        Sector& sector = _sectors[rebuilt[i]];
+        _findPaths(rebuilt[i]);
+        sector.version++;
+        sector.dirty = false;
+    });
+    _dirty = false;
+    _version++;
+    
+    _stats.entrances = (unsigned)_entrances.size();
+    _stats.sectorsRebuilt = (unsigned)rebuilt.size();
+    _stats.rebuildMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    
+    for (size_t i=0; i<_fields.size(); i++)
+        _refresh(*_fields[i]);
+}
+
+unsigned NavigationGrid::version() const {
+    return _version;
+}
+
+const FlowField& NavigationGrid::flowField(const glm::vec2& destination) {
+    if (_dirty)
+        update();
+    
+    unsigned x, z;
+    if (!cellAt(destination, &x, &z)) {
+        glm::vec2 cell = glm::clamp(glm::floor((destination - _origin) / _cellSize), glm::vec2(0.0f), glm::vec2(_cellsX - 1, _cellsZ - 1));
+        x = (unsigned)cell.x;
+        z = (unsigned)cell.y;
+    }
+    unsigned cell = x + z * _cellsX;
+    
+    _useCount++;
+    for (size_t i=0; i<_fields.size(); i++) {
+        if (_fields[i]->_destination == cell) {
+            _fields[i]->_lastUsed = _useCount;
+            return *_fields[i];
+        }
+    }
+    
+    // make room by dropping the least recently used
+    if (_fields.size() >= _maxCachedFields && !_fields.empty()) {
+        size_t oldest = 0;
+        for (size_t i=1; i<_fields.size(); i++) {
+            if (_fields[i]->_lastUsed < _fields[oldest]->_lastUsed)
+                oldest = i;
+        }
+        delete _fields[oldest];
+        _fields.erase(_fields.begin() + oldest);
+    }
+    
+    FlowField* field = new FlowField(*this, cell);
+    field->_lastUsed = _useCount;
+    _refresh(*field);
+    _fields.push_back(field);
+    _stats.cachedFields = (unsigned)_fields.size();
+    return *field;
+}
+
+unsigned NavigationGrid::maxCachedFields() const {
+    return _maxCachedFields;
+}
+
+void NavigationGrid::setMaxCachedFields(unsigned maxCachedFields) {
+    assert(maxCachedFields > 0);
+    _maxCachedFields = maxCachedFields;
+}
+
+const NavigationGrid::Stats& NavigationGrid::stats() const {
+    return _stats;
+}
+
+unsigned NavigationGrid::_sectorOf(unsigned cell) const {
+    unsigned x = cell % _cellsX, z = cell / _cellsX;
+    return x / SectorCells + (z / SectorCells) * _sectorsX;
+}
+
+unsigned NavigationGrid::_sectorCell(unsigned sector, unsigned localCell) const {
+    unsigned x = (sector % _sectorsX) * SectorCells + localCell % SectorCells;
+    unsigned z = (sector / _sectorsX) * SectorCells + localCell / SectorCells;
+    return x + z * _cellsX;
+}
+
+unsigned NavigationGrid::_localCell(unsigned cell) const {
+    return (cell % _cellsX) % SectorCells + ((cell / _cellsX) % SectorCells) * SectorCells;
+}
+
+/**
+ The cost of stepping between neighbouring cells is the average of the two cells' costs
+ times the length of the step, which makes the cost of a path the same both ways, so
+ searching outwards from a destination finds the cost of getting to it.
+ */
+float NavigationGrid::_stepCost(unsigned from, unsigned to, bool diagonal) const {
+    float cost = 0.5f * ((float)_costs[from] + (float)_costs[to]);
+    return diagonal ? cost * DiagonalLength : cost;
+}
+
+void NavigationGrid::_findEntrances() {
+    _entrances.clear();
+    for (size_t s=0; s<_sectors.size(); s++)
+        _sectors[s].entrances.clear();
+    
+    // each sector finds the entrances on its borders with its +x and +z neighbours, so the
+    // entrances of a sector are always found in the same order
+    for (unsigned sz=0; sz<_sectorsZ; sz++) {
+        for (unsigned sx=0; sx<_sectorsX; sx++) {
+            unsigned sector = sx + sz * _sectorsX;
+            if (sx + 1 < _sectorsX)
+                _addEntrances(sector, sector + 1, _sectorCell(sector, SectorCells - 1), _cellsX, 1);
+            if (sz + 1 < _sectorsZ)
+                _addEntrances(sector, sector + _sectorsX, _sectorCell(sector, (SectorCells - 1) * SectorCells), 1, (int)_cellsX);
+        }
+    }
+}
+
+void NavigationGrid::_addEntrances(unsigned sector, unsigned neighbor, unsigned firstCell, unsigned stride, int across) {
+    unsigned runStart = 0;
+    bool inRun = false;
+    for (unsigned i=0; i<=SectorCells; i++) {
+        unsigned cell = firstCell + i * stride;
+        bool open = i < SectorCells && _costs[cell] != Blocked && _costs[cell + across] != Blocked;
+        if (open && !inRun) {
+            runStart = i;
+            inRun = true;
+        } else if (!open && inRun) {
+            inRun = false;
+            
+            Entrance entrance;
+            entrance.sector = sector;
+            entrance.firstCell = firstCell + runStart * stride;
+            entrance.stride = stride;
+            entrance.count = i - runStart;
+            entrance.center = entrance.firstCell + (entrance.count / 2) * stride;
+            entrance.across = across;
+            entrance.opposite = (unsigned)_entrances.size() + 1;
+            entrance.slot = (unsigned)_sectors[sector].entrances.size();
+            _sectors[sector].entrances.push_back((unsigned)_entrances.size());
+            _entrances.push_back(entrance);
+            
+            entrance.sector = neighbor;
+            entrance.firstCell += across;
+            entrance.center += across;
+            entrance.across = -across;
+            entrance.opposite = (unsigned)_entrances.size() - 1;
+            entrance.slot = (unsigned)_sectors[neighbor].entrances.size();
+            _sectors[neighbor].entrances.push_back((unsigned)_entrances.size());
+            _entrances.push_back(entrance);
+        }
+    }
+}
+
+void NavigationGrid::_findPaths(unsigned sector) {
+    Sector& s = _sectors[sector];
+    size_t count = s.entrances.size();
+    s.paths.assign(count * count, Unreachable);
+    
+    float costs[SectorCellCount];
+    for (size_t i=0; i<count; i++) {
+        Seed seed = { _localCell(_entrances[s.entrances[i]].center), 0.0f };
+        _search(sector, &seed, 1, costs);
+        for (size_t j=0; j<count; j++)
+            s.paths[i * count + j] = costs[_localCell(_entrances[s.entrances[j]].center)];
+    }
+}
+
+/**
+ Dijkstra's algorithm over the cells of one sector, stepping to all eight neighbours but not
+ cutting the corners of blocked cells
+ 
+ @param costs  receives the cheapest cost from the seeds to each cell of the sector
+ */
+void NavigationGrid::_search(unsigned sector, const Seed* seeds, unsigned seedCount, float* costs) const {
+    std::fill(costs, costs + SectorCellCount, Unreachable);
+    OpenQueue open;
+    for (unsigned i=0; i<seedCount; i++) {
+        if (seeds[i].cost < costs[seeds[i].cell]) {
+            costs[seeds[i].cell] = seeds[i].cost;
+            open.push(Open(seeds[i].cost, seeds[i].cell));
+        }
+    }
+    
+    while (!open.empty()) {
+        Open current = open.top();
+        open.pop();
+        if (current.first > costs[current.second])
+            continue;
+        
+        int x = current.second % SectorCells, z = current.second / SectorCells;
+        unsigned cell = _sectorCell(sector, current.second);
+        for (int step=0; step<FlowField::Step_Count; step++) {
+            int nx = x + FlowField::StepX[step], nz = z + FlowField::StepZ[step];
+            if (nx < 0 || nz < 0 || nx >= (int)SectorCells || nz >= (int)SectorCells)
+                continue;
+            unsigned next = cell + FlowField::StepX[step] + FlowField::StepZ[step] * (int)_cellsX;
+            if (_costs[next] == Blocked)
+                continue;
+            bool diagonal = step % 2 == 1;
+            if (diagonal && (_costs[cell + FlowField::StepX[step]] == Blocked || _costs[cell + FlowField::StepZ[step] * (int)_cellsX] == Blocked))
+                continue;
+            
+            float cost = current.first + _stepCost(cell, next, diagonal);
+            unsigned local = nx + nz * SectorCells;
+            if (cost < costs[local]) {
+                costs[local] = cost;
+                open.push(Open(cost, local));
+            }
+        }
+    }
+}
+
+/**
+ Searches the entrance graph outwards from the destination, then works out the steps again
+ in the sectors that changed
+ */
+void NavigationGrid::_refresh(FlowField& field) {
+    Clock::time_point start = Clock::now();
+    
+    std::vector<float>& entranceCosts = field._entranceCosts;
+    entranceCosts.assign(_entrances.size(), Unreachable);
+    OpenQueue open;
+    
+    // the entrances of the destination's own sector cost what it takes to get to the
+    // destination inside the sector
+    unsigned destinationSector = _sectorOf(field._destination);
+    if (_costs[field._destination] != Blocked) {
+        float costs[SectorCellCount];
+        Seed seed = { _localCell(field._destination), 0.0f };
+        _search(destinationSector, &seed, 1, costs);
+        const std::vector<unsigned>& entrances = _sectors[destinationSector].entrances;
+        for (size_t i=0; i<entrances.size(); i++) {
+            float cost = costs[_localCell(_entrances[entrances[i]].center)];
+            if (cost < Unreachable) {
+                entranceCosts[entrances[i]] = cost;
+                open.push(Open(cost, entrances[i]));
+            }
+        }
+    }
+    
+    while (!open.empty()) {
+        Open current = open.top();
+        open.pop();
+        if (current.first > entranceCosts[current.second])
+            continue;
+        
+        // over the border, or over to another entrance of the same sector
+        const Entrance& entrance = _entrances[current.second];
+        float cost = current.first + _stepCost(entrance.center, _entrances[entrance.opposite].center, false);
+        if (cost < entranceCosts[entrance.opposite]) {
+            entranceCosts[entrance.opposite] = cost;
+            open.push(Open(cost, entrance.opposite));
+        }
+        
+        const Sector& sector = _sectors[entrance.sector];
+        size_t count = sector.entrances.size();
+        const float* paths = &sector.paths[entrance.slot * count];
+        for (size_t i=0; i<count; i++) {
+            float pathCost = current.first + paths[i];
+            if (pathCost < entranceCosts[sector.entrances[i]]) {
+                entranceCosts[sector.entrances[i]] = pathCost;
+                open.push(Open(pathCost, sector.entrances[i]));
+            }
+        }
+    }
+    
+    std::atomic<unsigned> integrated(0);
+    ParallelFor((unsigned)_sectors.size(), [&](unsigned s) {
+        // what the sector's steps depend on, besides its own costs
+        const std::vector<unsigned>& entrances = _sectors[s].entrances;
+        std::vector<float> seeds(entrances.size());
+        for (size_t i=0; i<entrances.size(); i++)
+            seeds[i] = entranceCosts[_entrances[entrances[i]].opposite];
+        
+        if (field._sectorVersions[s] == _sectors[s].version && field._sectorSeeds[s] == seeds)
+            return;
+        field._sectorVersions[s] = _sectors[s].version;
+        field._sectorSeeds[s].swap(seeds);
+        _integrate(field, s);
+        integrated++;
+    });
+    
+    _stats.sectorsIntegrated += integrated;
+    _stats.integrateMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/**
+ Works out the step out of each cell of a sector. The search is seeded from the destination
+ if it's in the sector, and from every cell of every entrance with what it costs to get to
+ the destination from the entrance on the other side, so every cell steps either to a
+ neighbour in the sector or over the border.
+ */
+void NavigationGrid::_integrate(FlowField& field, unsigned sector) {
+    const std::vector<unsigned>& entrances = _sectors[sector].entrances;
+    std::vector<Seed> seeds;
+    // the cheapest way out over the border from each cell, and which step it is
+    float exitCosts[SectorCellCount];
+    unsigned char exitSteps[SectorCellCount];
+    std::fill(exitCosts, exitCosts + SectorCellCount, Unreachable);
+    
+    if (_sectorOf(field._destination) == sector && _costs[field._destination] != Blocked) {
+        Seed seed = { _localCell(field._destination), 0.0f };
+        seeds.push_back(seed);
+    }
+    for (size_t i=0; i<entrances.size(); i++) {
+        const Entrance& entrance = _entrances[entrances[i]];
+        // only entrances that lead downhill are a way out. the costs of the cells along a
+        // run are only estimated from the middle one, so two sectors could each think the
+        // way is through the other.
+        float oppositeCost = field._entranceCosts[entrance.opposite];
+        if (oppositeCost == Unreachable || oppositeCost >= field._entranceCosts[entrances[i]])
+            continue;
+        
+        unsigned char step = entrance.across == 1 ? 0 : entrance.across == -1 ? 4 : entrance.across > 0 ? 2 : 6;
+        for (unsigned c=0; c<entrance.count; c++) {
+            unsigned cell = entrance.firstCell + c * entrance.stride;
+            Seed seed = { _localCell(cell), oppositeCost + _stepCost(cell, cell + entrance.across, false) };
+            seeds.push_back(seed);
+            if (seed.cost < exitCosts[seed.cell]) {
+                exitCosts[seed.cell] = seed.cost;
+                exitSteps[seed.cell] = step;
+            }
+        }
+    }
+    
+    float costs[SectorCellCount];
+    _search(sector, seeds.empty() ? NULL : &seeds[0], (unsigned)seeds.size(), costs);
+    
+    // each cell steps to wherever its cost came from
+    for (unsigned local=0; local<SectorCellCount; local++) {
+        unsigned cell = _sectorCell(sector, local);
+        unsigned char& step = field._steps[cell];
+        if (cell == field._destination) {
+            step = FlowField::Step_Arrived;
+            continue;
+        }
+        if (costs[local] == Unreachable) {
+            step = FlowField::Step_None;
+            continue;
+        }
+        
+        float best = exitCosts[local];
+        step = exitCosts[local] < Unreachable ? exitSteps[local] : (unsigned char)FlowField::Step_None;
+        int x = local % SectorCells, z = local / SectorCells;
+        for (int s=0; s<FlowField::Step_Count; s++) {
+            int nx = x + FlowField::StepX[s], nz = z + FlowField::StepZ[s];
+            if (nx < 0 || nz < 0 || nx >= (int)SectorCells || nz >= (int)SectorCells)
+                continue;
+            unsigned next = cell + FlowField::StepX[s] + FlowField::StepZ[s] * (int)_cellsX;
+            if (_costs[next] == Blocked)
+                continue;
+            bool diagonal = s % 2 == 1;
+            if (diagonal && (_costs[cell + FlowField::StepX[s]] == Blocked || _costs[cell + FlowField::StepZ[s] * (int)_cellsX] == Blocked))
+                continue;
+            
+            float cost = costs[nx + nz * SectorCells] + _stepCost(cell, next, diagonal);
+            if (cost < best) {
+                best = cost;
+                step = (unsigned char)s;
+            }
+        }
+    }
+}
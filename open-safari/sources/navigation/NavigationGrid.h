@@ -0,0 +1,188 @@
+//
+//  NavigationGrid.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/7/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__NavigationGrid__
+#define __open_safari__NavigationGrid__
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "navigation/FlowField.h"
+
+/**
+ A grid of travel costs over the ground, and the flow fields that lead groups of animals
+ across it.
+ 
+ The grid is split into square sectors. Wherever cells on both sides of the border between
+ two sectors can be walked on, the run of them is an entrance on each side, and the
+ entrances of a sector are joined by the cheapest paths between them inside the sector. The
+ entrances and paths are a small graph over the whole grid, so finding the cost from every
+ entrance to a destination is a quick search of the graph, after which each sector can work
+ out the cells' steps on its own, seeded from its entrances, with the sectors spread across
+ the worker threads.
+ 
+ A flow field is cached for each destination asked for. Changing costs only marks the
+ sectors they're in: update() rebuilds the entrances and paths of those sectors and their
+ neighbours, searches the graph again for each cached field, and works out the steps again
+ only in sectors that were rebuilt or whose entrance costs changed.
+ */
+class NavigationGrid {
+public:
+    /** the number of cells along each side of a sector */
+    static const unsigned SectorCells = 16;
+    
+    /** the cost of a cell that can't be walked on */
+    static const unsigned char Blocked = 255;
+    
+    struct Stats {
+        unsigned sectors;
+        unsigned entrances;
+        unsigned cachedFields;
+        /** the sectors whose entrances and paths were rebuilt the last time costs changed */
+        unsigned sectorsRebuilt;
+        /** the sectors whose flow was worked out since then, over every field */
+        unsigned sectorsIntegrated;
+        double rebuildMilliseconds;
+        double integrateMilliseconds;
+    };
+    
+    /**
+     Creates a grid with every cell costing 1
+     
+     @param origin    the world position of the corner of the first cell, x and z
+     @param cellSize  the width of a cell
+     @param sectorsX, sectorsZ  the size of the grid in sectors
+     */
+    NavigationGrid(const glm::vec2& origin, float cellSize, unsigned sectorsX, unsigned sectorsZ);
+    
+    /**
+     Deletes the cached flow fields
+     */
+    ~NavigationGrid();
+    
+    const glm::vec2& origin() const;
+    float cellSize() const;
+    unsigned cellsX() const;
+    unsigned cellsZ() const;
+    
+    /**
+     The cost of walking across a cell, from 1 to 254, or Blocked. Changes are picked up by
+     the next update().
+     */
+    unsigned char cost(unsigned x, unsigned z) const;
+    void setCost(unsigned x, unsigned z, unsigned char cost);
+    
+    /**
+     Finds the cell under a world position
+     
+     @result false if the position is off the grid
+     */
+    bool cellAt(const glm::vec2& position, unsigned* x, unsigned* z) const;
+    
+    /** @result the world position of the center of a cell, x and z */
+    glm::vec2 cellCenter(unsigned x, unsigned z) const;
+    
+    /**
+     Rebuilds the sectors whose costs changed and brings the cached flow fields up to date.
+     Does nothing if no costs changed.
+     */
+    void update();
+    
+    /**
+     Bumped by every update() that rebuilds something, so users of the entrances can tell
+     when they've changed
+     */
+    unsigned version() const;
+    
+    /**
+     Gets the flow field to the cell under `destination`, working it out if it isn't cached.
+     The least recently used field is dropped when there are too many cached. Calls update()
+     first if costs have changed.
+     
+     @result the field, which stays valid until a later call makes it the one dropped
+     */
+    const FlowField& flowField(const glm::vec2& destination);
+    
+    /**
+     The most flow fields kept at once
+     */
+    unsigned maxCachedFields() const;
+    void setMaxCachedFields(unsigned maxCachedFields);
+    
+    const Stats& stats() const;
+
+private:
+    friend class FlowField;
+    friend class PathFinder;
+    
+    /**
+     A run of cells along one side of a sector border, with walkable cells across from them
+     */
+    struct Entrance {
+        unsigned sector;
+        unsigned firstCell;
+        /** how far apart the cells of the run are: 1 along x, cellsX along z */
+        unsigned stride;
+        unsigned count;
+        /** the cell in the middle of the run, where paths to the entrance go */
+        unsigned center;
+        /** add to a cell of the run to get the cell across the border */
+        int across;
+        /** the entrance on the other side */
+        unsigned opposite;
+        /** its place in the sector's entrances */
+        unsigned slot;
+    };
+    
+    struct Sector {
+        /** the entrances along its borders, indexes into _entrances */
+        std::vector<unsigned> entrances;
+        /** the cheapest path between each pair of entrances inside the sector, by their
+            place in `entrances`, or infinity if they aren't connected */
+        std::vector<float> paths;
+        /** bumped whenever it's rebuilt */
+        unsigned version;
+        bool dirty;
+    };
+    
+    /** a cell to start a search in, by its place in the sector, and its cost so far */
+    struct Seed {
+        unsigned cell;
+        float cost;
+    };
+    
+    glm::vec2 _origin;
+    float _cellSize;
+    unsigned _sectorsX, _sectorsZ;
+    unsigned _cellsX, _cellsZ;
+    std::vector<unsigned char> _costs;
+    std::vector<Sector> _sectors;
+    std::vector<Entrance> _entrances;
+    bool _dirty;
+    unsigned _version;
+    std::vector<FlowField*> _fields;
+    unsigned _maxCachedFields;
+    unsigned long _useCount;
+    Stats _stats;
+    
+    unsigned _sectorOf(unsigned cell) const;
+    unsigned _sectorCell(unsigned sector, unsigned localCell) const;
+    unsigned _localCell(unsigned cell) const;
+    float _stepCost(unsigned from, unsigned to, bool diagonal) const;
+    void _findEntrances();
+    void _addEntrances(unsigned sector, unsigned neighbor, unsigned firstCell, unsigned stride, int across);
+    void _findPaths(unsigned sector);
+    void _search(unsigned sector, const Seed* seeds, unsigned seedCount, float* costs) const;
+    void _refresh(FlowField& field);
+    void _integrate(FlowField& field, unsigned sector);
+    
+    // copying disabled
+    NavigationGrid(const NavigationGrid&);
+    const NavigationGrid& operator=(const NavigationGrid&);
+};
+
+#endif /* defined(__open_safari__NavigationGrid__) */
@@ -0,0 +1,601 @@
+//
+//  PathFinder.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/8/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "PathFinder.h"
+#include "core/Profiler.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+static const unsigned SectorCellCount = NavigationGrid::SectorCells * NavigationGrid::SectorCells;
+static const float Unreachable = std::numeric_limits<float>::infinity();
+static const float DiagonalLength = 1.41421356f;
+static const unsigned NoNode = ~0u;
+
+/** the steps to the eight neighbours of a cell */
+static const int StepX[] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+static const int StepZ[] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+typedef std::chrono::high_resolution_clock Clock;
+
+/**
+ What the threads need of the grid, copied so the grid can change under them
+ */
+struct PathFinder::Snapshot {
+    glm::vec2 origin;
+    float cellSize;
+    unsigned cellsX, cellsZ;
+    unsigned sectorsX;
+    std::vector<unsigned char> costs;
+    std::vector<NavigationGrid::Sector> sectors;
+    std::vector<NavigationGrid::Entrance> entrances;
+    /** entrances with the same number are connected, so a search between entrances with
+        different ones can give up straight away */
+    std::vector<unsigned> components;
+    
+    /** numbers the connected groups of entrances, flooding out through the graph */
+    void findComponents() {
+        components.assign(entrances.size(), NoNode);
+        std::vector<unsigned> stack;
+        unsigned component = 0;
+        for (unsigned first=0; first<entrances.size(); first++) {
+            if (components[first] != NoNode)
+                continue;
+            components[first] = component;
+            stack.push_back(first);
+            while (!stack.empty()) {
+                unsigned node = stack.back();
+                stack.pop_back();
+                const NavigationGrid::Entrance& entrance = entrances[node];
+                if (components[entrance.opposite] == NoNode) {
+                    components[entrance.opposite] = component;
+                    stack.push_back(entrance.opposite);
+                }
+                const NavigationGrid::Sector& sector = sectors[entrance.sector];
+                size_t count = sector.entrances.size();
+                for (size_t i=0; i<count; i++) {
+                    unsigned next = sector.entrances[i];
+                    if (sector.paths[entrance.slot * count + i] < Unreachable && components[next] == NoNode) {
+                        components[next] = component;
+                        stack.push_back(next);
+                    }
+                }
+            }
+            component++;
+        }
+    }
+    
+    unsigned sectorOf(unsigned cell) const {
+        return (cell % cellsX) / NavigationGrid::SectorCells + ((cell / cellsX) / NavigationGrid::SectorCells) * sectorsX;
+    }
+    
+    unsigned localCell(unsigned cell) const {
+        return (cell % cellsX) % NavigationGrid::SectorCells + ((cell / cellsX) % NavigationGrid::SectorCells) * NavigationGrid::SectorCells;
+    }
+    
+    unsigned sectorCell(unsigned sector, unsigned localCell) const {
+        unsigned x = (sector % sectorsX) * NavigationGrid::SectorCells + localCell % NavigationGrid::SectorCells;
+        unsigned z = (sector / sectorsX) * NavigationGrid::SectorCells + localCell / NavigationGrid::SectorCells;
+        return x + z * cellsX;
+    }
+    
+    /** the same step cost as NavigationGrid's */
+    float stepCost(unsigned from, unsigned to, bool diagonal) const {
+        float cost = 0.5f * ((float)costs[from] + (float)costs[to]);
+        return diagonal ? cost * DiagonalLength : cost;
+    }
+    
+    /**
+     The cheapest a path between two cells could cost, with every cell costing 1 and
+     diagonal steps allowed. It never overestimates, so A* stays exact.
+     */
+    float estimate(unsigned from, unsigned to) const {
+        float dx = fabsf((float)(from % cellsX) - (float)(to % cellsX));
+        float dz = fabsf((float)(from / cellsX) - (float)(to / cellsX));
+        return std::max(dx, dz) + (DiagonalLength - 1.0f) * std::min(dx, dz);
+    }
+    
+    /** the cell under a world position, clamped onto the grid */
+    unsigned cellAt(const glm::vec2& position) const {
+        glm::vec2 cell = glm::clamp(glm::floor((position - origin) / cellSize), glm::vec2(0.0f), glm::vec2(cellsX - 1, cellsZ - 1));
+        return (unsigned)cell.x + (unsigned)cell.y * cellsX;
+    }
+    
+    glm::vec2 cellCenter(unsigned cell) const {
+        return origin + (glm::vec2(cell % cellsX, cell / cellsX) + 0.5f) * cellSize;
+    }
+};
+
+namespace {
+    /**
+     The open list of an A* search: a binary heap of node numbers, cheapest estimated total
+     first. The nodes' records live in a pool that's kept for the next search, and records
+     left over from an earlier search are told apart by a stamp, so starting a search
+     doesn't clear or allocate anything.
+     */
+    class OpenList {
+    public:
+        OpenList() : _stamp(0) {}
+        
+        /** starts a search over nodes numbered below `nodeCount` */
+        void reset(size_t nodeCount) {
+            if (_nodes.size() < nodeCount)
+                _nodes.resize(nodeCount);
+            _heap.clear();
+            if (++_stamp == 0) {
+                for (size_t i=0; i<_nodes.size(); i++)
+                    _nodes[i].stamp = 0;
+                _stamp = 1;
+            }
+        }
+        
+        bool empty() const {
+            return _heap.empty();
+        }
+        
+        /** the cheapest cost found to the node so far */
+        float cost(unsigned node) const {
+            return _nodes[node].stamp == _stamp ? _nodes[node].cost : Unreachable;
+        }
+        
+        unsigned parent(unsigned node) const {
+            return _nodes[node].parent;
+        }
+        
+        /**
+         Opens the node if `cost` is cheaper than any way to it found so far
+         
+         @param estimate  the least it could cost to get from the node to the goal
+         */
+        void relax(unsigned node, float cost, float estimate, unsigned parent) {
+            Node& record = _nodes[node];
+            if (record.stamp != _stamp) {
+                record.stamp = _stamp;
+                record.heapIndex = NoNode;
+            } else if (cost >= record.cost) {
+                return;
+            }
+            record.cost = cost;
+            record.priority = cost + estimate;
+            record.parent = parent;
+            if (record.heapIndex == NoNode) {
+                record.heapIndex = (unsigned)_heap.size();
+                _heap.push_back(node);
+            }
+            _siftUp(record.heapIndex);
+        }
+        
+        /** takes the node with the cheapest estimated total off the heap */
+        unsigned pop() {
+            unsigned top = _heap[0];
+            _nodes[top].heapIndex = NoNode;
+            unsigned last = _heap.back();
+            _heap.pop_back();
+            if (!_heap.empty()) {
+                _heap[0] = last;
+                _nodes[last].heapIndex = 0;
+                _siftDown(0);
+            }
+            return top;
+        }
+    
+    private:
+        struct Node {
+            float cost;
+            float priority;
+            unsigned parent;
+            unsigned heapIndex;
+            unsigned stamp;
+            
+            Node() : cost(0.0f), priority(0.0f), parent(NoNode), heapIndex(NoNode), stamp(0) {}
+        };
+        
+        std::vector<Node> _nodes;
+        std::vector<unsigned> _heap;
+        unsigned _stamp;
+        
+        void _place(unsigned index, unsigned node) {
+            _heap[index] = node;
+            _nodes[node].heapIndex = index;
+        }
+        
+        void _siftUp(unsigned index) {
+            unsigned node = _heap[index];
+            float priority = _nodes[node].priority;
+            while (index > 0) {
+                unsigned parent = (index - 1) / 2;
+                if (_nodes[_heap[parent]].priority <= priority)
+                    break;
+                _place(index, _heap[parent]);
+                index = parent;
+            }
+            _place(index, node);
+        }
+        
+        void _siftDown(unsigned index) {
+            unsigned node = _heap[index];
+            float priority = _nodes[node].priority;
+            unsigned count = (unsigned)_heap.size();
+            while (true) {
+                unsigned child = 2 * index + 1;
+                if (child >= count)
+                    break;
+                if (child + 1 < count && _nodes[_heap[child + 1]].priority < _nodes[_heap[child]].priority)
+                    child++;
+                if (_nodes[_heap[child]].priority >= priority)
+                    break;
+                _place(index, _heap[child]);
+                index = child;
+            }
+            _place(index, node);
+        }
+    };
+}
+
+/**
+ The working memory of one thread's searches
+ */
+class PathFinder::Search {
+public:
+    Search() : _nodesExpanded(0) {}
+    
+    Path find(const Snapshot& snapshot, const glm::vec2& start, const glm::vec2& goal) {
+        Path path;
+        path.request = 0;
+        path.found = false;
+        path.cost = 0.0f;
+        _nodesExpanded = 0;
+        
+        unsigned startCell = snapshot.cellAt(start);
+        unsigned goalCell = snapshot.cellAt(goal);
+        if (snapshot.costs[startCell] == NavigationGrid::Blocked || snapshot.costs[goalCell] == NavigationGrid::Blocked)
+            return path;
+        
+        std::vector<unsigned> entrances;
+        if (!_searchEntrances(snapshot, startCell, goalCell, entrances, path.cost))
+            return path;
+        
+        // turn each leg into cells. a leg is either a step over a border between the two
+        // sides of an entrance, or a search inside one sector.
+        _cells.clear();
+        unsigned cell = startCell;
+        for (size_t i=0; i<entrances.size(); i++) {
+            const NavigationGrid::Entrance& entrance = snapshot.entrances[entrances[i]];
+            if (i > 0 && snapshot.entrances[entrances[i - 1]].opposite == entrances[i])
+                _cells.push_back(entrance.center);
+            else if (!_searchSector(snapshot, entrance.sector, cell, entrance.center, NULL))
+                return path;
+            cell = entrance.center;
+        }
+        if (!_searchSector(snapshot, snapshot.sectorOf(goalCell), cell, goalCell, NULL))
+            return path;
+        
+        // only the corners are kept
+        for (size_t i=0; i + 1 < _cells.size(); i++) {
+            unsigned before = i == 0 ? startCell : _cells[i - 1];
+            if (_cells[i] - before != _cells[i + 1] - _cells[i])
+                path.waypoints.push_back(snapshot.cellCenter(_cells[i]));
+        }
+        path.waypoints.push_back(goal);
+        path.found = true;
+        return path;
+    }
+    
+    /** @result the entrances and cells the last find() looked at */
+    unsigned nodesExpanded() const {
+        return _nodesExpanded;
+    }
+
+private:
+    OpenList _abstract;
+    OpenList _local;
+    std::vector<unsigned> _cells;
+    std::vector<unsigned> _goalComponents;
+    float _startCosts[SectorCellCount];
+    float _goalCosts[SectorCellCount];
+    unsigned _nodesExpanded;
+    
+    /**
+     A* over the entrances. The start reaches the entrances of its sector, and the goal can
+     be reached from the entrances of its own, at the costs of searches inside those sectors.
+     The goal is one more node after the entrances.
+     
+     @param entrances  receives the entrances the path goes through, in order
+     */
+    bool _searchEntrances(const Snapshot& snapshot, unsigned startCell, unsigned goalCell, std::vector<unsigned>& entrances, float& cost) {
+        unsigned startSector = snapshot.sectorOf(startCell);
+        unsigned goalSector = snapshot.sectorOf(goalCell);
+        _searchSector(snapshot, startSector, startCell, NoNode, _startCosts);
+        _searchSector(snapshot, goalSector, goalCell, NoNode, _goalCosts);
+        
+        // the groups of entrances the goal can be reached from. if the start can't reach
+        // any of them, searching the whole of its group would be for nothing.
+        const NavigationGrid::Sector& last = snapshot.sectors[goalSector];
+        _goalComponents.clear();
+        for (size_t i=0; i<last.entrances.size(); i++) {
+            if (_goalCosts[snapshot.localCell(snapshot.entrances[last.entrances[i]].center)] < Unreachable)
+                _goalComponents.push_back(snapshot.components[last.entrances[i]]);
+        }
+        
+        unsigned goalNode = (unsigned)snapshot.entrances.size();
+        _abstract.reset(goalNode + 1);
+        const NavigationGrid::Sector& first = snapshot.sectors[startSector];
+        for (size_t i=0; i<first.entrances.size(); i++) {
+            unsigned center = snapshot.entrances[first.entrances[i]].center;
+            float startCost = _startCosts[snapshot.localCell(center)];
+            unsigned component = snapshot.components[first.entrances[i]];
+            if (startCost < Unreachable && std::find(_goalComponents.begin(), _goalComponents.end(), component) != _goalComponents.end())
+                _abstract.relax(first.entrances[i], startCost, snapshot.estimate(center, goalCell), NoNode);
+        }
+        if (startSector == goalSector && _startCosts[snapshot.localCell(goalCell)] < Unreachable)
+            _abstract.relax(goalNode, _startCosts[snapshot.localCell(goalCell)], 0.0f, NoNode);
+        
+        while (!_abstract.empty()) {
+            unsigned node = _abstract.pop();
+            _nodesExpanded++;
+            if (node == goalNode)
+                break;
+            
+            float nodeCost = _abstract.cost(node);
+            const NavigationGrid::Entrance& entrance = snapshot.entrances[node];
+            const NavigationGrid::Entrance& opposite = snapshot.entrances[entrance.opposite];
+            _abstract.relax(entrance.opposite, nodeCost + snapshot.stepCost(entrance.center, opposite.center, false),
+                            snapshot.estimate(opposite.center, goalCell), node);
+            
+            const NavigationGrid::Sector& sector = snapshot.sectors[entrance.sector];
+            size_t count = sector.entrances.size();
+            const float* paths = &sector.paths[entrance.slot * count];
+            for (size_t i=0; i<count; i++) {
+                if (paths[i] < Unreachable) {
+                    unsigned next = sector.entrances[i];
+                    _abstract.relax(next, nodeCost + paths[i], snapshot.estimate(snapshot.entrances[next].center, goalCell), node);
+                }
+            }
+            
+            if (entrance.sector == goalSector) {
+                float goalCost = _goalCosts[snapshot.localCell(entrance.center)];
+                if (goalCost < Unreachable)
+                    _abstract.relax(goalNode, nodeCost + goalCost, 0.0f, node);
+            }
+        }
+        
+        cost = _abstract.cost(goalNode);
+        if (cost == Unreachable)
+            return false;
+        entrances.clear();
+        for (unsigned node=_abstract.parent(goalNode); node!=NoNode; node=_abstract.parent(node))
+            entrances.push_back(node);
+        std::reverse(entrances.begin(), entrances.end());
+        return true;
+    }
+    
+    /**
+     A* between two cells of a sector, without leaving it, appending the cells after `from`
+     up to and including `to` to _cells. With `to` set to NoNode it's Dijkstra's algorithm
+     instead, filling `costs` with the cost from `from` to every cell of the sector.
+     */
+    bool _searchSector(const Snapshot& snapshot, unsigned sector, unsigned from, unsigned to, float* costs) {
+        if (from == to)
+            return true;
+        
+        const int sectorCells = NavigationGrid::SectorCells;
+        _local.reset(SectorCellCount);
+        unsigned fromLocal = snapshot.localCell(from);
+        unsigned toLocal = to == NoNode ? NoNode : snapshot.localCell(to);
+        _local.relax(fromLocal, 0.0f, to == NoNode ? 0.0f : snapshot.estimate(from, to), NoNode);
+        
+        while (!_local.empty()) {
+            unsigned local = _local.pop();
+            _nodesExpanded++;
+            if (local == toLocal)
+                break;
+            
+            float localCost = _local.cost(local);
+            int x = local % sectorCells, z = local / sectorCells;
+            unsigned cell = snapshot.sectorCell(sector, local);
+            for (int step=0; step<8; step++) {
+                int nx = x + StepX[step], nz = z + StepZ[step];
+                if (nx < 0 || nz < 0 || nx >= sectorCells || nz >= sectorCells)
+                    continue;
+                unsigned next = cell + StepX[step] + StepZ[step] * (int)snapshot.cellsX;
+                if (snapshot.costs[next] == NavigationGrid::Blocked)
+                    continue;
+                bool diagonal = step % 2 == 1;
+                if (diagonal && (snapshot.costs[cell + StepX[step]] == NavigationGrid::Blocked ||
+                                 snapshot.costs[cell + StepZ[step] * (int)snapshot.cellsX] == NavigationGrid::Blocked))
+                    continue;
+                _local.relax(nx + nz * sectorCells, localCost + snapshot.stepCost(cell, next, diagonal),
+                             to == NoNode ? 0.0f : snapshot.estimate(next, to), local);
+            }
+        }
+        
+        if (to == NoNode) {
+            for (unsigned local=0; local<SectorCellCount; local++)
+                costs[local] = _local.cost(local);
+            return true;
+        }
+        if (_local.cost(toLocal) == Unreachable)
+            return false;
+        
+        size_t end = _cells.size();
+        for (unsigned local=toLocal; local!=fromLocal; local=_local.parent(local))
+            _cells.push_back(snapshot.sectorCell(sector, local));
+        std::reverse(_cells.begin() + end, _cells.end());
+        return true;
+    }
+};
+
+PathFinder::PathFinder(const NavigationGrid& grid, unsigned threadCount) :
+    _grid(grid),
+    _snapshotVersion(0),
+    _search(new Search()),
+    _nextRequest(1),
+    _searchCount(0),
+    _totalSearchMilliseconds(0.0),
+    _totalNodesExpanded(0.0),
+    _stopping(false)
+{
+    assert(threadCount > 0);
+    _stats.pendingRequests = 0;
+    _stats.pathsFound = 0;
+    _stats.pathsFailed = 0;
+    _stats.averageSearchMilliseconds = 0.0;
+    _stats.averageNodesExpanded = 0.0;
+    
+    _takeSnapshot();
+    for (unsigned i=0; i<threadCount; i++)
+        _threads.push_back(std::thread(&PathFinder::_threadMain, this));
+}
+
+PathFinder::~PathFinder() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _queueChanged.notify_all();
+    for (size_t i=0; i<_threads.size(); i++)
+        _threads[i].join();
+}
+
+unsigned PathFinder::requestPath(const glm::vec2& start, const glm::vec2& goal, const Callback& callback) {
+    Request request;
+    request.start = start;
+    request.goal = goal;
+    request.callback = callback;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        request.id = _nextRequest++;
+        if (_nextRequest == 0)
+            _nextRequest = 1;
+        _queue.push_back(request);
+    }
+    _queueChanged.notify_one();
+    return request.id;
+}
+
+void PathFinder::cancel(unsigned request) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i=0; i<_queue.size(); i++) {
+        if (_queue[i].id == request) {
+            _queue.erase(_queue.begin() + i);
+            return;
+        }
+    }
+    for (size_t i=0; i<_finished.size(); i++) {
+        if (_finished[i].path.request == request) {
+            _finished.erase(_finished.begin() + i);
+            return;
+        }
+    }
+    if (std::find(_searching.begin(), _searching.end(), request) != _searching.end())
+        _cancelled.push_back(request);
+}
+
+void PathFinder::update() {
+    PROFILE_ZONE("PathFinder::update");
+    if (_grid.version() != _snapshotVersion)
+        _takeSnapshot();
+    
+    std::vector<Result> finished;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        finished.swap(_finished);
+        _stats.pendingRequests = (unsigned)(_queue.size() + _searching.size());
+        _stats.averageSearchMilliseconds = _searchCount > 0 ? _totalSearchMilliseconds / _searchCount : 0.0;
+        _stats.averageNodesExpanded = _searchCount > 0 ? _totalNodesExpanded / _searchCount : 0.0;
+    }
+    
+    // outside the lock, so the callbacks can ask for more paths
+    for (size_t i=0; i<finished.size(); i++) {
+        if (finished[i].path.found)
+            _stats.pathsFound++;
+        else
+            _stats.pathsFailed++;
+        finished[i].callback(finished[i].path);
+    }
+}
+
+PathFinder::Path PathFinder::findPath(const glm::vec2& start, const glm::vec2& goal) {
+    Clock::time_point begin = Clock::now();
+    // only update() replaces the snapshot, and it's on this thread too
+    Path path = _search->find(*_snapshot, start, goal);
+    double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    if (path.found)
+        _stats.pathsFound++;
+    else
+        _stats.pathsFailed++;
+    
+    std::lock_guard<std::mutex> lock(_mutex);
+    _searchCount++;
+    _totalSearchMilliseconds += milliseconds;
+    _totalNodesExpanded += _search->nodesExpanded();
+    _stats.averageSearchMilliseconds = _totalSearchMilliseconds / _searchCount;
+    _stats.averageNodesExpanded = _totalNodesExpanded / _searchCount;
+    return path;
+}
+
+const PathFinder::Stats& PathFinder::stats() const {
+    return _stats;
+}
+
+void PathFinder::_threadMain() {
+    Profiler::shared().setThreadName("Path finder");
+    Search search;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _queueChanged.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+        if (_stopping)
+            return;
+        
+        Request request = _queue.front();
+        _queue.pop_front();
+        _searching.push_back(request.id);
+        std::shared_ptr<const Snapshot> snapshot = _snapshot;
+        lock.unlock();
+        
+        Clock::time_point start = Clock::now();
+        Result result;
+        {
+            PROFILE_ZONE("PathFinder search");
+            result.path = search.find(*snapshot, request.start, request.goal);
+        }
+        result.path.request = request.id;
+        result.callback = request.callback;
+        double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        
+        lock.lock();
+        _searching.erase(std::find(_searching.begin(), _searching.end(), request.id));
+        std::vector<unsigned>::iterator cancelled = std::find(_cancelled.begin(), _cancelled.end(), request.id);
+        if (cancelled != _cancelled.end())
+            _cancelled.erase(cancelled);
+        else
+            _finished.push_back(result);
+        _searchCount++;
+        _totalSearchMilliseconds += milliseconds;
+        _totalNodesExpanded += search.nodesExpanded();
+    }
+}
+
+void PathFinder::_takeSnapshot() {
+    std::shared_ptr<Snapshot> snapshot(new Snapshot());
+    snapshot->origin = _grid._origin;
+    snapshot->cellSize = _grid._cellSize;
+    snapshot->cellsX = _grid._cellsX;
+    snapshot->cellsZ = _grid._cellsZ;
+    snapshot->sectorsX = _grid._sectorsX;
+    snapshot->costs = _grid._costs;
+    snapshot->sectors = _grid._sectors;
+    snapshot->entrances = _grid._entrances;
+    snapshot->findComponents();
+    _snapshotVersion = _grid.version();
+    
+    std::lock_guard<std::mutex> lock(_mutex);
+    _snapshot = snapshot;
+}
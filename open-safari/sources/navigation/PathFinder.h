@@ -0,0 +1,153 @@
+//
+//  PathFinder.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/8/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__PathFinder__
+#define __open_safari__PathFinder__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include "navigation/NavigationGrid.h"
+
+/**
+ Finds paths for single animals across a NavigationGrid with hierarchical A* (HPA*).
+ 
+ The search runs over the grid's sector entrances and the paths between them, which the
+ grid already keeps for its flow fields. The start and goal are joined to the entrances of
+ their own sectors with a search inside each sector, then A* finds the cheapest way through
+ the entrances, and each leg of that is turned into cells with an A* inside one sector. No
+ search ever looks at more than a sector's worth of cells at once, however long the path.
+ The open lists are binary heaps over node records that are kept from one search to the
+ next, so a search doesn't allocate once the path finder has warmed up.
+ 
+ Requests are queued and searched on background threads, and the finished paths are handed
+ to their callbacks in update(), on the thread that calls it. Asking for a path never waits
+ on a search. The threads search a copy of the grid, which update() takes again whenever
+ the grid's version changes, so the grid can change while paths are being found.
+ */
+class PathFinder {
+public:
+    struct Path {
+        /** the number requestPath() returned */
+        unsigned request;
+        bool found;
+        /** the corners of the path after the start, ending at the goal */
+        std::vector<glm::vec2> waypoints;
+        /** the sum of the grid costs along the path */
+        float cost;
+    };
+    
+    /**
+     @param path  the path, or found == false if the goal can't be reached
+     */
+    typedef std::function<void(const Path& path)> Callback;
+    
+    struct Stats {
+        /** requests waiting for a thread or being searched */
+        unsigned pendingRequests;
+        /** totals since the path finder was created */
+        unsigned pathsFound;
+        unsigned pathsFailed;
+        double averageSearchMilliseconds;
+        /** the entrances and cells the searches have looked at, on average */
+        double averageNodesExpanded;
+    };
+    
+    /**
+     @param grid         the grid to find paths across, which must outlive the path finder
+     @param threadCount  the number of background threads that search
+     */
+    PathFinder(const NavigationGrid& grid, unsigned threadCount = 1);
+    
+    /**
+     Stops the threads, dropping the requests that haven't been searched
+     */
+    ~PathFinder();
+    
+    /**
+     Queues a search for a path between two world positions, x and z. Positions off the grid
+     are moved onto its edge.
+     
+     @param callback  called from update() with the path once it's found
+     
+     @result a number for the request, never zero
+     */
+    unsigned requestPath(const glm::vec2& start, const glm::vec2& goal, const Callback& callback);
+    
+    /**
+     Makes sure the request's callback is never called
+     */
+    void cancel(unsigned request);
+    
+    /**
+     Takes a new copy of the grid if it has changed, then calls the callbacks of the paths
+     found since the last call. Call once per frame, after the grid's update().
+     */
+    void update();
+    
+    /**
+     Finds a path right away, on the calling thread, across the copy of the grid the
+     background threads are using
+     */
+    Path findPath(const glm::vec2& start, const glm::vec2& goal);
+    
+    const Stats& stats() const;
+
+private:
+    struct Snapshot;
+    class Search;
+    
+    struct Request {
+        unsigned id;
+        glm::vec2 start;
+        glm::vec2 goal;
+        Callback callback;
+    };
+    
+    struct Result {
+        Path path;
+        Callback callback;
+    };
+    
+    const NavigationGrid& _grid;
+    unsigned _snapshotVersion;
+    /** for findPath(), on the main thread */
+    std::unique_ptr<Search> _search;
+    Stats _stats;
+    
+    // shared with the threads
+    std::mutex _mutex;
+    std::condition_variable _queueChanged;
+    std::shared_ptr<const Snapshot> _snapshot;
+    std::deque<Request> _queue;
+    std::vector<Result> _finished;
+    /** the requests the threads are searching right now */
+    std::vector<unsigned> _searching;
+    /** requests cancelled while they were being searched */
+    std::vector<unsigned> _cancelled;
+    unsigned _nextRequest;
+    unsigned _searchCount;
+    double _totalSearchMilliseconds;
+    double _totalNodesExpanded;
+    bool _stopping;
+    std::vector<std::thread> _threads;
+    
+    void _threadMain();
+    void _takeSnapshot();
+    
+    // copying disabled
+    PathFinder(const PathFinder&);
+    const PathFinder& operator=(const PathFinder&);
+};
+
+#endif /* defined(__open_safari__PathFinder__) */
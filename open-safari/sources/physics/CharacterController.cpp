@@ -0,0 +1,374 @@
+//
+//  CharacterController.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/13/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include "CharacterController.h"
+#include "ClosestPoints.h"
+#include <algorithm>
+#include <cassert>
+
+namespace {
+    /** how many times a sweep moves the capsule closer to a triangle before calling it a hit */
+    const int MaxSweepIterations = 16;
+    /** a sweep hits when the capsule gets this close */
+    const float SweepTolerance = 0.001f;
+    /** hits this close together along a sweep count as at the same time */
+    const float SweepTie = 0.0001f;
+    /** how many times a move slides along what it hits */
+    const int MaxSlides = 4;
+    /** moves shorter than this aren't worth sweeping */
+    const float MinMotion = 0.0001f;
+    /** how many times the capsule is pushed out of what it's overlapping at the start of a step */
+    const int MaxDepenetrations = 4;
+    
+    /** @result whether segment pq passes through the triangle, and where */
+    bool SegmentCrossesTriangle(const glm::vec3& p, const glm::vec3& q, const Triangle& triangle, glm::vec3* point) {
+        glm::vec3 normal = glm::cross(triangle.b - triangle.a, triangle.c - triangle.a);
+        float distanceP = glm::dot(p - triangle.a, normal);
+        float distanceQ = glm::dot(q - triangle.a, normal);
+        if ((distanceP > 0.0f && distanceQ > 0.0f) || (distanceP < 0.0f && distanceQ < 0.0f) || distanceP == distanceQ)
+            return false;
+        
+        glm::vec3 crossing = p + (q - p) * (distanceP / (distanceP - distanceQ));
+        if (glm::dot(glm::cross(triangle.b - triangle.a, crossing - triangle.a), normal) < 0.0f ||
+            glm::dot(glm::cross(triangle.c - triangle.b, crossing - triangle.b), normal) < 0.0f ||
+            glm::dot(glm::cross(triangle.a - triangle.c, crossing - triangle.c), normal) < 0.0f)
+            return false;
+        *point = crossing;
+        return true;
+    }
+    
+    /**
+     @result the distance between segment pq and the triangle, with the closest points on
+             each
+     */
+    float SegmentTriangleDistance(const glm::vec3& p, const glm::vec3& q, const Triangle& triangle,
+                                  glm::vec3* onSegment, glm::vec3* onTriangle) {
+        glm::vec3 crossing;
+        if (SegmentCrossesTriangle(p, q, triangle, &crossing)) {
+            *onSegment = *onTriangle = crossing;
+            return 0.0f;
+        }
+        
+        // otherwise the closest points are at an end of the segment or on an edge
+        float best = -1.0f;
+        const glm::vec3 ends[2] = { p, q };
+        for (int i=0; i<2; i++) {
+            glm::vec3 closest = ClosestPointOnTriangle(ends[i], triangle);
+            float distance = glm::distance(ends[i], closest);
+            if (best < 0.0f || distance < best) {
+                best = distance;
+                *onSegment = ends[i];
+                *onTriangle = closest;
+            }
+        }
+        const glm::vec3* corners[3] = { &triangle.a, &triangle.b, &triangle.c };
+        for (int i=0; i<3; i++) {
+            glm::vec3 closestSegment, closestEdge;
+            ClosestPointsOnSegments(p, q, *corners[i], *corners[(i + 1) % 3], &closestSegment, &closestEdge);
+            float distance = glm::distance(closestSegment, closestEdge);
+            if (distance < best) {
+                best = distance;
+                *onSegment = closestSegment;
+                *onTriangle = closestEdge;
+            }
+        }
+        return best;
+    }
+    
+    float HorizontalDistance(const glm::vec3& from, const glm::vec3& to) {
+        return glm::length(glm::vec2(to.x - from.x, to.z - from.z));
+    }
+}
+
+CharacterController::Settings CharacterController::Settings::person() {
+    Settings settings;
+    settings.radius = 0.4f;
+    settings.height = 2.0f;
+    settings.gravity = 9.8f;
+    settings.jumpSpeed = 4.0f;
+    settings.stepHeight = 0.35f;
+    settings.maxSlope = 45.0f;
+    settings.skinWidth = 0.01f;
+    settings.timeStep = 1.0f / 60.0f;
+    settings.maxSteps = 5;
+    return settings;
+}
+
+CharacterController::CharacterController(const Settings& settings) :
+    _settings(settings),
+    _position(0.0f),
+    _previousPosition(0.0f),
+    _velocity(0.0f),
+    _groundNormal(0.0f, 1.0f, 0.0f),
+    _grounded(false),
+    _accumulator(0.0f),
+    _minGroundNormalY(cosf(settings.maxSlope * (float)M_PI / 180.0f))
+{
+    assert(settings.radius > 0.0f && settings.height >= 2.0f * settings.radius);
+    assert(settings.timeStep > 0.0f && settings.maxSteps > 0);
+    _stats.steps = 0;
+    _stats.sweeps = 0;
+    _stats.triangles = 0;
+}
+
+const CharacterController::Settings& CharacterController::settings() const {
+    return _settings;
+}
+
+void CharacterController::setGeometry(const Geometry& geometry) {
+    _geometry = geometry;
+}
+
+const glm::vec3& CharacterController::position() const {
+    return _position;
+}
+
+void CharacterController::setPosition(const glm::vec3& position) {
+    _position = _previousPosition = position;
+    _grounded = false;
+    _groundNormal = glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+glm::vec3 CharacterController::interpolatedPosition() const {
+    return glm::mix(_previousPosition, _position, _accumulator / _settings.timeStep);
+}
+
+const glm::vec3& CharacterController::velocity() const {
+    return _velocity;
+}
+
+bool CharacterController::grounded() const {
+    return _grounded;
+}
+
+const glm::vec3& CharacterController::groundNormal() const {
+    return _groundNormal;
+}
+
+void CharacterController::update(float delta, const glm::vec3& walkVelocity, bool jump) {
+    _stats.steps = 0;
+    _stats.sweeps = 0;
+    _stats.triangles = 0;
+    
+    _accumulator += delta;
+    while (_accumulator >= _settings.timeStep && _stats.steps < _settings.maxSteps) {
+        _step(walkVelocity, jump);
+        _accumulator -= _settings.timeStep;
+        _stats.steps++;
+    }
+    if (_accumulator >= _settings.timeStep)
+        _accumulator = fmodf(_accumulator, _settings.timeStep);
+}
+
+const CharacterController::Stats& CharacterController::stats() const {
+    return _stats;
+}
+
+void CharacterController::_step(const glm::vec3& walkVelocity, bool jump) {
+    const float timeStep = _settings.timeStep;
+    const float radius = _settings.radius;
+    const float skin = _settings.skinWidth;
+    _previousPosition = _position;
+    glm::vec3 walk(walkVelocity.x * timeStep, 0.0f, walkVelocity.z * timeStep);
+    
+    // everything the capsule could touch this step
+    float reach = glm::length(walk) + (fabsf(_velocity.y) + _settings.gravity * timeStep) * timeStep + _settings.stepHeight + 2.0f * skin;
+    AABB bounds(_position - glm::vec3(radius + reach, reach, radius + reach),
+                _position + glm::vec3(radius + reach, _settings.height + reach, radius + reach));
+    _triangles.clear();
+    if (_geometry)
+        _geometry(bounds, _triangles);
+    _stats.triangles += (unsigned)_triangles.size();
+    _depenetrate();
+    
+    if (_grounded && jump) {
+        _velocity.y = _settings.jumpSpeed;
+        _grounded = false;
+    }
+    
+    // walk, and if a wall gets in the way see if stepping up gets over it
+    glm::vec3 walked = _position;
+    glm::vec3 surface;
+    if (_slide(walked, walk, true, &surface) && _grounded && surface.y < _minGroundNormalY && _settings.stepHeight > 0.0f) {
+        glm::vec3 stepped = _position;
+        _slide(stepped, glm::vec3(0.0f, _settings.stepHeight, 0.0f), false, NULL);
+        float raised = stepped.y - _position.y;
+        _slide(stepped, walk, true, NULL);
+        if (_probeGround(stepped, raised + 2.0f * skin, &surface) &&
+            HorizontalDistance(_position, stepped) > HorizontalDistance(_position, walked) + MinMotion)
+            walked = stepped;
+    }
+    _position = walked;
+    
+    if (_grounded) {
+        // follow the ground down slopes and steps
+        _velocity.y = 0.0f;
+        if (_probeGround(_position, _settings.stepHeight + 2.0f * skin, &surface)) {
+            _groundNormal = surface;
+        } else {
+            _grounded = false;
+            _groundNormal = glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+    } else {
+        _velocity.y -= _settings.gravity * timeStep;
+        bool landed = false;
+        if (_slide(_position, glm::vec3(0.0f, _velocity.y * timeStep, 0.0f), false, &surface)) {
+            if (_velocity.y <= 0.0f && surface.y >= _minGroundNormalY)
+                landed = true;
+            else if (_velocity.y > 0.0f && surface.y < 0.0f)
+                _velocity.y = 0.0f; // bumped our head
+        }
+        // a fall that stopped just short of the ground still lands
+        if (!landed && _velocity.y <= 0.0f && _probeGround(_position, 2.0f * skin, &surface))
+            landed = true;
+        if (landed) {
+            _grounded = true;
+            _groundNormal = surface;
+            _velocity.y = 0.0f;
+        }
+    }
+    
+    _velocity.x = (_position.x - _previousPosition.x) / timeStep;
+    _velocity.z = (_position.z - _previousPosition.z) / timeStep;
+}
+
+void CharacterController::_depenetrate() {
+    const float radius = _settings.radius;
+    for (int iteration=0; iteration<MaxDepenetrations; iteration++) {
+        bool pushed = false;
+        for (size_t i=0; i<_triangles.size(); i++) {
+            glm::vec3 bottom = _position + glm::vec3(0.0f, radius, 0.0f);
+            glm::vec3 top = _position + glm::vec3(0.0f, _settings.height - radius, 0.0f);
+            glm::vec3 onSegment, onTriangle;
+            float distance = SegmentTriangleDistance(bottom, top, _triangles[i], &onSegment, &onTriangle);
+            if (distance >= radius)
+                continue;
+            
+            glm::vec3 face = _triangles[i].normal();
+            glm::vec3 direction = distance > 1e-6f ? (onSegment - onTriangle) / distance : face;
+            // behind the triangle, where it doesn't collide
+            if (glm::dot(direction, face) < 0.0f)
+                continue;
+            _position += direction * (radius - distance);
+            pushed = true;
+        }
+        if (!pushed)
+            break;
+    }
+}
+
+bool CharacterController::_sweep(const glm::vec3& position, const glm::vec3& motion, float* fraction, glm::vec3* normal, glm::vec3* surface) {
+    float length = glm::length(motion);
+    if (length <= 0.0f)
+        return false;
+    _stats.sweeps++;
+    
+    const float radius = _settings.radius;
+    glm::vec3 bottom = position + glm::vec3(0.0f, radius, 0.0f);
+    glm::vec3 top = position + glm::vec3(0.0f, _settings.height - radius, 0.0f);
+    AABB start(bottom - glm::vec3(radius), top + glm::vec3(radius));
+    AABB swept = AABB::merge(start, AABB(start.min + motion, start.max + motion));
+    
+    bool hit = false;
+    float earliest = 1.0f;
+    for (size_t i=0; i<_triangles.size(); i++) {
+        const Triangle& triangle = _triangles[i];
+        if (!triangle.bounds().overlaps(swept))
+            continue;
+        glm::vec3 face = triangle.normal();
+        if (glm::dot(face, motion) >= 0.0f)
+            continue;
+        
+        // conservative advancement: the capsule can't get closer than the gap in less time
+        // than the gap takes to cover at full speed, so move it that far and measure again
+        float t = 0.0f;
+        glm::vec3 contact;
+        bool touching = false;
+        for (int iteration=0; iteration<MaxSweepIterations && t < earliest; iteration++) {
+            glm::vec3 onSegment, onTriangle;
+            float distance = SegmentTriangleDistance(bottom + motion * t, top + motion * t, triangle, &onSegment, &onTriangle);
+            float gap = distance - radius;
+            if (gap <= SweepTolerance || iteration == MaxSweepIterations - 1) {
+                contact = distance > 1e-6f ? (onSegment - onTriangle) / distance : face;
+                touching = true;
+                break;
+            }
+            t += gap / length;
+        }
+        
+        // touching from behind, or already moving away from where they touch
+        if (!touching || t > earliest + SweepTie || glm::dot(contact, face) < 0.0f || glm::dot(contact, motion) >= 0.0f)
+            continue;
+        // of triangles hit at once, like the two sides of an edge, the one most like ground
+        // decides whether the capsule can stand there
+        if (hit && t > earliest - SweepTie && face.y <= surface->y)
+            continue;
+        earliest = std::min(earliest, t);
+        *normal = contact;
+        *surface = face;
+        hit = true;
+    }
+    *fraction = earliest;
+    return hit;
+}
+
+bool CharacterController::_slide(glm::vec3& position, glm::vec3 motion, bool walking, glm::vec3* surface) {
+    bool hit = false;
+    glm::vec3 lastPlane(0.0f);
+    for (int slide=0; slide<MaxSlides; slide++) {
+        float length = glm::length(motion);
+        if (length < MinMotion)
+            break;
+        
+        float fraction;
+        glm::vec3 plane, face;
+        if (!_sweep(position, motion, &fraction, &plane, &face)) {
+            position += motion;
+            break;
+        }
+        hit = true;
+        if (surface)
+            *surface = face;
+        
+        // up to just short of what it hit
+        float travel = std::max(0.0f, fraction * length - _settings.skinWidth);
+        position += motion * (travel / length);
+        motion *= 1.0f - travel / length;
+        
+        // ground too steep to walk up is a wall. edges of ground that isn't are rounded
+        // off by the capsule, so it rides up over them.
+        if (walking && face.y < _minGroundNormalY) {
+            glm::vec3 flat(plane.x, 0.0f, plane.z);
+            if (glm::length(flat) > MinMotion)
+                plane = glm::normalize(flat);
+        }
+        
+        // slide along it, and along the crease if that pushes back into the last one
+        motion -= plane * glm::dot(motion, plane);
+        if (slide > 0 && glm::dot(motion, lastPlane) < 0.0f) {
+            glm::vec3 crease = glm::cross(lastPlane, plane);
+            float creaseLengthSquared = glm::dot(crease, crease);
+            motion = creaseLengthSquared > 1e-8f ? crease * (glm::dot(crease, motion) / creaseLengthSquared) : glm::vec3(0.0f);
+        }
+        lastPlane = plane;
+    }
+    return hit;
+}
+
+bool CharacterController::_probeGround(glm::vec3& position, float distance, glm::vec3* surface) {
+    float fraction;
+    glm::vec3 plane, face;
+    glm::vec3 motion(0.0f, -distance, 0.0f);
+    if (!_sweep(position, motion, &fraction, &plane, &face) || face.y < _minGroundNormalY)
+        return false;
+    position.y -= std::max(0.0f, fraction * distance - _settings.skinWidth);
+    *surface = face;
+    return true;
+}
@@ -0,0 +1,143 @@
+//
+//  CharacterController.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/13/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__CharacterController__
+#define __open_safari__CharacterController__
+
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include "scene/AABB.h"
+#include "scene/Triangle.h"
+
+/**
+ Walks an upright capsule around a world made of triangles, for the player and anyone else
+ who walks.
+ 
+ The capsule moves in fixed time steps, however long the frames are, so it jumps as high
+ and collides the same at any frame rate. update() runs as many steps as the time since the
+ last one covers, and interpolatedPosition() blends the last two for drawing in between.
+ 
+ Each step sweeps the capsule along its motion against the triangles around it, stops it
+ just short of the first one it would hit and slides it along that one with what's left of
+ the motion, a few times over. Ground that's too steep acts like a wall while walking, and
+ the capsule slides off it when it falls. When walking is blocked by something low enough,
+ the capsule tries stepping up, across and back down onto it instead. While on the ground,
+ it's kept on the ground going down slopes and steps.
+ 
+ Triangles are one sided: the capsule only collides with their fronts.
+ */
+class CharacterController {
+public:
+    /**
+     Adds the triangles of the world that could be in the box to `triangles`. Called once
+     each step. It has to be safe to call from more than one thread at once if controllers
+     are stepped in parallel.
+     */
+    typedef std::function<void(const AABB& bounds, std::vector<Triangle>& triangles)> Geometry;
+    
+    struct Settings {
+        /** the capsule, standing on its bottom. The height includes the rounded ends. */
+        float radius;
+        float height;
+        /** downward acceleration, in units per second per second */
+        float gravity;
+        /** the upward speed a jump starts with */
+        float jumpSpeed;
+        /** the highest ledge the capsule walks up onto without jumping */
+        float stepHeight;
+        /** the steepest ground, in degrees, that can be stood and walked up on */
+        float maxSlope;
+        /** the gap kept between the capsule and what it touches, so it doesn't start the
+            next sweep touching */
+        float skinWidth;
+        /** the length of a step, in seconds */
+        float timeStep;
+        /** the most steps in one update. Any more time than they cover is dropped, so a
+            long frame slows the controller down rather than taking even longer. */
+        unsigned maxSteps;
+        
+        /** a person about two meters tall */
+        static Settings person();
+    };
+    
+    struct Stats {
+        /** over the last update */
+        unsigned steps;
+        unsigned sweeps;
+        unsigned triangles;
+    };
+    
+    explicit CharacterController(const Settings& settings = Settings::person());
+    
+    const Settings& settings() const;
+    
+    /**
+     The world to collide with. Without one the capsule falls forever.
+     */
+    void setGeometry(const Geometry& geometry);
+    
+    /**
+     The bottom of the capsule, after the last step
+     */
+    const glm::vec3& position() const;
+    
+    /**
+     Moves the capsule without colliding, and forgets the last step so it isn't
+     interpolated from
+     */
+    void setPosition(const glm::vec3& position);
+    
+    /**
+     The bottom of the capsule between the last two steps, by how far the time since the
+     last step is into the next one
+     */
+    glm::vec3 interpolatedPosition() const;
+    
+    const glm::vec3& velocity() const;
+    
+    /** whether the capsule is standing on ground that isn't too steep */
+    bool grounded() const;
+    
+    /** the normal of the ground it's standing on, straight up when it isn't */
+    const glm::vec3& groundNormal() const;
+    
+    /**
+     Runs the steps the time covers
+     
+     @param delta         the seconds since the last update
+     @param walkVelocity  the speed and direction to walk in. Only x and z are used.
+     @param jump          jumps, if the capsule is on the ground
+     */
+    void update(float delta, const glm::vec3& walkVelocity, bool jump);
+    
+    const Stats& stats() const;
+
+private:
+    Settings _settings;
+    Geometry _geometry;
+    glm::vec3 _position, _previousPosition;
+    glm::vec3 _velocity;
+    glm::vec3 _groundNormal;
+    bool _grounded;
+    /** the time left over that's less than a step */
+    float _accumulator;
+    /** the cosine of the max slope, the lowest y a walkable ground normal has */
+    float _minGroundNormalY;
+    Stats _stats;
+    /** the triangles around the capsule for the step being run */
+    std::vector<Triangle> _triangles;
+    
+    void _step(const glm::vec3& walkVelocity, bool jump);
+    void _depenetrate();
+    bool _sweep(const glm::vec3& position, const glm::vec3& motion, float* fraction, glm::vec3* normal, glm::vec3* surface);
+    bool _slide(glm::vec3& position, glm::vec3 motion, bool walking, glm::vec3* surface);
+    bool _probeGround(glm::vec3& position, float distance, glm::vec3* surface);
+};
+
+#endif /* defined(__open_safari__CharacterController__) */
@@ -0,0 +1,86 @@
+//
+//  ClosestPoints.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/14/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "ClosestPoints.h"
+
+// Real-Time Collision Detection 5.1.5
+glm::vec3 ClosestPointOnTriangle(const glm::vec3& point, const Triangle& triangle) {
+    const glm::vec3& a = triangle.a;
+    const glm::vec3& b = triangle.b;
+    const glm::vec3& c = triangle.c;
+    glm::vec3 ab = b - a, ac = c - a, ap = point - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+    
+    glm::vec3 bp = point - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+    
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+    
+    glm::vec3 cp = point - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+    
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+    
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    
+    float denominator = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// Real-Time Collision Detection 5.1.9
+void ClosestPointsOnSegments(const glm::vec3& p1, const glm::vec3& q1, const glm::vec3& p2, const glm::vec3& q2,
+                             glm::vec3* closest1, glm::vec3* closest2) {
+    const float epsilon = 1e-8f;
+    glm::vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+    float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+    float s = 0.0f, t = 0.0f;
+    if (a <= epsilon && e <= epsilon) {
+        // both are points
+    } else if (a <= epsilon) {
+        t = glm::clamp(f / e, 0.0f, 1.0f);
+    } else {
+        float c = glm::dot(d1, r);
+        if (e <= epsilon) {
+            s = glm::clamp(-c / a, 0.0f, 1.0f);
+        } else {
+            float b = glm::dot(d1, d2);
+            float denominator = a * e - b * b;
+            s = denominator != 0.0f ? glm::clamp((b * f - c * e) / denominator, 0.0f, 1.0f) : 0.0f;
+            t = (b * s + f) / e;
+            if (t < 0.0f) {
+                t = 0.0f;
+                s = glm::clamp(-c / a, 0.0f, 1.0f);
+            } else if (t > 1.0f) {
+                t = 1.0f;
+                s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+            }
+        }
+    }
+    *closest1 = p1 + d1 * s;
+    *closest2 = p2 + d2 * t;
+}
+
+glm::vec3 ClosestPointOnSegment(const glm::vec3& point, const glm::vec3& p, const glm::vec3& q) {
+    glm::vec3 pq = q - p;
+    float lengthSquared = glm::dot(pq, pq);
+    if (lengthSquared <= 0.0f)
+        return p;
+    return p + pq * glm::clamp(glm::dot(point - p, pq) / lengthSquared, 0.0f, 1.0f);
+}
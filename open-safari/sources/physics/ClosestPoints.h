@@ -0,0 +1,31 @@
+//
+//  ClosestPoints.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/14/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__ClosestPoints__
+#define __open_safari__ClosestPoints__
+
+#include <glm/glm.hpp>
+#include "scene/Triangle.h"
+
+/**
+ The point on the triangle closest to `point`
+ */
+glm::vec3 ClosestPointOnTriangle(const glm::vec3& point, const Triangle& triangle);
+
+/**
+ The closest points between segments p1q1 and p2q2
+ */
+void ClosestPointsOnSegments(const glm::vec3& p1, const glm::vec3& q1, const glm::vec3& p2, const glm::vec3& q2,
+                             glm::vec3* closest1, glm::vec3* closest2);
+
+/**
+ The point on segment pq closest to `point`
+ */
+glm::vec3 ClosestPointOnSegment(const glm::vec3& point, const glm::vec3& p, const glm::vec3& q);
+
+#endif /* defined(__open_safari__ClosestPoints__) */
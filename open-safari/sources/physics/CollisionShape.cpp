@@ -0,0 +1,93 @@
+//
+//  CollisionShape.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/14/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include "CollisionShape.h"
+#include <cassert>
+
+CollisionShape CollisionShape::sphere(float radius) {
+    assert(radius > 0.0f);
+    CollisionShape shape;
+    shape.type = Sphere;
+    shape.radius = radius;
+    shape.halfHeight = 0.0f;
+    shape.halfExtents = glm::vec3(radius);
+    return shape;
+}
+
+CollisionShape CollisionShape::capsule(float radius, float halfHeight) {
+    assert(radius > 0.0f && halfHeight >= 0.0f);
+    CollisionShape shape;
+    shape.type = Capsule;
+    shape.radius = radius;
+    shape.halfHeight = halfHeight;
+    shape.halfExtents = glm::vec3(radius, halfHeight + radius, radius);
+    return shape;
+}
+
+CollisionShape CollisionShape::box(const glm::vec3& halfExtents) {
+    assert(halfExtents.x > 0.0f && halfExtents.y > 0.0f && halfExtents.z > 0.0f);
+    CollisionShape shape;
+    shape.type = Box;
+    shape.radius = 0.0f;
+    shape.halfHeight = 0.0f;
+    shape.halfExtents = halfExtents;
+    return shape;
+}
+
+AABB CollisionShape::bounds(const glm::vec3& position, const glm::mat3& rotation) const {
+    switch (type) {
+        case Sphere:
+            return AABB::fromCenterExtents(position, glm::vec3(radius));
+        case Capsule: {
+            glm::vec3 axis = glm::abs(rotation[1]) * halfHeight;
+            return AABB::fromCenterExtents(position, axis + radius);
+        }
+        case Box:
+        default: {
+            // each axis of the box reaches as far as its projection
+            glm::vec3 extents = glm::abs(rotation[0]) * halfExtents.x +
+                                glm::abs(rotation[1]) * halfExtents.y +
+                                glm::abs(rotation[2]) * halfExtents.z;
+            return AABB::fromCenterExtents(position, extents);
+        }
+    }
+}
+
+glm::vec3 CollisionShape::inertia(float mass) const {
+    switch (type) {
+        case Sphere:
+            return glm::vec3(0.4f * mass * radius * radius);
+        case Capsule: {
+            // the cylinder and the two half spheres, split by volume, with the half spheres
+            // moved out to the ends of the cylinder
+            float height = 2.0f * halfHeight;
+            float cylinderVolume = (float)M_PI * radius * radius * height;
+            float sphereVolume = 4.0f / 3.0f * (float)M_PI * radius * radius * radius;
+            float cylinderMass = mass * cylinderVolume / (cylinderVolume + sphereVolume);
+            float sphereMass = mass - cylinderMass;
+            float r2 = radius * radius;
+            float along = 0.5f * cylinderMass * r2 + 0.4f * sphereMass * r2;
+            float across = cylinderMass * (height * height / 12.0f + 0.25f * r2) +
+                           sphereMass * (0.4f * r2 + 0.25f * height * height + 0.375f * height * radius);
+            return glm::vec3(across, along, across);
+        }
+        case Box:
+        default: {
+            glm::vec3 size2 = 4.0f * halfExtents * halfExtents;
+            return mass / 12.0f * glm::vec3(size2.y + size2.z, size2.x + size2.z, size2.x + size2.y);
+        }
+    }
+}
+
+void CollisionShape::segment(const glm::vec3& position, const glm::mat3& rotation, glm::vec3* p, glm::vec3* q) const {
+    glm::vec3 axis = type == Capsule ? rotation[1] * halfHeight : glm::vec3(0.0f);
+    *p = position - axis;
+    *q = position + axis;
+}
@@ -0,0 +1,54 @@
+//
+//  CollisionShape.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/14/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__CollisionShape__
+#define __open_safari__CollisionShape__
+
+#include <glm/glm.hpp>
+#include "scene/AABB.h"
+
+/**
+ The solid shape of a rigid body, centered on the body's position and turned with it
+ */
+struct CollisionShape {
+    enum Type {
+        Sphere,
+        /** a cylinder with rounded ends, along the y axis */
+        Capsule,
+        Box
+    };
+    
+    Type type;
+    /** of the sphere, or of the capsule's cylinder and ends */
+    float radius;
+    /** half the length of the capsule's cylinder */
+    float halfHeight;
+    /** of the box */
+    glm::vec3 halfExtents;
+    
+    static CollisionShape sphere(float radius);
+    static CollisionShape capsule(float radius, float halfHeight);
+    static CollisionShape box(const glm::vec3& halfExtents);
+    
+    /**
+     The box around the shape turned by `rotation` and moved to `position`
+     */
+    AABB bounds(const glm::vec3& position, const glm::mat3& rotation) const;
+    
+    /**
+     The moments of inertia about the shape's own axes, with its mass spread evenly through it
+     */
+    glm::vec3 inertia(float mass) const;
+    
+    /**
+     The ends of the capsule's segment, turned and moved. For anything else both are the center.
+     */
+    void segment(const glm::vec3& position, const glm::mat3& rotation, glm::vec3* p, glm::vec3* q) const;
+};
+
+#endif /* defined(__open_safari__CollisionShape__) */
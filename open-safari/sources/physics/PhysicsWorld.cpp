@@ -0,0 +1,664 @@
+//
+//  PhysicsWorld.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/14/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "PhysicsWorld.h"
+#include "core/ParallelFor.h"
+#include "core/Profiler.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    typedef std::chrono::high_resolution_clock Clock;
+    
+    /** a contact this close to one from the last step between the same bodies starts from
+        its impulses */
+    const float WarmStartDistance = 0.05f;
+    
+    double MillisecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+    
+    /** two directions at right angles to the normal and each other */
+    void Tangents(const glm::vec3& normal, glm::vec3* first, glm::vec3* second) {
+        if (fabsf(normal.x) >= 0.57735f)
+            *first = glm::normalize(glm::vec3(normal.y, -normal.x, 0.0f));
+        else
+            *first = glm::normalize(glm::vec3(0.0f, normal.z, -normal.y));
+        *second = glm::cross(normal, *first);
+    }
+    
+    /** how hard it is to push the bodies apart along the direction at the contact */
+    float EffectiveMass(float inverseMassA, const glm::mat3& inverseInertiaA, const glm::vec3& offsetA,
+                        float inverseMassB, const glm::mat3& inverseInertiaB, const glm::vec3& offsetB,
+                        const glm::vec3& direction) {
+        glm::vec3 turnA = glm::cross(offsetA, direction);
+        glm::vec3 turnB = glm::cross(offsetB, direction);
+        float k = inverseMassA + inverseMassB +
+                  glm::dot(turnA, inverseInertiaA * turnA) + glm::dot(turnB, inverseInertiaB * turnB);
+        return k > 0.0f ? 1.0f / k : 0.0f;
+    }
+    
+    void ApplyImpulse(float inverseMass, const glm::mat3& inverseInertia,
+                      const glm::vec3& offset, const glm::vec3& impulse, glm::vec3* linear, glm::vec3* angular) {
+        if (inverseMass == 0.0f)
+            return;
+        *linear += impulse * inverseMass;
+        *angular += inverseInertia * glm::cross(offset, impulse);
+    }
+}
+
+PhysicsWorld::Settings PhysicsWorld::Settings::defaults() {
+    Settings settings;
+    settings.gravity = glm::vec3(0.0f, -9.8f, 0.0f);
+    settings.timeStep = 1.0f / 60.0f;
+    settings.maxSteps = 3;
+    settings.iterations = 10;
+    settings.friction = 0.6f;
+    settings.restitution = 0.2f;
+    settings.bounceSpeed = 1.0f;
+    settings.allowedPenetration = 0.01f;
+    settings.contactMargin = 0.02f;
+    settings.correction = 0.2f;
+    settings.sleepSpeed = 0.08f;
+    settings.sleepAngularSpeed = 0.1f;
+    settings.sleepDelay = 0.5f;
+    return settings;
+}
+
+PhysicsWorld::PhysicsWorld(const Settings& settings) :
+    _settings(settings),
+    _accumulator(0.0f)
+{
+    assert(settings.timeStep > 0.0f && settings.maxSteps > 0 && settings.iterations > 0);
+    _stats = Stats();
+}
+
+const PhysicsWorld::Settings& PhysicsWorld::settings() const {
+    return _settings;
+}
+
+void PhysicsWorld::setGround(const Ground& ground) {
+    _ground = ground;
+}
+
+int PhysicsWorld::addBody(const CollisionShape& shape, float mass, const glm::vec3& position, const glm::quat& orientation) {
+    assert(mass >= 0.0f);
+    int index;
+    if (_freeBodies.empty()) {
+        index = (int)_bodies.size();
+        _bodies.push_back(Body());
+    } else {
+        index = _freeBodies.back();
+        _freeBodies.pop_back();
+    }
+    
+    Body& body = _bodies[index];
+    body.shape = shape;
+    body.position = position;
+    body.orientation = glm::normalize(orientation);
+    body.linearVelocity = glm::vec3(0.0f);
+    body.angularVelocity = glm::vec3(0.0f);
+    body.stillTime = 0.0f;
+    body.awake = mass > 0.0f;
+    body.used = true;
+    body.island = NullBody;
+    _updateMass(body, mass);
+    _updateRotation(body);
+    
+    // it'll be sorted into place by the next step
+    SweepEntry entry;
+    entry.bounds = body.bounds;
+    entry.body = index;
+    _sweep.push_back(entry);
+    return index;
+}
+
+void PhysicsWorld::removeBody(int body) {
+    assert(body >= 0 && body < (int)_bodies.size() && _bodies[body].used);
+    // wake what was touching it, and forget its contacts so whatever gets its number next
+    // doesn't start from them
+    size_t kept = 0;
+    for (size_t i=0; i<_previousManifolds.size(); i++) {
+        const Manifold& manifold = _previousManifolds[i];
+        if (manifold.a == body && manifold.b != NullBody)
+            _wake(manifold.b);
+        else if (manifold.b == body)
+            _wake(manifold.a);
+        if (manifold.a != body && manifold.b != body)
+            _previousManifolds[kept++] = manifold;
+    }
+    _previousManifolds.resize(kept);
+    for (size_t i=0; i<_sweep.size(); i++) {
+        if (_sweep[i].body == body) {
+            _sweep.erase(_sweep.begin() + i);
+            break;
+        }
+    }
+    _bodies[body].used = false;
+    _bodies[body].awake = false;
+    _freeBodies.push_back(body);
+}
+
+unsigned PhysicsWorld::size() const {
+    return (unsigned)(_bodies.size() - _freeBodies.size());
+}
+
+const CollisionShape& PhysicsWorld::shape(int body) const {
+    return _bodies[body].shape;
+}
+
+const glm::vec3& PhysicsWorld::position(int body) const {
+    return _bodies[body].position;
+}
+
+const glm::quat& PhysicsWorld::orientation(int body) const {
+    return _bodies[body].orientation;
+}
+
+glm::mat4 PhysicsWorld::transform(int body) const {
+    glm::mat4 transform(_bodies[body].rotation);
+    transform[3] = glm::vec4(_bodies[body].position, 1.0f);
+    return transform;
+}
+
+const AABB& PhysicsWorld::bounds(int body) const {
+    return _bodies[body].bounds;
+}
+
+const glm::vec3& PhysicsWorld::linearVelocity(int body) const {
+    return _bodies[body].linearVelocity;
+}
+
+const glm::vec3& PhysicsWorld::angularVelocity(int body) const {
+    return _bodies[body].angularVelocity;
+}
+
+void PhysicsWorld::setVelocity(int body, const glm::vec3& linear, const glm::vec3& angular) {
+    assert(_bodies[body].inverseMass > 0.0f);
+    _bodies[body].linearVelocity = linear;
+    _bodies[body].angularVelocity = angular;
+    _wake(body);
+}
+
+void PhysicsWorld::applyImpulse(int body, const glm::vec3& impulse, const glm::vec3& point) {
+    Body& target = _bodies[body];
+    assert(target.inverseMass > 0.0f);
+    target.linearVelocity += impulse * target.inverseMass;
+    target.angularVelocity += target.inverseInertia * glm::cross(point - target.position, impulse);
+    _wake(body);
+}
+
+bool PhysicsWorld::awake(int body) const {
+    return _bodies[body].awake;
+}
+
+void PhysicsWorld::update(float delta) {
+    PROFILE_ZONE("PhysicsWorld::update");
+    _accumulator += delta;
+    _stats.steps = 0;
+    _stats.broadphaseMilliseconds = 0.0;
+    _stats.narrowphaseMilliseconds = 0.0;
+    _stats.solveMilliseconds = 0.0;
+    while (_accumulator >= _settings.timeStep && _stats.steps < _settings.maxSteps) {
+        step();
+        _accumulator -= _settings.timeStep;
+    }
+    // drop whatever the steps couldn't catch up on
+    if (_accumulator >= _settings.timeStep)
+        _accumulator = 0.0f;
+}
+
+void PhysicsWorld::step() {
+    PROFILE_ZONE("PhysicsWorld::step");
+    Clock::time_point start = Clock::now();
+    _findPairs();
+    _stats.broadphaseMilliseconds += MillisecondsSince(start);
+    
+    // the contacts of each pair, and of each awake body with the ground
+    start = Clock::now();
+    for (size_t i=0; i<_bodies.size(); i++) {
+        if (_bodies[i].awake) {
+            Manifold manifold;
+            manifold.a = (int)i;
+            manifold.b = NullBody;
+            _manifolds.push_back(manifold);
+        }
+    }
+    std::sort(_manifolds.begin(), _manifolds.end());
+    ParallelFor((unsigned)_manifolds.size(), [this](unsigned i) {
+        _collide(_manifolds[i]);
+    });
+    unsigned kept = 0, contacts = 0;
+    for (size_t i=0; i<_manifolds.size(); i++) {
+        if (_manifolds[i].count > 0) {
+            contacts += _manifolds[i].count;
+            _manifolds[kept++] = _manifolds[i];
+        }
+    }
+    _manifolds.resize(kept);
+    _stats.narrowphaseMilliseconds += MillisecondsSince(start);
+    
+    // anything asleep that something awake ran into wakes up, and gets pushed along with
+    // it, so it needs its contacts with the ground now too, or it sinks in for a step. its
+    // contacts with the rest of what's asleep are found from the next step.
+    start = Clock::now();
+    unsigned touching = (unsigned)_manifolds.size();
+    for (unsigned i=0; i<touching; i++) {
+        if (_manifolds[i].b == NullBody)
+            continue;
+        int a = _manifolds[i].a, b = _manifolds[i].b;
+        int asleep = _bodies[a].awake && !_bodies[b].awake ? b : (_bodies[b].awake && !_bodies[a].awake ? a : NullBody);
+        if (asleep == NullBody)
+            continue;
+        _wake(asleep);
+        if (_bodies[asleep].awake) {
+            Manifold manifold;
+            manifold.a = asleep;
+            manifold.b = NullBody;
+            _manifolds.push_back(manifold);
+        }
+    }
+    if (_manifolds.size() > touching) {
+        ParallelFor((unsigned)_manifolds.size() - touching, [this, touching](unsigned i) {
+            _collide(_manifolds[touching + i]);
+        });
+        kept = touching;
+        for (size_t i=touching; i<_manifolds.size(); i++) {
+            if (_manifolds[i].count > 0) {
+                contacts += _manifolds[i].count;
+                _manifolds[kept++] = _manifolds[i];
+            }
+        }
+        _manifolds.resize(kept);
+        // back in order for the next step to find its warm starts in
+        std::sort(_manifolds.begin(), _manifolds.end());
+    }
+    _findIslands();
+    ParallelFor((unsigned)_islands.size(), [this](unsigned i) {
+        _solveIsland(_islands[i]);
+    });
+    _stats.solveMilliseconds += MillisecondsSince(start);
+    
+    _stats.bodies = size();
+    _stats.awake = 0;
+    for (size_t i=0; i<_bodies.size(); i++)
+        _stats.awake += _bodies[i].awake;
+    _stats.pairs = (unsigned)_manifolds.size();
+    _stats.contacts = contacts;
+    _stats.islands = (unsigned)_islands.size();
+    _stats.threads = ParallelForThreadCount();
+    _stats.steps++;
+    
+    // kept to start the next step's contacts from
+    _previousManifolds.swap(_manifolds);
+    _manifolds.clear();
+}
+
+const PhysicsWorld::Stats& PhysicsWorld::stats() const {
+    return _stats;
+}
+
+void PhysicsWorld::_wake(int body) {
+    Body& woken = _bodies[body];
+    if (woken.inverseMass == 0.0f)
+        return;
+    woken.awake = true;
+    woken.stillTime = 0.0f;
+}
+
+void PhysicsWorld::_updateMass(Body& body, float mass) {
+    if (mass == 0.0f) {
+        body.inverseMass = 0.0f;
+        body.localInverseInertia = glm::vec3(0.0f);
+        return;
+    }
+    body.inverseMass = 1.0f / mass;
+    glm::vec3 inertia = body.shape.inertia(mass);
+    body.localInverseInertia = glm::vec3(1.0f / inertia.x, 1.0f / inertia.y, 1.0f / inertia.z);
+}
+
+void PhysicsWorld::_updateRotation(Body& body) {
+    body.rotation = glm::mat3_cast(body.orientation);
+    // R * I^-1 * R^T, with the inertia diagonal in the body's own space
+    glm::mat3 scaled(body.rotation[0] * body.localInverseInertia.x,
+                     body.rotation[1] * body.localInverseInertia.y,
+                     body.rotation[2] * body.localInverseInertia.z);
+    body.inverseInertia = scaled * glm::transpose(body.rotation);
+    body.bounds = body.shape.bounds(body.position, body.rotation);
+}
+
+void PhysicsWorld::_findPairs() {
+    // the boxes are nearly in order from the last step, so insertion sort is about linear
+    for (size_t i=0; i<_sweep.size(); i++)
+        _sweep[i].bounds = _bodies[_sweep[i].body].bounds;
+    for (size_t i=1; i<_sweep.size(); i++) {
+        SweepEntry entry = _sweep[i];
+        size_t j = i;
+        for (; j>0 && _sweep[j-1].bounds.min.x > entry.bounds.min.x; j--)
+            _sweep[j] = _sweep[j-1];
+        _sweep[j] = entry;
+    }
+    
+    // each box overlaps the ones after it that start before it ends along x, and also
+    // overlap along y and z
+    _manifolds.clear();
+    for (size_t i=0; i<_sweep.size(); i++) {
+        const SweepEntry& first = _sweep[i];
+        bool firstAwake = _bodies[first.body].awake;
+        for (size_t j=i+1; j<_sweep.size() && _sweep[j].bounds.min.x <= first.bounds.max.x; j++) {
+            const SweepEntry& second = _sweep[j];
+            if (!firstAwake && !_bodies[second.body].awake)
+                continue;
+            if (first.bounds.min.y > second.bounds.max.y || first.bounds.max.y < second.bounds.min.y ||
+                first.bounds.min.z > second.bounds.max.z || first.bounds.max.z < second.bounds.min.z)
+                continue;
+            
+            Manifold manifold;
+            manifold.a = std::min(first.body, second.body);
+            manifold.b = std::max(first.body, second.body);
+            _manifolds.push_back(manifold);
+        }
+    }
+}
+
+void PhysicsWorld::_collide(Manifold& manifold) const {
+    const Body& a = _bodies[manifold.a];
+    if (manifold.b == NullBody) {
+        manifold.count = _collideGround(a, manifold.points);
+    } else {
+        const Body& b = _bodies[manifold.b];
+        manifold.count = CollideShapes(a.shape, a.position, a.rotation, b.shape, b.position, b.rotation,
+                                       _settings.contactMargin, manifold.points);
+    }
+    
+    // start from the impulses of the contacts in the same places last step
+    std::vector<Manifold>::const_iterator previous = std::lower_bound(_previousManifolds.begin(), _previousManifolds.end(), manifold);
+    bool matched = previous != _previousManifolds.end() && previous->a == manifold.a && previous->b == manifold.b;
+    for (unsigned i=0; i<manifold.count; i++) {
+        manifold.normalImpulses[i] = 0.0f;
+        manifold.tangentImpulses[i] = glm::vec2(0.0f);
+        if (!matched)
+            continue;
+        for (unsigned j=0; j<previous->count; j++) {
+            glm::vec3 offset = previous->points[j].position - manifold.points[i].position;
+            if (glm::dot(offset, offset) < WarmStartDistance * WarmStartDistance) {
+                manifold.normalImpulses[i] = previous->normalImpulses[j];
+                manifold.tangentImpulses[i] = previous->tangentImpulses[j];
+                break;
+            }
+        }
+    }
+}
+
+unsigned PhysicsWorld::_collideGround(const Body& body, ContactPoint* contacts) const {
+    if (!_ground)
+        return 0;
+    
+    // the points of the shape that could be lowest, each tested against the ground under
+    // it, with spheres around them for spheres and capsules
+    glm::vec3 points[8];
+    unsigned pointCount;
+    float radius = body.shape.radius;
+    if (body.shape.type == CollisionShape::Box) {
+        const glm::vec3& extents = body.shape.halfExtents;
+        for (int i=0; i<8; i++) {
+            points[i] = body.position +
+                        body.rotation[0] * (i & 1 ? extents.x : -extents.x) +
+                        body.rotation[1] * (i & 2 ? extents.y : -extents.y) +
+                        body.rotation[2] * (i & 4 ? extents.z : -extents.z);
+        }
+        pointCount = 8;
+    } else {
+        body.shape.segment(body.position, body.rotation, &points[0], &points[1]);
+        pointCount = points[0] == points[1] ? 1 : 2;
+    }
+    
+    ContactPoint found[8];
+    unsigned count = 0;
+    for (unsigned i=0; i<pointCount; i++) {
+        float height;
+        glm::vec3 normal;
+        if (!_ground(points[i].x, points[i].z, &height, &normal))
+            continue;
+        float distance = glm::dot(points[i] - glm::vec3(points[i].x, height, points[i].z), normal) - radius;
+        if (distance >= _settings.contactMargin)
+            continue;
+        ContactPoint& contact = found[count++];
+        contact.depth = -distance;
+        contact.normal = -normal;
+        contact.position = points[i] - normal * (radius - 0.5f * contact.depth);
+    }
+    count = ReduceContactPoints(found, count);
+    for (unsigned i=0; i<count; i++)
+        contacts[i] = found[i];
+    return count;
+}
+
+int PhysicsWorld::_findIsland(int body) {
+    while (_bodies[body].island != body) {
+        _bodies[body].island = _bodies[_bodies[body].island].island;
+        body = _bodies[body].island;
+    }
+    return body;
+}
+
+void PhysicsWorld::_findIslands() {
+    // join the awake bodies touching each other, the bodies without mass don't join anything
+    for (size_t i=0; i<_bodies.size(); i++)
+        _bodies[i].island = _bodies[i].awake ? (int)i : NullBody;
+    for (size_t i=0; i<_manifolds.size(); i++) {
+        const Manifold& manifold = _manifolds[i];
+        if (manifold.b == NullBody || !_bodies[manifold.a].awake || !_bodies[manifold.b].awake)
+            continue;
+        int first = _findIsland(manifold.a);
+        int second = _findIsland(manifold.b);
+        if (first != second)
+            _bodies[std::max(first, second)].island = std::min(first, second);
+    }
+    
+    // number the islands by their first body, which is their root, since roots are the
+    // lowest numbered in each
+    _islands.clear();
+    for (size_t i=0; i<_bodies.size(); i++) {
+        Body& body = _bodies[i];
+        if (!body.awake)
+            continue;
+        if (body.island == (int)i) {
+            Island island = { 0, 0, 0, 0, 0 };
+            body.island = (int)_islands.size();
+            _islands.push_back(island);
+        } else {
+            // its parent has a lower number, so it's already been given its island's
+            body.island = _bodies[body.island].island;
+        }
+        _islands[body.island].bodyCount++;
+    }
+    
+    // then lay out each one's bodies, manifolds and constraints one after another
+    for (size_t i=0; i<_manifolds.size(); i++) {
+        const Manifold& manifold = _manifolds[i];
+        int owner = _bodies[manifold.a].awake ? manifold.a : manifold.b;
+        _islands[_bodies[owner].island].manifoldCount++;
+        _islands[_bodies[owner].island].firstConstraint += manifold.count;
+    }
+    unsigned bodies = 0, manifolds = 0, constraints = 0;
+    for (size_t i=0; i<_islands.size(); i++) {
+        Island& island = _islands[i];
+        unsigned constraintCount = island.firstConstraint;
+        island.firstBody = bodies;
+        island.firstManifold = manifolds;
+        island.firstConstraint = constraints;
+        bodies += island.bodyCount;
+        manifolds += island.manifoldCount;
+        constraints += constraintCount;
+        island.bodyCount = 0;
+        island.manifoldCount = 0;
+    }
+    _islandBodies.resize(bodies);
+    _islandManifolds.resize(manifolds);
+    _constraints.resize(constraints);
+    for (size_t i=0; i<_bodies.size(); i++) {
+        if (_bodies[i].awake) {
+            Island& island = _islands[_bodies[i].island];
+            _islandBodies[island.firstBody + island.bodyCount++] = (int)i;
+        }
+    }
+    for (size_t i=0; i<_manifolds.size(); i++) {
+        const Manifold& manifold = _manifolds[i];
+        int owner = _bodies[manifold.a].awake ? manifold.a : manifold.b;
+        Island& island = _islands[_bodies[owner].island];
+        _islandManifolds[island.firstManifold + island.manifoldCount++] = (unsigned)i;
+    }
+}
+
+void PhysicsWorld::_solveIsland(const Island& island) {
+    const float timeStep = _settings.timeStep;
+    // the ground's velocities, which nothing changes since it has no mass
+    glm::vec3 groundLinear(0.0f), groundAngular(0.0f);
+    const glm::mat3 noInertia(0.0f);
+    
+    for (unsigned i=0; i<island.bodyCount; i++) {
+        Body& body = _bodies[_islandBodies[island.firstBody + i]];
+        body.linearVelocity += _settings.gravity * timeStep;
+    }
+    
+    // set up each contact, with the speeds the bodies hit at before anything pushes them,
+    // and then push with last step's impulses to start off close
+    Constraint* constraints = _constraints.empty() ? NULL : &_constraints[0] + island.firstConstraint;
+    unsigned constraintCount = 0;
+    for (unsigned m=0; m<island.manifoldCount; m++) {
+        const Manifold& manifold = _manifolds[_islandManifolds[island.firstManifold + m]];
+        Body& a = _bodies[manifold.a];
+        Body* b = manifold.b == NullBody ? NULL : &_bodies[manifold.b];
+        for (unsigned p=0; p<manifold.count; p++) {
+            const ContactPoint& point = manifold.points[p];
+            Constraint& constraint = constraints[constraintCount++];
+            constraint.linearA = &a.linearVelocity;
+            constraint.angularA = &a.angularVelocity;
+            constraint.inverseMassA = a.awake ? a.inverseMass : 0.0f;
+            constraint.inverseInertiaA = a.awake ? a.inverseInertia : noInertia;
+            constraint.offsetA = point.position - a.position;
+            if (b) {
+                constraint.linearB = &b->linearVelocity;
+                constraint.angularB = &b->angularVelocity;
+                constraint.inverseMassB = b->awake ? b->inverseMass : 0.0f;
+                constraint.inverseInertiaB = b->awake ? b->inverseInertia : noInertia;
+                constraint.offsetB = point.position - b->position;
+            } else {
+                constraint.linearB = &groundLinear;
+                constraint.angularB = &groundAngular;
+                constraint.inverseMassB = 0.0f;
+                constraint.inverseInertiaB = noInertia;
+                constraint.offsetB = glm::vec3(0.0f);
+            }
+            constraint.normal = point.normal;
+            Tangents(point.normal, &constraint.tangents[0], &constraint.tangents[1]);
+            constraint.normalMass = EffectiveMass(constraint.inverseMassA, constraint.inverseInertiaA, constraint.offsetA,
+                                                  constraint.inverseMassB, constraint.inverseInertiaB, constraint.offsetB,
+                                                  constraint.normal);
+            for (int t=0; t<2; t++) {
+                constraint.tangentMasses[t] = EffectiveMass(constraint.inverseMassA, constraint.inverseInertiaA, constraint.offsetA,
+                                                            constraint.inverseMassB, constraint.inverseInertiaB, constraint.offsetB,
+                                                            constraint.tangents[t]);
+            }
+            
+            glm::vec3 relative = *constraint.linearB + glm::cross(*constraint.angularB, constraint.offsetB) -
+                                 *constraint.linearA - glm::cross(*constraint.angularA, constraint.offsetA);
+            float approach = glm::dot(relative, constraint.normal);
+            // bodies that are still apart can close the gap in this step but no more
+            if (point.depth < 0.0f)
+                constraint.bias = point.depth / timeStep;
+            else
+                constraint.bias = _settings.correction / timeStep * std::max(point.depth - _settings.allowedPenetration, 0.0f);
+            if (approach < -_settings.bounceSpeed)
+                constraint.bias = std::max(constraint.bias, -_settings.restitution * approach);
+            
+            constraint.normalImpulse = manifold.normalImpulses[p];
+            constraint.tangentImpulse = manifold.tangentImpulses[p];
+        }
+    }
+    for (unsigned c=0; c<constraintCount; c++) {
+        const Constraint& constraint = constraints[c];
+        glm::vec3 impulse = constraint.normal * constraint.normalImpulse +
+                            constraint.tangents[0] * constraint.tangentImpulse.x +
+                            constraint.tangents[1] * constraint.tangentImpulse.y;
+        ApplyImpulse(constraint.inverseMassA, constraint.inverseInertiaA, constraint.offsetA, -impulse,
+                     constraint.linearA, constraint.angularA);
+        ApplyImpulse(constraint.inverseMassB, constraint.inverseInertiaB, constraint.offsetB, impulse,
+                     constraint.linearB, constraint.angularB);
+    }
+    
+    // sequential impulses: friction and then the contact itself, point by point, over and over
+    for (unsigned iteration=0; iteration<_settings.iterations; iteration++) {
+        for (unsigned c=0; c<constraintCount; c++) {
+            Constraint& constraint = constraints[c];
+            for (int t=0; t<2; t++) {
+                glm::vec3 relative = *constraint.linearB + glm::cross(*constraint.angularB, constraint.offsetB) -
+                                     *constraint.linearA - glm::cross(*constraint.angularA, constraint.offsetA);
+                float limit = _settings.friction * constraint.normalImpulse;
+                float previous = constraint.tangentImpulse[t];
+                float total = glm::clamp(previous - glm::dot(relative, constraint.tangents[t]) * constraint.tangentMasses[t], -limit, limit);
+                constraint.tangentImpulse[t] = total;
+                glm::vec3 impulse = constraint.tangents[t] * (total - previous);
+                ApplyImpulse(constraint.inverseMassA, constraint.inverseInertiaA, constraint.offsetA, -impulse,
+                             constraint.linearA, constraint.angularA);
+                ApplyImpulse(constraint.inverseMassB, constraint.inverseInertiaB, constraint.offsetB, impulse,
+                             constraint.linearB, constraint.angularB);
+            }
+            
+            glm::vec3 relative = *constraint.linearB + glm::cross(*constraint.angularB, constraint.offsetB) -
+                                 *constraint.linearA - glm::cross(*constraint.angularA, constraint.offsetA);
+            float previous = constraint.normalImpulse;
+            float total = std::max(previous + (constraint.bias - glm::dot(relative, constraint.normal)) * constraint.normalMass, 0.0f);
+            constraint.normalImpulse = total;
+            glm::vec3 impulse = constraint.normal * (total - previous);
+            ApplyImpulse(constraint.inverseMassA, constraint.inverseInertiaA, constraint.offsetA, -impulse,
+                         constraint.linearA, constraint.angularA);
+            ApplyImpulse(constraint.inverseMassB, constraint.inverseInertiaB, constraint.offsetB, impulse,
+                         constraint.linearB, constraint.angularB);
+        }
+    }
+    
+    // keep the impulses for next step
+    unsigned c = 0;
+    for (unsigned m=0; m<island.manifoldCount; m++) {
+        Manifold& manifold = _manifolds[_islandManifolds[island.firstManifold + m]];
+        for (unsigned p=0; p<manifold.count; p++, c++) {
+            manifold.normalImpulses[p] = constraints[c].normalImpulse;
+            manifold.tangentImpulses[p] = constraints[c].tangentImpulse;
+        }
+    }
+    
+    // move, and see whether the whole island has been still long enough to sleep
+    float stillest = _settings.sleepDelay;
+    for (unsigned i=0; i<island.bodyCount; i++) {
+        Body& body = _bodies[_islandBodies[island.firstBody + i]];
+        body.position += body.linearVelocity * timeStep;
+        glm::quat spin(0.0f, body.angularVelocity.x, body.angularVelocity.y, body.angularVelocity.z);
+        body.orientation = glm::normalize(body.orientation + spin * body.orientation * (0.5f * timeStep));
+        _updateRotation(body);
+        
+        float linear = glm::dot(body.linearVelocity, body.linearVelocity);
+        float angular = glm::dot(body.angularVelocity, body.angularVelocity);
+        if (linear > _settings.sleepSpeed * _settings.sleepSpeed || angular > _settings.sleepAngularSpeed * _settings.sleepAngularSpeed)
+            body.stillTime = 0.0f;
+        else
+            body.stillTime += timeStep;
+        stillest = std::min(stillest, body.stillTime);
+    }
+    if (stillest >= _settings.sleepDelay) {
+        for (unsigned i=0; i<island.bodyCount; i++) {
+            Body& body = _bodies[_islandBodies[island.firstBody + i]];
+            body.awake = false;
+            body.linearVelocity = glm::vec3(0.0f);
+            body.angularVelocity = glm::vec3(0.0f);
+        }
+    }
+}
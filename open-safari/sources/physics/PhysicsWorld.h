@@ -0,0 +1,253 @@
+//
+//  PhysicsWorld.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/14/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__PhysicsWorld__
+#define __open_safari__PhysicsWorld__
+
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "scene/AABB.h"
+#include "CollisionShape.h"
+#include "ShapeCollision.h"
+
+/**
+ Rigid bodies that fall, bounce off each other and the ground, and come to rest, for
+ tossed crates and crashing jeeps.
+ 
+ Each step:
+ 
+ - sorts the bodies' boxes along x, by insertion since they barely move between steps, and
+   sweeps along them for pairs whose boxes overlap (sweep and prune)
+ - finds where each pair, and each body and the ground, touch (see CollideShapes()), in
+   parallel
+ - groups the bodies touching each other into islands, and solves each island's contacts
+   with sequential impulses, starting from last step's, in parallel
+ - moves the bodies and puts islands that have been still for a while to sleep
+ 
+ Sleeping bodies cost nothing until something awake touches them. Bodies with no mass
+ never move and never join islands, so they don't join the islands either side of them.
+ */
+class PhysicsWorld {
+public:
+    enum {
+        NullBody = -1
+    };
+    
+    /**
+     Finds the height and normal of the ground under a point on the map. Returns false if
+     there isn't any ground there, or it isn't loaded. Called from worker threads, so it has
+     to be safe to call from more than one at once.
+     */
+    typedef std::function<bool(float x, float z, float* height, glm::vec3* normal)> Ground;
+    
+    struct Settings {
+        glm::vec3 gravity;
+        /** the length of a step, in seconds */
+        float timeStep;
+        /** the most steps in one update, any time left over is dropped */
+        unsigned maxSteps;
+        /** how many times each step goes over the contacts */
+        unsigned iterations;
+        float friction;
+        /** how much of the speed they hit at bodies bounce back with */
+        float restitution;
+        /** hits slower than this don't bounce */
+        float bounceSpeed;
+        /** how deep contacts can overlap before they're pushed apart */
+        float allowedPenetration;
+        /** how far apart bodies can be and still have contacts, which keep them from moving
+            any closer than touching in the next step */
+        float contactMargin;
+        /** how much of the overlap is pushed apart each step */
+        float correction;
+        /** bodies slower than these, in units and radians per second, count as still */
+        float sleepSpeed;
+        float sleepAngularSpeed;
+        /** islands still for this many seconds go to sleep */
+        float sleepDelay;
+        
+        static Settings defaults();
+    };
+    
+    struct Stats {
+        /** at the end of the last update */
+        unsigned bodies;
+        unsigned awake;
+        unsigned pairs;
+        unsigned contacts;
+        unsigned islands;
+        /** over the last update */
+        unsigned steps;
+        double broadphaseMilliseconds;
+        double narrowphaseMilliseconds;
+        double solveMilliseconds;
+        unsigned threads;
+    };
+    
+    explicit PhysicsWorld(const Settings& settings = Settings::defaults());
+    
+    const Settings& settings() const;
+    
+    /**
+     The ground to land on. Without one bodies fall forever.
+     */
+    void setGround(const Ground& ground);
+    
+    /**
+     Adds a body, awake
+     
+     @param mass  0 for one that never moves
+     @result      the body, for the other calls, until it's removed
+     */
+    int addBody(const CollisionShape& shape, float mass, const glm::vec3& position, const glm::quat& orientation = glm::quat());
+    
+    /**
+     Removes a body, waking what was touching it. Its number gets reused.
+     */
+    void removeBody(int body);
+    
+    /** the number of bodies */
+    unsigned size() const;
+    
+    const CollisionShape& shape(int body) const;
+    const glm::vec3& position(int body) const;
+    const glm::quat& orientation(int body) const;
+    
+    /** moves the body's shape from its own space to the world */
+    glm::mat4 transform(int body) const;
+    const AABB& bounds(int body) const;
+    
+    const glm::vec3& linearVelocity(int body) const;
+    const glm::vec3& angularVelocity(int body) const;
+    
+    /**
+     Sets the body moving, waking it
+     
+     @param angular  in radians per second about each axis
+     */
+    void setVelocity(int body, const glm::vec3& linear, const glm::vec3& angular = glm::vec3(0.0f));
+    
+    /**
+     Pushes the body at a point, waking it
+     */
+    void applyImpulse(int body, const glm::vec3& impulse, const glm::vec3& point);
+    
+    bool awake(int body) const;
+    
+    /**
+     Runs the steps the time covers
+     */
+    void update(float delta);
+    
+    /**
+     Runs one step
+     */
+    void step();
+    
+    const Stats& stats() const;
+
+private:
+    struct Body {
+        CollisionShape shape;
+        glm::vec3 position;
+        glm::quat orientation;
+        glm::mat3 rotation;
+        glm::vec3 linearVelocity;
+        glm::vec3 angularVelocity;
+        float inverseMass;
+        /** about the shape's own axes, and then turned into the world's */
+        glm::vec3 localInverseInertia;
+        glm::mat3 inverseInertia;
+        AABB bounds;
+        /** how long it's been still */
+        float stillTime;
+        bool awake;
+        bool used;
+        /** the island it's in this step, or its parent while they're being found */
+        int island;
+    };
+    
+    /** a body's box, kept in order along x */
+    struct SweepEntry {
+        AABB bounds;
+        int body;
+    };
+    
+    /** the contacts between two bodies, or a body and the ground when b is NullBody */
+    struct Manifold {
+        int a, b;
+        unsigned count;
+        ContactPoint points[MaxContactPoints];
+        /** the total impulses applied at each point, kept to start the next step from */
+        float normalImpulses[MaxContactPoints];
+        glm::vec2 tangentImpulses[MaxContactPoints];
+        
+        bool operator<(const Manifold& other) const {
+            return a < other.a || (a == other.a && b < other.b);
+        }
+    };
+    
+    struct Island {
+        unsigned firstBody, bodyCount;
+        unsigned firstManifold, manifoldCount;
+        unsigned firstConstraint;
+    };
+    
+    /** a contact point, set up for the solver. Static and sleeping bodies get no mass, and
+        the ground gets velocities of its own that stay zero. */
+    struct Constraint {
+        glm::vec3* linearA;
+        glm::vec3* angularA;
+        glm::vec3* linearB;
+        glm::vec3* angularB;
+        float inverseMassA, inverseMassB;
+        glm::mat3 inverseInertiaA, inverseInertiaB;
+        /** from each body's position to the contact */
+        glm::vec3 offsetA, offsetB;
+        glm::vec3 normal;
+        glm::vec3 tangents[2];
+        float normalMass;
+        float tangentMasses[2];
+        /** the speed the bodies are pushed apart at, to bounce and undo overlap */
+        float bias;
+        float normalImpulse;
+        glm::vec2 tangentImpulse;
+    };
+    
+    Settings _settings;
+    Ground _ground;
+    std::vector<Body> _bodies;
+    std::vector<int> _freeBodies;
+    std::vector<SweepEntry> _sweep;
+    std::vector<Manifold> _manifolds, _previousManifolds;
+    std::vector<Island> _islands;
+    /** the bodies and manifolds of each island, one island after another */
+    std::vector<int> _islandBodies;
+    std::vector<unsigned> _islandManifolds;
+    std::vector<Constraint> _constraints;
+    float _accumulator;
+    Stats _stats;
+    
+    void _wake(int body);
+    void _updateMass(Body& body, float mass);
+    void _updateRotation(Body& body);
+    void _findPairs();
+    void _collide(Manifold& manifold) const;
+    unsigned _collideGround(const Body& body, ContactPoint* contacts) const;
+    void _findIslands();
+    int _findIsland(int body);
+    void _solveIsland(const Island& island);
+    
+    // copying disabled
+    PhysicsWorld(const PhysicsWorld&);
+    const PhysicsWorld& operator=(const PhysicsWorld&);
+};
+
+#endif /* defined(__open_safari__PhysicsWorld__) */
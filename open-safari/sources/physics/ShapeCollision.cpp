@@ -0,0 +1,435 @@
+//
+//  ShapeCollision.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/14/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "ShapeCollision.h"
+#include "ClosestPoints.h"
+#include <cfloat>
+#include <cmath>
+#include <xmmintrin.h>
+
+namespace {
+    /** contacts closer together than this are the same contact */
+    const float ContactMergeDistance = 0.01f;
+    /** cross products of edges shorter than this are of parallel edges, and left to the faces */
+    const float ParallelEdgeLength = 0.0001f;
+    /** how much deeper an edge has to be than a face, relatively, before it's used instead,
+        so resting boxes don't flicker between the two */
+    const float EdgeBias = 1.05f;
+    /** likewise for the second box's faces over the first's */
+    const float SecondFaceBias = 1.02f;
+    /** how many times the search for the point on a capsule nearest a box narrows in */
+    const int SegmentSearchIterations = 20;
+    
+    struct OrientedBox {
+        glm::vec3 center;
+        glm::vec3 axes[3];
+        glm::vec3 extents;
+        
+        OrientedBox(const CollisionShape& shape, const glm::vec3& position, const glm::mat3& rotation) :
+            center(position),
+            extents(shape.halfExtents)
+        {
+            for (int i=0; i<3; i++)
+                axes[i] = rotation[i];
+        }
+        
+        /** how far the box reaches along four axes at once, either way from the center */
+        __m128 projectedRadii(__m128 x, __m128 y, __m128 z) const {
+            __m128 radii = _mm_setzero_ps();
+            for (int i=0; i<3; i++) {
+                __m128 alignment = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(axes[i].x)),
+                                                         _mm_mul_ps(y, _mm_set1_ps(axes[i].y))),
+                                              _mm_mul_ps(z, _mm_set1_ps(axes[i].z)));
+                // clearing the sign bit is fabsf()
+                alignment = _mm_andnot_ps(_mm_set1_ps(-0.0f), alignment);
+                radii = _mm_add_ps(radii, _mm_mul_ps(alignment, _mm_set1_ps(extents[i])));
+            }
+            return radii;
+        }
+        
+        glm::vec3 toLocal(const glm::vec3& point) const {
+            glm::vec3 offset = point - center;
+            return glm::vec3(glm::dot(offset, axes[0]), glm::dot(offset, axes[1]), glm::dot(offset, axes[2]));
+        }
+        
+        glm::vec3 toWorld(const glm::vec3& local) const {
+            return center + axes[0] * local.x + axes[1] * local.y + axes[2] * local.z;
+        }
+    };
+    
+    /** adds the contact unless there's already one where it is */
+    void AddContact(ContactPoint* contacts, unsigned& count, unsigned capacity, const ContactPoint& contact) {
+        for (unsigned i=0; i<count; i++) {
+            glm::vec3 offset = contacts[i].position - contact.position;
+            if (glm::dot(offset, offset) < ContactMergeDistance * ContactMergeDistance)
+                return;
+        }
+        if (count < capacity)
+            contacts[count++] = contact;
+    }
+    
+    /** a contact between spheres around each point, if they're within the margin */
+    bool CollidePoints(const glm::vec3& pointA, float radiusA, const glm::vec3& pointB, float radiusB, float margin, ContactPoint* contact) {
+        glm::vec3 offset = pointB - pointA;
+        float distanceSquared = glm::dot(offset, offset);
+        float radii = radiusA + radiusB;
+        if (distanceSquared >= (radii + margin) * (radii + margin))
+            return false;
+        
+        float distance = sqrtf(distanceSquared);
+        // right on top of each other there's no telling which way is out, so push up
+        contact->normal = distance > 0.0f ? offset / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+        contact->depth = radii - distance;
+        contact->position = pointA + contact->normal * (radiusA - 0.5f * contact->depth);
+        return true;
+    }
+    
+    /** spheres and capsules against each other */
+    unsigned CollideSegments(const glm::vec3& p1, const glm::vec3& q1, float radius1,
+                             const glm::vec3& p2, const glm::vec3& q2, float radius2, float margin, ContactPoint* contacts) {
+        const unsigned capacity = 5;
+        ContactPoint found[capacity];
+        unsigned count = 0;
+        ContactPoint contact;
+        
+        glm::vec3 closest1, closest2;
+        ClosestPointsOnSegments(p1, q1, p2, q2, &closest1, &closest2);
+        if (!CollidePoints(closest1, radius1, closest2, radius2, margin, &contact))
+            return 0;
+        AddContact(found, count, capacity, contact);
+        
+        // the ends as well, so capsules lying alongside each other don't roll on one point
+        if (p1 != q1) {
+            if (CollidePoints(p1, radius1, ClosestPointOnSegment(p1, p2, q2), radius2, margin, &contact))
+                AddContact(found, count, capacity, contact);
+            if (CollidePoints(q1, radius1, ClosestPointOnSegment(q1, p2, q2), radius2, margin, &contact))
+                AddContact(found, count, capacity, contact);
+        }
+        if (p2 != q2) {
+            if (CollidePoints(ClosestPointOnSegment(p2, p1, q1), radius1, p2, radius2, margin, &contact))
+                AddContact(found, count, capacity, contact);
+            if (CollidePoints(ClosestPointOnSegment(q2, p1, q1), radius1, q2, radius2, margin, &contact))
+                AddContact(found, count, capacity, contact);
+        }
+        
+        count = ReduceContactPoints(found, count);
+        for (unsigned i=0; i<count; i++)
+            contacts[i] = found[i];
+        return count;
+    }
+    
+    /** a sphere against a box, pushed out of the box's nearest face if its center is inside */
+    bool CollideSphereBox(const glm::vec3& center, float radius, const OrientedBox& box, float margin, ContactPoint* contact) {
+        glm::vec3 local = box.toLocal(center);
+        glm::vec3 clamped = glm::clamp(local, -box.extents, box.extents);
+        
+        if (local != clamped) {
+            glm::vec3 outside = local - clamped;
+            float distanceSquared = glm::dot(outside, outside);
+            if (distanceSquared >= (radius + margin) * (radius + margin))
+                return false;
+            float distance = sqrtf(distanceSquared);
+            glm::vec3 surface = box.toWorld(clamped);
+            contact->normal = glm::normalize(surface - center);
+            contact->depth = radius - distance;
+            contact->position = surface + contact->normal * (0.5f * contact->depth);
+            return true;
+        }
+        
+        int axis = 0;
+        float least = FLT_MAX;
+        for (int i=0; i<3; i++) {
+            float inside = box.extents[i] - fabsf(local[i]);
+            if (inside < least) {
+                least = inside;
+                axis = i;
+            }
+        }
+        glm::vec3 out = box.axes[axis] * (local[axis] < 0.0f ? -1.0f : 1.0f);
+        contact->normal = -out;
+        contact->depth = radius + least;
+        contact->position = center + out * (0.5f * (least - radius));
+        return true;
+    }
+    
+    /** spheres and capsules against a box */
+    unsigned CollideSegmentBox(const glm::vec3& p, const glm::vec3& q, float radius, const OrientedBox& box, float margin,
+                               ContactPoint* contacts) {
+        unsigned count = 0;
+        ContactPoint contact;
+        if (CollideSphereBox(p, radius, box, margin, &contact))
+            AddContact(contacts, count, MaxContactPoints, contact);
+        if (p == q)
+            return count;
+        if (CollideSphereBox(q, radius, box, margin, &contact))
+            AddContact(contacts, count, MaxContactPoints, contact);
+        
+        // and the point along it nearest the box, which the distance to only falls and then
+        // rises towards, so a golden section search finds it
+        const float ratio = 0.618034f;
+        float low = 0.0f, high = 1.0f;
+        for (int i=0; i<SegmentSearchIterations; i++) {
+            float t1 = high - ratio * (high - low);
+            float t2 = low + ratio * (high - low);
+            glm::vec3 local1 = box.toLocal(p + (q - p) * t1);
+            glm::vec3 local2 = box.toLocal(p + (q - p) * t2);
+            glm::vec3 outside1 = local1 - glm::clamp(local1, -box.extents, box.extents);
+            glm::vec3 outside2 = local2 - glm::clamp(local2, -box.extents, box.extents);
+            if (glm::dot(outside1, outside1) <= glm::dot(outside2, outside2))
+                high = t2;
+            else
+                low = t1;
+        }
+        if (CollideSphereBox(p + (q - p) * (0.5f * (low + high)), radius, box, margin, &contact))
+            AddContact(contacts, count, MaxContactPoints, contact);
+        return count;
+    }
+    
+    /**
+     Clips the face of `incident` turned most towards `reference` against the sides of the
+     reference face, and keeps the points behind it
+     
+     @param normal  the reference face's normal, pointing out towards `incident`
+     */
+    unsigned ClipFaces(const OrientedBox& reference, int referenceAxis, const glm::vec3& normal,
+                       const OrientedBox& incident, float margin, ContactPoint* contacts) {
+        int incidentAxis = 0;
+        float most = -1.0f;
+        for (int i=0; i<3; i++) {
+            float alignment = fabsf(glm::dot(incident.axes[i], normal));
+            if (alignment > most) {
+                most = alignment;
+                incidentAxis = i;
+            }
+        }
+        glm::vec3 incidentNormal = incident.axes[incidentAxis];
+        if (glm::dot(incidentNormal, normal) > 0.0f)
+            incidentNormal = -incidentNormal;
+        glm::vec3 incidentCenter = incident.center + incidentNormal * incident.extents[incidentAxis];
+        glm::vec3 u = incident.axes[(incidentAxis + 1) % 3] * incident.extents[(incidentAxis + 1) % 3];
+        glm::vec3 v = incident.axes[(incidentAxis + 2) % 3] * incident.extents[(incidentAxis + 2) % 3];
+        
+        // a quad clipped by four planes has at most eight corners
+        glm::vec3 polygon[8], clipped[8];
+        unsigned count = 4;
+        polygon[0] = incidentCenter + u + v;
+        polygon[1] = incidentCenter - u + v;
+        polygon[2] = incidentCenter - u - v;
+        polygon[3] = incidentCenter + u - v;
+        for (int side=0; side<4; side++) {
+            int axis = (referenceAxis + 1 + side / 2) % 3;
+            glm::vec3 planeNormal = reference.axes[axis] * (side % 2 == 0 ? 1.0f : -1.0f);
+            float planeOffset = glm::dot(planeNormal, reference.center) + reference.extents[axis];
+            
+            unsigned clippedCount = 0;
+            for (unsigned i=0; i<count; i++) {
+                const glm::vec3& from = polygon[i];
+                const glm::vec3& to = polygon[(i + 1) % count];
+                float fromDistance = glm::dot(planeNormal, from) - planeOffset;
+                float toDistance = glm::dot(planeNormal, to) - planeOffset;
+                if (fromDistance <= 0.0f)
+                    clipped[clippedCount++] = from;
+                if ((fromDistance <= 0.0f) != (toDistance <= 0.0f))
+                    clipped[clippedCount++] = from + (to - from) * (fromDistance / (fromDistance - toDistance));
+            }
+            count = clippedCount;
+            for (unsigned i=0; i<count; i++)
+                polygon[i] = clipped[i];
+            if (count == 0)
+                return 0;
+        }
+        
+        glm::vec3 face = reference.center + normal * reference.extents[referenceAxis];
+        unsigned contactCount = 0;
+        for (unsigned i=0; i<count; i++) {
+            float separation = glm::dot(normal, polygon[i] - face);
+            if (separation > margin)
+                continue;
+            ContactPoint& contact = contacts[contactCount++];
+            contact.position = polygon[i] - normal * (0.5f * separation);
+            contact.depth = -separation;
+        }
+        return contactCount;
+    }
+    
+    /** Real-Time Collision Detection 4.4.1, with contacts from Box2D's clipping */
+    unsigned CollideBoxes(const OrientedBox& a, const OrientedBox& b, float margin, ContactPoint* contacts) {
+        glm::vec3 offset = b.center - a.center;
+        
+        // the three face normals of each, then the cross products of an edge from each, with
+        // a sixteenth of zero length so they're tested four at a time
+        float directions[3][16], lengths[16], distances[16], depths[16];
+        for (int axis=0; axis<16; axis++) {
+            glm::vec3 direction;
+            if (axis < 3)
+                direction = a.axes[axis];
+            else if (axis < 6)
+                direction = b.axes[axis - 3];
+            else if (axis < 15)
+                direction = glm::cross(a.axes[(axis - 6) / 3], b.axes[(axis - 6) % 3]);
+            else
+                direction = glm::vec3(0.0f);
+            for (int i=0; i<3; i++)
+                directions[i][axis] = direction[i];
+        }
+        
+        const __m128 parallelLength = _mm_set1_ps(ParallelEdgeLength);
+        const __m128 separated = _mm_set1_ps(-margin);
+        for (int axis=0; axis<16; axis+=4) {
+            __m128 x = _mm_loadu_ps(&directions[0][axis]);
+            __m128 y = _mm_loadu_ps(&directions[1][axis]);
+            __m128 z = _mm_loadu_ps(&directions[2][axis]);
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+            __m128 parallel = _mm_cmplt_ps(length, parallelLength);
+            // parallel edges are divided by one instead of nearly nothing, and skipped below
+            __m128 divisor = _mm_or_ps(_mm_andnot_ps(parallel, length), _mm_and_ps(parallel, _mm_set1_ps(1.0f)));
+            x = _mm_div_ps(x, divisor);
+            y = _mm_div_ps(y, divisor);
+            z = _mm_div_ps(z, divisor);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(offset.x)), _mm_mul_ps(y, _mm_set1_ps(offset.y))),
+                                         _mm_mul_ps(z, _mm_set1_ps(offset.z)));
+            __m128 depth = _mm_sub_ps(_mm_add_ps(a.projectedRadii(x, y, z), b.projectedRadii(x, y, z)),
+                                      _mm_andnot_ps(_mm_set1_ps(-0.0f), distance));
+            if (_mm_movemask_ps(_mm_andnot_ps(parallel, _mm_cmplt_ps(depth, separated))))
+                return 0;
+            
+            _mm_storeu_ps(&directions[0][axis], x);
+            _mm_storeu_ps(&directions[1][axis], y);
+            _mm_storeu_ps(&directions[2][axis], z);
+            _mm_storeu_ps(&lengths[axis], length);
+            _mm_storeu_ps(&distances[axis], distance);
+            _mm_storeu_ps(&depths[axis], depth);
+        }
+        
+        // nothing separates them, so they're pushed apart along the axis they overlap least on
+        float bestScore = FLT_MAX, bestDepth = 0.0f;
+        int bestAxis = -1;
+        glm::vec3 bestNormal;
+        for (int axis=0; axis<15; axis++) {
+            if (lengths[axis] < ParallelEdgeLength)
+                continue;
+            float depth = depths[axis];
+            float score = axis < 3 ? depth : (axis < 6 ? depth * SecondFaceBias : depth * EdgeBias);
+            if (score < bestScore) {
+                bestScore = score;
+                bestDepth = depth;
+                bestAxis = axis;
+                glm::vec3 direction(directions[0][axis], directions[1][axis], directions[2][axis]);
+                bestNormal = distances[axis] < 0.0f ? -direction : direction;
+            }
+        }
+        
+        if (bestAxis < 6) {
+            ContactPoint clipped[8];
+            unsigned count = bestAxis < 3 ? ClipFaces(a, bestAxis, bestNormal, b, margin, clipped)
+                                          : ClipFaces(b, bestAxis - 3, -bestNormal, a, margin, clipped);
+            for (unsigned i=0; i<count; i++)
+                clipped[i].normal = bestNormal;
+            count = ReduceContactPoints(clipped, count);
+            for (unsigned i=0; i<count; i++)
+                contacts[i] = clipped[i];
+            if (count > 0)
+                return count;
+        }
+        
+        // edge against edge, or faces that clipped away to nothing: one point, between the
+        // edges of each closest to the other along the normal
+        int edgeA = bestAxis < 6 ? 0 : (bestAxis - 6) / 3;
+        int edgeB = bestAxis < 6 ? 0 : (bestAxis - 6) % 3;
+        glm::vec3 onA = a.center, onB = b.center;
+        for (int i=0; i<3; i++) {
+            if (i != edgeA)
+                onA += a.axes[i] * (a.extents[i] * (glm::dot(a.axes[i], bestNormal) > 0.0f ? 1.0f : -1.0f));
+            if (i != edgeB)
+                onB += b.axes[i] * (b.extents[i] * (glm::dot(b.axes[i], bestNormal) > 0.0f ? -1.0f : 1.0f));
+        }
+        glm::vec3 alongA = a.axes[edgeA] * a.extents[edgeA];
+        glm::vec3 alongB = b.axes[edgeB] * b.extents[edgeB];
+        glm::vec3 closestA, closestB;
+        ClosestPointsOnSegments(onA - alongA, onA + alongA, onB - alongB, onB + alongB, &closestA, &closestB);
+        contacts[0].position = 0.5f * (closestA + closestB);
+        contacts[0].normal = bestNormal;
+        contacts[0].depth = bestDepth;
+        return 1;
+    }
+}
+
+unsigned CollideShapes(const CollisionShape& a, const glm::vec3& positionA, const glm::mat3& rotationA,
+                       const CollisionShape& b, const glm::vec3& positionB, const glm::mat3& rotationB,
+                       float margin, ContactPoint* contacts) {
+    // only one order of each pair of types is handled, so turn the others around
+    if (a.type > b.type) {
+        unsigned count = CollideShapes(b, positionB, rotationB, a, positionA, rotationA, margin, contacts);
+        for (unsigned i=0; i<count; i++)
+            contacts[i].normal = -contacts[i].normal;
+        return count;
+    }
+    
+    if (b.type != CollisionShape::Box) {
+        glm::vec3 p1, q1, p2, q2;
+        a.segment(positionA, rotationA, &p1, &q1);
+        b.segment(positionB, rotationB, &p2, &q2);
+        return CollideSegments(p1, q1, a.radius, p2, q2, b.radius, margin, contacts);
+    }
+    
+    OrientedBox boxB(b, positionB, rotationB);
+    if (a.type != CollisionShape::Box) {
+        glm::vec3 p, q;
+        a.segment(positionA, rotationA, &p, &q);
+        return CollideSegmentBox(p, q, a.radius, boxB, margin, contacts);
+    }
+    return CollideBoxes(OrientedBox(a, positionA, rotationA), boxB, margin, contacts);
+}
+
+unsigned ReduceContactPoints(ContactPoint* contacts, unsigned count) {
+    if (count <= MaxContactPoints)
+        return count;
+    
+    unsigned first = 0;
+    for (unsigned i=1; i<count; i++) {
+        if (contacts[i].depth > contacts[first].depth)
+            first = i;
+    }
+    unsigned second = first;
+    float furthest = -1.0f;
+    for (unsigned i=0; i<count; i++) {
+        glm::vec3 offset = contacts[i].position - contacts[first].position;
+        if (glm::dot(offset, offset) > furthest) {
+            furthest = glm::dot(offset, offset);
+            second = i;
+        }
+    }
+    
+    // the signed areas of the triangles each point makes with the first two
+    int third = -1, fourth = -1;
+    float most = 0.0f, least = 0.0f;
+    glm::vec3 edge = contacts[second].position - contacts[first].position;
+    for (unsigned i=0; i<count; i++) {
+        float area = glm::dot(glm::cross(edge, contacts[i].position - contacts[first].position), contacts[first].normal);
+        if (area > most) {
+            most = area;
+            third = i;
+        } else if (area < least) {
+            least = area;
+            fourth = i;
+        }
+    }
+    
+    ContactPoint kept[MaxContactPoints];
+    unsigned keptCount = 0;
+    kept[keptCount++] = contacts[first];
+    if (second != first)
+        kept[keptCount++] = contacts[second];
+    if (third != -1)
+        kept[keptCount++] = contacts[third];
+    if (fourth != -1)
+        kept[keptCount++] = contacts[fourth];
+    for (unsigned i=0; i<keptCount; i++)
+        contacts[i] = kept[i];
+    return keptCount;
+}
@@ -0,0 +1,60 @@
+//
+//  ShapeCollision.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/14/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__ShapeCollision__
+#define __open_safari__ShapeCollision__
+
+#include <glm/glm.hpp>
+#include "CollisionShape.h"
+
+/**
+ A point where two shapes overlap
+ */
+struct ContactPoint {
+    /** halfway between the two surfaces */
+    glm::vec3 position;
+    /** the way the second shape has to move to stop overlapping the first */
+    glm::vec3 normal;
+    /** how far it has to move, negative where the shapes are apart but close */
+    float depth;
+};
+
+enum {
+    /** the most points CollideShapes() finds for a pair */
+    MaxContactPoints = 4
+};
+
+/**
+ Finds where two shapes overlap.
+ 
+ Spheres and capsules are tested as the segments at their middles with the radius around
+ them. Boxes are tested against each other with the separating axis test, four axes at a
+ time with SSE, and touch where the face of one that they overlap least across is clipped
+ against the other's facing face, so boxes resting on each other get a point near each
+ corner.
+ 
+ Shapes that are apart by less than the margin touch too, with negative depths, so the
+ contacts between resting shapes don't come and go as they settle.
+ 
+ @param margin    how far apart shapes can be and still touch
+ @param contacts  room for MaxContactPoints
+ @result          the number of points written to contacts, 0 if the shapes don't overlap
+ */
+unsigned CollideShapes(const CollisionShape& a, const glm::vec3& positionA, const glm::mat3& rotationA,
+                       const CollisionShape& b, const glm::vec3& positionB, const glm::mat3& rotationB,
+                       float margin, ContactPoint* contacts);
+
+/**
+ Picks the points that best cover the area the contacts are spread over: the deepest, the
+ one furthest from it, and the two making the biggest triangles with those on either side.
+ 
+ @result the number of points kept, at the front of contacts
+ */
+unsigned ReduceContactPoints(ContactPoint* contacts, unsigned count);
+
+#endif /* defined(__open_safari__ShapeCollision__) */
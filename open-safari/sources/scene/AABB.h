@@ -0,0 +1,96 @@
+//
+//  AABB.h
+//  open-safari
+//
+//  Created by Darren Tsung on 5/25/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__AABB__
+#define __open_safari__AABB__
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/**
+ An axis aligned bounding box, stored as its minimum and maximum corners
+ */
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+    
+    AABB() : min(0.0f), max(0.0f) {}
+    AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+    
+    /** Creates the box with the given center and half-size */
+    static AABB fromCenterExtents(const glm::vec3& center, const glm::vec3& extents) {
+        return AABB(center - extents, center + extents);
+    }
+    
+    glm::vec3 center() const { return 0.5f * (min + max); }
+    
+    /** the half-size of the box along each axis */
+    glm::vec3 extents() const { return 0.5f * (max - min); }
+    
+    /** used as the cost of a box when building trees (surface area heuristic) */
+    float surfaceArea() const {
+        glm::vec3 size = max - min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+    
+    bool contains(const AABB& other) const {
+        return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z &&
+               max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+    }
+    
+    bool overlaps(const AABB& other) const {
+        return min.x <= other.max.x && max.x >= other.min.x &&
+               min.y <= other.max.y && max.y >= other.min.y &&
+               min.z <= other.max.z && max.z >= other.min.z;
+    }
+    
+    /** the squared distance from `point` to the closest point in the box, 0 if inside */
+    float distanceSquared(const glm::vec3& point) const {
+        glm::vec3 closest = glm::clamp(point, min, max);
+        glm::vec3 offset = point - closest;
+        return glm::dot(offset, offset);
+    }
+    
+    /**
+     Slab test of a ray against the box
+     
+     @param inverseDirection  1 / the ray's direction, per component
+     @param maxDistance       ignore hits further than this, in multiples of the direction
+     @param distance          set to where the ray enters the box (0 if it starts inside)
+     
+     @result true if the ray hits the box within maxDistance
+     */
+    bool raycast(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float* distance = NULL) const {
+        glm::vec3 t0 = (min - origin) * inverseDirection;
+        glm::vec3 t1 = (max - origin) * inverseDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+        float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+        float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDistance));
+        if (distance)
+            *distance = enter;
+        return enter <= exit;
+    }
+    
+    /** the smallest box holding this one moved, rotated and scaled by the matrix */
+    AABB transformed(const glm::mat4& matrix) const {
+        glm::vec3 center = glm::vec3(matrix * glm::vec4(this->center(), 1.0f));
+        glm::vec3 extents = this->extents();
+        glm::vec3 transformedExtents(0.0f);
+        for (int column=0; column<3; column++)
+            transformedExtents += glm::abs(glm::vec3(matrix[column])) * extents[column];
+        return fromCenterExtents(center, transformedExtents);
+    }
+    
+    /** the smallest box holding both `a` and `b` */
+    static AABB merge(const AABB& a, const AABB& b) {
+        return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+    }
+};
+
+#endif /* defined(__open_safari__AABB__) */
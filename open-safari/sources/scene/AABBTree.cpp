@@ -0,0 +1,320 @@
+//
+//  AABBTree.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 5/25/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "AABBTree.h"
+
+AABBTree::AABBTree(float margin) :
+_root(NullNode),
+_freeList(NullNode),
+_proxyCount(0),
+_margin(margin)
+{
+    assert(margin >= 0.0f);
+}
+
+int AABBTree::insert(const AABB& bounds, unsigned userData) {
+    int proxy = _allocateNode();
+    Node& node = _nodes[proxy];
+    node.bounds = bounds;
+    node.aabb = AABB(bounds.min - glm::vec3(_margin), bounds.max + glm::vec3(_margin));
+    node.userData = userData;
+    node.height = 0;
+    
+    _insertLeaf(proxy);
+    _proxyCount++;
+    return proxy;
+}
+
+void AABBTree::remove(int proxy) {
+    assert(proxy >= 0 && proxy < (int)_nodes.size());
+    assert(_nodes[proxy].isLeaf());
+    
+    _removeLeaf(proxy);
+    _freeNode(proxy);
+    _proxyCount--;
+}
+
+bool AABBTree::move(int proxy, const AABB& bounds, const glm::vec3& displacement) {
+    assert(proxy >= 0 && proxy < (int)_nodes.size());
+    assert(_nodes[proxy].isLeaf());
+    
+    Node& node = _nodes[proxy];
+    node.bounds = bounds;
+    if (node.aabb.contains(bounds))
+        return false;
+    
+    _removeLeaf(proxy);
+    
+    // fatten, then stretch the box in the direction the object is moving
+    AABB fat(bounds.min - glm::vec3(_margin), bounds.max + glm::vec3(_margin));
+    const glm::vec3 prediction = 2.0f * displacement;
+    fat.min += glm::min(prediction, glm::vec3(0.0f));
+    fat.max += glm::max(prediction, glm::vec3(0.0f));
+    _nodes[proxy].aabb = fat;
+    
+    _insertLeaf(proxy);
+    return true;
+}
+
+unsigned AABBTree::userData(int proxy) const {
+    assert(proxy >= 0 && proxy < (int)_nodes.size());
+    return _nodes[proxy].userData;
+}
+
+const AABB& AABBTree::bounds(int proxy) const {
+    assert(proxy >= 0 && proxy < (int)_nodes.size());
+    return _nodes[proxy].bounds;
+}
+
+const AABB& AABBTree::fatBounds(int proxy) const {
+    assert(proxy >= 0 && proxy < (int)_nodes.size());
+    return _nodes[proxy].aabb;
+}
+
+unsigned AABBTree::size() const {
+    return _proxyCount;
+}
+
+int AABBTree::height() const {
+    return _root == NullNode ? 0 : _nodes[_root].height;
+}
+
+int AABBTree::_allocateNode() {
+    if (_freeList == NullNode) {
+        Node node;
+        node.height = -1;
+        node.parent = NullNode;
+        _nodes.push_back(node);
+        _freeList = (int)_nodes.size() - 1;
+    }
+    
+    int node = _freeList;
+    _freeList = _nodes[node].parent;
+    _nodes[node].parent = NullNode;
+    _nodes[node].child1 = NullNode;
+    _nodes[node].child2 = NullNode;
+    _nodes[node].height = 0;
+    _nodes[node].userData = 0;
+    return node;
+}
+
+void AABBTree::_freeNode(int node) {
+    _nodes[node].parent = _freeList;
+    _nodes[node].height = -1;
+    _freeList = node;
+}
+
+void AABBTree::_insertLeaf(int leaf) {
+    if (_root == NullNode) {
+        _root = leaf;
+        _nodes[_root].parent = NullNode;
+        return;
+    }
+    
+    // find the best sibling by walking down the tree, choosing the child whose cost
+    // (the area it would add to the tree) is the lowest
+    AABB leafAABB = _nodes[leaf].aabb;
+    int index = _root;
+    while (!_nodes[index].isLeaf()) {
+        int child1 = _nodes[index].child1;
+        int child2 = _nodes[index].child2;
+        
+        float area = _nodes[index].aabb.surfaceArea();
+        float combinedArea = AABB::merge(_nodes[index].aabb, leafAABB).surfaceArea();
+        
+        // cost of making a new parent for this node and the leaf
+        float cost = 2.0f * combinedArea;
+        // minimum cost of pushing the leaf further down the tree
+        float inheritanceCost = 2.0f * (combinedArea - area);
+        
+        float cost1 = AABB::merge(leafAABB, _nodes[child1].aabb).surfaceArea() + inheritanceCost;
+        if (!_nodes[child1].isLeaf())
+            cost1 -= _nodes[child1].aabb.surfaceArea();
+        float cost2 = AABB::merge(leafAABB, _nodes[child2].aabb).surfaceArea() + inheritanceCost;
+        if (!_nodes[child2].isLeaf())
+            cost2 -= _nodes[child2].aabb.surfaceArea();
+        
+        if (cost < cost1 && cost < cost2)
+            break;
+        
+        index = cost1 < cost2 ? child1 : child2;
+    }
+    int sibling = index;
+    
+    // create a new parent for the leaf and its sibling
+    int oldParent = _nodes[sibling].parent;
+    int newParent = _allocateNode();
+    _nodes[newParent].parent = oldParent;
+    _nodes[newParent].aabb = AABB::merge(leafAABB, _nodes[sibling].aabb);
+    _nodes[newParent].height = _nodes[sibling].height + 1;
+    _nodes[newParent].child1 = sibling;
+    _nodes[newParent].child2 = leaf;
+    _nodes[sibling].parent = newParent;
+    _nodes[leaf].parent = newParent;
+    
+    if (oldParent != NullNode) {
+        if (_nodes[oldParent].child1 == sibling)
+            _nodes[oldParent].child1 = newParent;
+        else
+            _nodes[oldParent].child2 = newParent;
+    } else {
+        _root = newParent;
+    }
+    
+    // walk back up the tree fixing heights and boxes
+    index = _nodes[leaf].parent;
+    while (index != NullNode) {
+        index = _balance(index);
+        
+        int child1 = _nodes[index].child1;
+        int child2 = _nodes[index].child2;
+        _nodes[index].height = 1 + glm::max(_nodes[child1].height, _nodes[child2].height);
+        _nodes[index].aabb = AABB::merge(_nodes[child1].aabb, _nodes[child2].aabb);
+        
+        index = _nodes[index].parent;
+    }
+}
+
+void AABBTree::_removeLeaf(int leaf) {
+    if (leaf == _root) {
+        _root = NullNode;
+        return;
+    }
+    
+    int parent = _nodes[leaf].parent;
+    int grandParent = _nodes[parent].parent;
+    int sibling = _nodes[parent].child1 == leaf ? _nodes[parent].child2 : _nodes[parent].child1;
+    
+    if (grandParent != NullNode) {
+        // connect the sibling to the grandparent, dropping the parent
+        if (_nodes[grandParent].child1 == parent)
+            _nodes[grandParent].child1 = sibling;
+        else
+            _nodes[grandParent].child2 = sibling;
+        _nodes[sibling].parent = grandParent;
+        _freeNode(parent);
+        
+        int index = grandParent;
+        while (index != NullNode) {
+            index = _balance(index);
+            
+            int child1 = _nodes[index].child1;
+            int child2 = _nodes[index].child2;
+            _nodes[index].aabb = AABB::merge(_nodes[child1].aabb, _nodes[child2].aabb);
+            _nodes[index].height = 1 + glm::max(_nodes[child1].height, _nodes[child2].height);
+            
+            index = _nodes[index].parent;
+        }
+    } else {
+        _root = sibling;
+        _nodes[sibling].parent = NullNode;
+        _freeNode(parent);
+    }
+}
+
+/**
+ Rotates the tree at node A if one of its children is more than one level taller than
+ the other, promoting the taller grandchild
+ 
+ @result the node that is now where A was
+ */
+int AABBTree::_balance(int iA) {
+    Node& A = _nodes[iA];
+    if (A.isLeaf() || A.height < 2)
+        return iA;
+    
+    int iB = A.child1;
+    int iC = A.child2;
+    Node& B = _nodes[iB];
+    Node& C = _nodes[iC];
+    int balance = C.height - B.height;
+    
+    // promote C
+    if (balance > 1) {
+        int iF = C.child1;
+        int iG = C.child2;
+        Node& F = _nodes[iF];
+        Node& G = _nodes[iG];
+        
+        // swap A and C
+        C.child1 = iA;
+        C.parent = A.parent;
+        A.parent = iC;
+        if (C.parent != NullNode) {
+            if (_nodes[C.parent].child1 == iA)
+                _nodes[C.parent].child1 = iC;
+            else
+                _nodes[C.parent].child2 = iC;
+        } else {
+            _root = iC;
+        }
+        
+        // rotate
+        if (F.height > G.height) {
+            C.child2 = iF;
+            A.child2 = iG;
+            G.parent = iA;
+            A.aabb = AABB::merge(B.aabb, G.aabb);
+            C.aabb = AABB::merge(A.aabb, F.aabb);
+            A.height = 1 + glm::max(B.height, G.height);
+            C.height = 1 + glm::max(A.height, F.height);
+        } else {
+            C.child2 = iG;
+            A.child2 = iF;
+            F.parent = iA;
+            A.aabb = AABB::merge(B.aabb, F.aabb);
+            C.aabb = AABB::merge(A.aabb, G.aabb);
+            A.height = 1 + glm::max(B.height, F.height);
+            C.height = 1 + glm::max(A.height, G.height);
+        }
+        return iC;
+    }
+    
+    // promote B
+    if (balance < -1) {
+        int iD = B.child1;
+        int iE = B.child2;
+        Node& D = _nodes[iD];
+        Node& E = _nodes[iE];
+        
+        // swap A and B
+        B.child1 = iA;
+        B.parent = A.parent;
+        A.parent = iB;
+        if (B.parent != NullNode) {
+            if (_nodes[B.parent].child1 == iA)
+                _nodes[B.parent].child1 = iB;
+            else
+                _nodes[B.parent].child2 = iB;
+        } else {
+            _root = iB;
+        }
+        
+        // rotate
+        if (D.height > E.height) {
+            B.child2 = iD;
+            A.child1 = iE;
+            E.parent = iA;
+            A.aabb = AABB::merge(C.aabb, E.aabb);
+            B.aabb = AABB::merge(A.aabb, D.aabb);
+            A.height = 1 + glm::max(C.height, E.height);
+            B.height = 1 + glm::max(A.height, D.height);
+        } else {
+            B.child2 = iE;
+            A.child1 = iD;
+            D.parent = iA;
+            A.aabb = AABB::merge(C.aabb, D.aabb);
+            B.aabb = AABB::merge(A.aabb, E.aabb);
+            A.height = 1 + glm::max(C.height, D.height);
+            B.height = 1 + glm::max(A.height, E.height);
+        }
+        return iB;
+    }
+    
+    return iA;
+}
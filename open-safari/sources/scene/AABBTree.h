@@ -0,0 +1,315 @@
+//
+//  AABBTree.h
+//  open-safari
+//
+//  Created by Darren Tsung on 5/25/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__AABBTree__
+#define __open_safari__AABBTree__
+
+#include <vector>
+#include <cassert>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "Frustum.h"
+#include "Ray.h"
+
+/**
+ A dynamic bounding volume hierarchy over the bounds of scene objects.
+ 
+ Every object gets a leaf (a "proxy") whose box is fattened by a margin, so objects that
+ move a little don't have to be re-inserted every frame. Inserting picks the sibling that
+ grows the tree's surface area the least, and the tree is kept balanced with rotations.
+ 
+ Queries never allocate: they walk the tree with a fixed size stack and report each
+ matching proxy to a callback. They are const and keep no state in the tree, so any
+ number of threads can query at once as long as nothing is inserting, removing, or
+ moving proxies at the same time.
+ */
+class AABBTree {
+public:
+    enum {
+        NullNode = -1,
+        /** deepest tree the queries can walk, the balancing keeps us far from it */
+        MaxQueryDepth = 64
+    };
+    
+    /**
+     @param margin  how much to fatten the leaf boxes by on each side
+     */
+    explicit AABBTree(float margin = 0.1f);
+    
+    /**
+     Adds an object to the tree
+     
+     @param bounds    the (tight) bounds of the object
+     @param userData  anything identifying the object, reported back by userData()
+     
+     @result the proxy id of the object
+     */
+    int insert(const AABB& bounds, unsigned userData);
+    
+    /** Removes the object with the given proxy id */
+    void remove(int proxy);
+    
+    /**
+     Updates the bounds of an object
+     
+     The proxy is only re-inserted when the new bounds leave its fattened box. The fat box
+     is stretched in the direction of `displacement` to predict further movement.
+     
+     @result true if the proxy was re-inserted
+     */
+    bool move(int proxy, const AABB& bounds, const glm::vec3& displacement = glm::vec3(0.0f));
+    
+    unsigned userData(int proxy) const;
+    
+    /** the bounds the proxy was last inserted or moved with */
+    const AABB& bounds(int proxy) const;
+    
+    /** the fattened bounds the tree stores for the proxy */
+    const AABB& fatBounds(int proxy) const;
+    
+    /** the number of objects in the tree */
+    unsigned size() const;
+    
+    /** the height of the tree, 0 if it is empty */
+    int height() const;
+    
+    /**
+     Reports each proxy whose bounds overlap `bounds`
+     
+     @param callback  called as bool(int proxy), returning false stops the query
+     */
+    template <typename Callback>
+    void queryAABB(const AABB& bounds, const Callback& callback) const;
+    
+    /**
+     Reports each proxy whose bounds touch the sphere
+     
+     @param callback  called as bool(int proxy), returning false stops the query
+     */
+    template <typename Callback>
+    void querySphere(const glm::vec3& center, float radius, const Callback& callback) const;
+    
+    /**
+     Reports each proxy whose bounds are at least partially inside the frustum. Subtrees
+     that are completely inside are reported without testing their leaves.
+     
+     @param callback  called as bool(int proxy), returning false stops the query
+     */
+    template <typename Callback>
+    void queryFrustum(const Frustum& frustum, const Callback& callback) const;
+    
+    /**
+     Reports each proxy whose bounds are hit by the ray, roughly front to back
+     
+     @param direction    the direction of the ray, doesn't need to be normalized
+     @param maxDistance  how far along the ray to look, in multiples of `direction`
+     @param callback     called as float(int proxy, float maxDistance). It returns the new
+                         maximum distance: the distance of a hit to only look for closer
+                         hits, `maxDistance` to carry on, or 0 to stop the query.
+     */
+    template <typename Callback>
+    void raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                 const Callback& callback) const;
+    
+    /**
+     Reports each proxy whose bounds are hit by any of the packet's rays, roughly front to
+     back, walking the tree once for all of them
+     
+     @param callback  called as bool(int proxy, int rays) with a bit for each ray that hit
+                      the proxy's bounds. It shortens the packet's distances to any hits it
+                      finds, so boxes behind them are skipped, and returns false to stop
+                      the query.
+     */
+    template <typename Callback>
+    void raycast(RayPacket& packet, const Callback& callback) const;
+
+private:
+    struct Node {
+        /** fattened bounds for leaves, the union of the children otherwise */
+        AABB aabb;
+        /** the object's own bounds, only used by leaves */
+        AABB bounds;
+        /** the parent node, or the next free node when on the free list */
+        int parent;
+        int child1, child2;
+        /** 0 for leaves, -1 for free nodes */
+        int height;
+        unsigned userData;
+        
+        bool isLeaf() const { return child1 == NullNode; }
+    };
+    
+    std::vector<Node> _nodes;
+    int _root;
+    int _freeList;
+    unsigned _proxyCount;
+    float _margin;
+    
+    int _allocateNode();
+    void _freeNode(int node);
+    void _insertLeaf(int leaf);
+    void _removeLeaf(int leaf);
+    int _balance(int node);
+};
+
+template <typename Callback>
+void AABBTree::queryAABB(const AABB& bounds, const Callback& callback) const {
+    int stack[MaxQueryDepth];
+    int count = 0;
+    if (_root != NullNode)
+        stack[count++] = _root;
+    
+    while (count > 0) {
+        const Node& node = _nodes[stack[--count]];
+        if (!node.aabb.overlaps(bounds))
+            continue;
+        
+        if (node.isLeaf()) {
+            if (node.bounds.overlaps(bounds) && !callback(stack[count]))
+                return;
+        } else {
+            assert(count + 2 <= MaxQueryDepth);
+            stack[count++] = node.child1;
+            stack[count++] = node.child2;
+        }
+    }
+}
+
+template <typename Callback>
+void AABBTree::querySphere(const glm::vec3& center, float radius, const Callback& callback) const {
+    int stack[MaxQueryDepth];
+    int count = 0;
+    if (_root != NullNode)
+        stack[count++] = _root;
+    
+    const float radiusSquared = radius * radius;
+    while (count > 0) {
+        const Node& node = _nodes[stack[--count]];
+        if (node.aabb.distanceSquared(center) > radiusSquared)
+            continue;
+        
+        if (node.isLeaf()) {
+            if (node.bounds.distanceSquared(center) <= radiusSquared && !callback(stack[count]))
+                return;
+        } else {
+            assert(count + 2 <= MaxQueryDepth);
+            stack[count++] = node.child1;
+            stack[count++] = node.child2;
+        }
+    }
+}
+
+template <typename Callback>
+void AABBTree::queryFrustum(const Frustum& frustum, const Callback& callback) const {
+    // the second half of each entry says the node is already known to be inside
+    int stack[MaxQueryDepth];
+    bool inside[MaxQueryDepth];
+    int count = 0;
+    if (_root != NullNode) {
+        stack[count] = _root;
+        inside[count++] = false;
+    }
+    
+    while (count > 0) {
+        --count;
+        const Node& node = _nodes[stack[count]];
+        bool nodeInside = inside[count];
+        if (!nodeInside) {
+            const AABB& aabb = node.isLeaf() ? node.bounds : node.aabb;
+            Frustum::Containment containment = frustum.classifyAABB(aabb.center(), aabb.extents());
+            if (containment == Frustum::Containment_Outside)
+                continue;
+            nodeInside = containment == Frustum::Containment_Inside;
+        }
+        
+        if (node.isLeaf()) {
+            if (!callback(stack[count]))
+                return;
+        } else {
+            assert(count + 2 <= MaxQueryDepth);
+            stack[count] = node.child1;
+            inside[count++] = nodeInside;
+            stack[count] = node.child2;
+            inside[count++] = nodeInside;
+        }
+    }
+}
+
+template <typename Callback>
+void AABBTree::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                       const Callback& callback) const {
+    // dividing by zero gives infinities, which the slab test handles
+    const glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    
+    int stack[MaxQueryDepth];
+    int count = 0;
+    if (_root != NullNode)
+        stack[count++] = _root;
+    
+    while (count > 0) {
+        const Node& node = _nodes[stack[--count]];
+        if (!(node.isLeaf() ? node.bounds : node.aabb).raycast(origin, inverseDirection, maxDistance))
+            continue;
+        
+        if (node.isLeaf()) {
+            maxDistance = callback(stack[count], maxDistance);
+            if (maxDistance <= 0.0f)
+                return;
+        } else {
+            assert(count + 2 <= MaxQueryDepth);
+            // push the far child first so the near one is visited first
+            const Node& child1 = _nodes[node.child1];
+            const Node& child2 = _nodes[node.child2];
+            float distance1 = glm::dot(child1.aabb.center() - origin, direction);
+            float distance2 = glm::dot(child2.aabb.center() - origin, direction);
+            if (distance1 < distance2) {
+                stack[count++] = node.child2;
+                stack[count++] = node.child1;
+            } else {
+                stack[count++] = node.child1;
+                stack[count++] = node.child2;
+            }
+        }
+    }
+}
+
+template <typename Callback>
+void AABBTree::raycast(RayPacket& packet, const Callback& callback) const {
+    int stack[MaxQueryDepth];
+    int count = 0;
+    if (_root != NullNode)
+        stack[count++] = _root;
+    
+    while (count > 0) {
+        const Node& node = _nodes[stack[--count]];
+        int rays = packet.hitsBox(node.isLeaf() ? node.bounds : node.aabb);
+        if (!rays)
+            continue;
+        
+        if (node.isLeaf()) {
+            if (!callback(stack[count], rays))
+                return;
+        } else {
+            assert(count + 2 <= MaxQueryDepth);
+            const Node& child1 = _nodes[node.child1];
+            const Node& child2 = _nodes[node.child2];
+            float distance1 = glm::dot(child1.aabb.center(), packet.mainDirection);
+            float distance2 = glm::dot(child2.aabb.center(), packet.mainDirection);
+            if (distance1 < distance2) {
+                stack[count++] = node.child2;
+                stack[count++] = node.child1;
+            } else {
+                stack[count++] = node.child1;
+                stack[count++] = node.child2;
+            }
+        }
+    }
+}
+
+#endif /* defined(__open_safari__AABBTree__) */
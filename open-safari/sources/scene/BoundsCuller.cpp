@@ -0,0 +1,169 @@
+//
+//  BoundsCuller.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 5/24/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "BoundsCuller.h"
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+BoundsCuller::BoundsCuller()
+{
+    clear();
+}
+
+unsigned BoundsCuller::add(const glm::vec3& center, const glm::vec3& extents, float radius) {
+    unsigned index = size();
+    _centerX.push_back(0.0f);
+    _centerY.push_back(0.0f);
+    _centerZ.push_back(0.0f);
+    _extentX.push_back(0.0f);
+    _extentY.push_back(0.0f);
+    _extentZ.push_back(0.0f);
+    _radius.push_back(0.0f);
+    // new objects are visible until proven otherwise
+    _visible.push_back(1);
+    setBounds(index, center, extents, radius);
+    return index;
+}
+
+void BoundsCuller::setBounds(unsigned index, const glm::vec3& center, const glm::vec3& extents, float radius) {
+    assert(index < size());
+    assert(extents.x >= 0.0f && extents.y >= 0.0f && extents.z >= 0.0f);
+    if (radius < 0.0f)
+        radius = glm::length(extents);
+    
+    _centerX[index] = center.x;
+    _centerY[index] = center.y;
+    _centerZ[index] = center.z;
+    _extentX[index] = extents.x;
+    _extentY[index] = extents.y;
+    _extentZ[index] = extents.z;
+    _radius[index] = radius;
+}
+
+void BoundsCuller::clear() {
+    _centerX.clear();
+    _centerY.clear();
+    _centerZ.clear();
+    _extentX.clear();
+    _extentY.clear();
+    _extentZ.clear();
+    _radius.clear();
+    _visible.clear();
+    _visibleIndices.clear();
+    _stats.tested = _stats.visible = _stats.culled = 0;
+    _stats.milliseconds = 0.0;
+}
+
+unsigned BoundsCuller::size() const {
+    return (unsigned)_radius.size();
+}
+
+void BoundsCuller::cull(const Frustum& frustum) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    
+    // sized for the worst case so the inner loop can write indices without branching
+    _visibleIndices.resize(size());
+    unsigned visibleCount = _cullRange(frustum, 0, size(), _visibleIndices.empty() ? NULL : &_visibleIndices[0]);
+    _visibleIndices.resize(visibleCount);
+    
+    std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+    _stats.tested = size();
+    _stats.visible = (unsigned)_visibleIndices.size();
+    _stats.culled = _stats.tested - _stats.visible;
+    _stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+bool BoundsCuller::isVisible(unsigned index) const {
+    assert(index < size());
+    return _visible[index] != 0;
+}
+
+const std::vector<unsigned>& BoundsCuller::visibleIndices() const {
+    return _visibleIndices;
+}
+
+const BoundsCuller::Stats& BoundsCuller::stats() const {
+    return _stats;
+}
+
+/**
+ An object is outside when its center is further behind any plane than its radius along
+ that plane's normal. Both the box and the sphere contain the whole object, so the smaller
+ of the two radii is used.
+ */
+unsigned BoundsCuller::_cullRange(const Frustum& frustum, unsigned begin, unsigned end, unsigned* visibleIndices) {
+    unsigned i = begin;
+    unsigned visibleCount = 0;
+    
+#if defined(__SSE__)
+    __m128 planeX[Frustum::Plane_Count], planeY[Frustum::Plane_Count];
+    __m128 planeZ[Frustum::Plane_Count], planeW[Frustum::Plane_Count];
+    __m128 absPlaneX[Frustum::Plane_Count], absPlaneY[Frustum::Plane_Count], absPlaneZ[Frustum::Plane_Count];
+    for (int p=0; p<Frustum::Plane_Count; p++) {
+        const glm::vec4& plane = frustum.plane((Frustum::Plane)p);
+        planeX[p] = _mm_set1_ps(plane.x);
+        planeY[p] = _mm_set1_ps(plane.y);
+        planeZ[p] = _mm_set1_ps(plane.z);
+        planeW[p] = _mm_set1_ps(plane.w);
+        absPlaneX[p] = _mm_set1_ps(fabsf(plane.x));
+        absPlaneY[p] = _mm_set1_ps(fabsf(plane.y));
+        absPlaneZ[p] = _mm_set1_ps(fabsf(plane.z));
+    }
+    const __m128 zero = _mm_setzero_ps();
+    
+    for (; i + 4 <= end; i += 4) {
+        __m128 cx = _mm_loadu_ps(&_centerX[i]);
+        __m128 cy = _mm_loadu_ps(&_centerY[i]);
+        __m128 cz = _mm_loadu_ps(&_centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&_extentX[i]);
+        __m128 ey = _mm_loadu_ps(&_extentY[i]);
+        __m128 ez = _mm_loadu_ps(&_extentZ[i]);
+        __m128 sphereRadius = _mm_loadu_ps(&_radius[i]);
+        
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int p=0; p<Frustum::Plane_Count; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+                                         _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+            __m128 boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absPlaneX[p], ex), _mm_mul_ps(absPlaneY[p], ey)),
+                                          _mm_mul_ps(absPlaneZ[p], ez));
+            __m128 radius = _mm_min_ps(boxRadius, sphereRadius);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+        }
+        
+        int mask = _mm_movemask_ps(inside);
+        for (unsigned j=0; j<4; j++) {
+            unsigned visible = (mask >> j) & 1;
+            _visible[i + j] = (unsigned char)visible;
+            visibleIndices[visibleCount] = i + j;
+            visibleCount += visible;
+        }
+    }
+#endif
+    
+    // whatever doesn't fill a group of four (or everything, without SSE)
+    for (; i < end; i++) {
+        bool inside = true;
+        for (int p=0; p<Frustum::Plane_Count && inside; p++) {
+            const glm::vec4& plane = frustum.plane((Frustum::Plane)p);
+            float distance = plane.x * _centerX[i] + plane.y * _centerY[i] + plane.z * _centerZ[i] + plane.w;
+            float boxRadius = fabsf(plane.x) * _extentX[i] + fabsf(plane.y) * _extentY[i] + fabsf(plane.z) * _extentZ[i];
+            float radius = boxRadius < _radius[i] ? boxRadius : _radius[i];
+            inside = distance + radius >= 0.0f;
+        }
+        _visible[i] = inside ? 1 : 0;
+        if (inside)
+            visibleIndices[visibleCount++] = i;
+    }
+    
+    return visibleCount;
+}
@@ -0,0 +1,96 @@
+//
+//  BoundsCuller.h
+//  open-safari
+//
+//  Created by Darren Tsung on 5/24/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__BoundsCuller__
+#define __open_safari__BoundsCuller__
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "Frustum.h"
+
+/**
+ Stores the bounding volumes of many objects and culls them against a frustum.
+ 
+ Each object is bounded by both an axis aligned box and a sphere. The bounds are kept as
+ a structure of arrays (all center x's together, all center y's together, etc.) so that
+ four objects can be tested against a plane at once with SSE.
+ */
+class BoundsCuller {
+public:
+    /**
+     Counts from the last call to cull()
+     */
+    struct Stats {
+        unsigned tested;
+        unsigned visible;
+        unsigned culled;
+        double milliseconds;
+    };
+    
+    BoundsCuller();
+    
+    /**
+     Adds an object to the store
+     
+     @param center   the center of the object's bounds, in world space
+     @param extents  the half-size of the bounding box along each axis
+     @param radius   the radius of the bounding sphere around `center`. If negative, the
+                     sphere that encloses the box is used.
+     
+     @result the index of the object, used with setBounds() and isVisible()
+     */
+    unsigned add(const glm::vec3& center, const glm::vec3& extents, float radius = -1.0f);
+    
+    /**
+     Updates the bounds of an object that has moved
+     */
+    void setBounds(unsigned index, const glm::vec3& center, const glm::vec3& extents, float radius = -1.0f);
+    
+    /** Removes every object */
+    void clear();
+    
+    /** the number of objects in the store */
+    unsigned size() const;
+    
+    /**
+     Tests every object against the frustum, updating the visibility of each object and
+     the stats
+     */
+    void cull(const Frustum& frustum);
+    
+    /**
+     @result true if the object was inside the frustum at the last call to cull()
+     */
+    bool isVisible(unsigned index) const;
+    
+    /**
+     @result the indices of the objects that were inside the frustum at the last call
+             to cull(), in increasing order
+     */
+    const std::vector<unsigned>& visibleIndices() const;
+    
+    const Stats& stats() const;
+    
+private:
+    std::vector<float> _centerX, _centerY, _centerZ;
+    std::vector<float> _extentX, _extentY, _extentZ;
+    std::vector<float> _radius;
+    
+    std::vector<unsigned char> _visible;
+    std::vector<unsigned> _visibleIndices;
+    Stats _stats;
+    
+    /**
+     Culls objects [begin, end), writing the indices of the visible ones to `visibleIndices`
+     
+     @result the number of visible objects
+     */
+    unsigned _cullRange(const Frustum& frustum, unsigned begin, unsigned end, unsigned* visibleIndices);
+};
+
+#endif /* defined(__open_safari__BoundsCuller__) */
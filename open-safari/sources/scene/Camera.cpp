@@ -0,0 +1,139 @@
+//
+//  Camera.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/12/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "Camera.h"
+#include <cassert>
+#include <glm/gtc/matrix_transform.hpp>
+
+Camera::Camera() :
+    _position(0.0f, 0.0f, 0.0f),
+    _fieldOfView(50.0f),
+    _nearPlane(0.01f),
+    _farPlane(100.0f),
+    _viewportAspectRatio(4.0f/3.0f),
+    _dirty(Dirty_Rotation | Dirty_View | Dirty_Projection | Dirty_Matrix)
+{
+}
+
+const glm::vec3& Camera::position() const {
+    return _position;
+}
+
+void Camera::setPosition(const glm::vec3& position) {
+    if (position == _position)
+        return;
+    _position = position;
+    _dirty |= Dirty_View | Dirty_Matrix;
+}
+
+const glm::quat& Camera::orientation() const {
+    return _orientation;
+}
+
+void Camera::setOrientation(const glm::quat& orientation) {
+    _orientation = glm::normalize(orientation);
+    _dirty |= Dirty_Rotation | Dirty_View | Dirty_Matrix;
+}
+
+float Camera::fieldOfView() const {
+    return _fieldOfView;
+}
+
+void Camera::setFieldOfView(float fieldOfView) {
+    assert(fieldOfView > 0.0f && fieldOfView < 180.0f);
+    if (fieldOfView == _fieldOfView)
+        return;
+    _fieldOfView = fieldOfView;
+    _dirty |= Dirty_Projection | Dirty_Matrix;
+}
+
+float Camera::nearPlane() const {
+    return _nearPlane;
+}
+
+float Camera::farPlane() const {
+    return _farPlane;
+}
+
+void Camera::setNearAndFarPlanes(float nearPlane, float farPlane) {
+    assert(nearPlane > 0.0f);
+    assert(farPlane > nearPlane);
+    _nearPlane = nearPlane;
+    _farPlane = farPlane;
+    _dirty |= Dirty_Projection | Dirty_Matrix;
+}
+
+float Camera::viewportAspectRatio() const {
+    return _viewportAspectRatio;
+}
+
+void Camera::setViewportAspectRatio(float viewportAspectRatio) {
+    assert(viewportAspectRatio > 0.0f);
+    _viewportAspectRatio = viewportAspectRatio;
+    _dirty |= Dirty_Projection | Dirty_Matrix;
+}
+
+const glm::vec3& Camera::forward() const {
+    if (_dirty & Dirty_Rotation)
+        _updateRotation();
+    return _forward;
+}
+
+const glm::vec3& Camera::right() const {
+    if (_dirty & Dirty_Rotation)
+        _updateRotation();
+    return _right;
+}
+
+const glm::vec3& Camera::up() const {
+    if (_dirty & Dirty_Rotation)
+        _updateRotation();
+    return _up;
+}
+
+const glm::mat4& Camera::rotation() const {
+    if (_dirty & Dirty_Rotation)
+        _updateRotation();
+    return _rotation;
+}
+
+const glm::mat4& Camera::view() const {
+    if (_dirty & Dirty_View) {
+        // the rotation, after moving the position to the origin
+        const glm::mat4& rotation = this->rotation();
+        _view = rotation;
+        _view[3] = rotation * glm::vec4(-_position, 1.0f);
+        _dirty &= ~Dirty_View;
+    }
+    return _view;
+}
+
+const glm::mat4& Camera::projection() const {
+    if (_dirty & Dirty_Projection) {
+        _projection = glm::perspective(_fieldOfView, _viewportAspectRatio, _nearPlane, _farPlane);
+        _dirty &= ~Dirty_Projection;
+    }
+    return _projection;
+}
+
+const glm::mat4& Camera::matrix() const {
+    if (_dirty & Dirty_Matrix) {
+        _matrix = projection() * view();
+        _dirty &= ~Dirty_Matrix;
+    }
+    return _matrix;
+}
+
+void Camera::_updateRotation() const {
+    _rotation = glm::mat4_cast(_orientation);
+    // the rotation's inverse is its transpose, so its rows are the camera's axes in world space
+    _right = glm::vec3(_rotation[0][0], _rotation[1][0], _rotation[2][0]);
+    _up = glm::vec3(_rotation[0][1], _rotation[1][1], _rotation[2][1]);
+    _forward = -glm::vec3(_rotation[0][2], _rotation[1][2], _rotation[2][2]);
+    _dirty &= ~Dirty_Rotation;
+}
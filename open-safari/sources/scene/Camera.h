@@ -0,0 +1,109 @@
+//
+//  Camera.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/12/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__Camera__
+#define __open_safari__Camera__
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+/**
+ A position, an orientation and a perspective projection, and the matrices and directions
+ worked out from them.
+ 
+ The matrices and directions are cached, and only worked out again the first time they're
+ asked for after something they depend on changes, so asking for them is cheap enough to do
+ as often as needed. The orientation is a rotation, so the directions are the rows of its
+ matrix and the view is built from it without inverting anything.
+ 
+ A camera is a plain value, so one can be copied to render from, or set up for another view
+ of the scene, without touching the one it came from.
+ */
+class Camera {
+public:
+    Camera();
+    
+    /**
+     The position of the camera.
+     */
+    const glm::vec3& position() const;
+    void setPosition(const glm::vec3& position);
+    
+    /**
+     The rotation from world space into the camera's space, where it looks down -z with +y
+     up. Normalized when it's set.
+     */
+    const glm::quat& orientation() const;
+    void setOrientation(const glm::quat& orientation);
+    
+    /**
+     The vertical viewing angle, in degrees, between 0 and 180
+     */
+    float fieldOfView() const;
+    void setFieldOfView(float fieldOfView);
+    
+    /**
+     The closest and farthest visible distances from the camera
+     
+     @param nearPlane  Must be > 0
+     @param farPlane   Must be > nearPlane
+     */
+    float nearPlane() const;
+    float farPlane() const;
+    void setNearAndFarPlanes(float nearPlane, float farPlane);
+    
+    /**
+     The width divided by the height of the viewport
+     */
+    float viewportAspectRatio() const;
+    void setViewportAspectRatio(float viewportAspectRatio);
+    
+    /** unit vectors in world space, in the direction the camera faces, to its right and out of its top */
+    const glm::vec3& forward() const;
+    const glm::vec3& right() const;
+    const glm::vec3& up() const;
+    
+    /** the orientation as a matrix, without the translation */
+    const glm::mat4& rotation() const;
+    
+    /** world space to camera space */
+    const glm::mat4& view() const;
+    
+    /** camera space to clip space */
+    const glm::mat4& projection() const;
+    
+    /** world space to clip space, projection() * view() */
+    const glm::mat4& matrix() const;
+
+private:
+    enum Dirty {
+        Dirty_Rotation = 1 << 0,
+        Dirty_View = 1 << 1,
+        Dirty_Projection = 1 << 2,
+        Dirty_Matrix = 1 << 3
+    };
+    
+    glm::vec3 _position;
+    glm::quat _orientation;
+    float _fieldOfView;
+    float _nearPlane;
+    float _farPlane;
+    float _viewportAspectRatio;
+    
+    // worked out when they're asked for, if their bit in _dirty is set
+    mutable unsigned _dirty;
+    mutable glm::mat4 _rotation;
+    mutable glm::vec3 _forward, _right, _up;
+    mutable glm::mat4 _view;
+    mutable glm::mat4 _projection;
+    mutable glm::mat4 _matrix;
+    
+    void _updateRotation() const;
+};
+
+#endif /* defined(__open_safari__Camera__) */
@@ -0,0 +1,86 @@
+//
+//  Frustum.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 5/24/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "Frustum.h"
+#include <cassert>
+
+/**
+ Row `row` of a column-major glm matrix
+ */
+static inline glm::vec4 MatrixRow(const glm::mat4& m, int row) {
+    return glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+}
+
+static inline glm::vec4 NormalizePlane(const glm::vec4& plane) {
+    float length = glm::length(glm::vec3(plane));
+    assert(length > 0.0f);
+    return plane / length;
+}
+
+Frustum::Frustum() {
+    for (int i=0; i<Plane_Count; i++)
+        _planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection) {
+    setMatrix(viewProjection);
+}
+
+void Frustum::setMatrix(const glm::mat4& viewProjection) {
+    // Gribb & Hartmann - a point p is inside when -w <= x,y,z <= w in clip space,
+    // which gives one plane per inequality as the sum/difference of two rows
+    glm::vec4 row0 = MatrixRow(viewProjection, 0);
+    glm::vec4 row1 = MatrixRow(viewProjection, 1);
+    glm::vec4 row2 = MatrixRow(viewProjection, 2);
+    glm::vec4 row3 = MatrixRow(viewProjection, 3);
+    
+    _planes[Plane_Left] = NormalizePlane(row3 + row0);
+    _planes[Plane_Right] = NormalizePlane(row3 - row0);
+    _planes[Plane_Bottom] = NormalizePlane(row3 + row1);
+    _planes[Plane_Top] = NormalizePlane(row3 - row1);
+    _planes[Plane_Near] = NormalizePlane(row3 + row2);
+    _planes[Plane_Far] = NormalizePlane(row3 - row2);
+}
+
+const glm::vec4& Frustum::plane(Plane plane) const {
+    assert(plane >= 0 && plane < Plane_Count);
+    return _planes[plane];
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const {
+    for (int i=0; i<Plane_Count; i++) {
+        if (glm::dot(glm::vec3(_planes[i]), center) + _planes[i].w < -radius)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::intersectsAABB(const glm::vec3& center, const glm::vec3& extents) const {
+    for (int i=0; i<Plane_Count; i++) {
+        glm::vec3 normal(_planes[i]);
+        // projected "radius" of the box onto the plane normal
+        float radius = glm::dot(glm::abs(normal), extents);
+        if (glm::dot(normal, center) + _planes[i].w < -radius)
+            return false;
+    }
+    return true;
+}
+
+Frustum::Containment Frustum::classifyAABB(const glm::vec3& center, const glm::vec3& extents) const {
+    Containment result = Containment_Inside;
+    for (int i=0; i<Plane_Count; i++) {
+        glm::vec3 normal(_planes[i]);
+        float radius = glm::dot(glm::abs(normal), extents);
+        float distance = glm::dot(normal, center) + _planes[i].w;
+        if (distance < -radius)
+            return Containment_Outside;
+        if (distance < radius)
+            result = Containment_Intersecting;
+    }
+    return result;
+}
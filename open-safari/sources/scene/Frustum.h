@@ -0,0 +1,85 @@
+//
+//  Frustum.h
+//  open-safari
+//
+//  Created by Darren Tsung on 5/24/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__Frustum__
+#define __open_safari__Frustum__
+
+#include <glm/glm.hpp>
+
+/**
+ The six clipping planes of a camera's view volume, in world space.
+ 
+ Planes are extracted straight from a combined projection * view matrix (such as
+ Player::matrix()) and are normalized so that plane.xyz is a unit normal pointing
+ into the frustum and plane.w is the signed distance from the origin.
+ */
+class Frustum {
+public:
+    enum Plane {
+        Plane_Left = 0,
+        Plane_Right,
+        Plane_Bottom,
+        Plane_Top,
+        Plane_Near,
+        Plane_Far,
+        Plane_Count
+    };
+    
+    /**
+     How much of a volume is inside the frustum
+     */
+    enum Containment {
+        Containment_Outside = 0,
+        Containment_Intersecting,
+        Containment_Inside
+    };
+    
+    /** Creates a degenerate frustum that contains everything */
+    Frustum();
+    
+    /**
+     Creates the frustum of the given camera matrix
+     
+     @param viewProjection  the projection * view matrix of the camera
+     */
+    explicit Frustum(const glm::mat4& viewProjection);
+    
+    /**
+     Re-extracts the planes from the given projection * view matrix
+     */
+    void setMatrix(const glm::mat4& viewProjection);
+    
+    /**
+     @result the plane as (normal.x, normal.y, normal.z, distance)
+     */
+    const glm::vec4& plane(Plane plane) const;
+    
+    /**
+     @result false if the sphere is completely outside of the frustum
+     */
+    bool intersectsSphere(const glm::vec3& center, float radius) const;
+    
+    /**
+     @result false if the axis aligned box is completely outside of the frustum
+     
+     @param center   the center of the box
+     @param extents  the half-size of the box along each axis
+     */
+    bool intersectsAABB(const glm::vec3& center, const glm::vec3& extents) const;
+    
+    /**
+     Like intersectsAABB(), but also tells whether the box is completely inside, which
+     lets hierarchical culling accept a whole subtree without testing its children
+     */
+    Containment classifyAABB(const glm::vec3& center, const glm::vec3& extents) const;
+    
+private:
+    glm::vec4 _planes[Plane_Count];
+};
+
+#endif /* defined(__open_safari__Frustum__) */
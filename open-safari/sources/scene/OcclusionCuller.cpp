@@ -0,0 +1,306 @@
+//
+//  OcclusionCuller.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 5/26/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "OcclusionCuller.h"
+#include "core/ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/** rows per rasterization task, small enough to keep every thread busy */
+static const unsigned BandHeight = 16;
+
+OcclusionCuller::OcclusionCuller(unsigned width, unsigned height) :
+_width((width + 3) & ~3u),
+_height(height)
+{
+    assert(width > 0 && height > 0);
+    
+    unsigned levelWidth = _width;
+    unsigned levelHeight = _height;
+    while (true) {
+        Level level;
+        level.width = levelWidth;
+        level.height = levelHeight;
+        level.depth.resize(levelWidth * levelHeight, 1.0f);
+        _levels.push_back(level);
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+        levelWidth = std::max(1u, (levelWidth + 1) / 2);
+        levelHeight = std::max(1u, (levelHeight + 1) / 2);
+    }
+    
+    _stats.occluderTriangles = _stats.tested = _stats.occluded = 0;
+    _stats.rasterizeMilliseconds = 0.0;
+}
+
+void OcclusionCuller::beginFrame(const glm::mat4& viewProjection) {
+    _viewProjection = viewProjection;
+    _triangles.clear();
+    _stats.occluderTriangles = _stats.tested = _stats.occluded = 0;
+}
+
+void OcclusionCuller::addOccluder(const glm::mat4& model, const glm::vec3* vertices,
+                                  const unsigned short* indices, unsigned indexCount) {
+    assert(indexCount % 3 == 0);
+    const glm::mat4 transform = _viewProjection * model;
+    const glm::vec2 screenSize((float)_width, (float)_height);
+    
+    for (unsigned i=0; i<indexCount; i += 3) {
+        glm::vec3 screen[3];
+        bool clipped = false;
+        for (int v=0; v<3; v++) {
+            glm::vec4 clip = transform * glm::vec4(vertices[indices[i + v]], 1.0f);
+            // triangles poking through the near plane are skipped, which only ever makes
+            // the culling less aggressive
+            if (clip.z < -clip.w || clip.w <= 0.0f) {
+                clipped = true;
+                break;
+            }
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            screen[v] = glm::vec3((0.5f * glm::vec2(ndc) + 0.5f) * screenSize, 0.5f * ndc.z + 0.5f);
+        }
+        if (clipped)
+            continue;
+        
+        ScreenTriangle triangle;
+        triangle.v0 = screen[0];
+        triangle.v1 = screen[1];
+        triangle.v2 = screen[2];
+        
+        // make every triangle counter-clockwise so the edge functions are positive inside
+        float area = (triangle.v1.x - triangle.v0.x) * (triangle.v2.y - triangle.v0.y) -
+                     (triangle.v1.y - triangle.v0.y) * (triangle.v2.x - triangle.v0.x);
+        if (fabsf(area) < 1e-6f)
+            continue;
+        if (area < 0.0f)
+            std::swap(triangle.v1, triangle.v2);
+        
+        triangle.minY = std::min(triangle.v0.y, std::min(triangle.v1.y, triangle.v2.y));
+        triangle.maxY = std::max(triangle.v0.y, std::max(triangle.v1.y, triangle.v2.y));
+        float minX = std::min(triangle.v0.x, std::min(triangle.v1.x, triangle.v2.x));
+        float maxX = std::max(triangle.v0.x, std::max(triangle.v1.x, triangle.v2.x));
+        if (maxX < 0.0f || minX >= screenSize.x || triangle.maxY < 0.0f || triangle.minY >= screenSize.y)
+            continue;
+        
+        _triangles.push_back(triangle);
+    }
+    _stats.occluderTriangles = (unsigned)_triangles.size();
+}
+
+void OcclusionCuller::finishFrame() {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    
+    // every band clears and fills its own rows, so no locking is needed
+    unsigned bandCount = (_height + BandHeight - 1) / BandHeight;
+    ParallelFor(bandCount, [this](unsigned band) {
+        unsigned firstRow = band * BandHeight;
+        unsigned lastRow = std::min(firstRow + BandHeight, _height);
+        std::fill(_levels[0].depth.begin() + firstRow * _width,
+                  _levels[0].depth.begin() + lastRow * _width, 1.0f);
+        
+        for (size_t i=0; i<_triangles.size(); i++) {
+            const ScreenTriangle& triangle = _triangles[i];
+            if (triangle.maxY < (float)firstRow || triangle.minY >= (float)lastRow)
+                continue;
+            _rasterizeTriangle(triangle, firstRow, lastRow);
+        }
+    });
+    _buildPyramid();
+    
+    std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+    _stats.rasterizeMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/**
+ Each edge function is A*x + B*y + C, positive on the inside of the edge. Depth is
+ interpolated with a plane equation of the same form.
+ 
+ Only texels the triangle covers completely are written, with the farthest depth the
+ triangle has inside them, so a big occluder's silhouette never hides anything that
+ peeks out by less than a texel.
+ */
+void OcclusionCuller::_rasterizeTriangle(const ScreenTriangle& triangle, unsigned firstRow, unsigned lastRow) {
+    const glm::vec3* v[3] = { &triangle.v0, &triangle.v1, &triangle.v2 };
+    float A[3], B[3], C[3];
+    for (int i=0; i<3; i++) {
+        const glm::vec3& a = *v[(i + 1) % 3];
+        const glm::vec3& b = *v[(i + 2) % 3];
+        A[i] = a.y - b.y;
+        B[i] = b.x - a.x;
+        C[i] = -A[i] * a.x - B[i] * a.y;
+    }
+    float area = A[0] * triangle.v0.x + B[0] * triangle.v0.y + C[0];
+    float zA = (A[0] * triangle.v0.z + A[1] * triangle.v1.z + A[2] * triangle.v2.z) / area;
+    float zB = (B[0] * triangle.v0.z + B[1] * triangle.v1.z + B[2] * triangle.v2.z) / area;
+    float zC = (C[0] * triangle.v0.z + C[1] * triangle.v1.z + C[2] * triangle.v2.z) / area;
+    
+    // tested at texel centers, so pull every edge in and push the depth back by half a texel
+    for (int i=0; i<3; i++)
+        C[i] -= 0.5f * (fabsf(A[i]) + fabsf(B[i]));
+    zC += 0.5f * (fabsf(zA) + fabsf(zB));
+    
+    float minX = std::min(triangle.v0.x, std::min(triangle.v1.x, triangle.v2.x));
+    float maxX = std::max(triangle.v0.x, std::max(triangle.v1.x, triangle.v2.x));
+    int startX = std::max(0, (int)floorf(minX)) & ~3;
+    int endX = std::min((int)_width - 1, (int)ceilf(maxX));
+    int startY = std::max((int)firstRow, (int)floorf(triangle.minY));
+    int endY = std::min((int)lastRow - 1, (int)ceilf(triangle.maxY));
+    
+    float* depth = &_levels[0].depth[0];
+    for (int y=startY; y<=endY; y++) {
+        float py = (float)y + 0.5f;
+        float* row = depth + y * _width;
+        int x = startX;
+        
+#if defined(__SSE__)
+        __m128 e0Row = _mm_set1_ps(B[0] * py + C[0]);
+        __m128 e1Row = _mm_set1_ps(B[1] * py + C[1]);
+        __m128 e2Row = _mm_set1_ps(B[2] * py + C[2]);
+        __m128 zRow = _mm_set1_ps(zB * py + zC);
+        __m128 a0 = _mm_set1_ps(A[0]), a1 = _mm_set1_ps(A[1]), a2 = _mm_set1_ps(A[2]);
+        __m128 za = _mm_set1_ps(zA);
+        __m128 px = _mm_add_ps(_mm_set1_ps((float)x + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+        const __m128 four = _mm_set1_ps(4.0f);
+        const __m128 zero = _mm_setzero_ps();
+        
+        for (; x<=endX; x += 4) {
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), e0Row);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), e1Row);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), e2Row);
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+            if (_mm_movemask_ps(inside)) {
+                __m128 z = _mm_add_ps(_mm_mul_ps(za, px), zRow);
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_min_ps(old, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+            }
+            px = _mm_add_ps(px, four);
+        }
+#else
+        for (; x<=endX; x++) {
+            float px = (float)x + 0.5f;
+            if (A[0] * px + B[0] * py + C[0] >= 0.0f &&
+                A[1] * px + B[1] * py + C[1] >= 0.0f &&
+                A[2] * px + B[2] * py + C[2] >= 0.0f) {
+                float z = zA * px + zB * py + zC;
+                if (z < row[x])
+                    row[x] = z;
+            }
+        }
+#endif
+    }
+}
+
+void OcclusionCuller::_buildPyramid() {
+    for (size_t l=1; l<_levels.size(); l++) {
+        const Level& source = _levels[l - 1];
+        Level& level = _levels[l];
+        for (unsigned y=0; y<level.height; y++) {
+            unsigned y0 = std::min(2 * y, source.height - 1);
+            unsigned y1 = std::min(2 * y + 1, source.height - 1);
+            for (unsigned x=0; x<level.width; x++) {
+                unsigned x0 = std::min(2 * x, source.width - 1);
+                unsigned x1 = std::min(2 * x + 1, source.width - 1);
+                // the farthest depth, so a texel never claims to hide more than its children
+                float farthest = std::max(std::max(source.depth[y0 * source.width + x0], source.depth[y0 * source.width + x1]),
+                                          std::max(source.depth[y1 * source.width + x0], source.depth[y1 * source.width + x1]));
+                level.depth[y * level.width + x] = farthest;
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isVisible(const AABB& bounds) const {
+    glm::vec2 screenMin(1e30f), screenMax(-1e30f);
+    float nearestDepth = 1.0f;
+    for (int i=0; i<8; i++) {
+        glm::vec3 corner((i & 1) ? bounds.max.x : bounds.min.x,
+                         (i & 2) ? bounds.max.y : bounds.min.y,
+                         (i & 4) ? bounds.max.z : bounds.min.z);
+        glm::vec4 clip = _viewProjection * glm::vec4(corner, 1.0f);
+        // crossing the near plane, so it's right in front of the camera
+        if (clip.z < -clip.w || clip.w <= 0.0f)
+            return true;
+        
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        glm::vec2 screen = (0.5f * glm::vec2(ndc) + 0.5f) * glm::vec2((float)_width, (float)_height);
+        screenMin = glm::min(screenMin, screen);
+        screenMax = glm::max(screenMax, screen);
+        nearestDepth = std::min(nearestDepth, 0.5f * ndc.z + 0.5f);
+    }
+    
+    // off screen, leave that to frustum culling
+    if (screenMax.x < 0.0f || screenMax.y < 0.0f || screenMin.x >= (float)_width || screenMin.y >= (float)_height)
+        return true;
+    
+    int x0 = std::max(0, (int)floorf(screenMin.x));
+    int y0 = std::max(0, (int)floorf(screenMin.y));
+    int x1 = std::min((int)_width - 1, (int)floorf(screenMax.x));
+    int y1 = std::min((int)_height - 1, (int)floorf(screenMax.y));
+    
+    // go up the pyramid until the box covers at most 2x2 texels
+    size_t l = 0;
+    while ((x1 - x0 > 1 || y1 - y0 > 1) && l + 1 < _levels.size()) {
+        x0 >>= 1; y0 >>= 1; x1 >>= 1; y1 >>= 1;
+        l++;
+    }
+    
+    const Level& level = _levels[l];
+    for (int y=y0; y<=y1; y++) {
+        for (int x=x0; x<=x1; x++) {
+            if (nearestDepth <= level.depth[y * level.width + x])
+                return true;
+        }
+    }
+    return false;
+}
+
+bool OcclusionCuller::test(const AABB& bounds) {
+    bool visible = isVisible(bounds);
+    _stats.tested++;
+    if (!visible)
+        _stats.occluded++;
+    return visible;
+}
+
+const OcclusionCuller::Stats& OcclusionCuller::stats() const {
+    return _stats;
+}
+
+tdogl::Bitmap OcclusionCuller::debugBitmap(unsigned level) const {
+    assert(level < _levels.size());
+    const Level& source = _levels[level];
+    
+    // perspective depth bunches up near 1, so stretch whatever range is in use
+    float nearest = 1.0f;
+    for (size_t i=0; i<source.depth.size(); i++)
+        nearest = std::min(nearest, source.depth[i]);
+    float scale = nearest < 1.0f ? 255.0f / (1.0f - nearest) : 0.0f;
+    
+    // gray RGB rather than grayscale, luminance textures aren't in the core profile
+    std::vector<unsigned char> pixels(source.width * source.height * 3);
+    for (size_t i=0; i<source.depth.size(); i++) {
+        unsigned char value = (unsigned char)((source.depth[i] - nearest) * scale);
+        pixels[3*i] = pixels[3*i + 1] = pixels[3*i + 2] = value;
+    }
+    return tdogl::Bitmap(source.width, source.height, tdogl::Bitmap::Format_RGB, &pixels[0]);
+}
+
+unsigned OcclusionCuller::width() const {
+    return _width;
+}
+
+unsigned OcclusionCuller::height() const {
+    return _height;
+}
@@ -0,0 +1,119 @@
+//
+//  OcclusionCuller.h
+//  open-safari
+//
+//  Created by Darren Tsung on 5/26/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__OcclusionCuller__
+#define __open_safari__OcclusionCuller__
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "tdogl/Bitmap.h"
+
+/**
+ A low resolution depth buffer of a few big occluders, used to skip drawing objects that
+ are hidden behind them.
+ 
+ Each frame the occluder triangles are rasterized on the CPU (four pixels at a time with
+ SSE, in horizontal bands spread across threads), then a hierarchical-Z pyramid is built
+ where each texel holds the farthest depth of the four texels below it. An object is
+ occluded if the nearest point of its bounds is behind the farthest occluder depth
+ everywhere it covers on screen.
+ 
+ Usage per frame: beginFrame(), addOccluder() for each occluder, finishFrame(), then
+ isVisible() for each object (which is const and safe to call from many threads).
+ */
+class OcclusionCuller {
+public:
+    /**
+     Counts from the last frame
+     */
+    struct Stats {
+        unsigned occluderTriangles;
+        unsigned tested;
+        unsigned occluded;
+        double rasterizeMilliseconds;
+    };
+    
+    /**
+     @param width   the width of the depth buffer in pixels, rounded up to a multiple of 4
+     @param height  the height of the depth buffer in pixels
+     */
+    OcclusionCuller(unsigned width = 256, unsigned height = 128);
+    
+    /**
+     Clears the depth buffer and the occluders
+     
+     @param viewProjection  the camera matrix the scene is drawn with
+     */
+    void beginFrame(const glm::mat4& viewProjection);
+    
+    /**
+     Adds an occluder mesh for this frame. The mesh should be solid: anything behind any
+     of its triangles will be treated as hidden.
+     
+     @param model        the transformation from the mesh's space to world space
+     @param vertices     the vertex positions of the mesh
+     @param indices      three indices into `vertices` per triangle
+     @param indexCount   the number of indices
+     */
+    void addOccluder(const glm::mat4& model, const glm::vec3* vertices,
+                     const unsigned short* indices, unsigned indexCount);
+    
+    /**
+     Rasterizes the occluders and builds the depth pyramid
+     */
+    void finishFrame();
+    
+    /**
+     @result false if the box is completely hidden behind the occluders
+     */
+    bool isVisible(const AABB& bounds) const;
+    
+    /**
+     Same as isVisible(), but counts the result in the stats. Not safe to call from more
+     than one thread at once.
+     */
+    bool test(const AABB& bounds);
+    
+    const Stats& stats() const;
+    
+    /**
+     The depth buffer as an RGB image, near is black and far is white. The first row is
+     the bottom of the screen, so it can be uploaded to a texture directly.
+     
+     @param level  which level of the depth pyramid to show, 0 is full resolution
+     */
+    tdogl::Bitmap debugBitmap(unsigned level = 0) const;
+    
+    unsigned width() const;
+    unsigned height() const;
+    
+private:
+    /** a triangle after projection, x and y in pixels and z in [0, 1] */
+    struct ScreenTriangle {
+        glm::vec3 v0, v1, v2;
+        float minY, maxY;
+    };
+    
+    struct Level {
+        unsigned width, height;
+        std::vector<float> depth;
+    };
+    
+    unsigned _width, _height;
+    glm::mat4 _viewProjection;
+    std::vector<ScreenTriangle> _triangles;
+    /** level 0 is the rasterized depth buffer, each level after is half the size */
+    std::vector<Level> _levels;
+    Stats _stats;
+    
+    void _rasterizeTriangle(const ScreenTriangle& triangle, unsigned firstRow, unsigned lastRow);
+    void _buildPyramid();
+};
+
+#endif /* defined(__open_safari__OcclusionCuller__) */
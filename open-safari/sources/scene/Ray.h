@@ -0,0 +1,204 @@
+//
+//  Ray.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/15/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__Ray__
+#define __open_safari__Ray__
+
+#include <cassert>
+#include <xmmintrin.h>
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "Triangle.h"
+
+/**
+ A ray from a point. Distances along it are in multiples of `direction`, so they stay the
+ same when the ray is moved into another space with a matrix.
+ */
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    
+    Ray() : origin(0.0f), direction(0.0f, 0.0f, -1.0f) {}
+    Ray(const glm::vec3& origin, const glm::vec3& direction) : origin(origin), direction(direction) {}
+    
+    glm::vec3 pointAt(float distance) const { return origin + direction * distance; }
+    
+    /** the ray with its origin and direction multiplied by the matrix */
+    Ray transformed(const glm::mat4& matrix) const {
+        return Ray(glm::vec3(matrix * glm::vec4(origin, 1.0f)), glm::vec3(matrix * glm::vec4(direction, 0.0f)));
+    }
+};
+
+/**
+ Where a ray hit a triangle
+ */
+struct RayHit {
+    float distance;
+    /** the unit normal of the side of the triangle the ray hit */
+    glm::vec3 normal;
+    /** the triangle, in whatever it was cast at */
+    unsigned triangle;
+};
+
+/**
+ Four rays tested together, a coordinate of each in each SSE register, so a box or a
+ triangle is tested against all four in about the time one would take. Rays that start
+ close together and point the same way, like those through neighboring pixels, mostly
+ visit the same nodes of a tree, so a packet walks it once for all of them.
+ 
+ Each ray has its own maximum distance, which the casts shorten as they find hits. Rays
+ that are switched off have a negative one, so they never hit anything.
+ */
+struct RayPacket {
+    enum {
+        Size = 4,
+        /** the mask with every ray in it */
+        AllRays = (1 << Size) - 1
+    };
+    
+    __m128 originX, originY, originZ;
+    __m128 directionX, directionY, directionZ;
+    __m128 inverseX, inverseY, inverseZ;
+    __m128 maxDistance;
+    /** the rays' directions added up, to visit near nodes before far ones */
+    glm::vec3 mainDirection;
+    
+    RayPacket() {}
+    
+    /**
+     @param count  how many of the rays there are, the rest are switched off
+     */
+    RayPacket(const Ray* rays, unsigned count, float maxDistance) : mainDirection(0.0f) {
+        assert(count <= Size);
+        float components[7][Size];
+        for (unsigned r=0; r<Size; r++) {
+            const Ray& ray = rays[r < count ? r : 0];
+            for (int axis=0; axis<3; axis++) {
+                components[axis][r] = ray.origin[axis];
+                components[3 + axis][r] = ray.direction[axis];
+            }
+            components[6][r] = r < count ? maxDistance : -1.0f;
+            if (r < count)
+                mainDirection += ray.direction;
+        }
+        originX = _mm_loadu_ps(components[0]);
+        originY = _mm_loadu_ps(components[1]);
+        originZ = _mm_loadu_ps(components[2]);
+        directionX = _mm_loadu_ps(components[3]);
+        directionY = _mm_loadu_ps(components[4]);
+        directionZ = _mm_loadu_ps(components[5]);
+        this->maxDistance = _mm_loadu_ps(components[6]);
+        _updateInverse();
+    }
+    
+    /** the packet with each ray's origin and direction multiplied by the matrix, and the
+        same maximum distances */
+    RayPacket transformed(const glm::mat4& m) const {
+        RayPacket packet;
+        packet.originX = _transform(m, 0, originX, originY, originZ, _mm_set1_ps(m[3][0]));
+        packet.originY = _transform(m, 1, originX, originY, originZ, _mm_set1_ps(m[3][1]));
+        packet.originZ = _transform(m, 2, originX, originY, originZ, _mm_set1_ps(m[3][2]));
+        packet.directionX = _transform(m, 0, directionX, directionY, directionZ, _mm_setzero_ps());
+        packet.directionY = _transform(m, 1, directionX, directionY, directionZ, _mm_setzero_ps());
+        packet.directionZ = _transform(m, 2, directionX, directionY, directionZ, _mm_setzero_ps());
+        packet.maxDistance = maxDistance;
+        packet.mainDirection = glm::vec3(m * glm::vec4(mainDirection, 0.0f));
+        packet._updateInverse();
+        return packet;
+    }
+    
+    /** the maximum distance of one of the rays */
+    float distance(int ray) const {
+        float distances[Size];
+        _mm_storeu_ps(distances, maxDistance);
+        return distances[ray];
+    }
+    
+    /** the rays that haven't been switched off */
+    int active() const {
+        return _mm_movemask_ps(_mm_cmpge_ps(maxDistance, _mm_setzero_ps()));
+    }
+    
+    /**
+     A slab test of each ray against the box
+     
+     @result  a bit for each ray that enters the box before its maximum distance
+     */
+    int hitsBox(const AABB& box) const {
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.min.x), originX), inverseX);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.max.x), originX), inverseX);
+        __m128 enter = _mm_max_ps(_mm_min_ps(t0, t1), _mm_setzero_ps());
+        __m128 exit = _mm_min_ps(_mm_max_ps(t0, t1), maxDistance);
+        t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.min.y), originY), inverseY);
+        t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.max.y), originY), inverseY);
+        enter = _mm_max_ps(_mm_min_ps(t0, t1), enter);
+        exit = _mm_min_ps(_mm_max_ps(t0, t1), exit);
+        t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.min.z), originZ), inverseZ);
+        t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.max.z), originZ), inverseZ);
+        enter = _mm_max_ps(_mm_min_ps(t0, t1), enter);
+        exit = _mm_min_ps(_mm_max_ps(t0, t1), exit);
+        return _mm_movemask_ps(_mm_cmple_ps(enter, exit));
+    }
+    
+    /**
+     Tests each ray against both sides of the triangle (Möller–Trumbore), and shortens the
+     maximum distance of the ones that hit it to where they hit. Rays that are switched off
+     never hit.
+     
+     @result  a bit for each ray that hit the triangle before its maximum distance
+     */
+    int hitTriangle(const Triangle& triangle) {
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        glm::vec3 edge1 = triangle.b - triangle.a, edge2 = triangle.c - triangle.a;
+        __m128 e1x = _mm_set1_ps(edge1.x), e1y = _mm_set1_ps(edge1.y), e1z = _mm_set1_ps(edge1.z);
+        __m128 e2x = _mm_set1_ps(edge2.x), e2y = _mm_set1_ps(edge2.y), e2z = _mm_set1_ps(edge2.z);
+        
+        // p = direction x edge2
+        __m128 px = _mm_sub_ps(_mm_mul_ps(directionY, e2z), _mm_mul_ps(directionZ, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(directionZ, e2x), _mm_mul_ps(directionX, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(directionX, e2y), _mm_mul_ps(directionY, e2x));
+        __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 inverseDeterminant = _mm_div_ps(one, determinant);
+        
+        // s = origin - a, q = s x edge1
+        __m128 sx = _mm_sub_ps(originX, _mm_set1_ps(triangle.a.x));
+        __m128 sy = _mm_sub_ps(originY, _mm_set1_ps(triangle.a.y));
+        __m128 sz = _mm_sub_ps(originZ, _mm_set1_ps(triangle.a.z));
+        __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDeterminant);
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, qx), _mm_mul_ps(directionY, qy)), _mm_mul_ps(directionZ, qz)), inverseDeterminant);
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDeterminant);
+        
+        // a ray along the triangle's plane gets an infinite or NaN u, which fails the tests
+        __m128 hit = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, maxDistance)));
+        maxDistance = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, maxDistance));
+        return _mm_movemask_ps(hit);
+    }
+
+private:
+    void _updateInverse() {
+        // dividing by zero gives infinities, which the slab test handles
+        const __m128 one = _mm_set1_ps(1.0f);
+        inverseX = _mm_div_ps(one, directionX);
+        inverseY = _mm_div_ps(one, directionY);
+        inverseZ = _mm_div_ps(one, directionZ);
+    }
+    
+    /** row `row` of the matrix times (x, y, z), plus `w` */
+    static __m128 _transform(const glm::mat4& m, int row, __m128 x, __m128 y, __m128 z, __m128 w) {
+        __m128 result = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][row]), x), w);
+        result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(m[1][row]), y));
+        return _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(m[2][row]), z));
+    }
+};
+
+#endif /* defined(__open_safari__Ray__) */
@@ -0,0 +1,46 @@
+//
+//  Triangle.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/13/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__Triangle__
+#define __open_safari__Triangle__
+
+#include <glm/glm.hpp>
+#include "AABB.h"
+
+/**
+ A triangle given by its corners. The front is the side the corners go around
+ counterclockwise.
+ */
+struct Triangle {
+    glm::vec3 a, b, c;
+    
+    Triangle() : a(0.0f), b(0.0f), c(0.0f) {}
+    Triangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) : a(a), b(b), c(c) {}
+    
+    /** the unit normal out of the front, or zero if the triangle has no area */
+    glm::vec3 normal() const {
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        return length > 0.0f ? normal / length : glm::vec3(0.0f);
+    }
+    
+    glm::vec3 centroid() const { return (a + b + c) / 3.0f; }
+    
+    AABB bounds() const {
+        return AABB(glm::min(glm::min(a, b), c), glm::max(glm::max(a, b), c));
+    }
+    
+    /** the triangle with each corner multiplied by the matrix */
+    Triangle transformed(const glm::mat4& matrix) const {
+        return Triangle(glm::vec3(matrix * glm::vec4(a, 1.0f)),
+                        glm::vec3(matrix * glm::vec4(b, 1.0f)),
+                        glm::vec3(matrix * glm::vec4(c, 1.0f)));
+    }
+};
+
+#endif /* defined(__open_safari__Triangle__) */
@@ -0,0 +1,302 @@
+//
+//  TriangleBVH.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/13/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "TriangleBVH.h"
+#include <algorithm>
+
+namespace {
+    /** how many places along the axis each split tries */
+    const int SplitBins = 8;
+    
+    struct Bin {
+        AABB bounds;
+        unsigned count;
+    };
+    
+    void Grow(AABB& bounds, bool& empty, const AABB& other) {
+        bounds = empty ? other : AABB::merge(bounds, other);
+        empty = false;
+    }
+    
+    /** the distance along the ray it hits either side of the triangle (Möller–Trumbore), if
+        it does before `maxDistance` */
+    bool RayTriangle(const Ray& ray, const Triangle& triangle, float maxDistance, float* distance) {
+        glm::vec3 edge1 = triangle.b - triangle.a;
+        glm::vec3 edge2 = triangle.c - triangle.a;
+        glm::vec3 p = glm::cross(ray.direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (determinant == 0.0f)
+            return false;
+        float inverseDeterminant = 1.0f / determinant;
+        glm::vec3 s = ray.origin - triangle.a;
+        float u = glm::dot(s, p) * inverseDeterminant;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, edge1);
+        float v = glm::dot(ray.direction, q) * inverseDeterminant;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        float t = glm::dot(edge2, q) * inverseDeterminant;
+        if (t <= 0.0f || t >= maxDistance)
+            return false;
+        *distance = t;
+        return true;
+    }
+    
+    /** the triangle's normal, turned to face back along the ray */
+    glm::vec3 FacingNormal(const Triangle& triangle, const glm::vec3& direction) {
+        glm::vec3 normal = triangle.normal();
+        return glm::dot(normal, direction) > 0.0f ? -normal : normal;
+    }
+}
+
+TriangleBVH::TriangleBVH(const std::vector<Triangle>& triangles) :
+    _triangles(triangles)
+{
+    _build();
+}
+
+TriangleBVH::TriangleBVH(const std::vector<glm::vec3>& positions, const std::vector<unsigned>& indices) {
+    assert(indices.size() % 3 == 0);
+    _triangles.reserve(indices.size() / 3);
+    for (size_t i=0; i+2<indices.size(); i+=3)
+        _triangles.push_back(Triangle(positions[indices[i]], positions[indices[i+1]], positions[indices[i+2]]));
+    _build();
+}
+
+const std::vector<Triangle>& TriangleBVH::triangles() const {
+    return _triangles;
+}
+
+const Triangle& TriangleBVH::triangle(unsigned index) const {
+    return _triangles[index];
+}
+
+const AABB& TriangleBVH::bounds() const {
+    static const AABB empty;
+    return _nodes.empty() ? empty : _nodes[0].bounds;
+}
+
+unsigned TriangleBVH::nodeCount() const {
+    return (unsigned)_nodes.size();
+}
+
+bool TriangleBVH::raycast(const Ray& ray, float maxDistance, RayHit* hit) const {
+    // dividing by zero gives infinities, which the slab test handles
+    const glm::vec3 inverseDirection(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+    
+    unsigned stack[MaxQueryDepth];
+    int count = 0;
+    if (!_nodes.empty())
+        stack[count++] = 0;
+    
+    int hitTriangle = -1;
+    while (count > 0) {
+        unsigned index = stack[--count];
+        const Node& node = _nodes[index];
+        if (!node.bounds.raycast(ray.origin, inverseDirection, maxDistance))
+            continue;
+        
+        if (node.isLeaf()) {
+            for (unsigned i=node.first; i<node.first+node.count; i++) {
+                if (RayTriangle(ray, _triangles[i], maxDistance, &maxDistance))
+                    hitTriangle = (int)i;
+            }
+        } else {
+            assert(count + 2 <= MaxQueryDepth);
+            // push the far child first so the near one is visited first, and the hits in
+            // it can rule the far one out
+            float distance1 = glm::dot(_nodes[index + 1].bounds.center() - ray.origin, ray.direction);
+            float distance2 = glm::dot(_nodes[node.first].bounds.center() - ray.origin, ray.direction);
+            if (distance1 < distance2) {
+                stack[count++] = node.first;
+                stack[count++] = index + 1;
+            } else {
+                stack[count++] = index + 1;
+                stack[count++] = node.first;
+            }
+        }
+    }
+    
+    if (hitTriangle == -1)
+        return false;
+    hit->distance = maxDistance;
+    hit->normal = FacingNormal(_triangles[hitTriangle], ray.direction);
+    hit->triangle = (unsigned)hitTriangle;
+    return true;
+}
+
+int TriangleBVH::raycast(RayPacket& packet, RayHit* hits) const {
+    unsigned stack[MaxQueryDepth];
+    int count = 0;
+    if (!_nodes.empty())
+        stack[count++] = 0;
+    
+    // which triangle each ray hit last, which is the nearest since the distances only shrink
+    unsigned hitTriangles[RayPacket::Size];
+    int hitRays = 0;
+    while (count > 0) {
+        unsigned index = stack[--count];
+        const Node& node = _nodes[index];
+        if (!packet.hitsBox(node.bounds))
+            continue;
+        
+        if (node.isLeaf()) {
+            for (unsigned i=node.first; i<node.first+node.count; i++) {
+                int rays = packet.hitTriangle(_triangles[i]);
+                hitRays |= rays;
+                for (int r=0; rays; r++, rays >>= 1) {
+                    if (rays & 1)
+                        hitTriangles[r] = i;
+                }
+            }
+        } else {
+            assert(count + 2 <= MaxQueryDepth);
+            float distance1 = glm::dot(_nodes[index + 1].bounds.center(), packet.mainDirection);
+            float distance2 = glm::dot(_nodes[node.first].bounds.center(), packet.mainDirection);
+            if (distance1 < distance2) {
+                stack[count++] = node.first;
+                stack[count++] = index + 1;
+            } else {
+                stack[count++] = index + 1;
+                stack[count++] = node.first;
+            }
+        }
+    }
+    
+    if (hitRays) {
+        float distances[RayPacket::Size], directions[3][RayPacket::Size];
+        _mm_storeu_ps(distances, packet.maxDistance);
+        _mm_storeu_ps(directions[0], packet.directionX);
+        _mm_storeu_ps(directions[1], packet.directionY);
+        _mm_storeu_ps(directions[2], packet.directionZ);
+        for (int r=0; r<RayPacket::Size; r++) {
+            if (!(hitRays & (1 << r)))
+                continue;
+            glm::vec3 direction(directions[0][r], directions[1][r], directions[2][r]);
+            hits[r].distance = distances[r];
+            hits[r].normal = FacingNormal(_triangles[hitTriangles[r]], direction);
+            hits[r].triangle = hitTriangles[r];
+        }
+    }
+    return hitRays;
+}
+
+void TriangleBVH::_build() {
+    _nodes.clear();
+    if (_triangles.empty())
+        return;
+    
+    std::vector<glm::vec3> centroids(_triangles.size());
+    for (size_t i=0; i<_triangles.size(); i++)
+        centroids[i] = _triangles[i].centroid();
+    
+    // there are never more than 2n - 1 nodes
+    _nodes.reserve(2 * _triangles.size());
+    Node root;
+    root.first = 0;
+    root.count = (unsigned)_triangles.size();
+    _nodes.push_back(root);
+    _split(0, centroids);
+}
+
+void TriangleBVH::_split(unsigned node, std::vector<glm::vec3>& centroids) {
+    unsigned first = _nodes[node].first;
+    unsigned count = _nodes[node].count;
+    
+    AABB bounds = _triangles[first].bounds();
+    AABB centroidBounds(centroids[first], centroids[first]);
+    for (unsigned i=first+1; i<first+count; i++) {
+        bounds = AABB::merge(bounds, _triangles[i].bounds());
+        centroidBounds = AABB::merge(centroidBounds, AABB(centroids[i], centroids[i]));
+    }
+    _nodes[node].bounds = bounds;
+    if (count <= MaxLeafTriangles)
+        return;
+    
+    // bin the centroids along the axis they're most spread out on
+    glm::vec3 size = centroidBounds.max - centroidBounds.min;
+    int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+    unsigned middle = first + count / 2;
+    if (size[axis] > 0.0f) {
+        Bin bins[SplitBins];
+        bool empty[SplitBins];
+        for (int b=0; b<SplitBins; b++) {
+            bins[b].count = 0;
+            empty[b] = true;
+        }
+        float scale = SplitBins / size[axis];
+        for (unsigned i=first; i<first+count; i++) {
+            int b = std::min((int)((centroids[i][axis] - centroidBounds.min[axis]) * scale), SplitBins - 1);
+            bins[b].count++;
+            Grow(bins[b].bounds, empty[b], _triangles[i].bounds());
+        }
+        
+        // the cost of splitting after each bin, sweeping in from both ends
+        float rightCosts[SplitBins];
+        AABB right;
+        bool rightEmpty = true;
+        unsigned rightCount = 0;
+        for (int b=SplitBins-1; b>0; b--) {
+            if (!empty[b])
+                Grow(right, rightEmpty, bins[b].bounds);
+            rightCount += bins[b].count;
+            rightCosts[b] = rightEmpty ? 0.0f : rightCount * right.surfaceArea();
+        }
+        AABB left;
+        bool leftEmpty = true;
+        unsigned leftCount = 0;
+        int bestBin = -1;
+        float bestCost = 0.0f;
+        for (int b=0; b<SplitBins-1; b++) {
+            if (!empty[b])
+                Grow(left, leftEmpty, bins[b].bounds);
+            leftCount += bins[b].count;
+            if (leftCount == 0 || leftCount == count)
+                continue;
+            float cost = leftCount * left.surfaceArea() + rightCosts[b+1];
+            if (bestBin == -1 || cost < bestCost) {
+                bestBin = b;
+                bestCost = cost;
+            }
+        }
+        
+        if (bestBin != -1) {
+            // move the triangles in the bins up to the best one to the front
+            unsigned i = first, j = first + count;
+            while (i < j) {
+                int b = std::min((int)((centroids[i][axis] - centroidBounds.min[axis]) * scale), SplitBins - 1);
+                if (b <= bestBin) {
+                    i++;
+                } else {
+                    j--;
+                    std::swap(_triangles[i], _triangles[j]);
+                    std::swap(centroids[i], centroids[j]);
+                }
+            }
+            middle = i;
+        }
+    }
+    
+    Node left;
+    left.first = first;
+    left.count = middle - first;
+    Node right;
+    right.first = middle;
+    right.count = first + count - middle;
+    
+    unsigned leftIndex = (unsigned)_nodes.size();
+    _nodes.push_back(left);
+    _split(leftIndex, centroids);
+    unsigned rightIndex = (unsigned)_nodes.size();
+    _nodes.push_back(right);
+    _split(rightIndex, centroids);
+    
+    _nodes[node].first = rightIndex;
+    _nodes[node].count = 0;
+}
@@ -0,0 +1,133 @@
+//
+//  TriangleBVH.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/13/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__TriangleBVH__
+#define __open_safari__TriangleBVH__
+
+#include <vector>
+#include <cassert>
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "Triangle.h"
+#include "Ray.h"
+
+/**
+ A bounding volume hierarchy over the triangles of a mesh that doesn't change, for finding
+ the few triangles near a point or a box, or in the way of a ray, without testing all of
+ them.
+ 
+ Unlike AABBTree, which keeps a tree of moving objects balanced as they come and go, this
+ is built once from all of the triangles. Each node is split where the surface area
+ heuristic, estimated with a handful of bins along the longest axis, says it's cheapest,
+ and the triangles are sorted so every leaf's are next to each other. The nodes are in one
+ array, depth first, so a node's first child is right after it.
+ 
+ Queries are const and don't allocate, so any number of threads can query at once.
+ */
+class TriangleBVH {
+public:
+    enum {
+        /** deepest tree the queries can walk */
+        MaxQueryDepth = 64,
+        /** leaves hold at most this many triangles */
+        MaxLeafTriangles = 4
+    };
+    
+    /**
+     @param triangles  the mesh, in whatever space it'll be queried in
+     */
+    explicit TriangleBVH(const std::vector<Triangle>& triangles);
+    
+    /**
+     Builds the tree over an indexed mesh, such as the one a tdogl::Mesh is made from
+     
+     @param indices  three for each triangle
+     */
+    TriangleBVH(const std::vector<glm::vec3>& positions, const std::vector<unsigned>& indices);
+    
+    /** the triangles, in the order the leaves hold them */
+    const std::vector<Triangle>& triangles() const;
+    const Triangle& triangle(unsigned index) const;
+    
+    /** the bounds of every triangle */
+    const AABB& bounds() const;
+    
+    unsigned nodeCount() const;
+    
+    /**
+     Reports each triangle whose bounds overlap `bounds`
+     
+     @param callback  called as bool(unsigned triangle), returning false stops the query
+     */
+    template <typename Callback>
+    void queryAABB(const AABB& bounds, const Callback& callback) const;
+    
+    /**
+     Finds the first triangle the ray hits, from either side
+     
+     @param maxDistance  how far along the ray to look, in multiples of its direction
+     @param hit          set to the nearest hit, if there is one
+     @result             whether the ray hit anything
+     */
+    bool raycast(const Ray& ray, float maxDistance, RayHit* hit) const;
+    
+    /**
+     Finds the first triangle each ray of the packet hits, walking the tree once for all of
+     them. The packet's distances are shortened to the hits, so a packet can be cast at one
+     mesh after another to find the nearest hit among them.
+     
+     @param hits  set for the rays that hit something, one for each ray
+     @result      a bit for each ray that hit something
+     */
+    int raycast(RayPacket& packet, RayHit* hits) const;
+
+private:
+    struct Node {
+        AABB bounds;
+        /** the first triangle for leaves, the second child otherwise */
+        unsigned first;
+        /** the triangles in a leaf, 0 for inner nodes */
+        unsigned count;
+        
+        bool isLeaf() const { return count > 0; }
+    };
+    
+    std::vector<Triangle> _triangles;
+    std::vector<Node> _nodes;
+    
+    void _build();
+    void _split(unsigned node, std::vector<glm::vec3>& centroids);
+};
+
+template <typename Callback>
+void TriangleBVH::queryAABB(const AABB& bounds, const Callback& callback) const {
+    unsigned stack[MaxQueryDepth];
+    int count = 0;
+    if (!_nodes.empty())
+        stack[count++] = 0;
+    
+    while (count > 0) {
+        unsigned index = stack[--count];
+        const Node& node = _nodes[index];
+        if (!node.bounds.overlaps(bounds))
+            continue;
+        
+        if (node.isLeaf()) {
+            for (unsigned i=node.first; i<node.first+node.count; i++) {
+                if (_triangles[i].bounds().overlaps(bounds) && !callback(i))
+                    return;
+            }
+        } else {
+            assert(count + 2 <= MaxQueryDepth);
+            stack[count++] = node.first;
+            stack[count++] = index + 1;
+        }
+    }
+}
+
+#endif /* defined(__open_safari__TriangleBVH__) */
@@ -8,6 +8,11 @@
 
 #include "Bitmap.h"
 #include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+#include <stdint.h>
 
 //uses stb_image to try load files
 #define STBI_FAILURE_USERMSG
@@ -157,6 +162,248 @@ inline bool RectsOverlap(unsigned srcCol, unsigned srcRow, unsigned destCol, uns
 }
 
 
+/**
+ PNG writing
+ 
+ The image data is compressed with LZ77, matches found with hash chains, and coded with
+ deflate's fixed Huffman codes, which is most of the way to what zlib does at a fraction
+ of the code and time
+ */
+struct CrcTable {
+    uint32_t values[256];
+    
+    CrcTable() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            values[n] = c;
+        }
+    }
+};
+
+static uint32_t Crc32(const unsigned char* data, size_t size, uint32_t crc = 0) {
+    static const CrcTable table;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t Adler32(const unsigned char* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        // the sums can go this long before they have to be reduced
+        size_t run = size < 5552 ? size : 5552;
+        for (size_t i = 0; i < run; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += run;
+        size -= run;
+    }
+    return (b << 16) | a;
+}
+
+static void AppendBigEndian(std::vector<unsigned char>& out, uint32_t value) {
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)value);
+}
+
+/** writes bits from the least significant bit of each byte up, as deflate wants */
+class BitWriter {
+public:
+    BitWriter(std::vector<unsigned char>& out) : _out(out), _bits(0), _count(0) {}
+    
+    void write(uint32_t value, int count) {
+        _bits |= value << _count;
+        _count += count;
+        while (_count >= 8) {
+            _out.push_back((unsigned char)_bits);
+            _bits >>= 8;
+            _count -= 8;
+        }
+    }
+    
+    /** Huffman codes go most significant bit first */
+    void writeCode(uint32_t code, int count) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < count; i++)
+            reversed |= ((code >> i) & 1) << (count - 1 - i);
+        write(reversed, count);
+    }
+    
+    void flush() {
+        if (_count > 0)
+            _out.push_back((unsigned char)_bits);
+        _bits = 0;
+        _count = 0;
+    }
+
+private:
+    std::vector<unsigned char>& _out;
+    uint32_t _bits;
+    int _count;
+};
+
+static const unsigned LengthBases[] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const unsigned LengthExtraBits[] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const unsigned DistanceBases[] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const unsigned DistanceExtraBits[] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+static void WriteFixedSymbol(BitWriter& writer, unsigned symbol) {
+    if (symbol < 144)
+        writer.writeCode(0x30 + symbol, 8);
+    else if (symbol < 256)
+        writer.writeCode(0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        writer.writeCode(symbol - 256, 7);
+    else
+        writer.writeCode(0xc0 + symbol - 280, 8);
+}
+
+static void WriteMatch(BitWriter& writer, unsigned length, unsigned distance) {
+    unsigned code = 0;
+    while (code + 1 < 29 && LengthBases[code + 1] <= length)
+        code++;
+    WriteFixedSymbol(writer, 257 + code);
+    writer.write(length - LengthBases[code], LengthExtraBits[code]);
+    
+    code = 0;
+    while (code + 1 < 30 && DistanceBases[code + 1] <= distance)
+        code++;
+    writer.writeCode(code, 5);
+    writer.write(distance - DistanceBases[code], DistanceExtraBits[code]);
+}
+
+/** the data as a zlib stream holding one deflate block */
+static void Compress(const unsigned char* data, size_t size, std::vector<unsigned char>& out) {
+    const int WindowSize = 32768, HashSize = 1 << 15, MaxChain = 32;
+    const unsigned MinMatch = 3, MaxMatch = 258;
+    
+    // 32K window, default compression
+    out.push_back(0x78);
+    out.push_back(0x9c);
+    
+    BitWriter writer(out);
+    writer.write(1, 1); // the last block
+    writer.write(1, 2); // with the fixed codes
+    
+    std::vector<int> heads(HashSize, -1), previous(WindowSize, -1);
+    auto hashAt = [&](size_t i) {
+        return ((data[i] << 10) ^ (data[i+1] << 5) ^ data[i+2]) & (HashSize - 1);
+    };
+    auto insert = [&](size_t i) {
+        if (i + MinMatch > size)
+            return;
+        unsigned hash = hashAt(i);
+        previous[i & (WindowSize - 1)] = heads[hash];
+        heads[hash] = (int)i;
+    };
+    
+    size_t i = 0;
+    while (i < size) {
+        unsigned bestLength = 0, bestDistance = 0;
+        if (i + MinMatch <= size) {
+            unsigned maxLength = (unsigned)std::min<size_t>(MaxMatch, size - i);
+            int candidate = heads[hashAt(i)];
+            for (int chain = 0; chain < MaxChain && candidate >= 0 && i - candidate <= (size_t)WindowSize; chain++) {
+                // only longer matches are worth comparing all of
+                if (data[candidate + bestLength] == data[i + bestLength] || bestLength == 0) {
+                    unsigned length = 0;
+                    while (length < maxLength && data[candidate + length] == data[i + length])
+                        length++;
+                    if (length > bestLength) {
+                        bestLength = length;
+                        bestDistance = (unsigned)(i - candidate);
+                        if (length == maxLength)
+                            break;
+                    }
+                }
+                int next = previous[candidate & (WindowSize - 1)];
+                if (next >= candidate)
+                    break;
+                candidate = next;
+            }
+        }
+        
+        if (bestLength >= MinMatch) {
+            WriteMatch(writer, bestLength, bestDistance);
+            for (unsigned j = 0; j < bestLength; j++)
+                insert(i + j);
+            i += bestLength;
+        } else {
+            WriteFixedSymbol(writer, data[i]);
+            insert(i);
+            i++;
+        }
+    }
+    WriteFixedSymbol(writer, 256);
+    writer.flush();
+    
+    AppendBigEndian(out, Adler32(data, size));
+}
+
+inline unsigned char Paeth(int left, int up, int upLeft) {
+    int estimate = left + up - upLeft;
+    int leftDistance = abs(estimate - left), upDistance = abs(estimate - up), upLeftDistance = abs(estimate - upLeft);
+    if (leftDistance <= upDistance && leftDistance <= upLeftDistance)
+        return (unsigned char)left;
+    return (unsigned char)(upDistance <= upLeftDistance ? up : upLeft);
+}
+
+/**
+ Each row gets whichever of PNG's five filters makes its bytes smallest, taken as signed
+ numbers, the usual guess at which will compress best
+ */
+static void FilterRows(const unsigned char* pixels, unsigned width, unsigned height, unsigned channels,
+                       std::vector<unsigned char>& filtered)
+{
+    size_t rowSize = (size_t)width * channels;
+    filtered.resize((rowSize + 1) * height);
+    std::vector<unsigned char> candidate(rowSize), zeros(rowSize, 0);
+    for (unsigned row = 0; row < height; ++row) {
+        const unsigned char* current = pixels + row * rowSize;
+        const unsigned char* above = row > 0 ? current - rowSize : &zeros[0];
+        unsigned char* out = &filtered[row * (rowSize + 1)];
+        unsigned long bestSum = 0;
+        for (int filter = 0; filter < 5; filter++) {
+            unsigned long sum = 0;
+            for (size_t i = 0; i < rowSize; i++) {
+                int left = i >= channels ? current[i - channels] : 0;
+                int upLeft = i >= channels ? above[i - channels] : 0;
+                unsigned char predicted = 0;
+                switch (filter) {
+                    case 1: predicted = (unsigned char)left; break;
+                    case 2: predicted = above[i]; break;
+                    case 3: predicted = (unsigned char)((left + above[i]) / 2); break;
+                    case 4: predicted = Paeth(left, above[i], upLeft); break;
+                }
+                candidate[i] = (unsigned char)(current[i] - predicted);
+                sum += candidate[i] < 128 ? candidate[i] : 256 - candidate[i];
+            }
+            if (filter == 0 || sum < bestSum) {
+                bestSum = sum;
+                out[0] = (unsigned char)filter;
+                memcpy(out + 1, &candidate[0], rowSize);
+            }
+        }
+    }
+}
+
+static void AppendChunk(std::vector<unsigned char>& png, const char* type, const std::vector<unsigned char>& data) {
+    AppendBigEndian(png, (uint32_t)data.size());
+    size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data.begin(), data.end());
+    AppendBigEndian(png, Crc32(&png[start], png.size() - start));
+}
+
+
 /*
  * Bitmap class functions
  */
@@ -180,6 +427,34 @@ Bitmap Bitmap::bitmapFromFile(std::string filePath) {
     return bmp;
 }
 
+void Bitmap::saveToFile(std::string filePath) const {
+    // the PNG color types for each format
+    static const unsigned char colorTypes[] = { 0, 0, 4, 2, 6 };
+    
+    std::vector<unsigned char> header;
+    AppendBigEndian(header, _width);
+    AppendBigEndian(header, _height);
+    header.push_back(8); // bits per channel
+    header.push_back(colorTypes[_format]);
+    header.push_back(0); // deflate
+    header.push_back(0); // the only filter method
+    header.push_back(0); // not interlaced
+    
+    std::vector<unsigned char> filtered, compressed;
+    FilterRows(_pixels, _width, _height, _format, filtered);
+    Compress(&filtered[0], filtered.size(), compressed);
+    
+    static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    std::vector<unsigned char> png(signature, signature + sizeof(signature));
+    AppendChunk(png, "IHDR", header);
+    AppendChunk(png, "IDAT", compressed);
+    AppendChunk(png, "IEND", std::vector<unsigned char>());
+    
+    std::ofstream file(filePath.c_str(), std::ios::out | std::ios::binary);
+    if(!file.write((const char*)&png[0], png.size()))
+        throw std::runtime_error(std::string("Failed to write ") + filePath);
+}
+
 /** width in pixels */
 unsigned Bitmap::width() const {
     return _width;
@@ -247,6 +522,28 @@ void Bitmap::rotate90CounterClockwise() {
     _width = swapTmp;
 }
 
+Bitmap Bitmap::shrunk(unsigned factor) const {
+    if(factor == 0 || factor > _width || factor > _height)
+        throw std::runtime_error("Can't shrink bitmap by that much");
+    
+    Bitmap small(_width / factor, _height / factor, _format);
+    const unsigned area = factor * factor;
+    for (unsigned row = 0; row < small._height; row++) {
+        for (unsigned col = 0; col < small._width; col++) {
+            unsigned sums[4] = { 0, 0, 0, 0 };
+            for (unsigned y = 0; y < factor; y++) {
+                const unsigned char* src = _pixels + GetPixelOffset(col * factor, row * factor + y, _width, _height, _format);
+                for (unsigned x = 0; x < factor * _format; x++)
+                    sums[x % _format] += src[x];
+            }
+            unsigned char* dest = small._pixels + GetPixelOffset(col, row, small._width, small._height, _format);
+            for (unsigned c = 0; c < (unsigned)_format; c++)
+                dest[c] = (unsigned char)((sums[c] + area / 2) / area);
+        }
+    }
+    return small;
+}
+
 /** copy constructor */
 Bitmap::Bitmap(const Bitmap& other) :
     _pixels(NULL)
@@ -47,6 +47,13 @@ namespace tdogl {
          */
         static Bitmap bitmapFromFile(std::string filePath);
         
+        /**
+         Saves the bitmap as a PNG file, in its own format
+         
+         Throws an exception if the file can't be written
+         */
+        void saveToFile(std::string filePath) const;
+        
         /** width in pixels */
         unsigned width() const;
         
@@ -86,6 +93,13 @@ namespace tdogl {
          */
         void rotate90CounterClockwise();
         
+        /**
+         Makes a smaller copy of the image, averaging each square of factor x factor pixels
+         into one. Pixels left over past the last whole square on the right and bottom are
+         dropped.
+         */
+        Bitmap shrunk(unsigned factor) const;
+        
         /** 
          Copies a rectangular area from the bitmap src to this bitmap.
          
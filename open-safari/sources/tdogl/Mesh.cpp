@@ -0,0 +1,112 @@
+//
+//  Mesh.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/2/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "Mesh.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+
+using namespace tdogl;
+
+Mesh::Mesh(const Program& program,
+           const std::vector<Vertex>& vertices,
+           const std::vector<std::vector<GLuint> >& lods) :
+_vao(0),
+_vbo(0),
+_ibo(0),
+_radius(0.0f)
+{
+    if (vertices.empty() || lods.empty())
+        throw std::runtime_error("Mesh needs vertices and at least one level of detail");
+    
+    // the sphere around the bounding box
+    glm::vec3 min = vertices[0].position, max = vertices[0].position;
+    for (size_t i=1; i<vertices.size(); i++) {
+        min = glm::min(min, vertices[i].position);
+        max = glm::max(max, vertices[i].position);
+    }
+    _center = 0.5f * (min + max);
+    for (size_t i=0; i<vertices.size(); i++)
+        _radius = std::max(_radius, glm::length(vertices[i].position - _center));
+    
+    std::vector<GLuint> indices;
+    for (size_t lod=0; lod<lods.size(); lod++) {
+        assert(lods[lod].size() % 3 == 0);
+        IndexRange range = { (GLsizei)indices.size(), (GLsizei)lods[lod].size() };
+        indices.insert(indices.end(), lods[lod].begin(), lods[lod].end());
+        _lods.push_back(range);
+    }
+    
+    glGenVertexArrays(1, &_vao);
+    glBindVertexArray(_vao);
+    
+    glGenBuffers(1, &_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    
+    glEnableVertexAttribArray(program.attrib("vert"));
+    glVertexAttribPointer(program.attrib("vert"), 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, position));
+    
+    // the optional attributes are looked up directly, Program::attrib() throws when they're missing
+    GLint normal = glGetAttribLocation(program.object(), "vertNormal");
+    if (normal != -1) {
+        glEnableVertexAttribArray(normal);
+        glVertexAttribPointer(normal, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, normal));
+    }
+    GLint texCoord = glGetAttribLocation(program.object(), "vertTexCoord");
+    if (texCoord != -1) {
+        glEnableVertexAttribArray(texCoord);
+        glVertexAttribPointer(texCoord, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, texCoord));
+    }
+    
+    // the element buffer binding is part of the VAO
+    glGenBuffers(1, &_ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+    
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+Mesh::~Mesh()
+{
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteBuffers(1, &_vbo);
+    glDeleteBuffers(1, &_ibo);
+}
+
+unsigned Mesh::lodCount() const
+{
+    return (unsigned)_lods.size();
+}
+
+unsigned Mesh::triangleCount(unsigned lod) const
+{
+    assert(lod < _lods.size());
+    return _lods[lod].count / 3;
+}
+
+const glm::vec3& Mesh::center() const
+{
+    return _center;
+}
+
+float Mesh::radius() const
+{
+    return _radius;
+}
+
+void Mesh::draw(unsigned lod) const
+{
+    assert(lod < _lods.size());
+    glBindVertexArray(_vao);
+    glDrawElements(GL_TRIANGLES, _lods[lod].count, GL_UNSIGNED_INT, (const GLvoid*)(_lods[lod].offset * sizeof(GLuint)));
+    glBindVertexArray(0);
+}
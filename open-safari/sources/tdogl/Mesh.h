@@ -0,0 +1,88 @@
+//
+//  Mesh.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/2/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__Mesh__
+#define __open_safari__Mesh__
+
+#include "Program.h"
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+namespace tdogl {
+    /**
+     An indexed triangle mesh with a chain of levels of detail.
+     
+     Every level indexes the same vertex buffer, so the coarser levels only cost their
+     indices. All the index lists are kept in one element buffer.
+     */
+    class Mesh {
+    public:
+        struct Vertex {
+            glm::vec3 position;
+            glm::vec3 normal;
+            glm::vec2 texCoord;
+        };
+        
+        /**
+         Uploads the mesh.
+         
+         The positions go to the program's "vert" attribute. The normals and texture
+         coordinates go to "vertNormal" and "vertTexCoord" if the program has them.
+         
+         @param program   the program the mesh will be drawn with
+         @param vertices  the vertices shared by every level of detail
+         @param lods      the triangle indices of each level of detail, the most detailed
+                          first. There must be at least one.
+         */
+        Mesh(const Program& program,
+             const std::vector<Vertex>& vertices,
+             const std::vector<std::vector<GLuint> >& lods);
+        
+        /**
+         Deletes the buffers using glDeleteBuffers()
+         */
+        ~Mesh();
+        
+        /** the number of levels of detail */
+        unsigned lodCount() const;
+        
+        /** the number of triangles in a level of detail */
+        unsigned triangleCount(unsigned lod) const;
+        
+        /** the center of a sphere around every vertex */
+        const glm::vec3& center() const;
+        
+        /** the radius of the sphere around every vertex */
+        float radius() const;
+        
+        /**
+         Draws a level of detail. The program must be in use.
+         */
+        void draw(unsigned lod) const;
+    
+    private:
+        struct IndexRange {
+            GLsizei offset;
+            GLsizei count;
+        };
+        
+        GLuint _vao;
+        GLuint _vbo;
+        GLuint _ibo;
+        std::vector<IndexRange> _lods;
+        glm::vec3 _center;
+        float _radius;
+        
+        //copying disabled
+        Mesh(const Mesh&);
+        const Mesh& operator=(const Mesh&);
+    };
+}
+
+#endif /* defined(__open_safari__Mesh__) */
@@ -12,7 +12,7 @@
 
 using namespace tdogl;
 
-Program::Program(const std::vector<Shader>& shaders) :
+Program::Program(const std::vector<Shader>& shaders, const std::vector<std::string>& attribs) :
     _object(0)
 {
     if (shaders.size() == 0)
@@ -27,6 +27,10 @@ Program::Program(const std::vector<Shader>& shaders) :
     for (int i=0; i<shaders.size(); i++)
         glAttachShader(_object, shaders[i].object());
     
+    // fix the attribute locations, if asked to
+    for (int i=0; i<attribs.size(); i++)
+        glBindAttribLocation(_object, i, attribs[i].c_str());
+    
     // link all the shaders together
     glLinkProgram(_object);
     
@@ -27,12 +27,15 @@ namespace tdogl {
          Creates a program from a vector of tdogl::shaders
          
          @param shaders     The shaders to link together to create the program
+         @param attribs     Attributes to bind to locations 0, 1, 2 and so on before
+                            linking, so programs sharing a vertex shader can draw the same
+                            vertex arrays
          
          @throws std::exception if an error occurs
          
          @see tdogl::shader
          */
-        Program(const std::vector<Shader>& shaders);
+        Program(const std::vector<Shader>& shaders, const std::vector<std::string>& attribs = std::vector<std::string>());
         ~Program();
         
         /**
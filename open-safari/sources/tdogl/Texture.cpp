@@ -44,6 +44,28 @@ _originalHeight((GLfloat)bitmap.height())
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+Texture::Texture(GLsizei width, GLsizei height, GLenum internalFormat, const GLfloat* pixels, GLint minMagFilter, GLint wrapMode) :
+_originalWidth((GLfloat)width),
+_originalHeight((GLfloat)height)
+{
+    glGenTextures(1, &_object);
+    glBindTexture(GL_TEXTURE_2D, _object);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minMagFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, minMagFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 internalFormat,
+                 width,
+                 height,
+                 0,
+                 GL_RGBA,
+                 GL_FLOAT,
+                 pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 Texture::~Texture()
 {
     glDeleteTextures(1, &_object);
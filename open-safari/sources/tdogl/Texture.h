@@ -33,6 +33,26 @@ namespace tdogl {
                 GLint minMagFilter = GL_LINEAR,
                 GLint wrapMode = GL_CLAMP_TO_EDGE);
         
+        /**
+         Creates a texture from floating point data rather than an image, such as
+         positions or other values that need more precision than a byte.
+         
+         The rows are loaded in order, so row 0 of `pixels` is t = 0.
+         
+         @param width           width in pixels
+         @param height          height in pixels
+         @param internalFormat  how the texture is stored, e.g. GL_RGBA16F or GL_RGBA32F
+         @param pixels          four floats per pixel, row after row
+         @param minMagFilter    GL_NEAREST (default) or GL_LINEAR
+         @param wrapMode        GL_REPEAT, GL_MIRRORED_REPEAT, GL_CLAMP_TO_EDGE (default), or GL_CLAMP_TO_BORDER
+         */
+        Texture(GLsizei width,
+                GLsizei height,
+                GLenum internalFormat,
+                const GLfloat* pixels,
+                GLint minMagFilter = GL_NEAREST,
+                GLint wrapMode = GL_CLAMP_TO_EDGE);
+        
         /**
          Deletes the texture object using glDeleteTextures()
          */
@@ -0,0 +1,531 @@
+//
+//  Terrain.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 5/28/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "Terrain.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ The vertex layout of the chunk buffers
+ */
+struct TerrainVertex {
+    GLfloat position[3];
+    /** normalized to [-127, 127], the fourth byte is padding */
+    GLbyte normal[4];
+};
+
+static float HeightFromPixel(const unsigned char* pixel, tdogl::Bitmap::Format format) {
+    if (format == tdogl::Bitmap::Format_Grayscale)
+        return pixel[0] / 255.0f;
+    return ((pixel[0] << 8) | pixel[1]) / 65535.0f;
+}
+
+/**
+ @result the index of the i'th surface vertex along one of the four chunk edges, which are
+         numbered in the order of the Edge bits (left, right, top, bottom)
+ */
+static inline int EdgeVertexIndex(int edge, int i, int cells) {
+    const int side = cells + 1;
+    switch (edge) {
+        case 0: return i * side;
+        case 1: return i * side + cells;
+        case 2: return i;
+        default: return cells * side + i;
+    }
+}
+
+static inline GLbyte PackNormalComponent(float value) {
+    return (GLbyte)(value * 127.0f);
+}
+
+Terrain::Terrain(const tdogl::Bitmap& heightmap,
+                 const tdogl::Program& program,
+                 const glm::vec3& origin,
+                 float cellSize,
+                 float heightScale,
+                 unsigned chunkCells) :
+_samplesX(heightmap.width()),
+_samplesZ(heightmap.height()),
+_origin(origin),
+_cellSize(cellSize),
+_chunkCells(chunkCells),
+_lodDistance(64.0f),
+_indexBuffer(0),
+_gpuBytes(0)
+{
+    assert(cellSize > 0.0f);
+    assert(chunkCells >= 2 && chunkCells <= 128 && (chunkCells & (chunkCells - 1)) == 0);
+    if (_samplesX < 2 || _samplesZ < 2)
+        throw std::runtime_error("Heightmap must be at least 2x2 pixels");
+    
+    _heights.resize(_samplesX * _samplesZ);
+    for (unsigned z=0; z<_samplesZ; z++) {
+        for (unsigned x=0; x<_samplesX; x++)
+            _heights[z * _samplesX + x] = heightScale * HeightFromPixel(heightmap.getPixel(x, z), heightmap.format());
+    }
+    
+    _maxLod = 0;
+    while ((1u << _maxLod) < _chunkCells)
+        _maxLod++;
+    
+    _chunksX = (_samplesX - 1 + _chunkCells - 1) / _chunkCells;
+    _chunksZ = (_samplesZ - 1 + _chunkCells - 1) / _chunkCells;
+    
+    _buildIndexBuffer();
+    
+    _chunks.resize(_chunksX * _chunksZ);
+    for (unsigned z=0; z<_chunksZ; z++) {
+        for (unsigned x=0; x<_chunksX; x++) {
+            Chunk& chunk = _chunks[z * _chunksX + x];
+            _buildChunk(chunk, x, z, program);
+            _bounds = (x == 0 && z == 0) ? chunk.bounds : AABB::merge(_bounds, chunk.bounds);
+        }
+    }
+    
+    _stats.chunksDrawn = _stats.trianglesDrawn = 0;
+}
+
+Terrain::~Terrain() {
+    for (size_t i=0; i<_chunks.size(); i++) {
+        glDeleteVertexArrays(1, &_chunks[i].vao);
+        glDeleteBuffers(1, &_chunks[i].vbo);
+    }
+    glDeleteBuffers(1, &_indexBuffer);
+}
+
+void Terrain::update(const glm::vec3& viewPosition) {
+    // the level grows by one every time the distance doubles
+    for (size_t i=0; i<_chunks.size(); i++) {
+        float distance = sqrtf(_chunks[i].bounds.distanceSquared(viewPosition));
+        int lod = 0;
+        if (distance > _lodDistance)
+            lod = (int)floorf(log2f(distance / _lodDistance)) + 1;
+        _chunks[i].lod = std::min(lod, _maxLod);
+    }
+    
+    // neighbours may only be one level apart for the stitching to work, so refine any chunk
+    // that is too coarse next to a detailed one until nothing changes
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (unsigned z=0; z<_chunksZ; z++) {
+            for (unsigned x=0; x<_chunksX; x++) {
+                Chunk& chunk = _chunks[z * _chunksX + x];
+                int finest = chunk.lod;
+                if (x > 0) finest = std::min(finest, _chunks[z * _chunksX + x - 1].lod);
+                if (x + 1 < _chunksX) finest = std::min(finest, _chunks[z * _chunksX + x + 1].lod);
+                if (z > 0) finest = std::min(finest, _chunks[(z - 1) * _chunksX + x].lod);
+                if (z + 1 < _chunksZ) finest = std::min(finest, _chunks[(z + 1) * _chunksX + x].lod);
+                if (chunk.lod > finest + 1) {
+                    chunk.lod = finest + 1;
+                    changed = true;
+                }
+            }
+        }
+    }
+    
+    for (unsigned z=0; z<_chunksZ; z++) {
+        for (unsigned x=0; x<_chunksX; x++) {
+            Chunk& chunk = _chunks[z * _chunksX + x];
+            chunk.stitchEdges = 0;
+            if (x > 0 && _chunks[z * _chunksX + x - 1].lod > chunk.lod)
+                chunk.stitchEdges |= Edge_Left;
+            if (x + 1 < _chunksX && _chunks[z * _chunksX + x + 1].lod > chunk.lod)
+                chunk.stitchEdges |= Edge_Right;
+            if (z > 0 && _chunks[(z - 1) * _chunksX + x].lod > chunk.lod)
+                chunk.stitchEdges |= Edge_Top;
+            if (z + 1 < _chunksZ && _chunks[(z + 1) * _chunksX + x].lod > chunk.lod)
+                chunk.stitchEdges |= Edge_Bottom;
+        }
+    }
+}
+
+void Terrain::render(const Frustum& frustum) {
+    _stats.chunksDrawn = _stats.trianglesDrawn = 0;
+    
+    for (size_t i=0; i<_chunks.size(); i++) {
+        const Chunk& chunk = _chunks[i];
+        if (!frustum.intersectsAABB(chunk.bounds.center(), chunk.bounds.extents()))
+            continue;
+        
+        const IndexRange& range = _indexRanges[chunk.lod * Edge_Count + chunk.stitchEdges];
+        glBindVertexArray(chunk.vao);
+        glDrawElements(GL_TRIANGLES, range.count, GL_UNSIGNED_SHORT, (const GLvoid*)(range.offset * sizeof(GLushort)));
+        
+        _stats.chunksDrawn++;
+        _stats.trianglesDrawn += range.count / 3;
+        
+        if (chunk.borderEdges) {
+            const IndexRange& skirt = _skirtRanges[chunk.lod * Edge_Count + chunk.borderEdges];
+            glDrawElements(GL_TRIANGLES, skirt.count, GL_UNSIGNED_SHORT, (const GLvoid*)(skirt.offset * sizeof(GLushort)));
+            _stats.trianglesDrawn += skirt.count / 3;
+        }
+    }
+    glBindVertexArray(0);
+}
+
+float Terrain::lodDistance() const {
+    return _lodDistance;
+}
+
+void Terrain::setLodDistance(float lodDistance) {
+    assert(lodDistance > 0.0f);
+    _lodDistance = lodDistance;
+}
+
+const AABB& Terrain::bounds() const {
+    return _bounds;
+}
+
+const glm::vec3& Terrain::origin() const {
+    return _origin;
+}
+
+float Terrain::cellSize() const {
+    return _cellSize;
+}
+
+unsigned Terrain::samplesX() const {
+    return _samplesX;
+}
+
+unsigned Terrain::samplesZ() const {
+    return _samplesZ;
+}
+
+unsigned Terrain::chunkCells() const {
+    return _chunkCells;
+}
+
+size_t Terrain::cpuBytes() const {
+    return _heights.size() * sizeof(float);
+}
+
+size_t Terrain::gpuBytes() const {
+    return _gpuBytes;
+}
+
+float Terrain::sampleHeight(int x, int z) const {
+    x = std::max(0, std::min(x, (int)_samplesX - 1));
+    z = std::max(0, std::min(z, (int)_samplesZ - 1));
+    return _heights[z * _samplesX + x];
+}
+
+float Terrain::heightAt(float x, float z) const {
+    float height;
+    sampleBatch(&x, &z, 1, &height);
+    return height;
+}
+
+glm::vec3 Terrain::normalAt(float x, float z) const {
+    float height;
+    glm::vec3 normal;
+    sample(x, z, &height, &normal);
+    return normal;
+}
+
+void Terrain::sample(float x, float z, float* height, glm::vec3* normal) const {
+    sampleBatch(&x, &z, 1, height, &normal->x, &normal->y, &normal->z);
+}
+
+/**
+ Each position is clamped onto the terrain, split into a cell and the fraction across it,
+ then the four corner heights are blended. The normal comes from the slope of the same
+ bilinear patch. Clamping the cell to one before the last edge keeps all four corners in
+ range without any branches.
+ */
+void Terrain::sampleBatch(const float* x, const float* z, unsigned count, float* heights,
+                          float* normalX, float* normalY, float* normalZ) const {
+    const float inverseCellSize = 1.0f / _cellSize;
+    const float maxCellX = (float)(_samplesX - 2);
+    const float maxCellZ = (float)(_samplesZ - 2);
+    const float* samples = &_heights[0];
+    const int stride = (int)_samplesX;
+    const bool wantNormals = normalX && normalY && normalZ;
+    unsigned i = 0;
+
+#if defined(__SSE2__)
+    const __m128 originX = _mm_set1_ps(_origin.x);
+    const __m128 originY = _mm_set1_ps(_origin.y);
+    const __m128 originZ = _mm_set1_ps(_origin.z);
+    const __m128 scale = _mm_set1_ps(inverseCellSize);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 lastSampleX = _mm_set1_ps((float)(_samplesX - 1));
+    const __m128 lastSampleZ = _mm_set1_ps((float)(_samplesZ - 1));
+    const __m128 lastCellX = _mm_set1_ps(maxCellX);
+    const __m128 lastCellZ = _mm_set1_ps(maxCellZ);
+    const __m128 cellSize = _mm_set1_ps(_cellSize);
+    
+    for (; i + 4 <= count; i += 4) {
+        // position in cells, clamped to the terrain. The last edge is fraction 1 of the
+        // last cell.
+        __m128 gridX = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(x + i), originX), scale);
+        __m128 gridZ = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(z + i), originZ), scale);
+        gridX = _mm_min_ps(lastSampleX, _mm_max_ps(zero, gridX));
+        gridZ = _mm_min_ps(lastSampleZ, _mm_max_ps(zero, gridZ));
+        __m128 cellX = _mm_min_ps(lastCellX, _mm_cvtepi32_ps(_mm_cvttps_epi32(gridX)));
+        __m128 cellZ = _mm_min_ps(lastCellZ, _mm_cvtepi32_ps(_mm_cvttps_epi32(gridZ)));
+        __m128 fractionX = _mm_min_ps(one, _mm_sub_ps(gridX, cellX));
+        __m128 fractionZ = _mm_min_ps(one, _mm_sub_ps(gridZ, cellZ));
+        
+        int cellIndex[4];
+        __m128i rowStart = _mm_cvttps_epi32(cellZ);
+        // no 32-bit multiply in SSE2, so do the row offset in floats (exact below 2^24)
+        __m128 index = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(rowStart), _mm_set1_ps((float)stride)), cellX);
+        _mm_storeu_si128((__m128i*)cellIndex, _mm_cvttps_epi32(index));
+        
+        // SSE has no gather, the four corners of each cell are next to each other in pairs
+        const float* c0 = samples + cellIndex[0];
+        const float* c1 = samples + cellIndex[1];
+        const float* c2 = samples + cellIndex[2];
+        const float* c3 = samples + cellIndex[3];
+        __m128 h00 = _mm_setr_ps(c0[0], c1[0], c2[0], c3[0]);
+        __m128 h10 = _mm_setr_ps(c0[1], c1[1], c2[1], c3[1]);
+        __m128 h01 = _mm_setr_ps(c0[stride], c1[stride], c2[stride], c3[stride]);
+        __m128 h11 = _mm_setr_ps(c0[stride + 1], c1[stride + 1], c2[stride + 1], c3[stride + 1]);
+        
+        __m128 top = _mm_add_ps(h00, _mm_mul_ps(_mm_sub_ps(h10, h00), fractionX));
+        __m128 bottom = _mm_add_ps(h01, _mm_mul_ps(_mm_sub_ps(h11, h01), fractionX));
+        __m128 height = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fractionZ));
+        _mm_storeu_ps(heights + i, _mm_add_ps(height, originY));
+        
+        if (wantNormals) {
+            // the normal of the surface y = h(x, z) is (-dh/dx, 1, -dh/dz), scaled here by
+            // the cell size to save dividing the slopes
+            __m128 slopeX = _mm_add_ps(_mm_sub_ps(h10, h00), _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(h11, h01), _mm_sub_ps(h10, h00)), fractionZ));
+            __m128 slopeZ = _mm_sub_ps(bottom, top);
+            __m128 nx = _mm_sub_ps(zero, slopeX);
+            __m128 nz = _mm_sub_ps(zero, slopeZ);
+            __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(cellSize, cellSize)), _mm_mul_ps(nz, nz));
+            __m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+            _mm_storeu_ps(normalX + i, _mm_mul_ps(nx, inverseLength));
+            _mm_storeu_ps(normalY + i, _mm_mul_ps(cellSize, inverseLength));
+            _mm_storeu_ps(normalZ + i, _mm_mul_ps(nz, inverseLength));
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        float gridX = std::min((float)(_samplesX - 1), std::max(0.0f, (x[i] - _origin.x) * inverseCellSize));
+        float gridZ = std::min((float)(_samplesZ - 1), std::max(0.0f, (z[i] - _origin.z) * inverseCellSize));
+        float cellX = std::min(maxCellX, floorf(gridX));
+        float cellZ = std::min(maxCellZ, floorf(gridZ));
+        float fractionX = std::min(1.0f, gridX - cellX);
+        float fractionZ = std::min(1.0f, gridZ - cellZ);
+        
+        const float* corner = samples + (int)cellZ * stride + (int)cellX;
+        float h00 = corner[0], h10 = corner[1];
+        float h01 = corner[stride], h11 = corner[stride + 1];
+        float top = h00 + (h10 - h00) * fractionX;
+        float bottom = h01 + (h11 - h01) * fractionX;
+        heights[i] = _origin.y + top + (bottom - top) * fractionZ;
+        
+        if (wantNormals) {
+            float slopeX = (h10 - h00) + ((h11 - h01) - (h10 - h00)) * fractionZ;
+            float slopeZ = bottom - top;
+            glm::vec3 normal = glm::normalize(glm::vec3(-slopeX, _cellSize, -slopeZ));
+            normalX[i] = normal.x;
+            normalY[i] = normal.y;
+            normalZ[i] = normal.z;
+        }
+    }
+}
+
+void Terrain::gatherTriangles(const AABB& bounds, std::vector<Triangle>& triangles) const {
+    const float inverseCellSize = 1.0f / _cellSize;
+    int firstX = std::max(0, (int)floorf((bounds.min.x - _origin.x) * inverseCellSize));
+    int firstZ = std::max(0, (int)floorf((bounds.min.z - _origin.z) * inverseCellSize));
+    int lastX = std::min((int)_samplesX - 2, (int)floorf((bounds.max.x - _origin.x) * inverseCellSize));
+    int lastZ = std::min((int)_samplesZ - 2, (int)floorf((bounds.max.z - _origin.z) * inverseCellSize));
+    
+    for (int z=firstZ; z<=lastZ; z++) {
+        for (int x=firstX; x<=lastX; x++) {
+            float heights[4] = { sampleHeight(x, z), sampleHeight(x + 1, z), sampleHeight(x, z + 1), sampleHeight(x + 1, z + 1) };
+            float low = std::min(std::min(heights[0], heights[1]), std::min(heights[2], heights[3])) + _origin.y;
+            float high = std::max(std::max(heights[0], heights[1]), std::max(heights[2], heights[3])) + _origin.y;
+            if (low > bounds.max.y || high < bounds.min.y)
+                continue;
+            
+            glm::vec3 corners[4];
+            for (int c=0; c<4; c++)
+                corners[c] = _origin + glm::vec3((x + (c & 1)) * _cellSize, heights[c], (z + (c >> 1)) * _cellSize);
+            triangles.push_back(Triangle(corners[0], corners[2], corners[1]));
+            triangles.push_back(Triangle(corners[1], corners[2], corners[3]));
+        }
+    }
+}
+
+const Terrain::Stats& Terrain::stats() const {
+    return _stats;
+}
+
+void Terrain::_buildChunk(Chunk& chunk, unsigned chunkX, unsigned chunkZ, const tdogl::Program& program) {
+    const unsigned side = _chunkCells + 1;
+    // the surface grid followed by a skirt vertex under each vertex of the four edges
+    std::vector<TerrainVertex> vertices(side * side + 4 * side);
+    
+    int firstX = chunkX * _chunkCells;
+    int firstZ = chunkZ * _chunkCells;
+    float minHeight = sampleHeight(firstX, firstZ);
+    float maxHeight = minHeight;
+    
+    for (unsigned z=0; z<side; z++) {
+        for (unsigned x=0; x<side; x++) {
+            int sampleX = firstX + x;
+            int sampleZ = firstZ + z;
+            float height = sampleHeight(sampleX, sampleZ);
+            minHeight = std::min(minHeight, height);
+            maxHeight = std::max(maxHeight, height);
+            
+            // central differences
+            glm::vec3 normal = glm::normalize(glm::vec3(sampleHeight(sampleX - 1, sampleZ) - sampleHeight(sampleX + 1, sampleZ),
+                                                        2.0f * _cellSize,
+                                                        sampleHeight(sampleX, sampleZ - 1) - sampleHeight(sampleX, sampleZ + 1)));
+            
+            TerrainVertex& vertex = vertices[z * side + x];
+            vertex.position[0] = _origin.x + sampleX * _cellSize;
+            vertex.position[1] = _origin.y + height;
+            vertex.position[2] = _origin.z + sampleZ * _cellSize;
+            vertex.normal[0] = PackNormalComponent(normal.x);
+            vertex.normal[1] = PackNormalComponent(normal.y);
+            vertex.normal[2] = PackNormalComponent(normal.z);
+            vertex.normal[3] = 0;
+        }
+    }
+    
+    // deep enough to reach below anything a neighbouring terrain can put along the edge
+    const float skirtDepth = maxHeight - minHeight + _cellSize;
+    for (int edge=0; edge<4; edge++) {
+        for (unsigned i=0; i<side; i++) {
+            TerrainVertex& vertex = vertices[side * side + edge * side + i];
+            vertex = vertices[EdgeVertexIndex(edge, i, _chunkCells)];
+            vertex.position[1] -= skirtDepth;
+        }
+    }
+    minHeight -= skirtDepth;
+    
+    chunk.bounds = AABB(glm::vec3(_origin.x + firstX * _cellSize, _origin.y + minHeight, _origin.z + firstZ * _cellSize),
+                        glm::vec3(_origin.x + (firstX + _chunkCells) * _cellSize, _origin.y + maxHeight, _origin.z + (firstZ + _chunkCells) * _cellSize));
+    chunk.lod = _maxLod;
+    chunk.stitchEdges = 0;
+    chunk.borderEdges = 0;
+    if (chunkX == 0) chunk.borderEdges |= Edge_Left;
+    if (chunkX + 1 == _chunksX) chunk.borderEdges |= Edge_Right;
+    if (chunkZ == 0) chunk.borderEdges |= Edge_Top;
+    if (chunkZ + 1 == _chunksZ) chunk.borderEdges |= Edge_Bottom;
+    
+    glGenVertexArrays(1, &chunk.vao);
+    glBindVertexArray(chunk.vao);
+    
+    glGenBuffers(1, &chunk.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(TerrainVertex), &vertices[0], GL_STATIC_DRAW);
+    _gpuBytes += vertices.size() * sizeof(TerrainVertex);
+    
+    glEnableVertexAttribArray(program.attrib("vert"));
+    glVertexAttribPointer(program.attrib("vert"), 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), NULL);
+    glEnableVertexAttribArray(program.attrib("vertNormal"));
+    glVertexAttribPointer(program.attrib("vertNormal"), 3, GL_BYTE, GL_TRUE, sizeof(TerrainVertex), (const GLvoid*)(3*sizeof(GLfloat)));
+    
+    // the element buffer binding is part of the VAO
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+    
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void Terrain::_buildIndexBuffer() {
+    const int cells = (int)_chunkCells;
+    const int side = cells + 1;
+    std::vector<GLushort> indices;
+    
+    _indexRanges.resize((_maxLod + 1) * Edge_Count);
+    for (int lod=0; lod<=_maxLod; lod++) {
+        const int step = 1 << lod;
+        for (unsigned edges=0; edges<Edge_Count; edges++) {
+            IndexRange& range = _indexRanges[lod * Edge_Count + edges];
+            range.offset = (GLsizei)indices.size();
+            
+            for (int z=0; z<cells; z += step) {
+                for (int x=0; x<cells; x += step) {
+                    int corners[4][2] = { {x, z}, {x + step, z}, {x, z + step}, {x + step, z + step} };
+                    GLushort index[4];
+                    for (int c=0; c<4; c++) {
+                        int cx = corners[c][0];
+                        int cz = corners[c][1];
+                        // vertices between the neighbour's (twice as far apart) edge vertices
+                        // collapse onto the previous one, making the edge a straight line
+                        // between the vertices the neighbour has
+                        if (((edges & Edge_Top) && cz == 0) || ((edges & Edge_Bottom) && cz == cells)) {
+                            if ((cx / step) % 2 == 1) cx -= step;
+                        }
+                        if (((edges & Edge_Left) && cx == 0) || ((edges & Edge_Right) && cx == cells)) {
+                            if ((cz / step) % 2 == 1) cz -= step;
+                        }
+                        index[c] = (GLushort)(cz * side + cx);
+                    }
+                    
+                    const int triangles[2][3] = { {0, 2, 1}, {1, 2, 3} };
+                    for (int t=0; t<2; t++) {
+                        GLushort a = index[triangles[t][0]];
+                        GLushort b = index[triangles[t][1]];
+                        GLushort c = index[triangles[t][2]];
+                        if (a == b || b == c || a == c)
+                            continue;
+                        indices.push_back(a);
+                        indices.push_back(b);
+                        indices.push_back(c);
+                    }
+                }
+            }
+            range.count = (GLsizei)indices.size() - range.offset;
+        }
+    }
+    
+    // a strip of quads down from each border edge to the skirt vertices under it
+    _skirtRanges.resize((_maxLod + 1) * Edge_Count);
+    for (int lod=0; lod<=_maxLod; lod++) {
+        const int step = 1 << lod;
+        for (unsigned edges=0; edges<Edge_Count; edges++) {
+            IndexRange& range = _skirtRanges[lod * Edge_Count + edges];
+            range.offset = (GLsizei)indices.size();
+            
+            for (int edge=0; edge<4; edge++) {
+                if (!(edges & (1 << edge)))
+                    continue;
+                for (int i=0; i<cells; i += step) {
+                    GLushort top0 = (GLushort)EdgeVertexIndex(edge, i, cells);
+                    GLushort top1 = (GLushort)EdgeVertexIndex(edge, i + step, cells);
+                    GLushort bottom0 = (GLushort)(side * side + edge * side + i);
+                    GLushort bottom1 = (GLushort)(side * side + edge * side + i + step);
+                    indices.push_back(top0);
+                    indices.push_back(bottom0);
+                    indices.push_back(top1);
+                    indices.push_back(top1);
+                    indices.push_back(bottom0);
+                    indices.push_back(bottom1);
+                }
+            }
+            range.count = (GLsizei)indices.size() - range.offset;
+        }
+    }
+    
+    glGenBuffers(1, &_indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), &indices[0], GL_STATIC_DRAW);
+    _gpuBytes += indices.size() * sizeof(GLushort);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
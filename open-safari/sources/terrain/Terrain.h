@@ -0,0 +1,213 @@
+//
+//  Terrain.h
+//  open-safari
+//
+//  Created by Darren Tsung on 5/28/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__Terrain__
+#define __open_safari__Terrain__
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "tdogl/Bitmap.h"
+#include "tdogl/Program.h"
+#include "scene/AABB.h"
+#include "scene/Frustum.h"
+#include "scene/Triangle.h"
+
+/**
+ Ground made from a heightmap, drawn as a grid of chunks with distance based level of
+ detail.
+ 
+ Every chunk has its own vertex buffer at full resolution. Each level of detail skips every
+ other vertex of the level before it, and all chunks share one index buffer holding every
+ level. Neighbouring chunks are never more than one level apart, and a chunk next to a
+ coarser neighbour uses an index variant that snaps its in-between edge vertices onto the
+ neighbour's edge, so there are no cracks at the seams.
+ 
+ The chunks along the outside of the terrain also hang a skirt down from their outer edges.
+ Terrains laid side by side pick their levels independently, so the skirts fill the cracks
+ between them where the levels don't match.
+ */
+class Terrain {
+public:
+    /**
+     Counts from the last call to render()
+     */
+    struct Stats {
+        unsigned chunksDrawn;
+        unsigned trianglesDrawn;
+    };
+    
+    /**
+     Creates the terrain from a heightmap.
+     
+     Bitmap channels are only 8 bits, so 16-bit heightmaps are stored with the high byte in
+     the first channel and the low byte in the second (a grayscale + alpha or RGB(A) image).
+     Plain grayscale images are read as 8-bit heights.
+     
+     @param heightmap    the heights, one pixel per sample. Rows go along the z axis.
+     @param program      the program the terrain will be drawn with. It needs "vert" and
+                         "vertNormal" attributes.
+     @param origin       the world position of the first pixel at height 0
+     @param cellSize     the distance between neighbouring samples
+     @param heightScale  the height of the largest possible sample value above origin.y
+     @param chunkCells   the number of cells along each side of a chunk, a power of two
+                         no larger than 128
+     
+     @throws std::exception if the heightmap is too small
+     */
+    Terrain(const tdogl::Bitmap& heightmap,
+            const tdogl::Program& program,
+            const glm::vec3& origin,
+            float cellSize,
+            float heightScale,
+            unsigned chunkCells = 64);
+    
+    /**
+     Deletes the chunk buffers
+     */
+    ~Terrain();
+    
+    /**
+     Picks the level of detail of each chunk based on its distance to `viewPosition`
+     */
+    void update(const glm::vec3& viewPosition);
+    
+    /**
+     Draws the chunks that are inside the frustum. The terrain's program must be in use.
+     */
+    void render(const Frustum& frustum);
+    
+    /**
+     The distance up to which chunks are drawn at full detail. Each level after that covers
+     twice the distance of the level before.
+     */
+    float lodDistance() const;
+    void setLodDistance(float lodDistance);
+    
+    /** the bounds of the whole terrain */
+    const AABB& bounds() const;
+    
+    /** the world position of the first sample at height 0 */
+    const glm::vec3& origin() const;
+    
+    /** the distance between neighbouring samples */
+    float cellSize() const;
+    
+    /** the number of samples along the x axis */
+    unsigned samplesX() const;
+    
+    /** the number of samples along the z axis */
+    unsigned samplesZ() const;
+    
+    /** the number of cells along each side of a chunk */
+    unsigned chunkCells() const;
+    
+    /** the number of bytes of heights kept in memory for the queries */
+    size_t cpuBytes() const;
+    
+    /** the number of bytes of vertex and index buffers */
+    size_t gpuBytes() const;
+    
+    /**
+     @result the height of the sample, relative to origin.y. Out of range samples are
+             clamped to the edge.
+     */
+    float sampleHeight(int x, int z) const;
+    
+    /**
+     @result the world space height of the ground at the world position (x, z), bilinearly
+             interpolated between the samples. Positions off the terrain get the height of
+             the nearest edge.
+     */
+    float heightAt(float x, float z) const;
+    
+    /**
+     @result the unit normal of the ground at the world position (x, z)
+     */
+    glm::vec3 normalAt(float x, float z) const;
+    
+    /**
+     Gets both the height and the normal of the ground at the world position (x, z), for
+     less than the price of calling heightAt() and normalAt()
+     */
+    void sample(float x, float z, float* height, glm::vec3* normal) const;
+    
+    /**
+     Samples the ground under many positions at once, four at a time with SSE. The inputs
+     and outputs are separate arrays of each component so they can be loaded straight into
+     SSE registers.
+     
+     @param x, z     `count` world positions
+     @param heights  receives the world space height under each position
+     @param normalX, normalY, normalZ  receive the components of the normal under each
+                     position. May all be NULL if the normals aren't needed.
+     */
+    void sampleBatch(const float* x, const float* z, unsigned count, float* heights,
+                     float* normalX = NULL, float* normalY = NULL, float* normalZ = NULL) const;
+    
+    /**
+     Adds the full detail triangles of the ground under the box to `triangles`, split the
+     same way the chunks draw them and facing up, for colliding with. Cells entirely above
+     or below the box are left out.
+     */
+    void gatherTriangles(const AABB& bounds, std::vector<Triangle>& triangles) const;
+    
+    const Stats& stats() const;
+
+private:
+    enum Edge {
+        Edge_Left = 1,    /**< x == 0 */
+        Edge_Right = 2,   /**< x == chunkCells */
+        Edge_Top = 4,     /**< z == 0 */
+        Edge_Bottom = 8,  /**< z == chunkCells */
+        Edge_Count = 16   /**< number of edge combinations */
+    };
+    
+    struct Chunk {
+        GLuint vao;
+        GLuint vbo;
+        AABB bounds;
+        int lod;
+        unsigned stitchEdges;
+        /** the edges on the outside of the terrain, which get skirts */
+        unsigned borderEdges;
+    };
+    
+    struct IndexRange {
+        GLsizei offset;
+        GLsizei count;
+    };
+    
+    std::vector<float> _heights;
+    unsigned _samplesX, _samplesZ;
+    glm::vec3 _origin;
+    float _cellSize;
+    unsigned _chunkCells;
+    unsigned _chunksX, _chunksZ;
+    int _maxLod;
+    float _lodDistance;
+    AABB _bounds;
+    
+    std::vector<Chunk> _chunks;
+    GLuint _indexBuffer;
+    /** indexed by lod * Edge_Count + stitched edges */
+    std::vector<IndexRange> _indexRanges;
+    /** indexed by lod * Edge_Count + border edges */
+    std::vector<IndexRange> _skirtRanges;
+    size_t _gpuBytes;
+    Stats _stats;
+    
+    void _buildChunk(Chunk& chunk, unsigned chunkX, unsigned chunkZ, const tdogl::Program& program);
+    void _buildIndexBuffer();
+    
+    // copying disabled
+    Terrain(const Terrain&);
+    const Terrain& operator=(const Terrain&);
+};
+
+#endif /* defined(__open_safari__Terrain__) */
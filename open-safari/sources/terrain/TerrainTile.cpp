@@ -0,0 +1,63 @@
+//
+//  TerrainTile.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 5/30/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "TerrainTile.h"
+
+TerrainTile::TerrainTile(const std::string& heightmapPath,
+                         const tdogl::Program& program,
+                         const glm::vec3& origin,
+                         float cellSize,
+                         float heightScale,
+                         Vegetation* vegetation) :
+_heightmapPath(heightmapPath),
+_program(program),
+_origin(origin),
+_cellSize(cellSize),
+_heightScale(heightScale),
+_vegetation(vegetation),
+_heightmap(NULL),
+_terrain(NULL)
+{
+}
+
+TerrainTile::~TerrainTile() {
+    if (_vegetation && _terrain)
+        _vegetation->removeTerrain(*_terrain);
+    delete _heightmap;
+    delete _terrain;
+}
+
+void TerrainTile::load() {
+    _heightmap = new tdogl::Bitmap(tdogl::Bitmap::bitmapFromFile(_heightmapPath));
+}
+
+void TerrainTile::upload() {
+    _terrain = new Terrain(*_heightmap, _program, _origin, _cellSize, _heightScale);
+    // the terrain keeps its own copy of the heights
+    delete _heightmap;
+    _heightmap = NULL;
+    
+    if (_vegetation)
+        _vegetation->addTerrain(*_terrain);
+}
+
+size_t TerrainTile::cpuBytes() const {
+    if (_heightmap)
+        return _heightmap->width() * _heightmap->height() * _heightmap->format();
+    return _terrain ? _terrain->cpuBytes() : 0;
+}
+
+size_t TerrainTile::gpuBytes() const {
+    if (!_terrain)
+        return 0;
+    return _terrain->gpuBytes() + (_vegetation ? _vegetation->gpuBytes(*_terrain) : 0);
+}
+
+Terrain* TerrainTile::terrain() const {
+    return _terrain;
+}
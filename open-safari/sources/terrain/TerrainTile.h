@@ -0,0 +1,67 @@
+//
+//  TerrainTile.h
+//  open-safari
+//
+//  Created by Darren Tsung on 5/30/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__TerrainTile__
+#define __open_safari__TerrainTile__
+
+#include <string>
+#include "world/WorldStreamer.h"
+#include "terrain/Terrain.h"
+#include "vegetation/Vegetation.h"
+
+/**
+ A world tile holding the terrain of its square, streamed in from a heightmap file.
+ 
+ The heightmap is decoded on the I/O thread and turned into a Terrain in upload(), which
+ also scatters the tile's plants if it has a Vegetation. Tiles
+ share their edge samples with their neighbours, so a tile of 256 cells needs a 257 pixel
+ heightmap.
+ */
+class TerrainTile : public WorldTile {
+public:
+    /**
+     @param heightmapPath  the path of the heightmap image file
+     @param program        the program the terrain will be drawn with
+     @param origin         the world position of the tile's first sample at height 0
+     @param vegetation     the plants to scatter over the terrain, or NULL for bare ground
+     
+     The other parameters are passed on to the Terrain constructor.
+     */
+    TerrainTile(const std::string& heightmapPath,
+                const tdogl::Program& program,
+                const glm::vec3& origin,
+                float cellSize,
+                float heightScale,
+                Vegetation* vegetation = NULL);
+    
+    ~TerrainTile();
+    
+    void load();
+    void upload();
+    size_t cpuBytes() const;
+    size_t gpuBytes() const;
+    
+    /** the terrain, or NULL until the tile is uploaded */
+    Terrain* terrain() const;
+    
+private:
+    std::string _heightmapPath;
+    const tdogl::Program& _program;
+    glm::vec3 _origin;
+    float _cellSize;
+    float _heightScale;
+    Vegetation* _vegetation;
+    tdogl::Bitmap* _heightmap;
+    Terrain* _terrain;
+    
+    // copying disabled
+    TerrainTile(const TerrainTile&);
+    const TerrainTile& operator=(const TerrainTile&);
+};
+
+#endif /* defined(__open_safari__TerrainTile__) */
@@ -0,0 +1,376 @@
+//
+//  Vegetation.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 6/1/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include "Vegetation.h"
+#include "core/ParallelFor.h"
+#include "terrain/Terrain.h"
+#include <algorithm>
+#include <cassert>
+
+/** the smallest GL_MAX_TEXTURE_BUFFER_SIZE that OpenGL 3.2 allows */
+static const unsigned MaxPatchInstances = 65536;
+
+/**
+ How each kind of plant is scattered and drawn
+ */
+struct KindSettings {
+    /** instances per square meter where the density map is full */
+    float density;
+    /** no plants on ground steeper than this */
+    float minNormalY;
+    float minScale, maxScale;
+    /** how far the kind is drawn, relative to the draw distance */
+    float distanceScale;
+    glm::vec3 baseColor, tipColor;
+};
+
+static const KindSettings Kinds[] = {
+    // grass
+    { 2.0f, 0.85f, 0.4f, 0.9f, 1.0f, glm::vec3(0.40f, 0.38f, 0.16f), glm::vec3(0.80f, 0.74f, 0.44f) },
+    // bushes
+    { 0.01f, 0.75f, 1.0f, 2.5f, 2.0f, glm::vec3(0.18f, 0.22f, 0.08f), glm::vec3(0.32f, 0.40f, 0.14f) }
+};
+
+static inline unsigned NextRandom(unsigned& state) {
+    // xorshift
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/** @result a random number in [0, 1) */
+static inline float RandomFraction(unsigned& state) {
+    return (NextRandom(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+static inline float SmoothStep(float edge0, float edge1, float x) {
+    float t = std::max(0.0f, std::min(1.0f, (x - edge0) / (edge1 - edge0)));
+    return t * t * (3.0f - 2.0f * t);
+}
+
+static inline GLushort Quantize(float value, float min, float size) {
+    return (GLushort)(std::max(0.0f, std::min(1.0f, (value - min) / size)) * 65535.0f + 0.5f);
+}
+
+/**
+ Adds a blade of grass, a thin bent triangle strip one unit tall, turned `angle` radians
+ around the y axis
+ */
+static void AddBlade(std::vector<glm::vec3>& vertices, float angle, float lean) {
+    const glm::vec3 points[5] = {
+        glm::vec3(-0.03f, 0.0f, 0.0f), glm::vec3(0.03f, 0.0f, 0.0f),
+        glm::vec3(-0.02f, 0.5f, 0.3f * lean), glm::vec3(0.02f, 0.5f, 0.3f * lean),
+        glm::vec3(0.0f, 1.0f, lean)
+    };
+    const int triangles[3][3] = { {0, 1, 2}, {1, 3, 2}, {2, 3, 4} };
+    float c = cosf(angle), s = sinf(angle);
+    for (int t=0; t<3; t++) {
+        for (int v=0; v<3; v++) {
+            const glm::vec3& p = points[triangles[t][v]];
+            vertices.push_back(glm::vec3(c * p.x + s * p.z, p.y, -s * p.x + c * p.z));
+        }
+    }
+}
+
+/**
+ Adds a vertical quad for a bush, one unit wide and tall, turned `angle` radians around the
+ y axis
+ */
+static void AddBushQuad(std::vector<glm::vec3>& vertices, float angle) {
+    float c = 0.5f * cosf(angle), s = 0.5f * sinf(angle);
+    glm::vec3 a(-c, 0.0f, s), b(c, 0.0f, -s);
+    glm::vec3 up(0.0f, 0.8f, 0.0f);
+    vertices.push_back(a); vertices.push_back(b); vertices.push_back(a + up);
+    vertices.push_back(b); vertices.push_back(b + up); vertices.push_back(a + up);
+}
+
+Vegetation::Vegetation(tdogl::Program& program,
+                       const tdogl::Bitmap& density,
+                       const glm::vec3& origin,
+                       float size) :
+_program(program),
+_density(density),
+_origin(origin),
+_size(size),
+_drawDistance(60.0f),
+_vao(0),
+_vbo(0)
+{
+    assert(size > 0.0f);
+    
+    // a tuft of three blades, and a bush of three crossed quads
+    std::vector<glm::vec3> vertices;
+    _firstVertex[Kind_Grass] = (GLint)vertices.size();
+    AddBlade(vertices, 0.0f, 0.15f);
+    AddBlade(vertices, 2.1f, 0.25f);
+    AddBlade(vertices, 4.2f, 0.1f);
+    _vertexCount[Kind_Grass] = (GLsizei)vertices.size() - _firstVertex[Kind_Grass];
+    
+    _firstVertex[Kind_Bush] = (GLint)vertices.size();
+    for (int i=0; i<3; i++)
+        AddBushQuad(vertices, i * (float)M_PI / 3.0f);
+    _vertexCount[Kind_Bush] = (GLsizei)vertices.size() - _firstVertex[Kind_Bush];
+    
+    glGenVertexArrays(1, &_vao);
+    glBindVertexArray(_vao);
+    
+    glGenBuffers(1, &_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
+    
+    glEnableVertexAttribArray(program.attrib("vert"));
+    glVertexAttribPointer(program.attrib("vert"), 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), NULL);
+    
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    
+    _stats.patches = _stats.instances = 0;
+    _stats.gpuBytes = 0;
+    _stats.patchesDrawn = _stats.drawCalls = _stats.instancesDrawn = 0;
+}
+
+Vegetation::~Vegetation() {
+    for (size_t i=0; i<_patches.size(); i++)
+        _deletePatch(_patches[i]);
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteBuffers(1, &_vbo);
+}
+
+void Vegetation::addTerrain(const Terrain& terrain) {
+    const unsigned chunksX = (terrain.samplesX() - 1 + terrain.chunkCells() - 1) / terrain.chunkCells();
+    const unsigned chunksZ = (terrain.samplesZ() - 1 + terrain.chunkCells() - 1) / terrain.chunkCells();
+    
+    std::vector<Scatter> scatters(chunksX * chunksZ);
+    ParallelFor((unsigned)scatters.size(), [&](unsigned i) {
+        _scatter(terrain, i % chunksX, i / chunksX, scatters[i]);
+    });
+    
+    for (size_t i=0; i<scatters.size(); i++) {
+        const Scatter& scatter = scatters[i];
+        if (scatter.instances.empty())
+            continue;
+        
+        Patch patch;
+        patch.terrain = &terrain;
+        patch.bounds = scatter.bounds;
+        std::copy(scatter.firstInstance, scatter.firstInstance + Kind_Count, patch.firstInstance);
+        std::copy(scatter.instanceCount, scatter.instanceCount + Kind_Count, patch.instanceCount);
+        
+        glGenBuffers(1, &patch.buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, patch.buffer);
+        glBufferData(GL_TEXTURE_BUFFER, scatter.instances.size() * sizeof(Instance), &scatter.instances[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        
+        glGenTextures(1, &patch.texture);
+        glBindTexture(GL_TEXTURE_BUFFER, patch.texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA16UI, patch.buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        
+        _patches.push_back(patch);
+        _stats.patches++;
+        _stats.instances += (unsigned)scatter.instances.size();
+        _stats.gpuBytes += scatter.instances.size() * sizeof(Instance);
+    }
+}
+
+void Vegetation::removeTerrain(const Terrain& terrain) {
+    size_t kept = 0;
+    for (size_t i=0; i<_patches.size(); i++) {
+        if (_patches[i].terrain == &terrain)
+            _deletePatch(_patches[i]);
+        else
+            _patches[kept++] = _patches[i];
+    }
+    _patches.resize(kept);
+}
+
+size_t Vegetation::gpuBytes(const Terrain& terrain) const {
+    size_t bytes = 0;
+    for (size_t i=0; i<_patches.size(); i++) {
+        if (_patches[i].terrain != &terrain)
+            continue;
+        for (int kind=0; kind<Kind_Count; kind++)
+            bytes += _patches[i].instanceCount[kind] * sizeof(Instance);
+    }
+    return bytes;
+}
+
+void Vegetation::render(const Frustum& frustum, const glm::vec3& viewPosition) {
+    _stats.patchesDrawn = _stats.drawCalls = _stats.instancesDrawn = 0;
+    if (_patches.empty())
+        return;
+    
+    glBindVertexArray(_vao);
+    glActiveTexture(GL_TEXTURE0);
+    _program.setUniform("instances", 0);
+    _program.setUniform("viewPosition", viewPosition);
+    
+    for (size_t i=0; i<_patches.size(); i++) {
+        const Patch& patch = _patches[i];
+        float distance = sqrtf(patch.bounds.distanceSquared(viewPosition));
+        if (distance >= _drawDistance * Kinds[Kind_Bush].distanceScale)
+            continue;
+        if (!frustum.intersectsAABB(patch.bounds.center(), patch.bounds.extents()))
+            continue;
+        
+        bool bound = false;
+        for (int kind=0; kind<Kind_Count; kind++) {
+            const KindSettings& settings = Kinds[kind];
+            float fadeEnd = _drawDistance * settings.distanceScale;
+            float fadeStart = 0.5f * fadeEnd;
+            if (distance >= fadeEnd || patch.instanceCount[kind] == 0)
+                continue;
+            
+            // the nearest point of the patch keeps the most instances, the shader fades out
+            // the rest of them by their own distance
+            float kept = 1.0f - SmoothStep(fadeStart, fadeEnd, distance);
+            GLsizei count = std::min(patch.instanceCount[kind], (GLsizei)ceilf(kept * patch.instanceCount[kind]));
+            if (count == 0)
+                continue;
+            
+            if (!bound) {
+                glBindTexture(GL_TEXTURE_BUFFER, patch.texture);
+                _program.setUniform("patchOrigin", patch.bounds.min);
+                _program.setUniform("patchSize", patch.bounds.max - patch.bounds.min);
+                bound = true;
+                _stats.patchesDrawn++;
+            }
+            _program.setUniform("firstInstance", patch.firstInstance[kind]);
+            _program.setUniform("instanceCount", (GLfloat)patch.instanceCount[kind]);
+            _program.setUniform("fadeRange", fadeStart, fadeEnd);
+            _program.setUniform("scaleRange", settings.minScale, settings.maxScale);
+            _program.setUniform("baseColor", settings.baseColor);
+            _program.setUniform("tipColor", settings.tipColor);
+            glDrawArraysInstanced(GL_TRIANGLES, _firstVertex[kind], _vertexCount[kind], count);
+            
+            _stats.drawCalls++;
+            _stats.instancesDrawn += count;
+        }
+    }
+    
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+float Vegetation::drawDistance() const {
+    return _drawDistance;
+}
+
+void Vegetation::setDrawDistance(float drawDistance) {
+    assert(drawDistance > 0.0f);
+    _drawDistance = drawDistance;
+}
+
+const Vegetation::Stats& Vegetation::stats() const {
+    return _stats;
+}
+
+void Vegetation::_scatter(const Terrain& terrain, unsigned chunkX, unsigned chunkZ, Scatter& scatter) const {
+    const float chunkSize = terrain.chunkCells() * terrain.cellSize();
+    const float minX = terrain.origin().x + chunkX * chunkSize;
+    const float minZ = terrain.origin().z + chunkZ * chunkSize;
+    const float maxX = std::min(minX + chunkSize, terrain.origin().x + (terrain.samplesX() - 1) * terrain.cellSize());
+    const float maxZ = std::min(minZ + chunkSize, terrain.origin().z + (terrain.samplesZ() - 1) * terrain.cellSize());
+    
+    std::vector<glm::vec3> positions;
+    std::vector<GLushort> rotationScales;
+    std::vector<float> x, z, heights, normalX, normalY, normalZ;
+    
+    for (int kind=0; kind<Kind_Count; kind++) {
+        const KindSettings& settings = Kinds[kind];
+        
+        // the same patch of ground always gets the same plants
+        unsigned random = (unsigned)((int)floorf(minX) * 73856093) ^ (unsigned)((int)floorf(minZ) * 19349663) ^ (unsigned)((kind + 1) * 83492791);
+        if (random == 0)
+            random = 1;
+        
+        // one candidate jittered inside each cell of a grid as fine as the full density,
+        // kept with the probability the density map gives
+        x.clear();
+        z.clear();
+        const float spacing = 1.0f / sqrtf(settings.density);
+        const unsigned room = MaxPatchInstances - (unsigned)positions.size();
+        for (float cellZ = minZ; cellZ < maxZ && x.size() < room; cellZ += spacing) {
+            for (float cellX = minX; cellX < maxX && x.size() < room; cellX += spacing) {
+                float candidateX = cellX + RandomFraction(random) * spacing;
+                float candidateZ = cellZ + RandomFraction(random) * spacing;
+                float keep = RandomFraction(random);
+                if (candidateX >= maxX || candidateZ >= maxZ)
+                    continue;
+                if (keep < _densityAt(candidateX, candidateZ, kind)) {
+                    x.push_back(candidateX);
+                    z.push_back(candidateZ);
+                }
+            }
+        }
+        
+        heights.resize(x.size());
+        normalX.resize(x.size());
+        normalY.resize(x.size());
+        normalZ.resize(x.size());
+        if (!x.empty())
+            terrain.sampleBatch(&x[0], &z[0], (unsigned)x.size(), &heights[0], &normalX[0], &normalY[0], &normalZ[0]);
+        
+        scatter.firstInstance[kind] = (GLint)positions.size();
+        for (size_t i=0; i<x.size(); i++) {
+            if (normalY[i] < settings.minNormalY)
+                continue;
+            positions.push_back(glm::vec3(x[i], heights[i], z[i]));
+            rotationScales.push_back((GLushort)(NextRandom(random) & 0xffff));
+        }
+        scatter.instanceCount[kind] = (GLsizei)positions.size() - scatter.firstInstance[kind];
+        
+        // shuffle so any prefix of the instances is spread over the whole patch
+        for (GLsizei i = scatter.instanceCount[kind] - 1; i > 0; i--) {
+            GLsizei j = (GLsizei)(NextRandom(random) % (unsigned)(i + 1));
+            std::swap(positions[scatter.firstInstance[kind] + i], positions[scatter.firstInstance[kind] + j]);
+        }
+    }
+    
+    float minY = 0.0f, maxY = 0.0f;
+    for (size_t i=0; i<positions.size(); i++) {
+        minY = (i == 0) ? positions[i].y : std::min(minY, positions[i].y);
+        maxY = (i == 0) ? positions[i].y : std::max(maxY, positions[i].y);
+    }
+    // keep the size above zero on flat ground so the quantizing doesn't divide by it
+    maxY = std::max(maxY, minY + 0.01f);
+    scatter.bounds = AABB(glm::vec3(minX, minY, minZ), glm::vec3(maxX, maxY, maxZ));
+    
+    const glm::vec3 size = scatter.bounds.max - scatter.bounds.min;
+    scatter.instances.resize(positions.size());
+    for (size_t i=0; i<positions.size(); i++) {
+        Instance& instance = scatter.instances[i];
+        instance.x = Quantize(positions[i].x, minX, size.x);
+        instance.y = Quantize(positions[i].y, minY, size.y);
+        instance.z = Quantize(positions[i].z, minZ, size.z);
+        instance.rotationScale = rotationScales[i];
+    }
+}
+
+float Vegetation::_densityAt(float x, float z, unsigned channel) const {
+    int column = (int)((x - _origin.x) / _size * _density.width());
+    int row = (int)((z - _origin.z) / _size * _density.height());
+    column = std::max(0, std::min(column, (int)_density.width() - 1));
+    row = std::max(0, std::min(row, (int)_density.height() - 1));
+    channel = std::min(channel, (unsigned)_density.format() - 1);
+    return _density.getPixel(column, row)[channel] / 255.0f;
+}
+
+void Vegetation::_deletePatch(Patch& patch) {
+    glDeleteTextures(1, &patch.texture);
+    glDeleteBuffers(1, &patch.buffer);
+    
+    _stats.patches--;
+    for (int kind=0; kind<Kind_Count; kind++) {
+        _stats.instances -= patch.instanceCount[kind];
+        _stats.gpuBytes -= patch.instanceCount[kind] * sizeof(Instance);
+    }
+}
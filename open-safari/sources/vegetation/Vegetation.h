@@ -0,0 +1,153 @@
+//
+//  Vegetation.h
+//  open-safari
+//
+//  Created by Darren Tsung on 6/1/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__Vegetation__
+#define __open_safari__Vegetation__
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "tdogl/Bitmap.h"
+#include "tdogl/Program.h"
+#include "scene/AABB.h"
+#include "scene/Frustum.h"
+
+class Terrain;
+
+/**
+ Grass tufts and bushes scattered over the terrain and drawn with instancing.
+ 
+ Every terrain chunk gets a patch of instances, scattered from a density map and placed on
+ the ground with Terrain::sampleBatch(). The scattering is seeded from the patch position,
+ so a terrain that is streamed out and back in gets the same plants.
+ 
+ An instance is 8 bytes: its position as 16-bit fractions of the patch bounds, and its
+ rotation and scale as a byte each. A patch keeps its instances in a texture buffer that
+ the vertex shader reads with gl_InstanceID, so each kind of plant in a patch is one draw
+ call. The instances of a patch are shuffled, so drawing the first N of them thins the patch
+ out evenly; far patches draw fewer instances, and the vertex shader shrinks each instance
+ away as it reaches the distance where it gets cut, so there is no popping.
+ */
+class Vegetation {
+public:
+    struct Stats {
+        /** patches and instances kept on the GPU */
+        unsigned patches;
+        unsigned instances;
+        size_t gpuBytes;
+        /** counts from the last call to render() */
+        unsigned patchesDrawn;
+        unsigned drawCalls;
+        unsigned instancesDrawn;
+    };
+    
+    /**
+     @param program  the program the plants will be drawn with, made from the vegetation
+                     shaders. It needs a "vert" attribute.
+     @param density  how densely plants grow across the world: the first channel for grass
+                     and the second for bushes (the first for both in a grayscale image).
+                     Rows go along the z axis.
+     @param origin   the world position of the density map's first pixel. Only x and z are
+                     used.
+     @param size     the width of the world the density map covers along x and z
+     */
+    Vegetation(tdogl::Program& program,
+               const tdogl::Bitmap& density,
+               const glm::vec3& origin,
+               float size);
+    
+    /**
+     Deletes the meshes and every patch
+     */
+    ~Vegetation();
+    
+    /**
+     Scatters plants over every chunk of `terrain`, with the chunks spread over the worker
+     threads, and uploads them. The terrain must stay alive until removeTerrain().
+     */
+    void addTerrain(const Terrain& terrain);
+    
+    /**
+     Deletes the plants of a terrain added with addTerrain()
+     */
+    void removeTerrain(const Terrain& terrain);
+    
+    /**
+     @result the number of bytes of GPU memory the plants of `terrain` are using
+     */
+    size_t gpuBytes(const Terrain& terrain) const;
+    
+    /**
+     Draws the plants inside the frustum. The vegetation's program must be in use.
+     */
+    void render(const Frustum& frustum, const glm::vec3& viewPosition);
+    
+    /**
+     The distance where grass has thinned out to nothing. Bushes are bigger, so they are drawn
+     out to twice the distance.
+     */
+    float drawDistance() const;
+    void setDrawDistance(float drawDistance);
+    
+    const Stats& stats() const;
+
+private:
+    enum Kind {
+        Kind_Grass,
+        Kind_Bush,
+        Kind_Count
+    };
+    
+    struct Instance {
+        /** fractions of the patch bounds */
+        GLushort x, y, z;
+        /** the rotation in the high byte and the scale in the low byte */
+        GLushort rotationScale;
+    };
+    
+    struct Patch {
+        const Terrain* terrain;
+        AABB bounds;
+        GLuint buffer;
+        GLuint texture;
+        /** where the instances of each kind start in the buffer, and how many there are */
+        GLint firstInstance[Kind_Count];
+        GLsizei instanceCount[Kind_Count];
+    };
+    
+    /** the instances of one patch before they're uploaded */
+    struct Scatter {
+        AABB bounds;
+        std::vector<Instance> instances;
+        GLint firstInstance[Kind_Count];
+        GLsizei instanceCount[Kind_Count];
+    };
+    
+    tdogl::Program& _program;
+    tdogl::Bitmap _density;
+    glm::vec3 _origin;
+    float _size;
+    float _drawDistance;
+    GLuint _vao;
+    GLuint _vbo;
+    /** where each kind's mesh is in the vertex buffer */
+    GLint _firstVertex[Kind_Count];
+    GLsizei _vertexCount[Kind_Count];
+    std::vector<Patch> _patches;
+    Stats _stats;
+    
+    void _scatter(const Terrain& terrain, unsigned chunkX, unsigned chunkZ, Scatter& scatter) const;
+    float _densityAt(float x, float z, unsigned channel) const;
+    void _deletePatch(Patch& patch);
+    
+    // copying disabled
+    Vegetation(const Vegetation&);
+    const Vegetation& operator=(const Vegetation&);
+};
+
+#endif /* defined(__open_safari__Vegetation__) */
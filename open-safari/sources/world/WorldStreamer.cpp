@@ -0,0 +1,323 @@
+//
+//  WorldStreamer.cpp
+//  open-safari
+//
+//  Created by Darren Tsung on 5/30/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#include "WorldStreamer.h"
+#include "core/Profiler.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+
+/** once over budget, tiles are evicted until the usage is under this fraction of it */
+static const float EvictionTarget = 0.75f;
+
+static double MillisecondsSince(const std::chrono::high_resolution_clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+WorldStreamer::WorldStreamer(const glm::vec3& origin,
+                             float tileSize,
+                             int tilesX,
+                             int tilesZ,
+                             const TileFactory& factory,
+                             const Budget& budget,
+                             unsigned ioThreadCount) :
+_origin(origin),
+_tileSize(tileSize),
+_tilesX(tilesX),
+_tilesZ(tilesZ),
+_factory(factory),
+_budget(budget),
+_loadRadius(tileSize),
+_keepRadius(2.0f * tileSize),
+_maxUploadsPerFrame(1),
+_frame(0),
+_loadsInProgress(0),
+_completedLoads(0),
+_totalLoadMilliseconds(0.0),
+_stopping(false)
+{
+    assert(tileSize > 0.0f);
+    assert(tilesX > 0 && tilesZ > 0);
+    assert(ioThreadCount > 0);
+    
+    Slot empty = { NULL, TileState_Unloaded, 0.0f, 0, false };
+    _slots.resize(tilesX * tilesZ, empty);
+    
+    _stats.residentTiles = _stats.queuedTiles = _stats.loadingTiles = 0;
+    _stats.cpuBytes = _stats.gpuBytes = 0;
+    _stats.loads = _stats.cancelledLoads = _stats.evictions = 0;
+    _stats.averageLoadMilliseconds = _stats.uploadMilliseconds = 0.0;
+    
+    for (unsigned i=0; i<ioThreadCount; i++)
+        _ioThreads.push_back(std::thread(&WorldStreamer::_ioThreadMain, this));
+}
+
+WorldStreamer::~WorldStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _queueChanged.notify_all();
+    for (size_t i=0; i<_ioThreads.size(); i++)
+        _ioThreads[i].join();
+    
+    for (size_t i=0; i<_slots.size(); i++)
+        delete _slots[i].tile;
+}
+
+void WorldStreamer::update(const glm::vec3& viewPosition) {
+    PROFILE_ZONE("WorldStreamer::update");
+    _frame++;
+    
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (int i=0; i<(int)_slots.size(); i++) {
+            Slot& slot = _slots[i];
+            slot.distance = _distanceToTile(i, viewPosition);
+            
+            if (slot.state == TileState_Unloaded && slot.distance <= _loadRadius) {
+                glm::vec3 origin = _origin + glm::vec3((i % _tilesX) * _tileSize, 0.0f, (i / _tilesX) * _tileSize);
+                slot.tile = _factory(i % _tilesX, i / _tilesX, origin);
+                slot.state = TileState_Queued;
+                _queue.push_back(i);
+                queued = true;
+            } else if (slot.state == TileState_Queued && slot.distance > _keepRadius) {
+                // walked away before an I/O thread got to it
+                _queue.erase(std::find(_queue.begin(), _queue.end(), i));
+                delete slot.tile;
+                slot.tile = NULL;
+                slot.state = TileState_Unloaded;
+                _stats.cancelledLoads++;
+            }
+            
+            if (slot.distance <= _keepRadius)
+                slot.lastUsedFrame = _frame;
+        }
+    }
+    if (queued)
+        _queueChanged.notify_all();
+    
+    _collectFinished();
+    _upload(_maxUploadsPerFrame);
+    _evict();
+    _updateStats();
+}
+
+void WorldStreamer::finishLoading() {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _loadFinished.wait(lock, [this]() { return _queue.empty() && _loadsInProgress == 0; });
+    }
+    _collectFinished();
+    _upload(UINT_MAX);
+    _evict();
+    _updateStats();
+}
+
+float WorldStreamer::loadRadius() const {
+    return _loadRadius;
+}
+
+float WorldStreamer::keepRadius() const {
+    return _keepRadius;
+}
+
+void WorldStreamer::setRadii(float loadRadius, float keepRadius) {
+    assert(loadRadius >= 0.0f);
+    assert(keepRadius >= loadRadius);
+    _loadRadius = loadRadius;
+    _keepRadius = keepRadius;
+}
+
+const WorldStreamer::Budget& WorldStreamer::budget() const {
+    return _budget;
+}
+
+void WorldStreamer::setBudget(const Budget& budget) {
+    _budget = budget;
+}
+
+unsigned WorldStreamer::maxUploadsPerFrame() const {
+    return _maxUploadsPerFrame;
+}
+
+void WorldStreamer::setMaxUploadsPerFrame(unsigned maxUploadsPerFrame) {
+    assert(maxUploadsPerFrame > 0);
+    _maxUploadsPerFrame = maxUploadsPerFrame;
+}
+
+WorldTile* WorldStreamer::tile(int tileX, int tileZ) const {
+    if (tileX < 0 || tileX >= _tilesX || tileZ < 0 || tileZ >= _tilesZ)
+        return NULL;
+    const Slot& slot = _slots[tileZ * _tilesX + tileX];
+    return slot.resident ? slot.tile : NULL;
+}
+
+WorldTile* WorldStreamer::tileAt(float x, float z) const {
+    return tile((int)floorf((x - _origin.x) / _tileSize), (int)floorf((z - _origin.z) / _tileSize));
+}
+
+const WorldStreamer::Stats& WorldStreamer::stats() const {
+    return _stats;
+}
+
+void WorldStreamer::_ioThreadMain() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _queueChanged.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+        if (_stopping)
+            return;
+        
+        // the nearest tile is the one the player will walk into first
+        size_t nearest = 0;
+        for (size_t i=1; i<_queue.size(); i++) {
+            if (_slots[_queue[i]].distance < _slots[_queue[nearest]].distance)
+                nearest = i;
+        }
+        int index = _queue[nearest];
+        _queue[nearest] = _queue.back();
+        _queue.pop_back();
+        
+        Slot& slot = _slots[index];
+        slot.state = TileState_Loading;
+        WorldTile* tile = slot.tile;
+        _loadsInProgress++;
+        lock.unlock();
+        
+        std::string error;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        try {
+            tile->load();
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        double milliseconds = MillisecondsSince(start);
+        
+        lock.lock();
+        slot.state = TileState_Loaded;
+        _finished.push_back(index);
+        if (!error.empty() && _error.empty())
+            _error = error;
+        _loadsInProgress--;
+        _completedLoads++;
+        _totalLoadMilliseconds += milliseconds;
+        _loadFinished.notify_all();
+    }
+}
+
+void WorldStreamer::_collectFinished() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_error.empty())
+        throw std::runtime_error(std::string("Failed to load world tile: ") + _error);
+    _uploads.insert(_uploads.end(), _finished.begin(), _finished.end());
+    _finished.clear();
+}
+
+void WorldStreamer::_upload(unsigned maxUploads) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    
+    // nearest first, same as the loads
+    std::sort(_uploads.begin(), _uploads.end(), [this](int a, int b) {
+        return _slots[a].distance < _slots[b].distance;
+    });
+    
+    unsigned uploaded = 0;
+    size_t i = 0;
+    for (; i<_uploads.size() && uploaded < maxUploads; i++) {
+        Slot& slot = _slots[_uploads[i]];
+        // only the main thread touches tiles once they're loaded
+        if (slot.distance > _keepRadius) {
+            delete slot.tile;
+            slot.tile = NULL;
+            _stats.cancelledLoads++;
+        } else {
+            slot.tile->upload();
+            slot.resident = true;
+            slot.lastUsedFrame = _frame;
+            _residents.push_back(_uploads[i]);
+            uploaded++;
+        }
+        
+        std::lock_guard<std::mutex> lock(_mutex);
+        slot.state = slot.tile ? TileState_Resident : TileState_Unloaded;
+    }
+    _uploads.erase(_uploads.begin(), _uploads.begin() + i);
+    
+    _stats.uploadMilliseconds = MillisecondsSince(start);
+}
+
+void WorldStreamer::_evict() {
+    size_t cpuBytes = 0, gpuBytes = 0;
+    for (size_t i=0; i<_residents.size(); i++) {
+        cpuBytes += _slots[_residents[i]].tile->cpuBytes();
+        gpuBytes += _slots[_residents[i]].tile->gpuBytes();
+    }
+    for (size_t i=0; i<_uploads.size(); i++)
+        cpuBytes += _slots[_uploads[i]].tile->cpuBytes();
+    
+    if (cpuBytes <= _budget.cpuBytes && gpuBytes <= _budget.gpuBytes)
+        return;
+    
+    // least recently used first, and the farthest of those
+    std::vector<int> candidates;
+    for (size_t i=0; i<_residents.size(); i++) {
+        if (_slots[_residents[i]].distance > _loadRadius)
+            candidates.push_back(_residents[i]);
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](int a, int b) {
+        if (_slots[a].lastUsedFrame != _slots[b].lastUsedFrame)
+            return _slots[a].lastUsedFrame < _slots[b].lastUsedFrame;
+        return _slots[a].distance > _slots[b].distance;
+    });
+    
+    const size_t cpuTarget = (size_t)(EvictionTarget * _budget.cpuBytes);
+    const size_t gpuTarget = (size_t)(EvictionTarget * _budget.gpuBytes);
+    for (size_t i=0; i<candidates.size(); i++) {
+        if (cpuBytes <= cpuTarget && gpuBytes <= gpuTarget)
+            break;
+        
+        Slot& slot = _slots[candidates[i]];
+        cpuBytes -= slot.tile->cpuBytes();
+        gpuBytes -= slot.tile->gpuBytes();
+        delete slot.tile;
+        slot.tile = NULL;
+        slot.resident = false;
+        _residents.erase(std::find(_residents.begin(), _residents.end(), candidates[i]));
+        _stats.evictions++;
+        
+        std::lock_guard<std::mutex> lock(_mutex);
+        slot.state = TileState_Unloaded;
+    }
+}
+
+void WorldStreamer::_updateStats() {
+    _stats.residentTiles = (unsigned)_residents.size();
+    _stats.cpuBytes = _stats.gpuBytes = 0;
+    for (size_t i=0; i<_residents.size(); i++) {
+        _stats.cpuBytes += _slots[_residents[i]].tile->cpuBytes();
+        _stats.gpuBytes += _slots[_residents[i]].tile->gpuBytes();
+    }
+    
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.queuedTiles = (unsigned)_queue.size();
+    _stats.loadingTiles = _loadsInProgress + (unsigned)(_finished.size() + _uploads.size());
+    _stats.loads = _completedLoads;
+    _stats.averageLoadMilliseconds = _completedLoads ? _totalLoadMilliseconds / _completedLoads : 0.0;
+}
+
+float WorldStreamer::_distanceToTile(int slot, const glm::vec3& position) const {
+    float minX = _origin.x + (slot % _tilesX) * _tileSize;
+    float minZ = _origin.z + (slot / _tilesX) * _tileSize;
+    float dx = std::max(0.0f, std::max(minX - position.x, position.x - (minX + _tileSize)));
+    float dz = std::max(0.0f, std::max(minZ - position.z, position.z - (minZ + _tileSize)));
+    return sqrtf(dx * dx + dz * dz);
+}
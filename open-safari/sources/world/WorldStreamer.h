@@ -0,0 +1,238 @@
+//
+//  WorldStreamer.h
+//  open-safari
+//
+//  Created by Darren Tsung on 5/30/14.
+//  Copyright (c) 2014 Lambawoof. All rights reserved.
+//
+
+#ifndef __open_safari__WorldStreamer__
+#define __open_safari__WorldStreamer__
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ The contents of one square of the world, loaded in two steps.
+ 
+ load() does the slow part (reading and decoding files) on one of the streamer's I/O
+ threads, so it must not touch OpenGL or anything the main thread uses. upload() runs
+ afterwards on the main thread and creates the GL objects. The tile is deleted on the main
+ thread when it is evicted.
+ */
+class WorldTile {
+public:
+    virtual ~WorldTile() {}
+    
+    /**
+     Reads the tile from disk. Called once, on an I/O thread.
+     
+     @throws std::exception if the tile can't be loaded
+     */
+    virtual void load() = 0;
+    
+    /**
+     Creates the GL objects for the loaded tile. Called once, on the main thread.
+     */
+    virtual void upload() = 0;
+    
+    /** the number of bytes of main memory the tile is using */
+    virtual size_t cpuBytes() const = 0;
+    
+    /** the number of bytes of GL buffers and textures the tile is using */
+    virtual size_t gpuBytes() const = 0;
+};
+
+/**
+ Keeps the tiles of a large world near the viewer loaded.
+ 
+ The world is a grid of square tiles. Every tile within the load radius of the view
+ position is queued for loading, nearest first, and loaded by a pool of background I/O
+ threads. Loaded tiles are uploaded on the main thread a few per frame so a burst of loads
+ doesn't cause a hitch.
+ 
+ Tiles stay resident after the viewer walks away, so walking back and forth over a tile
+ border doesn't reload anything. Only when the resident tiles go over the CPU or GPU memory
+ budget are tiles evicted, least recently used first, and then until the usage is back
+ under a fraction of the budget, so one new tile doesn't cause one eviction every time.
+ Tiles within the load radius are never evicted. A tile is used for as long as it is within
+ the keep radius, which is larger than the load radius.
+ */
+class WorldStreamer {
+public:
+    /**
+     Creates an unloaded tile. Called on the main thread; the slow work belongs in load().
+     
+     @param tileX, tileZ  the tile's position in the grid
+     @param origin        the world position of the tile's corner with the smallest x and z
+     */
+    typedef std::function<WorldTile*(int tileX, int tileZ, const glm::vec3& origin)> TileFactory;
+    
+    struct Budget {
+        size_t cpuBytes;
+        size_t gpuBytes;
+    };
+    
+    struct Stats {
+        unsigned residentTiles;
+        /** tiles waiting for an I/O thread */
+        unsigned queuedTiles;
+        /** tiles being loaded, or loaded and waiting for their upload */
+        unsigned loadingTiles;
+        size_t cpuBytes;
+        size_t gpuBytes;
+        /** totals since the streamer was created */
+        unsigned loads;
+        unsigned cancelledLoads;
+        unsigned evictions;
+        /** the average time an I/O thread spent in WorldTile::load() */
+        double averageLoadMilliseconds;
+        /** the time the last update() spent uploading tiles */
+        double uploadMilliseconds;
+    };
+    
+    /**
+     @param origin          the world position of the grid corner with the smallest x and z
+     @param tileSize        the width of a tile along x and z
+     @param tilesX, tilesZ  the size of the grid in tiles
+     @param factory         creates the tiles
+     @param budget          the memory the resident tiles may use before some are evicted
+     @param ioThreadCount   the number of background threads that load tiles
+     */
+    WorldStreamer(const glm::vec3& origin,
+                  float tileSize,
+                  int tilesX,
+                  int tilesZ,
+                  const TileFactory& factory,
+                  const Budget& budget,
+                  unsigned ioThreadCount = 2);
+    
+    /**
+     Stops the I/O threads, waiting for the loads in progress, and deletes every tile
+     */
+    ~WorldStreamer();
+    
+    /**
+     Queues the tiles around `viewPosition`, uploads the tiles that finished loading and
+     evicts tiles when over budget. Call once per frame on the main thread.
+     
+     @throws std::exception if a tile failed to load
+     */
+    void update(const glm::vec3& viewPosition);
+    
+    /**
+     Blocks until every queued tile is loaded and uploaded. Use it at startup so the tiles
+     around the player are there before the first frame.
+     */
+    void finishLoading();
+    
+    /**
+     The distance around the view position within which tiles are loaded, and the larger
+     distance within which loaded tiles count as in use.
+     */
+    float loadRadius() const;
+    float keepRadius() const;
+    void setRadii(float loadRadius, float keepRadius);
+    
+    const Budget& budget() const;
+    void setBudget(const Budget& budget);
+    
+    /**
+     The most tiles that get uploaded in one update()
+     */
+    unsigned maxUploadsPerFrame() const;
+    void setMaxUploadsPerFrame(unsigned maxUploadsPerFrame);
+    
+    /**
+     @result the uploaded tile at that grid position, or NULL if it isn't resident
+     */
+    WorldTile* tile(int tileX, int tileZ) const;
+    
+    /**
+     @result the uploaded tile under the world position, or NULL if it isn't resident
+     */
+    WorldTile* tileAt(float x, float z) const;
+    
+    /**
+     Calls `callback` with every uploaded tile
+     
+     @param callback  void(WorldTile* tile)
+     */
+    template <typename Callback>
+    void forEachResident(const Callback& callback) const;
+    
+    const Stats& stats() const;
+
+private:
+    enum TileState {
+        TileState_Unloaded,
+        TileState_Queued,
+        TileState_Loading,
+        TileState_Loaded,
+        TileState_Resident
+    };
+    
+    struct Slot {
+        WorldTile* tile;
+        /** guarded by _mutex */
+        TileState state;
+        /** distance to the view position at the last update, for the load order. Written
+            by the main thread with _mutex held. */
+        float distance;
+        /** main thread only */
+        unsigned long lastUsedFrame;
+        bool resident;
+    };
+    
+    glm::vec3 _origin;
+    float _tileSize;
+    int _tilesX, _tilesZ;
+    TileFactory _factory;
+    Budget _budget;
+    float _loadRadius, _keepRadius;
+    unsigned _maxUploadsPerFrame;
+    unsigned long _frame;
+    
+    std::vector<Slot> _slots;
+    /** the loaded tiles waiting for their upload, main thread only */
+    std::vector<int> _uploads;
+    std::vector<int> _residents;
+    Stats _stats;
+    
+    // shared with the I/O threads
+    std::mutex _mutex;
+    std::condition_variable _queueChanged;
+    std::condition_variable _loadFinished;
+    std::vector<int> _queue;
+    std::vector<int> _finished;
+    std::string _error;
+    unsigned _loadsInProgress;
+    unsigned _completedLoads;
+    double _totalLoadMilliseconds;
+    bool _stopping;
+    std::vector<std::thread> _ioThreads;
+    
+    void _ioThreadMain();
+    void _collectFinished();
+    void _upload(unsigned maxUploads);
+    void _evict();
+    void _updateStats();
+    float _distanceToTile(int slot, const glm::vec3& position) const;
+    
+    // copying disabled
+    WorldStreamer(const WorldStreamer&);
+    const WorldStreamer& operator=(const WorldStreamer&);
+};
+
+template <typename Callback>
+void WorldStreamer::forEachResident(const Callback& callback) const {
+    for (size_t i=0; i<_residents.size(); i++)
+        callback(_slots[_residents[i]].tile);
+}
+
+#endif /* defined(__open_safari__WorldStreamer__) */